@@ -83,6 +83,8 @@ typedef struct rnp_op_sign_st *            rnp_op_sign_t;
 typedef struct rnp_op_sign_signature_st *  rnp_op_sign_signature_t;
 typedef struct rnp_op_verify_st *          rnp_op_verify_t;
 typedef struct rnp_op_verify_signature_st *rnp_op_verify_signature_t;
+typedef struct rnp_op_sign_digest_st *     rnp_op_sign_digest_t;
+typedef struct rnp_op_verify_digest_st *   rnp_op_verify_digest_t;
 typedef struct rnp_op_encrypt_st *         rnp_op_encrypt_t;
 typedef struct rnp_identifier_iterator_st *rnp_identifier_iterator_t;
 
@@ -142,7 +144,29 @@ typedef void (*rnp_get_key_cb)(rnp_ffi_t   ffi,
                                const char *identifier,
                                bool        secret);
 
+/** callback used to signal the application that an asynchronous operation is finished
+ *
+ *  It is called from the ffi's worker thread, so it should not block for long: usually it
+ *  just passes result to the application's event loop. It must not destroy the ffi object.
+ *
+ *  @param app_ctx provided by application in rnp_op_*_execute_async
+ *  @param result the same value which would be returned by rnp_op_*_execute
+ */
+typedef void (*rnp_op_complete_cb)(void *app_ctx, rnp_result_t result);
+
 /** create the top-level object used for interacting with the library
+ *
+ *  Thread safety: a single ffi object may be shared by any number of threads, so the
+ *  process needs to keep only one copy of the keyrings. Signing, verification, encryption,
+ *  decryption and key lookups run concurrently, while loading, generating and changing
+ *  keys (adding userids, protecting, unprotecting, locking and unlocking) wait for them
+ *  and run exclusively. Password callback, called during the concurrent operation, may not
+ *  change keys: such calls fail with RNP_ERROR_BAD_STATE. Each thread uses its own random
+ *  number generator.
+ *  Callbacks, log and provider settings must be set up before sharing the object.
+ *  Key handles, operations, inputs and outputs are not thread-safe: each of them must be
+ *  used by one thread at a time, however they may be created and used in different threads.
+ *  Keys are never removed from the keyrings, so a key handle stays valid until destroyed.
  *
  *  @param ffi pointer that will be set to the created ffi object
  *  @param pub_format the format of the public keyring
@@ -169,6 +193,32 @@ rnp_result_t rnp_ffi_set_pass_provider(rnp_ffi_t       ffi,
                                        rnp_password_cb getpasscb,
                                        void *          getpasscb_ctx);
 
+/** enable or disable caching of the keys, derived from passwords, for the ffi object
+ *
+ *  Cache speeds up repeated decryption and key unlocking with the same password, since the
+ *  derived key is kept for 5 minutes. However cache entries allow to check the password much
+ *  faster than via the S2K, so it is disabled by default. Entries are wiped on disabling the
+ *  cache and on rnp_ffi_destroy().
+ *
+ *  @param ffi the ffi object
+ *  @param enable true to enable the cache or false to disable it and wipe all entries
+ *  @return RNP_SUCCESS or error code on failure
+ */
+rnp_result_t rnp_ffi_set_s2k_cache(rnp_ffi_t ffi, bool enable);
+
+/** set the number of worker threads, running asynchronous operations of the ffi object
+ *
+ *  Threads are started on the first rnp_op_*_execute_async or rnp_op_*_execute_batch call,
+ *  so this must be called before it. Batch calls use the calling thread and the worker
+ *  threads, up to the given number in total. By default number of threads equals to number
+ *  of the available CPUs.
+ *
+ *  @param ffi the ffi object
+ *  @param threads number of threads, or 0 for the default value
+ *  @return RNP_SUCCESS, or RNP_ERROR_BAD_STATE if threads are already started
+ */
+rnp_result_t rnp_ffi_set_worker_threads(rnp_ffi_t ffi, size_t threads);
+
 /* Operations on key rings */
 
 /** retrieve the default homedir (example: /home/user/.rnp)
@@ -195,6 +245,34 @@ rnp_result_t rnp_get_default_homedir(char **homedir);
 rnp_result_t rnp_detect_homedir_info(
   const char *homedir, char **pub_format, char **pub_path, char **sec_format, char **sec_path);
 
+/** calculate the number of S2K iterations, which would take the specified time on this
+ *  machine. Hash speed is measured only once per process, or never if calibration data was
+ *  loaded with rnp_s2k_calibration_load().
+ *
+ * @param hash the hash algorithm name (example: "SHA256")
+ * @param msec desired key derivation time in milliseconds, 0 for the default value
+ * @param iterations pointer that will be set to the number of iterations
+ * @return 0 on success, or any other value on error
+ */
+rnp_result_t rnp_calculate_iterations(const char *hash, size_t msec, size_t *iterations);
+
+/** load the S2K calibration data, stored with rnp_s2k_calibration_save().
+ *  Data obtained on different hardware or crypto backend is ignored.
+ *
+ * @param path path to the calibration file (example: /home/user/.rnp/s2k-calibration)
+ * @return 0 on success, or any other value on error, including the case when file is not
+ *         found or doesn't match this machine
+ */
+rnp_result_t rnp_s2k_calibration_load(const char *path);
+
+/** store the S2K calibration data, if there was any new measurement since the last
+ *  load/save.
+ *
+ * @param path path to the calibration file
+ * @return 0 on success, or any other value on error
+ */
+rnp_result_t rnp_s2k_calibration_save(const char *path);
+
 /** try to detect the key format of the provided data
  *
  * @param buf the key data, must not be NULL
@@ -421,8 +499,9 @@ rnp_result_t rnp_key_have_public(rnp_key_handle_t key, bool *result);
  *         function should be used.
  *  @param op pointer to opaque signing context
  *  @param ffi
- *  @param input stream with data to be signed. Could not be NULL.
- *  @param output stream to write results to. Could not be NULL.
+ *  @param input stream with data to be signed. May be NULL only together with output, if
+ *         operation is used with rnp_op_sign_execute_batch or bound via rnp_op_sign_reset.
+ *  @param output stream to write results to.
  *  @return RNP_SUCCESS or error code if failed
  */
 rnp_result_t rnp_op_sign_create(rnp_op_sign_t *op,
@@ -434,8 +513,9 @@ rnp_result_t rnp_op_sign_create(rnp_op_sign_t *op,
  *         contain source data with additional headers and armored signature.
  *  @param op pointer to opaque signing context
  *  @param ffi
- *  @param input stream with data to be signed. Could not be NULL.
- *  @param output stream to write results to. Could not be NULL.
+ *  @param input stream with data to be signed. May be NULL only together with output, if
+ *         operation is used with rnp_op_sign_execute_batch or bound via rnp_op_sign_reset.
+ *  @param output stream to write results to.
  *  @return RNP_SUCCESS or error code if failed
  */
 rnp_result_t rnp_op_sign_cleartext_create(rnp_op_sign_t *op,
@@ -447,8 +527,9 @@ rnp_result_t rnp_op_sign_cleartext_create(rnp_op_sign_t *op,
  *         source data.
  *  @param op pointer to opaque signing context
  *  @param ffi
- *  @param input stream with data to be signed. Could not be NULL.
- *  @param output stream to write results to. Could not be NULL.
+ *  @param input stream with data to be signed. May be NULL only together with output, if
+ *         operation is used with rnp_op_sign_execute_batch or bound via rnp_op_sign_reset.
+ *  @param output stream to write results to.
  *  @return RNP_SUCCESS or error code if failed
  */
 rnp_result_t rnp_op_sign_detached_create(rnp_op_sign_t *op,
@@ -500,6 +581,34 @@ rnp_result_t rnp_op_sign_signature_set_expiration_time(rnp_op_sign_signature_t s
  */
 rnp_result_t rnp_op_sign_set_compression(rnp_op_sign_t op, const char *compression, int level);
 
+/** @brief Enable or disable multi-threaded compression. Input is split into blocks, which
+ *         are compressed on the worker threads. Output is slightly larger, but still is a
+ *         single valid compressed stream. Used for ZIP, ZLIB and BZip2 algorithms.
+ *  @param op opaque signing context. Must be initialized with rnp_op_sign_create function
+ *  @param parallel true to compress in parallel (it is disabled by default)
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_set_compression_parallel(rnp_op_sign_t op, bool parallel);
+
+/** @brief Enable or disable adaptive compression. First 64KB of data are test-compressed, and
+ *         if data looks incompressible (like already compressed archives or media files),
+ *         then compression layer is omitted from the output. This saves the CPU time and
+ *         a few bytes of output.
+ *  @param op opaque signing context. Must be initialized with rnp_op_sign_create function
+ *  @param adaptive true to enable adaptive compression (it is disabled by default)
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_set_compression_adaptive(rnp_op_sign_t op, bool adaptive);
+
+/** @brief Check whether compression was skipped by the adaptive compression, see the
+ *         rnp_op_sign_set_compression_adaptive.
+ *  @param op opaque signing context, which was executed
+ *  @param skipped true will be stored here if output data is not compressed since it was
+ *         found incompressible, or false otherwise
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_get_compression_skipped(rnp_op_sign_t op, bool *skipped);
+
 /** @brief Enabled or disable armored (textual) output. Doesn't make sense for cleartext sign.
  *  @param op opaque signing context. Must be initialized with rnp_op_sign_create or
  *         rnp_op_sign_detached_create function.
@@ -508,6 +617,16 @@ rnp_result_t rnp_op_sign_set_compression(rnp_op_sign_t op, const char *compressi
  */
 rnp_result_t rnp_op_sign_set_armor(rnp_op_sign_t op, bool armored);
 
+/** @brief Enable or disable text mode. In text mode line endings of the input are converted
+ *         to CRLF, literal data is marked as text and text signatures are produced.
+ *         Doesn't make sense for cleartext sign, which is always text.
+ *  @param op opaque signing context. Must be initialized with rnp_op_sign_create or
+ *         rnp_op_sign_detached_create function.
+ *  @param textmode true if text mode should be used (it is disabled by default)
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_set_textmode(rnp_op_sign_t op, bool textmode);
+
 /** @brief Set hash algorithm used during signature calculation. This will set hash function
  *         for all signature. To change it for a single signature use
  *         rnp_op_sign_signature_set_hash function.
@@ -559,6 +678,71 @@ rnp_result_t rnp_op_sign_set_file_mtime(rnp_op_sign_t op, uint32_t mtime);
  */
 rnp_result_t rnp_op_sign_execute(rnp_op_sign_t op);
 
+/** @brief Queue signing operation to be executed by the ffi's worker thread, and return
+ *         immediately. Operation, its input and output must not be used or destroyed until
+ *         the callback is called. Password and key provider callbacks are called from the
+ *         worker thread as well. Destroying the ffi object waits for the queued operations.
+ *  @param op opaque signing context, the same as for rnp_op_sign_execute
+ *  @param cb callback, called once operation is finished. May be NULL.
+ *  @param app_ctx opaque parameter, passed to the callback
+ *  @return RNP_SUCCESS if operation was queued, or error code otherwise. In the last case
+ *          callback will not be called.
+ */
+rnp_result_t rnp_op_sign_execute_async(rnp_op_sign_t      op,
+                                       rnp_op_complete_cb cb,
+                                       void *             app_ctx);
+
+/** @brief Bind the executed signing operation to the new input and output, so it may be
+ *         executed once more with the same signers and parameters. This avoids setting up the
+ *         operation for each of many small messages. To avoid decryption of the signing keys
+ *         on each execution, they may be unlocked via rnp_key_unlock.
+ *  @param op opaque signing context, created with one of the rnp_op_sign_*_create functions
+ *  @param input stream with data to be signed. Could not be NULL.
+ *  @param output stream to write results to. Could not be NULL.
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_reset(rnp_op_sign_t op, rnp_input_t input, rnp_output_t output);
+
+/** @brief Sign each of the memory buffers with the same signers and parameters, processing
+ *         them in parallel. This is much faster than executing the operation for each of the
+ *         small messages, since setup is done only once. Input and output of the operation are
+ *         not used, so it may be created with NULL ones.
+ *  @param op opaque signing context, created with one of the rnp_op_sign_*_create functions
+ *  @param count number of the buffers
+ *  @param bufs array of count buffers with data to be signed
+ *  @param lens array of count buffer lengths
+ *  @param outbufs array of count pointers, which will be set to the signed data. Must be
+ *         freed via rnp_buffer_destroy. On failure of the item pointer is set to NULL.
+ *  @param outlens array of count lengths of the signed data
+ *  @param results array of count results of each item, the same as would be returned by
+ *         rnp_op_sign_execute
+ *  @return RNP_SUCCESS if all of the items were processed successfully, RNP_ERROR_GENERIC if
+ *          some of the items failed, or other error code if the call itself failed
+ */
+rnp_result_t rnp_op_sign_execute_batch(rnp_op_sign_t         op,
+                                       size_t                count,
+                                       const uint8_t *const *bufs,
+                                       const size_t *        lens,
+                                       uint8_t **            outbufs,
+                                       size_t *              outlens,
+                                       rnp_result_t *        results);
+
+/** @brief Calculate size of the signing output for the input of the given length, with the
+ *         current signers and parameters, without doing the actual signing. This allows to
+ *         allocate output buffer once, see rnp_output_to_buffer.
+ *  @param op opaque signing context, created with one of the rnp_op_sign_*_create functions
+ *  @param input_len length of the data to be signed
+ *  @param size output size will be stored here. Could not be NULL.
+ *  @param exact if not NULL then it will be set to true if size is exact, or to false if it
+ *         is an upper bound: signature MPIs may be shorter because of leading zero bytes,
+ *         output of compression, text mode and cleartext signing depends on the data.
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_get_output_size(rnp_op_sign_t op,
+                                         uint64_t      input_len,
+                                         uint64_t *    size,
+                                         bool *        exact);
+
 /** @brief Free resources associated with signing operation.
  *  @param op opaque signing context. Must be successfully initialized with one of the
  *         rnp_op_sign_*_create functions. At least one signing key should be added.
@@ -566,6 +750,84 @@ rnp_result_t rnp_op_sign_execute(rnp_op_sign_t op);
  */
 rnp_result_t rnp_op_sign_destroy(rnp_op_sign_t op);
 
+/* Two-phase signing of the digest, calculated elsewhere */
+
+/** @brief Create signing operation context for the remotely calculated digest. Data is never
+ *         passed to this operation: rnp_op_sign_digest_get_trailer() returns the signature
+ *         fields, which must be hashed by the caller right after the data, and then resulting
+ *         digest is signed via rnp_op_sign_digest_execute(). Binary detached signature is
+ *         produced.
+ *  @param op pointer to opaque digest signing context
+ *  @param ffi
+ *  @param key handle of the private key. Private key should be capable for signing.
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_digest_create(rnp_op_sign_digest_t *op,
+                                       rnp_ffi_t             ffi,
+                                       rnp_key_handle_t      key);
+
+/** @brief Set hash algorithm used during signature calculation. It may be adjusted to the
+ *         signing key, use rnp_op_sign_digest_get_hash() to get the actual one.
+ *  @param op opaque digest signing context. Cannot be called after the trailer is retrieved.
+ *  @param hash hash algorithm to be used
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_digest_set_hash(rnp_op_sign_digest_t op, const char *hash);
+
+/** @brief Set signature creation time. By default current time is used.
+ *  @param op opaque digest signing context. Cannot be called after the trailer is retrieved.
+ *  @param create creation time in seconds since Jan, 1 1970 UTC
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_digest_set_creation_time(rnp_op_sign_digest_t op, uint32_t create);
+
+/** @brief Set signature expiration time.
+ *  @param op opaque digest signing context. Cannot be called after the trailer is retrieved.
+ *  @param expire expiration time in seconds since the creation time. 0 value is used to mark
+ *         signature as non-expiring (default value)
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_digest_set_expiration_time(rnp_op_sign_digest_t op, uint32_t expire);
+
+/** @brief Get hash algorithm which must be used to calculate the digest.
+ *  @param op opaque digest signing context.
+ *  @param hash pointer to string with hash algorithm name will be put here on success.
+ *              Caller is responsible for freeing it with rnp_buffer_destroy
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_digest_get_hash(rnp_op_sign_digest_t op, char **hash);
+
+/** @brief Get the signature trailer. Digest to sign is hash of the data, followed by the
+ *         trailer. Signature parameters are fixed after the first call.
+ *  @param op opaque digest signing context.
+ *  @param trailer on success pointer to the allocated buffer will be stored here. Caller is
+ *                 responsible for freeing it with rnp_buffer_destroy
+ *  @param len on success length of the trailer will be stored here
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_digest_get_trailer(rnp_op_sign_digest_t op,
+                                            uint8_t **           trailer,
+                                            size_t *             len);
+
+/** @brief Sign the digest and write signature packet to the output. Secret key password is
+ *         requested here if needed.
+ *  @param op opaque digest signing context. Trailer must be retrieved before this call.
+ *  @param digest hash of the data followed by the trailer
+ *  @param len length of the digest, must match the hash algorithm
+ *  @param signature stream to write the signature to
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_sign_digest_execute(rnp_op_sign_digest_t op,
+                                        const uint8_t *      digest,
+                                        size_t               len,
+                                        rnp_output_t         signature);
+
+/** @brief Free resources associated with digest signing operation.
+ *  @param op opaque digest signing context.
+ *  @return RNP_SUCCESS or error code if failed.
+ */
+rnp_result_t rnp_op_sign_digest_destroy(rnp_op_sign_digest_t op);
+
 /* Verification */
 
 /** @brief Create verification operation context. This method should be used for embedded
@@ -573,7 +835,8 @@ rnp_result_t rnp_op_sign_destroy(rnp_op_sign_t op);
  *         function should be used.
  *  @param op pointer to opaque verification context
  *  @param ffi
- *  @param input stream with signed data. Could not be NULL.
+ *  @param input stream with signed data. May be NULL only together with output, if operation
+ *         is used with rnp_op_verify_execute_batch or bound via rnp_op_verify_reset.
  *  @param output stream to write results to. Could not be NULL, but may be null output stream
  *         if verified data should be discarded.
  *  @return RNP_SUCCESS or error code if failed
@@ -604,6 +867,60 @@ rnp_result_t rnp_op_verify_detached_create(rnp_op_verify_t *op,
  */
 rnp_result_t rnp_op_verify_execute(rnp_op_verify_t op);
 
+/** @brief Queue verification operation to be executed by the ffi's worker thread. See the
+ *         rnp_op_sign_execute_async for the details.
+ *  @param op opaque verification context, the same as for rnp_op_verify_execute
+ *  @param cb callback, called once operation is finished. May be NULL.
+ *  @param app_ctx opaque parameter, passed to the callback
+ *  @return RNP_SUCCESS if operation was queued, or error code otherwise.
+ */
+rnp_result_t rnp_op_verify_execute_async(rnp_op_verify_t    op,
+                                         rnp_op_complete_cb cb,
+                                         void *             app_ctx);
+
+/** @brief Bind the verification operation to the new input and output, so it may be
+ *         executed once more. Results of the previous execution are dropped, while session key
+ *         and password count settings are kept.
+ *  @param op opaque verification context, created with rnp_op_verify_create
+ *  @param input stream with signed data. Could not be NULL.
+ *  @param output stream to write the verified data to. May be NULL.
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_verify_reset(rnp_op_verify_t op, rnp_input_t input, rnp_output_t output);
+
+/** @brief Bind the detached verification operation to the new data and signature. See the
+ *         rnp_op_verify_reset for the details.
+ *  @param op opaque verification context, created with rnp_op_verify_detached_create
+ *  @param input stream with raw data. Could not be NULL.
+ *  @param signature stream with detached signature data. Could not be NULL.
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_verify_detached_reset(rnp_op_verify_t op,
+                                          rnp_input_t     input,
+                                          rnp_input_t     signature);
+
+/** @brief Verify (and decrypt if needed) each of the memory buffers in parallel. See the
+ *         rnp_op_sign_execute_batch for the details. Item result is RNP_SUCCESS only if it
+ *         has signatures, and all of them are valid. Signature details are not reported.
+ *  @param op opaque verification context, created with rnp_op_verify_create. Detached
+ *         verification is not supported.
+ *  @param count number of the buffers
+ *  @param bufs array of count buffers with signed data
+ *  @param lens array of count buffer lengths
+ *  @param outbufs array of count pointers, which will be set to the verified data
+ *  @param outlens array of count lengths of the verified data
+ *  @param results array of count verification results
+ *  @return RNP_SUCCESS if all of the items were verified successfully, RNP_ERROR_GENERIC if
+ *          some of the items failed, or other error code if the call itself failed
+ */
+rnp_result_t rnp_op_verify_execute_batch(rnp_op_verify_t       op,
+                                         size_t                count,
+                                         const uint8_t *const *bufs,
+                                         const size_t *        lens,
+                                         uint8_t **            outbufs,
+                                         size_t *              outlens,
+                                         rnp_result_t *        results);
+
 /** @brief Get number of the signatures for verified data.
  *  @param op opaque verification context. Must be initialized and have execute() called on it.
  *  @param count result will be stored here on success.
@@ -631,6 +948,45 @@ rnp_result_t rnp_op_verify_get_signature_at(rnp_op_verify_t            op,
  */
 rnp_result_t rnp_op_verify_get_file_info(rnp_op_verify_t op, char **filename, uint32_t *mtime);
 
+/** @brief Set the session key to decrypt the data with. If set then neither secret keys nor
+ *         password will be requested, so this may be used to avoid costly public-key
+ *         decryption or key derivation for the data which was already decrypted once.
+ *  @param op opaque verification context. Must be initialized.
+ *  @param sesskey nul-terminated session key string in form 'algorithm:hex key', as returned
+ *                 by rnp_op_verify_get_session_key(). Algorithm is the OpenPGP symmetric
+ *                 algorithm id, i.e. '9:' prefix for AES256.
+ *  @return RNP_SUCCESS if call succeeded.
+ */
+rnp_result_t rnp_op_verify_set_session_key(rnp_op_verify_t op, const char *sesskey);
+
+/** @brief Get the session key, used to decrypt the data.
+ *  @param op opaque verification context. Must be initialized and have execute() called on it.
+ *  @param sesskey on success session key string in form 'algorithm:hex key' will be stored
+ *                 here. Caller is responsible for freeing it via the rnp_buffer_free function
+ *                 call.
+ *  @return RNP_SUCCESS if call succeeded, or RNP_ERROR_BAD_STATE if data was not decrypted.
+ */
+rnp_result_t rnp_op_verify_get_session_key(rnp_op_verify_t op, char **sesskey);
+
+/** @brief Set the number of candidate passwords to request for the password-encrypted data.
+ *         All of them are requested from the password provider before the decryption, which
+ *         may return false to stop earlier, and then tried against all of the SKESK packets
+ *         in parallel. By default single password is requested.
+ *  @param op opaque verification context. Must be initialized.
+ *  @param count number of passwords, must be positive.
+ *  @return RNP_SUCCESS if call succeeded.
+ */
+rnp_result_t rnp_op_verify_set_password_count(rnp_op_verify_t op, size_t count);
+
+/** @brief Enable or disable multi-threaded decompression of BZip2 data. Blocks of the stream
+ *         are decompressed on the worker threads, each of them keeping the whole decompressed
+ *         block in memory. Output is the same as for the single-threaded decompression.
+ *  @param op opaque verification context. Must be initialized.
+ *  @param parallel true to decompress in parallel (it is disabled by default)
+ *  @return RNP_SUCCESS if call succeeded.
+ */
+rnp_result_t rnp_op_verify_set_decompression_parallel(rnp_op_verify_t op, bool parallel);
+
 /** @brief Free resources allocated in verification context.
  *  @param op opaque verification context. Must be initialized.
  *  @return RNP_SUCCESS if call succeeded.
@@ -675,6 +1031,63 @@ rnp_result_t rnp_op_verify_signature_get_times(rnp_op_verify_signature_t sig,
                                                uint32_t *                create,
                                                uint32_t *                expires);
 
+/** @brief Create verification context for the detached signature and remotely calculated
+ *         digest. Signature is read and parsed during this call, then caller gets the hash
+ *         algorithm and trailer, hashes data followed by the trailer and passes digest to the
+ *         rnp_op_verify_digest_execute().
+ *  @param op pointer to opaque digest verification context
+ *  @param ffi
+ *  @param signature stream with the detached signature, may be armored.
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_verify_digest_create(rnp_op_verify_digest_t *op,
+                                         rnp_ffi_t               ffi,
+                                         rnp_input_t             signature);
+
+/** @brief Get hash algorithm which must be used to calculate the digest.
+ *  @param op opaque digest verification context.
+ *  @param hash pointer to string with hash algorithm name will be put here on success.
+ *              Caller is responsible for freeing it with rnp_buffer_destroy
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_verify_digest_get_hash(rnp_op_verify_digest_t op, char **hash);
+
+/** @brief Get the signature trailer, which must be hashed right after the data.
+ *  @param op opaque digest verification context.
+ *  @param trailer on success pointer to the allocated buffer will be stored here. Caller is
+ *                 responsible for freeing it with rnp_buffer_destroy
+ *  @param len on success length of the trailer will be stored here
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_verify_digest_get_trailer(rnp_op_verify_digest_t op,
+                                              uint8_t **             trailer,
+                                              size_t *               len);
+
+/** @brief Verify the signature against the digest.
+ *  @param op opaque digest verification context.
+ *  @param digest hash of the data followed by the trailer
+ *  @param len length of the digest
+ *  @return signature verification status, same as of rnp_op_verify_signature_get_status()
+ */
+rnp_result_t rnp_op_verify_digest_execute(rnp_op_verify_digest_t op,
+                                          const uint8_t *        digest,
+                                          size_t                 len);
+
+/** @brief Get the signature information. Status is available after the execute call.
+ *  @param op opaque digest verification context.
+ *  @param sig opaque signature context data will be stored here on success. It is valid
+ *             until the verification context is destroyed.
+ *  @return RNP_SUCCESS if call succeeded.
+ */
+rnp_result_t rnp_op_verify_digest_get_signature(rnp_op_verify_digest_t     op,
+                                                rnp_op_verify_signature_t *sig);
+
+/** @brief Free resources allocated in digest verification context.
+ *  @param op opaque digest verification context.
+ *  @return RNP_SUCCESS if call succeeded.
+ */
+rnp_result_t rnp_op_verify_digest_destroy(rnp_op_verify_digest_t op);
+
 /* TODO define functions for encrypt+sign */
 
 /**
@@ -769,6 +1182,43 @@ rnp_result_t rnp_output_memory_get_buf(rnp_output_t output,
                                        size_t *     len,
                                        bool         do_copy);
 
+/**
+ * @brief Initialize output structure to write to the caller-provided buffer, without any
+ *        allocations. If written data doesn't fit into the buffer then operation fails with
+ *        RNP_ERROR_SHORT_BUFFER. Number of written bytes may be retrieved via the
+ *        rnp_output_memory_get_buf with do_copy set to false.
+ *
+ * @param output pointer to the opaque output structure.
+ * @param buf buffer to write to, could not be NULL. It must be valid during the lifetime of
+ *        the output.
+ * @param len size of the buffer in bytes.
+ * @return RNP_SUCCESS if operation succeeded or error code otherwise.
+ */
+rnp_result_t rnp_output_to_buffer(rnp_output_t *output, uint8_t *buf, size_t len);
+
+/**
+ * @brief Preallocate memory for the output, initialized by rnp_output_to_memory, so up to
+ *        size more bytes may be written without reallocation. Sign and encrypt operations
+ *        do this automatically when the input size is known.
+ *
+ * @param output output structure, initialized by rnp_output_to_memory.
+ * @param size number of bytes, which are expected to be written.
+ * @return RNP_SUCCESS if operation succeeded or error code otherwise.
+ */
+rnp_result_t rnp_output_memory_reserve(rnp_output_t output, size_t size);
+
+/**
+ * @brief Take the ownership on the buffer of output, initialized by rnp_output_to_memory,
+ *        without copying it. Output continues with the empty buffer and may be reused.
+ *
+ * @param output output structure, initialized by rnp_output_to_memory.
+ * @param buf pointer to the buffer will be stored here, could not be NULL. It must be freed
+ *        with rnp_buffer_destroy. NULL is stored if nothing was written to the output.
+ * @param len number of bytes in buffer will be stored here, could not be NULL.
+ * @return RNP_SUCCESS if operation succeeded or error code otherwise.
+ */
+rnp_result_t rnp_output_memory_take_buf(rnp_output_t output, uint8_t **buf, size_t *len);
+
 /**
  * @brief Initialize output structure to write to callbacks.
  *
@@ -800,6 +1250,8 @@ rnp_result_t rnp_output_to_null(rnp_output_t *output);
 rnp_result_t rnp_output_destroy(rnp_output_t output);
 
 /* encrypt */
+/* input and output may be NULL together, if operation is used with
+ * rnp_op_encrypt_execute_batch or bound later via rnp_op_encrypt_reset */
 rnp_result_t rnp_op_encrypt_create(rnp_op_encrypt_t *op,
                                    rnp_ffi_t         ffi,
                                    rnp_input_t       input,
@@ -855,14 +1307,98 @@ rnp_result_t rnp_op_encrypt_add_password(rnp_op_encrypt_t op,
                                          const char *     s2k_cipher);
 
 rnp_result_t rnp_op_encrypt_set_armor(rnp_op_encrypt_t op, bool armored);
+rnp_result_t rnp_op_encrypt_set_textmode(rnp_op_encrypt_t op, bool textmode);
 rnp_result_t rnp_op_encrypt_set_cipher(rnp_op_encrypt_t op, const char *cipher);
+
+/**
+ * @brief set AEAD algorithm used to encrypt the data instead of CFB with MDC.
+ *        AEAD requires cipher with 128-bit block.
+ *
+ * @param op opaque encrypting context. Must be allocated and initialized.
+ * @param alg AEAD algorithm: "None", "EAX" or "OCB".
+ * @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_encrypt_set_aead(rnp_op_encrypt_t op, const char *alg);
+
+/**
+ * @brief set AEAD chunk size, which is 2 ** (bits + 6) bytes.
+ *
+ * @param op opaque encrypting context. Must be allocated and initialized.
+ * @param bits chunk size bits, 0..56. Default is 21, i.e. 128 KB chunks.
+ * @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_encrypt_set_aead_bits(rnp_op_encrypt_t op, int bits);
 rnp_result_t rnp_op_encrypt_set_compression(rnp_op_encrypt_t op,
                                             const char *     compression,
                                             int              level);
+rnp_result_t rnp_op_encrypt_set_compression_parallel(rnp_op_encrypt_t op, bool parallel);
+rnp_result_t rnp_op_encrypt_set_compression_adaptive(rnp_op_encrypt_t op, bool adaptive);
+rnp_result_t rnp_op_encrypt_get_compression_skipped(rnp_op_encrypt_t op, bool *skipped);
 rnp_result_t rnp_op_encrypt_set_file_name(rnp_op_encrypt_t op, const char *filename);
 rnp_result_t rnp_op_encrypt_set_file_mtime(rnp_op_encrypt_t op, uint32_t mtime);
 
 rnp_result_t rnp_op_encrypt_execute(rnp_op_encrypt_t op);
+/** @brief Queue encryption operation to be executed by the ffi's worker thread. See the
+ *         rnp_op_sign_execute_async for the details.
+ *  @param op opaque encrypting context, the same as for rnp_op_encrypt_execute
+ *  @param cb callback, called once operation is finished. May be NULL.
+ *  @param app_ctx opaque parameter, passed to the callback
+ *  @return RNP_SUCCESS if operation was queued, or error code otherwise.
+ */
+rnp_result_t rnp_op_encrypt_execute_async(rnp_op_encrypt_t   op,
+                                          rnp_op_complete_cb cb,
+                                          void *             app_ctx);
+/** @brief Bind the executed encryption operation to the new input and output, so it may be
+ *         executed once more with the same recipients, passwords, signers and parameters.
+ *  @param op opaque encrypting context, created with rnp_op_encrypt_create
+ *  @param input stream with data to be encrypted. Could not be NULL.
+ *  @param output stream to write results to. Could not be NULL.
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_encrypt_reset(rnp_op_encrypt_t op, rnp_input_t input, rnp_output_t output);
+/** @brief Encrypt each of the memory buffers in parallel. See the rnp_op_sign_execute_batch
+ *         for the details.
+ *  @param op opaque encrypting context, created with rnp_op_encrypt_create
+ *  @param count number of the buffers
+ *  @param bufs array of count buffers with data to be encrypted
+ *  @param lens array of count buffer lengths
+ *  @param outbufs array of count pointers, which will be set to the encrypted data
+ *  @param outlens array of count lengths of the encrypted data
+ *  @param results array of count results of each item
+ *  @return RNP_SUCCESS if all of the items were encrypted successfully, RNP_ERROR_GENERIC if
+ *          some of the items failed, or other error code if the call itself failed
+ */
+rnp_result_t rnp_op_encrypt_execute_batch(rnp_op_encrypt_t      op,
+                                          size_t                count,
+                                          const uint8_t *const *bufs,
+                                          const size_t *        lens,
+                                          uint8_t **            outbufs,
+                                          size_t *              outlens,
+                                          rnp_result_t *        results);
+/** @brief Calculate size of the encryption output for the input of the given length, with
+ *         the current recipients, passwords, signers and parameters, without doing the actual
+ *         encryption. Size is exact for the uncompressed binary data, encrypted with passwords
+ *         or ECDH recipients, and an upper bound otherwise. See the
+ *         rnp_op_sign_get_output_size for the details.
+ *  @param op opaque encrypting context, created with rnp_op_encrypt_create
+ *  @param input_len length of the data to be encrypted
+ *  @param size output size will be stored here. Could not be NULL.
+ *  @param exact if not NULL then it will be set to false if size is an upper bound
+ *  @return RNP_SUCCESS or error code if failed
+ */
+rnp_result_t rnp_op_encrypt_get_output_size(rnp_op_encrypt_t op,
+                                            uint64_t         input_len,
+                                            uint64_t *       size,
+                                            bool *           exact);
+/** @brief Replace recipients of the already encrypted input instead of encrypting it.
+ *         Session key is decrypted using the ffi key and password providers, then the new
+ *         session key packets are written for the recipients and passwords added to op, and
+ *         the encrypted data is copied as it is. Cipher, AEAD and compression settings of op
+ *         are ignored, signers are not allowed.
+ *  @param op opaque encrypting context, created with input of the encrypted data.
+ *  @return RNP_SUCCESS if call succeeded.
+ */
+rnp_result_t rnp_op_encrypt_rewrap(rnp_op_encrypt_t op);
 rnp_result_t rnp_op_encrypt_destroy(rnp_op_encrypt_t op);
 
 rnp_result_t rnp_decrypt(rnp_ffi_t ffi, rnp_input_t input, rnp_output_t output);
@@ -45,6 +45,7 @@
 #define SECRING_GPG "secring.gpg"
 #define PUBRING_G10 "public-keys-v1.d"
 #define SECRING_G10 "private-keys-v1.d"
+#define S2K_CALIBRATION "s2k-calibration"
 
 #define MAX_PASSWORD_ATTEMPTS 3
 #define INFINITE_ATTEMPTS -1
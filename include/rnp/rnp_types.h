@@ -58,6 +58,7 @@ typedef struct rnp_t {
     FILE *           user_input_fp; /* file pointer for user input */
     FILE *           passfp;        /* file pointer for password input */
     char *           defkey;        /* default key id */
+    char *           s2kpath;       /* S2K calibration data path */
     int              pswdtries;     /* number of password tries, -1 for unlimited */
 
     union {
@@ -86,6 +87,7 @@ typedef struct rnp_params_t {
     char *      pubpath;           /* public keystore path */
     char *      secpath;           /* secret keystore path */
     char *      defkey;            /* default/preferred key id */
+    char *      s2kpath;           /* S2K calibration data path */
     bool        keystore_disabled; /* indicates wether keystore must be initialized */
     pgp_password_provider_t password_provider;
 } rnp_params_t;
@@ -116,6 +118,9 @@ typedef enum rnp_operation_t {
  *  For operations with OpenPGP embedded data (i.e. encrypted data and attached signatures):
  *  - filename, filemtime : to specify information about the contents of literal data packet
  *  - zalg, zlevel : compression algorithm and level, zlevel = 0 to disable compression
+ *  - zparallel : compress independent blocks of data on the worker threads
+ *  - zadaptive : check compressibility of the first data block and skip the compression layer
+ *    for the incompressible data. zskipped is set to true on output if this happened.
  * 
  *  For encryption operation (including encrypt-and-sign):
  *  - halg : hash algorithm used during key derivation for password-based encryption
@@ -137,6 +142,10 @@ typedef enum rnp_operation_t {
  *    If we have just encrypted data then it will not be called.
  *  - sig_cb_param: parameter to be passed to on_signatures callback.
  *  - discard: dicard the output data (i.e. just decrypt and/or verify signatures)
+ *  - sesskey: if set then used to decrypt data instead of the public-key or password
+ *    encrypted session keys, so neither key nor password provider will be called.
+ *  - on_sesskey: callback, called with the decrypted session key of the encrypted data.
+ *  - zparallel: decompress BZip2 blocks on the worker threads.
  * 
  *  For enarmor/dearmor:
  *  - armortype: type of the armor headers (message, key, whatever else)
@@ -149,10 +158,14 @@ typedef struct rnp_ctx_t {
     uint64_t        sigexpire;     /* signature expiration time */
     bool            clearsign;     /* cleartext signature */
     bool            detached;      /* detached signature */
+    bool            textmode;      /* canonical text data and text signatures */
     pgp_hash_alg_t  halg;          /* hash algorithm */
     pgp_symm_alg_t  ealg;          /* encryption algorithm */
     int             zalg;          /* compression algorithm used */
     int             zlevel;        /* compression level */
+    bool            zparallel;     /* multi-threaded block (de)compression */
+    bool            zadaptive;     /* skip compression of the incompressible data */
+    bool            zskipped;      /* compression was skipped by zadaptive */
     pgp_aead_alg_t  aalg;          /* non-zero to use AEAD */
     int             abits;         /* AEAD chunk bits */
     bool            overwrite;     /* allow to overwrite output file if exists */
@@ -164,6 +177,9 @@ typedef struct rnp_ctx_t {
     bool            discard;       /* discard the output */
     void *          on_signatures; /* handler for signed messages */
     void *          sig_cb_param;  /* callback data passed to on_signatures */
+    pgp_sesskey_t * sesskey;       /* session key to decrypt data with */
+    void *          on_sesskey;    /* handler for the decrypted session key */
+    unsigned        passwordc;     /* number of passwords to request for decryption */
     rng_t *         rng;           /* pointer to rng_t */
     rnp_operation_t operation;     /* current operation type */
 } rnp_ctx_t;
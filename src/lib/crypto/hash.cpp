@@ -74,9 +74,17 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <rnp/rnp_sdk.h>
 #include <botan/ffi.h>
 #include "hash.h"
+#include "parallel.h"
 #include "types.h"
 #include "utils.h"
 #include "defaults.h"
@@ -317,6 +325,147 @@ pgp_hash_list_free(list *hashes)
     list_destroy(hashes);
 }
 
+/* maximum number of data blocks, waiting to be hashed by the slowest worker */
+#define HASH_WORKERS_MAX_BLOCKS 8
+
+/* block of data, shared between the workers */
+typedef struct pgp_hash_block_t {
+    unsigned refs; /* number of workers which didn't process block yet */
+    size_t   len;
+    uint8_t  data[1];
+} pgp_hash_block_t;
+
+struct pgp_hash_workers_t {
+    std::mutex                     lock;
+    std::condition_variable        cond;   /* signalled on new, processed blocks and stop */
+    std::deque<pgp_hash_block_t *> blocks; /* blocks, not processed by all workers yet */
+    uint64_t                       first;  /* sequence number of the first block in queue */
+    uint64_t                       next;   /* sequence number of the next added block */
+    bool                           stop;   /* workers should exit after processing blocks */
+    std::vector<pgp_hash_t *>      hashes; /* each hash is updated by its own worker */
+    std::vector<uint64_t>          pos;    /* sequence number of the next block for worker */
+    std::vector<std::thread>       threads;
+};
+
+static void
+pgp_hash_worker(pgp_hash_workers_t *workers, size_t idx)
+{
+    std::unique_lock<std::mutex> lock(workers->lock);
+
+    while (true) {
+        workers->cond.wait(lock, [workers, idx] {
+            return (workers->pos[idx] < workers->next) || workers->stop;
+        });
+        if (workers->pos[idx] == workers->next) {
+            return;
+        }
+        pgp_hash_block_t *block = workers->blocks[workers->pos[idx] - workers->first];
+
+        /* hash outside of the lock, block will not be freed until we release it */
+        lock.unlock();
+        pgp_hash_add(workers->hashes[idx], block->data, block->len);
+        lock.lock();
+
+        workers->pos[idx]++;
+        if (--block->refs) {
+            continue;
+        }
+        /* blocks are released in order, since all workers go through the same queue */
+        free(block);
+        workers->blocks.pop_front();
+        workers->first++;
+        workers->cond.notify_all();
+    }
+}
+
+pgp_hash_workers_t *
+pgp_hash_workers_start(list hashes)
+{
+    size_t              count = list_length(hashes);
+    pgp_hash_workers_t *workers = NULL;
+
+    if ((count < 2) || (rnp_parallel_threads(count) < 2)) {
+        return NULL;
+    }
+
+    try {
+        workers = new pgp_hash_workers_t();
+        workers->first = 0;
+        workers->next = 0;
+        workers->stop = false;
+        for (list_item *hash = list_front(hashes); hash; hash = list_next(hash)) {
+            workers->hashes.push_back((pgp_hash_t *) hash);
+        }
+        workers->pos.assign(count, 0);
+        for (size_t i = 0; i < count; i++) {
+            workers->threads.emplace_back(pgp_hash_worker, workers, i);
+        }
+    } catch (const std::exception &e) {
+        RNP_LOG("failed to start hash workers: %s", e.what());
+        /* no data was queued yet, so just stop the started ones */
+        pgp_hash_workers_stop(workers);
+        return NULL;
+    }
+
+    return workers;
+}
+
+void
+pgp_hash_workers_update(pgp_hash_workers_t *workers, const void *buf, size_t len)
+{
+    pgp_hash_block_t *block;
+
+    if (!len) {
+        return;
+    }
+    if (!(block = (pgp_hash_block_t *) malloc(sizeof(*block) + len))) {
+        /* fall back to the serial hashing */
+        RNP_LOG("allocation failed");
+        pgp_hash_workers_wait(workers);
+        for (auto hash : workers->hashes) {
+            pgp_hash_add(hash, buf, len);
+        }
+        return;
+    }
+    memcpy(block->data, buf, len);
+    block->len = len;
+    block->refs = workers->hashes.size();
+
+    std::unique_lock<std::mutex> lock(workers->lock);
+    workers->cond.wait(
+      lock, [workers] { return workers->blocks.size() < HASH_WORKERS_MAX_BLOCKS; });
+    workers->blocks.push_back(block);
+    workers->next++;
+    workers->cond.notify_all();
+}
+
+void
+pgp_hash_workers_wait(pgp_hash_workers_t *workers)
+{
+    if (!workers) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(workers->lock);
+    workers->cond.wait(lock, [workers] { return workers->blocks.empty(); });
+}
+
+void
+pgp_hash_workers_stop(pgp_hash_workers_t *workers)
+{
+    if (!workers) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers->lock);
+        workers->stop = true;
+        workers->cond.notify_all();
+    }
+    for (auto &thread : workers->threads) {
+        thread.join();
+    }
+    delete workers;
+}
+
 bool
 pgp_hash_uint32(pgp_hash_t *hash, uint32_t n)
 {
@@ -112,6 +112,41 @@ void pgp_hash_list_update(list hashes, const void *buf, size_t len);
  **/
 void pgp_hash_list_free(list *hashes);
 
+/* Workers which update each hash of the list on its own thread */
+typedef struct pgp_hash_workers_t pgp_hash_workers_t;
+
+/* @brief Start parallel hashing for the list of hashes. Each hash context gets its own worker
+ *        thread, and data blocks are shared between workers, so buffer is copied only once.
+ *        List must not be changed until workers are stopped.
+ *
+ * @param hashes List of pgp_hash_t structures
+ *
+ * @return workers handle, or NULL if parallel hashing doesn't make sense for the list (less
+ *         than two hashes or single CPU) or failed to start. Then pgp_hash_list_update()
+ *         should be used.
+ **/
+pgp_hash_workers_t *pgp_hash_workers_start(list hashes);
+
+/* @brief Queue data to be hashed by all workers. Blocks if too much data is queued.
+ *
+ * @param workers handle, returned by pgp_hash_workers_start
+ * @param buf buffer with data, may be reused after the call
+ * @param len number of bytes in the buffer
+ **/
+void pgp_hash_workers_update(pgp_hash_workers_t *workers, const void *buf, size_t len);
+
+/* @brief Wait until all queued data is hashed, so hashes may be used or copied
+ *
+ * @param workers handle, returned by pgp_hash_workers_start, or NULL
+ **/
+void pgp_hash_workers_wait(pgp_hash_workers_t *workers);
+
+/* @brief Wait for the queued data and stop the worker threads
+ *
+ * @param workers handle, returned by pgp_hash_workers_start, or NULL
+ **/
+void pgp_hash_workers_stop(pgp_hash_workers_t *workers);
+
 /*
  * @brief Hashes 4 bytes stored as big endian
  *
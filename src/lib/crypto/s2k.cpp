@@ -30,19 +30,226 @@
 
 #include <botan/ffi.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <rnp/rnp_sdk.h>
 
 #include "crypto/s2k.h"
+#include "crypto/rng.h"
 #include "defaults.h"
+#include "memory.h"
 #include "rnp.h"
 #include "types.h"
 #include "utils.h"
 
-bool
-pgp_s2k_derive_key(pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysize)
+/* Derived key, together with all the parameters which were used to obtain it. Password is
+ * stored as the hash of it, prefixed with the per-cache random secret. Specifier is not
+ * stored since it is fully described by the salt presence and iterations number. */
+typedef struct pgp_s2k_cache_entry_t {
+    bool           used;
+    time_t         stamp;
+    pgp_hash_alg_t alg;
+    bool           salted;
+    uint8_t        salt[PGP_SALT_SIZE];
+    size_t         iterations;
+    size_t         keylen;
+    uint8_t        pswd[PGP_MAX_HASH_SIZE];
+    uint8_t        key[PGP_MAX_KEY_SIZE];
+} pgp_s2k_cache_entry_t;
+
+struct pgp_s2k_cache_t {
+    std::mutex            mutex;
+    bool                  locked; /* memory is mlock()ed */
+    uint8_t               secret[PGP_MAX_HASH_SIZE];
+    pgp_s2k_cache_entry_t entries[DEFAULT_S2K_CACHE_SIZE];
+};
+
+pgp_s2k_cache_t *
+pgp_s2k_cache_create(void)
+{
+    pgp_s2k_cache_t *cache = NULL;
+
+    try {
+        cache = new pgp_s2k_cache_t();
+    } catch (const std::exception &e) {
+        RNP_LOG("failed to allocate s2k cache: %s", e.what());
+        return NULL;
+    }
+    /* failure to lock memory is not critical, it may be limited by the system */
+    cache->locked = !mlock(cache, sizeof(*cache));
+    if (!cache->locked && rnp_get_debug(__FILE__)) {
+        RNP_LOG("failed to lock s2k cache memory");
+    }
+    if (!rng_generate(cache->secret, sizeof(cache->secret))) {
+        RNP_LOG("failed to generate s2k cache secret");
+        pgp_s2k_cache_destroy(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void
+pgp_s2k_cache_destroy(pgp_s2k_cache_t *cache)
+{
+    if (!cache) {
+        return;
+    }
+    pgp_forget(cache->secret, sizeof(cache->secret));
+    pgp_forget(cache->entries, sizeof(cache->entries));
+    if (cache->locked) {
+        munlock(cache, sizeof(*cache));
+    }
+    delete cache;
+}
+
+static bool
+s2k_cache_password_hash(pgp_s2k_cache_t *cache, const char *password, uint8_t *pswd)
+{
+    pgp_hash_t hash;
+
+    memset(pswd, 0, PGP_MAX_HASH_SIZE);
+    if (!pgp_hash_create(&hash, PGP_HASH_SHA256)) {
+        return false;
+    }
+    pgp_hash_add(&hash, cache->secret, sizeof(cache->secret));
+    pgp_hash_add(&hash, password, strlen(password));
+    pgp_hash_finish(&hash, pswd);
+    return true;
+}
+
+static void
+s2k_cache_expire(pgp_s2k_cache_t *cache, time_t now)
+{
+    for (size_t i = 0; i < DEFAULT_S2K_CACHE_SIZE; i++) {
+        pgp_s2k_cache_entry_t *entry = &cache->entries[i];
+        if (!entry->used) {
+            continue;
+        }
+        if ((now < entry->stamp) || (now - entry->stamp > DEFAULT_S2K_CACHE_TTL)) {
+            pgp_forget(entry, sizeof(*entry));
+        }
+    }
+}
+
+static pgp_s2k_cache_entry_t *
+s2k_cache_find(pgp_s2k_cache_t *cache, const pgp_s2k_cache_entry_t *search)
+{
+    for (size_t i = 0; i < DEFAULT_S2K_CACHE_SIZE; i++) {
+        pgp_s2k_cache_entry_t *entry = &cache->entries[i];
+        if (!entry->used || (entry->alg != search->alg) ||
+            (entry->salted != search->salted) || (entry->iterations != search->iterations) ||
+            (entry->keylen != search->keylen)) {
+            continue;
+        }
+        if (search->salted && memcmp(entry->salt, search->salt, PGP_SALT_SIZE)) {
+            continue;
+        }
+        if (memcmp(entry->pswd, search->pswd, PGP_MAX_HASH_SIZE)) {
+            continue;
+        }
+        return entry;
+    }
+    return NULL;
+}
+
+static void
+s2k_cache_store(pgp_s2k_cache_t *cache, const pgp_s2k_cache_entry_t *src)
+{
+    pgp_s2k_cache_entry_t *dst = &cache->entries[0];
+
+    /* use free slot or evict the oldest one */
+    for (size_t i = 0; i < DEFAULT_S2K_CACHE_SIZE; i++) {
+        pgp_s2k_cache_entry_t *entry = &cache->entries[i];
+        if (!entry->used) {
+            dst = entry;
+            break;
+        }
+        if (entry->stamp < dst->stamp) {
+            dst = entry;
+        }
+    }
+    memcpy(dst, src, sizeof(*dst));
+    dst->used = true;
+}
+
+int
+pgp_s2k_iterated_cached(pgp_s2k_cache_t *cache,
+                        pgp_hash_alg_t   alg,
+                        uint8_t *        out,
+                        size_t           output_len,
+                        const char *     password,
+                        const uint8_t *  salt,
+                        size_t           iterations)
+{
+    pgp_s2k_cache_entry_t  search = {};
+    pgp_s2k_cache_entry_t *entry = NULL;
+    int                    res;
+
+    if (!cache || (output_len > PGP_MAX_KEY_SIZE) || !password) {
+        return pgp_s2k_iterated(alg, out, output_len, password, salt, iterations);
+    }
+
+    search.alg = alg;
+    search.salted = salt;
+    if (salt) {
+        memcpy(search.salt, salt, PGP_SALT_SIZE);
+    }
+    search.iterations = iterations;
+    search.keylen = output_len;
+
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        if (!s2k_cache_password_hash(cache, password, search.pswd)) {
+            pgp_forget(&search, sizeof(search));
+            return pgp_s2k_iterated(alg, out, output_len, password, salt, iterations);
+        }
+        s2k_cache_expire(cache, time(NULL));
+        if ((entry = s2k_cache_find(cache, &search))) {
+            memcpy(out, entry->key, output_len);
+            pgp_forget(&search, sizeof(search));
+            return 0;
+        }
+    }
+
+    /* derivation is the expensive part, so do not hold the lock while doing it */
+    if (!(res = pgp_s2k_iterated(alg, out, output_len, password, salt, iterations))) {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        memcpy(search.key, out, output_len);
+        search.stamp = time(NULL);
+        if (!s2k_cache_find(cache, &search)) {
+            s2k_cache_store(cache, &search);
+        }
+    }
+    pgp_forget(&search, sizeof(search));
+    return res;
+}
+
+void
+pgp_s2k_cache_clear(pgp_s2k_cache_t *cache)
+{
+    if (!cache) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    pgp_forget(cache->entries, sizeof(cache->entries));
+}
+
+static bool
+s2k_derive_key(
+  pgp_s2k_cache_t *cache, pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysize)
 {
     uint8_t *saltptr = NULL;
     unsigned iterations = 1;
+    int      res;
 
     switch (s2k->specifier) {
     case PGP_S2KS_SIMPLE:
@@ -62,7 +269,10 @@ pgp_s2k_derive_key(pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysi
         return false;
     }
 
-    if (pgp_s2k_iterated(s2k->hash_alg, key, keysize, password, saltptr, iterations)) {
+    /* without the cache this is the same as pgp_s2k_iterated() */
+    res = pgp_s2k_iterated_cached(
+      cache, s2k->hash_alg, key, keysize, password, saltptr, iterations);
+    if (res) {
         (void) fprintf(stderr, "s2k_derive_key: s2k failed\n");
         return false;
     }
@@ -70,6 +280,19 @@ pgp_s2k_derive_key(pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysi
     return true;
 }
 
+bool
+pgp_s2k_derive_key(pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysize)
+{
+    return s2k_derive_key(NULL, s2k, password, key, keysize);
+}
+
+bool
+pgp_s2k_derive_key_cached(
+  pgp_s2k_cache_t *cache, pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysize)
+{
+    return s2k_derive_key(cache, s2k, password, key, keysize);
+}
+
 int
 pgp_s2k_simple(pgp_hash_alg_t alg, uint8_t *out, size_t output_len, const char *password)
 {
@@ -86,6 +309,9 @@ pgp_s2k_salted(pgp_hash_alg_t alg,
     return pgp_s2k_iterated(alg, out, output_len, password, salt, 1);
 }
 
+/* Size of the buffer, filled with the repeated salt + password pattern */
+#define S2K_PATTERN_BLOCK 16384
+
 int
 pgp_s2k_iterated(pgp_hash_alg_t alg,
                  uint8_t *      out,
@@ -93,6 +319,89 @@ pgp_s2k_iterated(pgp_hash_alg_t alg,
                  const char *   password,
                  const uint8_t *salt,
                  size_t         iterations)
+{
+    const char * hname = pgp_hash_name_botan(alg);
+    botan_hash_t hash = NULL;
+    size_t       hlen = 0;
+    size_t       saltlen = salt ? PGP_SALT_SIZE : 0;
+    size_t       passlen = strlen(password);
+    size_t       patlen = saltlen + passlen;
+    size_t       buflen;
+    uint8_t *    buf = NULL;
+    uint8_t      digest[PGP_MAX_HASH_SIZE];
+    int          res = -1;
+
+    /* Botan's OpenPGP-S2K feeds the hash with the salt + password pattern, one pattern per
+     * call. Hashing large blocks of the repeated pattern instead gives the same result but
+     * removes per-call overhead, while Botan still picks the fastest hash implementation for
+     * the CPU at runtime. */
+    if (!hname || !patlen || ((iterations > 1) && !salt)) {
+        return pgp_s2k_iterated_botan(alg, out, output_len, password, salt, iterations);
+    }
+
+    if (iterations < patlen) {
+        iterations = patlen;
+    }
+    /* buffer holds the whole number of patterns */
+    buflen = std::max((size_t) 1, S2K_PATTERN_BLOCK / patlen);
+    buflen = std::min(buflen, (iterations + patlen - 1) / patlen) * patlen;
+    if (!(buf = (uint8_t *) malloc(buflen))) {
+        return -1;
+    }
+    for (size_t pos = 0; pos < buflen; pos += patlen) {
+        if (saltlen) {
+            memcpy(buf + pos, salt, saltlen);
+        }
+        memcpy(buf + pos + saltlen, password, passlen);
+    }
+
+    if (botan_hash_init(&hash, hname, 0) || botan_hash_output_length(hash, &hlen) ||
+        (hlen > sizeof(digest))) {
+        goto finish;
+    }
+
+    for (size_t pass = 0, generated = 0; generated < output_len; pass++) {
+        size_t left = iterations;
+        size_t outlen = std::min(hlen, output_len - generated);
+
+        /* preload pass number of zero bytes */
+        memset(digest, 0, sizeof(digest));
+        for (size_t zeroes = pass; zeroes;) {
+            size_t len = std::min(zeroes, sizeof(digest));
+            if (botan_hash_update(hash, digest, len)) {
+                goto finish;
+            }
+            zeroes -= len;
+        }
+        while (left) {
+            size_t len = std::min(left, buflen);
+            if (botan_hash_update(hash, buf, len)) {
+                goto finish;
+            }
+            left -= len;
+        }
+        if (botan_hash_final(hash, digest)) {
+            goto finish;
+        }
+        memcpy(out + generated, digest, outlen);
+        generated += outlen;
+    }
+    res = 0;
+finish:
+    botan_hash_destroy(hash);
+    pgp_forget(digest, sizeof(digest));
+    pgp_forget(buf, buflen);
+    free(buf);
+    return res;
+}
+
+int
+pgp_s2k_iterated_botan(pgp_hash_alg_t alg,
+                       uint8_t *      out,
+                       size_t         output_len,
+                       const char *   password,
+                       const uint8_t *salt,
+                       size_t         iterations)
 {
     char s2k_algo_str[128];
     snprintf(s2k_algo_str, sizeof(s2k_algo_str), "OpenPGP-S2K(%s)", pgp_hash_name_botan(alg));
@@ -151,22 +460,50 @@ get_timestamp_usec()
     return (static_cast<uint64_t>(tv.tv_sec) * 1000000) + static_cast<uint64_t>(tv.tv_usec);
 }
 
-size_t
-pgp_s2k_compute_iters(pgp_hash_alg_t alg, size_t desired_msec, size_t trial_msec)
-{
-    const uint8_t MIN_ITERS = 96;
-    uint8_t       buf[8192] = {0};
-    size_t        bytes = 0;
+/* Calibration data: number of hashed bytes per microsecond for the hash algorithm, measured
+ * with trial_msec long trial run. Stored to the file as bytes per second. */
+typedef struct pgp_s2k_calibration_t {
+    pgp_hash_alg_t alg;
+    size_t         trial_msec;
+    double         rate;
+} pgp_s2k_calibration_t;
 
-    if (desired_msec == 0) {
-        desired_msec = DEFAULT_S2K_MSEC;
+#define S2K_CALIBRATION_MAX 16
+#define S2K_CALIBRATION_HEADER "# rnp s2k calibration data"
+
+static pgp_s2k_calibration_t s2k_calibration[S2K_CALIBRATION_MAX];
+static size_t                s2k_calibration_count = 0;
+static bool                  s2k_calibration_dirty = false;
+static std::mutex            s2k_calibration_mutex;
+
+static pgp_s2k_calibration_t *
+s2k_calibration_find(pgp_hash_alg_t alg, bool add)
+{
+    for (size_t i = 0; i < s2k_calibration_count; i++) {
+        if (s2k_calibration[i].alg == alg) {
+            return &s2k_calibration[i];
+        }
     }
-    if (trial_msec == 0) {
-        trial_msec = DEFAULT_S2K_TUNE_MSEC;
+    if (!add || (s2k_calibration_count >= S2K_CALIBRATION_MAX)) {
+        return NULL;
     }
+    pgp_s2k_calibration_t *res = &s2k_calibration[s2k_calibration_count++];
+    res->alg = alg;
+    res->trial_msec = 0;
+    res->rate = 0;
+    return res;
+}
 
+static double
+s2k_measure_rate(pgp_hash_alg_t alg, size_t trial_msec)
+{
+    uint8_t    buf[8192] = {0};
+    size_t     bytes = 0;
     pgp_hash_t hash;
-    pgp_hash_create(&hash, alg);
+
+    if (!pgp_hash_create(&hash, alg)) {
+        return 0;
+    }
 
     const uint64_t start = get_timestamp_usec();
     uint64_t       end = start;
@@ -180,11 +517,183 @@ pgp_s2k_compute_iters(pgp_hash_alg_t alg, size_t desired_msec, size_t trial_msec
     pgp_hash_finish(&hash, buf);
 
     const uint64_t duration = end - start;
+    return duration ? static_cast<double>(bytes) / duration : 0;
+}
+
+double
+pgp_s2k_calibrate(pgp_hash_alg_t alg, size_t trial_msec)
+{
+    std::lock_guard<std::mutex> lock(s2k_calibration_mutex);
+    pgp_s2k_calibration_t *     cal = s2k_calibration_find(alg, true);
+
+    if (trial_msec == 0) {
+        trial_msec = DEFAULT_S2K_TUNE_MSEC;
+    }
+    /* longer trial gives more precise result, so re-measure if it was requested */
+    if (cal && (cal->rate > 0) && (cal->trial_msec >= trial_msec)) {
+        return cal->rate;
+    }
+
+    double rate = s2k_measure_rate(alg, trial_msec);
+    if (cal && (rate > 0)) {
+        cal->rate = rate;
+        cal->trial_msec = trial_msec;
+        s2k_calibration_dirty = true;
+    }
+    return rate;
+}
+
+void
+pgp_s2k_calibration_reset(void)
+{
+    std::lock_guard<std::mutex> lock(s2k_calibration_mutex);
+    s2k_calibration_count = 0;
+    s2k_calibration_dirty = false;
+}
+
+/* Calibration results are valid only for the same CPU and crypto backend, so fingerprint
+ * them */
+static bool
+s2k_cpu_fingerprint(char *fp, size_t len)
+{
+    pgp_hash_t     hash;
+    struct utsname un = {};
+    char           line[256];
+    uint8_t        digest[PGP_MAX_HASH_SIZE];
+    const char *   botanver = botan_version_string();
+    FILE *         cpuinfo;
+
+    if (!pgp_hash_create(&hash, PGP_HASH_SHA256)) {
+        return false;
+    }
+    if (!uname(&un)) {
+        pgp_hash_add(&hash, un.machine, strlen(un.machine));
+    }
+    if ((cpuinfo = fopen("/proc/cpuinfo", "r"))) {
+        while (fgets(line, sizeof(line), cpuinfo)) {
+            if (!strncmp(line, "model name", 10)) {
+                pgp_hash_add(&hash, line, strlen(line));
+                break;
+            }
+        }
+        fclose(cpuinfo);
+    }
+    pgp_hash_add_int(&hash, std::thread::hardware_concurrency(), 4);
+    pgp_hash_add(&hash, botanver, strlen(botanver));
+    pgp_hash_finish(&hash, digest);
+    return rnp_hex_encode(digest, 16, fp, len, RNP_HEX_LOWERCASE);
+}
+
+bool
+pgp_s2k_calibration_load(const char *path)
+{
+    char     fp[64] = {0};
+    char     line[256];
+    char     filefp[64] = {0};
+    FILE *   f = NULL;
+    unsigned alg;
+    size_t   trial;
+    uint64_t rate;
+    bool     res = false;
+
+    if (!s2k_cpu_fingerprint(fp, sizeof(fp))) {
+        return false;
+    }
+    if (!(f = fopen(path, "r"))) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s2k_calibration_mutex);
+    if (!fgets(line, sizeof(line), f) ||
+        strncmp(line, S2K_CALIBRATION_HEADER, strlen(S2K_CALIBRATION_HEADER))) {
+        RNP_LOG("wrong s2k calibration file header");
+        goto finish;
+    }
+    if (!fgets(line, sizeof(line), f) || (sscanf(line, "cpu %63s", filefp) != 1) ||
+        strcmp(fp, filefp)) {
+        /* calibrated on the other hardware, ignore */
+        goto finish;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "hash %u %zu %" SCNu64, &alg, &trial, &rate) != 3) {
+            RNP_LOG("wrong s2k calibration line: %s", line);
+            goto finish;
+        }
+        pgp_s2k_calibration_t *cal = s2k_calibration_find((pgp_hash_alg_t) alg, true);
+        /* do not overwrite more precise value */
+        if (cal && rate && (cal->trial_msec < trial)) {
+            cal->trial_msec = trial;
+            cal->rate = rate / 1000000.0;
+        }
+    }
+    res = true;
+finish:
+    fclose(f);
+    return res;
+}
+
+bool
+pgp_s2k_calibration_save(const char *path)
+{
+    char  fp[64] = {0};
+    char  tmp[PATH_MAX];
+    FILE *f = NULL;
+    bool  res = false;
+
+    std::lock_guard<std::mutex> lock(s2k_calibration_mutex);
+    if (!s2k_calibration_dirty) {
+        return true;
+    }
+    if (!s2k_cpu_fingerprint(fp, sizeof(fp))) {
+        return false;
+    }
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)) {
+        return false;
+    }
+    if (!(f = fopen(tmp, "w"))) {
+        RNP_LOG("failed to create %s", tmp);
+        return false;
+    }
+    fprintf(f, "%s\ncpu %s\n", S2K_CALIBRATION_HEADER, fp);
+    for (size_t i = 0; i < s2k_calibration_count; i++) {
+        pgp_s2k_calibration_t *cal = &s2k_calibration[i];
+        if (cal->rate <= 0) {
+            continue;
+        }
+        fprintf(f,
+                "hash %u %zu %" PRIu64 "\n",
+                (unsigned) cal->alg,
+                cal->trial_msec,
+                (uint64_t)(cal->rate * 1000000));
+    }
+    res = !ferror(f);
+    res = !fclose(f) && res;
+    if (!res || rename(tmp, path)) {
+        RNP_LOG("failed to write s2k calibration to %s", path);
+        unlink(tmp);
+        return false;
+    }
+    s2k_calibration_dirty = false;
+    return true;
+}
+
+size_t
+pgp_s2k_compute_iters(pgp_hash_alg_t alg, size_t desired_msec, size_t trial_msec)
+{
+    const uint8_t MIN_ITERS = 96;
+
+    if (desired_msec == 0) {
+        desired_msec = DEFAULT_S2K_MSEC;
+    }
+    if (trial_msec == 0) {
+        trial_msec = DEFAULT_S2K_TUNE_MSEC;
+    }
+
+    const double bytes_per_usec = pgp_s2k_calibrate(alg, trial_msec);
 
-    if (duration == 0)
+    if (bytes_per_usec <= 0)
         return pgp_s2k_decode_iterations(MIN_ITERS);
 
-    const double  bytes_per_usec = static_cast<double>(bytes) / duration;
     const double  desired_usec = desired_msec * 1000.0;
     const double  bytes_for_target = bytes_per_usec * desired_usec;
     const uint8_t iters = pgp_s2k_encode_iterations(bytes_for_target);
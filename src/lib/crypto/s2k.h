@@ -33,7 +33,8 @@
 
 #include "hash.h"
 
-typedef struct pgp_s2k_t pgp_s2k_t;
+typedef struct pgp_s2k_t       pgp_s2k_t;
+typedef struct pgp_s2k_cache_t pgp_s2k_cache_t;
 
 int pgp_s2k_simple(pgp_hash_alg_t alg, uint8_t *out, size_t output_len, const char *password);
 
@@ -50,6 +51,16 @@ int pgp_s2k_iterated(pgp_hash_alg_t alg,
                      const uint8_t *salt,
                      size_t         iterations);
 
+/** @brief Same as pgp_s2k_iterated(), but uses Botan's generic OpenPGP-S2K implementation
+ *         instead of the native one. Used as a fallback and for cross-checking.
+ */
+int pgp_s2k_iterated_botan(pgp_hash_alg_t alg,
+                           uint8_t *      out,
+                           size_t         output_len,
+                           const char *   password,
+                           const uint8_t *salt,
+                           size_t         iterations);
+
 size_t pgp_s2k_decode_iterations(uint8_t encoded_iter);
 
 uint8_t pgp_s2k_encode_iterations(size_t iterations);
@@ -57,8 +68,33 @@ uint8_t pgp_s2k_encode_iterations(size_t iterations);
 // Round iterations to nearest representable value
 size_t pgp_s2k_round_iterations(size_t iterations);
 
+/** @brief Compute the number of iterations, which would take desired_msec to derive the key.
+ *         Uses cached calibration data, so hash speed is measured only once.
+ *  @param alg hash algorithm
+ *  @param desired_msec desired derivation time, or 0 for the default value
+ *  @param trial_msec duration of the calibration trial, or 0 for the default value
+ *  @return number of iterations, rounded to the representable value
+ */
 size_t pgp_s2k_compute_iters(pgp_hash_alg_t alg, size_t desired_msec, size_t trial_msec);
 
+/** @brief Get hashing speed, measuring it only if there is no calibration data for the
+ *         algorithm yet, or it was obtained with shorter trial run.
+ *  @return number of bytes hashed per microsecond or 0 on failure
+ */
+double pgp_s2k_calibrate(pgp_hash_alg_t alg, size_t trial_msec);
+
+/** @brief Load calibration data, previously stored with pgp_s2k_calibration_save().
+ *         Data is ignored if it was obtained on other CPU or crypto backend version.
+ *  @return true if data was loaded or false otherwise
+ */
+bool pgp_s2k_calibration_load(const char *path);
+
+/** @brief Store calibration data to the file, if it was changed since the last load/save */
+bool pgp_s2k_calibration_save(const char *path);
+
+/** @brief Drop all the calibration data */
+void pgp_s2k_calibration_reset(void);
+
 /** @brief Derive key from password using the information stored in s2k structure
  *  @param s2k pointer to s2k structure, filled according to RFC 4880.
  *  Iterations field may contain encoded ( < 256) or decoded ( > 256) value.
@@ -69,4 +105,35 @@ size_t pgp_s2k_compute_iters(pgp_hash_alg_t alg, size_t desired_msec, size_t tri
 */
 bool pgp_s2k_derive_key(pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysize);
 
+/** @brief Create the cache of derived keys. Entries are keyed by the salted hash of the
+ *         password, so password may be checked against them much faster than via S2K. Storage
+ *         is mlock()ed when possible, entries expire after DEFAULT_S2K_CACHE_TTL seconds.
+ *  @return pointer to the cache or NULL on failure
+ */
+pgp_s2k_cache_t *pgp_s2k_cache_create(void);
+
+/** @brief Wipe all the entries and free the cache */
+void pgp_s2k_cache_destroy(pgp_s2k_cache_t *cache);
+
+/** @brief Wipe all the derived keys stored in the S2K cache */
+void pgp_s2k_cache_clear(pgp_s2k_cache_t *cache);
+
+/** @brief Same as pgp_s2k_derive_key(), but looks up the derived key in the S2K cache first,
+ *         and stores it there on successful derivation. Should be used only when deriving
+ *         key from the existing s2k parameters, i.e. for decryption.
+ *  @param cache S2K cache, may be NULL, then key is always derived
+ */
+bool pgp_s2k_derive_key_cached(
+  pgp_s2k_cache_t *cache, pgp_s2k_t *s2k, const char *password, uint8_t *key, int keysize);
+
+/** @brief Cached version of pgp_s2k_iterated(). Returns 0 on success like the original one.
+ */
+int pgp_s2k_iterated_cached(pgp_s2k_cache_t *cache,
+                            pgp_hash_alg_t   alg,
+                            uint8_t *        out,
+                            size_t           output_len,
+                            const char *     password,
+                            const uint8_t *  salt,
+                            size_t           iterations);
+
 #endif
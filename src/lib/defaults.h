@@ -49,6 +49,12 @@
 /* Default number of msec to run S2K tuning */
 #define DEFAULT_S2K_TUNE_MSEC 10
 
+/* Maximum number of derived keys kept in the S2K cache */
+#define DEFAULT_S2K_CACHE_SIZE 16
+
+/* Number of seconds derived key stays in the S2K cache */
+#define DEFAULT_S2K_CACHE_TTL 300
+
 /* Default compression algorithm and level */
 #define DEFAULT_Z_ALG PGP_C_ZIP
 #define DEFAULT_Z_LEVEL 6
@@ -56,6 +56,8 @@ rnp_key_matches_search(const pgp_key_t *key, const pgp_key_search_t *search)
             }
         }
     } break;
+    case PGP_KEY_SEARCH_ANY:
+        return true;
     default:
         assert(false);
         break;
@@ -97,8 +99,11 @@ rnp_key_provider_key_ptr_list(const pgp_key_request_ctx_t *ctx, void *userdata)
     list key_list = (list) userdata;
     for (list_item *item = list_front(key_list); item; item = list_next(item)) {
         pgp_key_t *key = *(pgp_key_t **) item;
-        if (rnp_key_matches_search(key, &ctx->search) &&
-            pgp_is_key_secret(key) == ctx->secret) {
+        if (!rnp_key_matches_search(key, &ctx->search) ||
+            (pgp_is_key_secret(key) != ctx->secret)) {
+            continue;
+        }
+        if (!ctx->enumcb || !ctx->enumcb(key, ctx->enumparam)) {
             return key;
         }
     }
@@ -127,7 +132,10 @@ rnp_key_provider_store(const pgp_key_request_ctx_t *ctx, void *userdata)
 
     for (pgp_key_t *key = rnp_key_store_search(NULL, ks, &ctx->search, NULL); key;
          key = rnp_key_store_search(NULL, ks, &ctx->search, key)) {
-        if (pgp_is_key_secret(key) == ctx->secret) {
+        if (pgp_is_key_secret(key) != ctx->secret) {
+            continue;
+        }
+        if (!ctx->enumcb || !ctx->enumcb(key, ctx->enumparam)) {
             return key;
         }
     }
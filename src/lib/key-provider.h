@@ -36,7 +36,8 @@ typedef enum {
     PGP_KEY_SEARCH_KEYID,
     PGP_KEY_SEARCH_FINGERPRINT,
     PGP_KEY_SEARCH_GRIP,
-    PGP_KEY_SEARCH_USERID
+    PGP_KEY_SEARCH_USERID,
+    PGP_KEY_SEARCH_ANY /* matches any key, used to enumerate keys of the provider */
 } pgp_key_search_type_t;
 
 typedef struct pgp_key_search_t {
@@ -49,10 +50,15 @@ typedef struct pgp_key_search_t {
     } by;
 } pgp_key_search_t;
 
+/* callback for the keys enumeration, returns false to stop it */
+typedef bool pgp_key_enum_callback_t(pgp_key_t *key, void *param);
+
 typedef struct pgp_key_request_ctx_t {
-    pgp_op_t         op;
-    bool             secret;
-    pgp_key_search_t search;
+    pgp_op_t                 op;
+    bool                     secret;
+    pgp_key_search_t         search;
+    pgp_key_enum_callback_t *enumcb; /* if not NULL then all matching keys are passed to it */
+    void *                   enumparam;
 } pgp_key_request_ctx_t;
 
 typedef pgp_key_t *pgp_key_callback_t(const pgp_key_request_ctx_t *ctx, void *userdata);
@@ -75,7 +81,9 @@ bool rnp_key_matches_search(const pgp_key_t *key, const pgp_key_search_t *search
 
 /** @brief request public or secret pgp key, according to information stored in ctx
  *  @param ctx information about the request - which operation requested the key, which search
- *  criteria should be used and whether secret or public key is needed
+ *  criteria should be used and whether secret or public key is needed. To enumerate all of the
+ *  matching keys set ctx->enumcb: provider will pass each of them to it, in a single pass over
+ *  the keyring, and return the key on which callback stopped enumeration, or NULL otherwise.
  *  @param key pointer to the key structure will be stored here on success
  *  @return a key pointer on success, or NULL if key was not found otherwise
  **/
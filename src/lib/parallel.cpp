@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2018, [Ribose Inc](https://www.ribose.com).
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1.  Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ * 2.  Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+#include "utils.h"
+
+typedef struct rnp_parallel_ctx_t {
+    std::atomic<size_t> next;    /* index of the next item to dispatch */
+    std::atomic<bool>   stopped; /* some job requested stop */
+    size_t              count;
+    rnp_parallel_job_t *job;
+    void *              param;
+} rnp_parallel_ctx_t;
+
+static void
+rnp_parallel_worker(rnp_parallel_ctx_t *ctx, size_t worker)
+{
+    while (!ctx->stopped.load()) {
+        size_t idx = ctx->next.fetch_add(1);
+        if (idx >= ctx->count) {
+            return;
+        }
+        if (!ctx->job(ctx->param, idx, worker)) {
+            ctx->stopped.store(true);
+        }
+    }
+}
+
+size_t
+rnp_parallel_threads(size_t count)
+{
+    size_t cpus = std::thread::hardware_concurrency();
+
+    if (!cpus) {
+        cpus = 1;
+    }
+    if (count && (cpus > count)) {
+        cpus = count;
+    }
+    return cpus;
+}
+
+bool
+rnp_parallel_for(size_t count, size_t threads, rnp_parallel_job_t *job, void *param)
+{
+    rnp_parallel_ctx_t       ctx;
+    std::vector<std::thread> workers;
+
+    ctx.next = 0;
+    ctx.stopped = false;
+    ctx.count = count;
+    ctx.job = job;
+    ctx.param = param;
+
+    if (threads > count) {
+        threads = count;
+    }
+
+    /* worker 0 is the calling thread */
+    try {
+        workers.reserve(threads ? threads - 1 : 0);
+        for (size_t i = 1; i < threads; i++) {
+            workers.emplace_back(rnp_parallel_worker, &ctx, i);
+        }
+    } catch (const std::exception &e) {
+        RNP_LOG("failed to start worker thread: %s", e.what());
+    }
+
+    rnp_parallel_worker(&ctx, 0);
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    return !ctx.stopped.load();
+}
+
+typedef struct rnp_worker_item_t {
+    rnp_worker_job_t *job;
+    void *            param;
+} rnp_worker_item_t;
+
+struct rnp_worker_pool_t {
+    std::mutex                    lock;
+    std::condition_variable       cond;  /* signalled on new job and stop */
+    std::deque<rnp_worker_item_t> jobs;  /* jobs, not picked by workers yet */
+    std::vector<std::thread>      threads;
+    size_t                        count; /* number of threads to start */
+    bool                          stop;  /* workers should exit once queue is empty */
+};
+
+static void
+rnp_worker_pool_worker(rnp_worker_pool_t *pool)
+{
+    std::unique_lock<std::mutex> lock(pool->lock);
+
+    while (true) {
+        pool->cond.wait(lock, [pool] { return !pool->jobs.empty() || pool->stop; });
+        if (pool->jobs.empty()) {
+            return;
+        }
+        rnp_worker_item_t item = pool->jobs.front();
+        pool->jobs.pop_front();
+        lock.unlock();
+        item.job(item.param);
+        lock.lock();
+    }
+}
+
+rnp_worker_pool_t *
+rnp_worker_pool_create(size_t threads)
+{
+    rnp_worker_pool_t *pool = NULL;
+
+    try {
+        pool = new rnp_worker_pool_t();
+    } catch (const std::exception &e) {
+        RNP_LOG("failed to allocate worker pool: %s", e.what());
+        return NULL;
+    }
+    pool->count = threads ? threads : rnp_parallel_threads(0);
+    pool->stop = false;
+    return pool;
+}
+
+bool
+rnp_worker_pool_set_threads(rnp_worker_pool_t *pool, size_t threads)
+{
+    std::lock_guard<std::mutex> lock(pool->lock);
+    if (!pool->threads.empty()) {
+        return false;
+    }
+    pool->count = threads ? threads : rnp_parallel_threads(0);
+    return true;
+}
+
+bool
+rnp_worker_pool_submit(rnp_worker_pool_t *pool, rnp_worker_job_t *job, void *param)
+{
+    std::lock_guard<std::mutex> lock(pool->lock);
+
+    try {
+        /* threads are started lazily, so pools of unused ffi objects do not cost anything */
+        while (pool->threads.size() < pool->count) {
+            pool->threads.emplace_back(rnp_worker_pool_worker, pool);
+        }
+    } catch (const std::exception &e) {
+        RNP_LOG("failed to start worker thread: %s", e.what());
+    }
+    if (pool->threads.empty()) {
+        return false;
+    }
+
+    try {
+        pool->jobs.push_back({job, param});
+    } catch (const std::exception &e) {
+        RNP_LOG("failed to queue job: %s", e.what());
+        return false;
+    }
+    pool->cond.notify_one();
+    return true;
+}
+
+/* items of the rnp_worker_pool_run call, shared by the caller and the queued helpers */
+typedef struct rnp_pool_run_t {
+    std::mutex              lock;
+    std::condition_variable cond;    /* signalled once all items are done */
+    std::atomic<size_t>     next;    /* index of the next item to dispatch */
+    std::atomic<size_t>     workers; /* number of workers which started processing */
+    std::atomic<bool>       stopped; /* some job requested stop */
+    size_t                  count;
+    size_t                  done;    /* number of processed or skipped items */
+    size_t                  refs;    /* caller and helpers which did not finish yet */
+    rnp_parallel_job_t *    job;
+    void *                  param;
+} rnp_pool_run_t;
+
+static void
+rnp_pool_run_items(rnp_pool_run_t *run)
+{
+    size_t worker = run->workers.fetch_add(1);
+    size_t idx;
+
+    while ((idx = run->next.fetch_add(1)) < run->count) {
+        if (!run->stopped.load() && !run->job(run->param, idx, worker)) {
+            run->stopped.store(true);
+        }
+        std::lock_guard<std::mutex> lock(run->lock);
+        if (++run->done == run->count) {
+            run->cond.notify_all();
+        }
+    }
+}
+
+static void
+rnp_pool_run_release(rnp_pool_run_t *run, size_t refs)
+{
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(run->lock);
+        run->refs -= refs;
+        last = !run->refs;
+    }
+    if (last) {
+        delete run;
+    }
+}
+
+/* helper may start after all items are done by others, so it owns a reference */
+static void
+rnp_pool_run_helper(void *param)
+{
+    rnp_pool_run_t *run = (rnp_pool_run_t *) param;
+
+    rnp_pool_run_items(run);
+    rnp_pool_run_release(run, 1);
+}
+
+bool
+rnp_worker_pool_run(rnp_worker_pool_t * pool,
+                    size_t              count,
+                    rnp_parallel_job_t *job,
+                    void *              param)
+{
+    rnp_pool_run_t *run = NULL;
+    size_t          threads;
+    size_t          helpers;
+    bool            res;
+
+    if (!count) {
+        return true;
+    }
+    if (pool) {
+        try {
+            run = new rnp_pool_run_t();
+        } catch (const std::exception &e) {
+            RNP_LOG("failed to allocate: %s", e.what());
+        }
+    }
+    if (!run) {
+        /* process everything in the calling thread */
+        return rnp_parallel_for(count, 1, job, param);
+    }
+    run->next = 0;
+    run->workers = 0;
+    run->stopped = false;
+    run->count = count;
+    run->done = 0;
+    run->job = job;
+    run->param = param;
+
+    /* caller is one of the workers, so the total number of threads is the pool's one */
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        threads = pool->count;
+    }
+    helpers = (threads < count ? threads : count) - 1;
+    run->refs = helpers + 1;
+    for (size_t i = 0; i < helpers; i++) {
+        if (!rnp_worker_pool_submit(pool, rnp_pool_run_helper, run)) {
+            rnp_pool_run_release(run, helpers - i);
+            break;
+        }
+    }
+
+    rnp_pool_run_items(run);
+    {
+        std::unique_lock<std::mutex> lock(run->lock);
+        run->cond.wait(lock, [run] { return run->done == run->count; });
+    }
+    res = !run->stopped.load();
+    rnp_pool_run_release(run, 1);
+    return res;
+}
+
+void
+rnp_worker_pool_destroy(rnp_worker_pool_t *pool)
+{
+    if (!pool) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        pool->stop = true;
+        pool->cond.notify_all();
+    }
+    for (auto &thread : pool->threads) {
+        thread.join();
+    }
+    delete pool;
+}
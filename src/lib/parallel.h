@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2018, [Ribose Inc](https://www.ribose.com).
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1.  Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ * 2.  Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RNP_PARALLEL_H_
+#define RNP_PARALLEL_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/** @brief Job callback used by rnp_parallel_for.
+ *  @param param opaque parameter, passed to rnp_parallel_for
+ *  @param idx index of the item to process, 0 <= idx < count
+ *  @param worker index of the worker thread running the job, 0 <= worker < threads. Worker 0
+ *         is always the calling thread, so it may safely use the caller's non-thread-safe
+ *         objects (like RNG).
+ *  @return true to continue processing, or false to stop: items which were not started yet
+ *          will be skipped.
+ */
+typedef bool rnp_parallel_job_t(void *param, size_t idx, size_t worker);
+
+/** @brief Get the number of worker threads which makes sense to run for count items.
+ *  @param count number of items to process
+ *  @return number of threads, at least 1 and at most count (if count is not zero)
+ */
+size_t rnp_parallel_threads(size_t count);
+
+/** @brief Run job for each of count items, using up to threads worker threads.
+ *         Items are dispatched in increasing order of index, however may complete in any
+ *         order, so results should be stored by index to keep the output deterministic.
+ *         If thread could not be started then remaining items are processed by the started
+ *         workers, so call never fails because of the threading issues.
+ *  @param count number of items to process
+ *  @param threads maximum number of threads, including the calling one. Usually the value,
+ *         returned from rnp_parallel_threads(count).
+ *  @param job callback, called for each item
+ *  @param param opaque parameter, passed to the job
+ *  @return true if all items were processed, or false if some job requested a stop
+ */
+bool rnp_parallel_for(size_t count, size_t threads, rnp_parallel_job_t *job, void *param);
+
+typedef struct rnp_worker_pool_t rnp_worker_pool_t;
+
+/** @brief Job callback used by rnp_worker_pool_submit.
+ *  @param param opaque parameter, passed to rnp_worker_pool_submit
+ */
+typedef void rnp_worker_job_t(void *param);
+
+/** @brief Create the pool of worker threads, running the submitted jobs in FIFO order.
+ *         Threads are not started until the first job is submitted.
+ *  @param threads number of worker threads, 0 means number of the available CPUs
+ *  @return pool handle, or NULL if allocation failed
+ */
+rnp_worker_pool_t *rnp_worker_pool_create(size_t threads);
+
+/** @brief Change the number of worker threads. Makes sense only before the first job.
+ *  @param pool pool handle, returned by rnp_worker_pool_create
+ *  @param threads number of worker threads, 0 means number of the available CPUs
+ *  @return true on success, or false if threads are already started
+ */
+bool rnp_worker_pool_set_threads(rnp_worker_pool_t *pool, size_t threads);
+
+/** @brief Queue job to be run by some of the pool's threads. Thread-safe.
+ *  @param pool pool handle, returned by rnp_worker_pool_create
+ *  @param job callback to run
+ *  @param param opaque parameter, passed to the job
+ *  @return true if job was queued, or false if no worker thread could be started or
+ *          allocation failed. In this case job will never be called.
+ */
+bool rnp_worker_pool_submit(rnp_worker_pool_t *pool, rnp_worker_job_t *job, void *param);
+
+/** @brief Run job for each of count items on the pool's threads and the calling one, and wait
+ *         until all of them are processed. Semantics are the same as for rnp_parallel_for,
+ *         however no threads are started besides the pool's ones. The calling thread
+ *         processes items as well, so the call completes even if all of the pool's threads
+ *         are busy, and it may be used from the pool's job.
+ *  @param pool pool handle, returned by rnp_worker_pool_create. If NULL then all of the
+ *         items are processed by the calling thread.
+ *  @param count number of items to process
+ *  @param job callback, called for each item
+ *  @param param opaque parameter, passed to the job
+ *  @return true if all items were processed, or false if some job requested a stop
+ */
+bool rnp_worker_pool_run(rnp_worker_pool_t * pool,
+                         size_t              count,
+                         rnp_parallel_job_t *job,
+                         void *              param);
+
+/** @brief Wait until all of the queued jobs are finished, stop the threads and free the pool.
+ *         Must not be called from the job.
+ *  @param pool pool handle, returned by rnp_worker_pool_create, or NULL
+ */
+void rnp_worker_pool_destroy(rnp_worker_pool_t *pool);
+
+#endif
@@ -28,7 +28,8 @@
 
 #include <rnp/rnp_sdk.h>
 
-typedef struct pgp_key_t pgp_key_t;
+typedef struct pgp_key_t       pgp_key_t;
+typedef struct pgp_s2k_cache_t pgp_s2k_cache_t;
 
 typedef struct pgp_password_ctx_t {
     uint8_t          op;
@@ -43,6 +44,7 @@ typedef bool pgp_password_callback_t(const pgp_password_ctx_t *ctx,
 typedef struct pgp_password_provider_t {
     pgp_password_callback_t *callback;
     void *                   userdata;
+    pgp_s2k_cache_t *        s2k_cache; /* cache of derived keys, may be NULL */
 } pgp_password_provider_t;
 
 bool pgp_request_password(const pgp_password_provider_t *provider,
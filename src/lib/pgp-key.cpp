@@ -357,7 +357,8 @@ pgp_key_pkt_t *
 pgp_decrypt_seckey_pgp(const uint8_t *      data,
                        size_t               data_len,
                        const pgp_key_pkt_t *pubkey,
-                       const char *         password)
+                       const char *         password,
+                       pgp_s2k_cache_t *    cache)
 {
     pgp_source_t   src = {0};
     pgp_key_pkt_t *res = NULL;
@@ -375,7 +376,7 @@ pgp_decrypt_seckey_pgp(const uint8_t *      data,
         goto error;
     }
 
-    if (decrypt_secret_key(res, password)) {
+    if (decrypt_secret_key_cached(res, password, cache)) {
         goto error;
     }
 
@@ -400,8 +401,11 @@ pgp_decrypt_seckey(const pgp_key_t *              key,
                    const pgp_password_ctx_t *     ctx)
 {
     pgp_key_pkt_t *               decrypted_seckey = NULL;
-    typedef struct pgp_key_pkt_t *pgp_seckey_decrypt_t(
-      const uint8_t *data, size_t data_len, const pgp_key_pkt_t *pubkey, const char *password);
+    typedef struct pgp_key_pkt_t *pgp_seckey_decrypt_t(const uint8_t *      data,
+                                                       size_t               data_len,
+                                                       const pgp_key_pkt_t *pubkey,
+                                                       const char *         password,
+                                                       pgp_s2k_cache_t *    cache);
     pgp_seckey_decrypt_t *decryptor = NULL;
     char                  password[MAX_PASSWORD_LENGTH] = {0};
 
@@ -435,8 +439,11 @@ pgp_decrypt_seckey(const pgp_key_t *              key,
         }
     }
     // attempt to decrypt with the provided password
-    decrypted_seckey =
-      decryptor(key->packets[0].raw, key->packets[0].length, pgp_get_key_pkt(key), password);
+    decrypted_seckey = decryptor(key->packets[0].raw,
+                                 key->packets[0].length,
+                                 pgp_get_key_pkt(key),
+                                 password,
+                                 provider->s2k_cache);
 
 done:
     pgp_forget(password, sizeof(password));
@@ -138,7 +138,8 @@ bool pgp_key_is_subkey(const pgp_key_t *key);
 pgp_key_pkt_t *pgp_decrypt_seckey_pgp(const uint8_t *,
                                       size_t,
                                       const pgp_key_pkt_t *,
-                                      const char *);
+                                      const char *,
+                                      pgp_s2k_cache_t *);
 
 pgp_key_pkt_t *pgp_decrypt_seckey(const pgp_key_t *,
                                   const pgp_password_provider_t *,
@@ -482,6 +482,12 @@ rnp_init(rnp_t *rnp, const rnp_params_t *params)
         }
     }
 
+    /* load S2K calibration data, it's fine if it doesn't exist or outdated */
+    if (params->s2kpath) {
+        rnp->s2kpath = strdup(params->s2kpath);
+        (void) pgp_s2k_calibration_load(rnp->s2kpath);
+    }
+
     // Lazy mode can't fail
     (void) rng_init(&rnp->rng, RNG_DRBG);
     return RNP_SUCCESS;
@@ -504,6 +510,11 @@ rnp_end(rnp_t *rnp)
         free(rnp->defkey);
         rnp->defkey = NULL;
     }
+    if (rnp->s2kpath) {
+        (void) pgp_s2k_calibration_save(rnp->s2kpath);
+        free(rnp->s2kpath);
+        rnp->s2kpath = NULL;
+    }
     free(rnp->io);
 }
 
@@ -528,6 +539,7 @@ rnp_params_free(rnp_params_t *params)
     if (params->defkey != NULL) {
         free(params->defkey);
     }
+    free(params->s2kpath);
 }
 
 /* rnp_ctx_t : init, reset, free internal pointers */
@@ -565,6 +577,11 @@ rnp_ctx_free(rnp_ctx_t *ctx)
     free(ctx->filename);
     list_destroy(&ctx->recipients);
     list_destroy(&ctx->signers);
+    /* passwords are kept till the end, so operation may be executed several times */
+    for (list_item *pi = list_front(ctx->passwords); pi; pi = list_next(pi)) {
+        rnp_symmetric_pass_info_t *pass = (rnp_symmetric_pass_info_t *) pi;
+        pgp_forget(pass, sizeof(*pass));
+    }
     list_destroy(&ctx->passwords);
 }
 
@@ -1214,6 +1231,7 @@ rnp_init_parse_handler(pgp_parse_handler_t *handler, rnp_ctx_t *ctx)
     handler->dest_provider = rnp_parse_handler_dest;
     handler->src_provider = rnp_parse_handler_src;
     handler->on_signatures = (pgp_signatures_func_t *) ctx->on_signatures;
+    handler->on_sesskey = (pgp_sesskey_func_t *) ctx->on_sesskey;
     handler->param = param;
 
     return true;
@@ -1441,6 +1459,35 @@ rnp_protect_file(rnp_ctx_t *ctx, const char *in, const char *out)
     return result;
 }
 
+rnp_result_t
+rnp_rewrap_file(rnp_ctx_t *ctx, const char *in, const char *out)
+{
+    pgp_write_handler_t        handler = {0};
+    pgp_write_handler_param_t *param;
+    rnp_result_t               result;
+
+    if (!rnp_init_write_handler(&handler, ctx)) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+
+    param = (pgp_write_handler_param_t *) handler.param;
+
+    if ((result = rnp_initialize_io(ctx, &param->src, &param->dst, in, out))) {
+        RNP_LOG("failed to initialize reading or writing");
+        rnp_free_write_handler(&handler);
+        return result;
+    }
+
+    if ((result = rnp_rewrap_src(&handler, &param->src, &param->dst))) {
+        RNP_LOG("failed with error code 0x%x", (int) result);
+    }
+
+    src_close(&param->src);
+    dst_close(&param->dst, result != RNP_SUCCESS);
+    rnp_free_write_handler(&handler);
+    return result;
+}
+
 rnp_result_t
 rnp_protect_mem(
   rnp_ctx_t *ctx, const void *in, size_t len, void *out, size_t outlen, size_t *reslen)
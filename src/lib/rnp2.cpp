@@ -41,11 +41,14 @@
 #include <librepgp/stream-packet.h>
 #include <librepgp/stream-key.h>
 #include "packet-create.h"
+#include "parallel.h"
 #include <rnp/rnp2.h>
 #include <rnp/rnp_types.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include "utils.h"
 #include "version.h"
@@ -65,9 +68,11 @@ struct rnp_ffi_st {
     void *                  getkeycb_ctx;
     rnp_password_cb         getpasscb;
     void *                  getpasscb_ctx;
-    rng_t                   rng;
     pgp_key_provider_t      key_provider;
     pgp_password_provider_t pass_provider;
+    pthread_rwlock_t        keylock; /* guards the keyrings and keys stored in them */
+    bool                    keylock_init;
+    rnp_worker_pool_t *     pool; /* runs the asynchronous operations */
 };
 
 struct rnp_input_st {
@@ -113,17 +118,37 @@ struct rnp_op_verify_signature_st {
     rnp_result_t   verify_status;
 };
 
+struct rnp_op_sign_digest_st {
+    rnp_ffi_t       ffi;
+    pgp_key_t *     key; /* secret signing key */
+    pgp_hash_alg_t  halg;
+    uint32_t        create;
+    uint32_t        expires;
+    pgp_signature_t sig;      /* signature with hashed fields, filled with the trailer call */
+    bool            prepared; /* hashed fields are filled so parameters cannot be changed */
+};
+
+struct rnp_op_verify_digest_st {
+    rnp_ffi_t                         ffi;
+    pgp_signature_t                   sig;
+    struct rnp_op_verify_signature_st info;
+};
+
 struct rnp_op_verify_st {
     rnp_ffi_t    ffi;
     rnp_input_t  input;
     rnp_input_t  detached_input; /* for detached signature will be source file/data */
     rnp_output_t output;
     rnp_ctx_t    rnpctx;
+    /* session key to decrypt data with, set via rnp_op_verify_set_session_key */
+    pgp_sesskey_t override_key;
     /* these fields are filled after operation execution */
     rnp_op_verify_signature_t signatures;
     size_t                    signature_count;
     char *                    filename;
     uint32_t                  file_mtime;
+    pgp_sesskey_t             sesskey;
+    bool                      sesskey_valid;
 };
 
 struct rnp_op_encrypt_st {
@@ -172,6 +197,98 @@ typedef enum key_type_t {
         RNP_LOG_FD(fp, __VA_ARGS__); \
     } while (0)
 
+/* Keyrings are shared by all threads, using the ffi object. Functions which only read keys
+ * take the lock in shared mode, while loading, generating or changing keys takes it
+ * exclusively. Keys are never removed from the keyring, so key pointers stay valid.
+ * Locks are reentrant within a thread, so callbacks may call back into the library. Shared
+ * lock cannot be upgraded to the exclusive one, so such request fails and must be checked
+ * via ok(). */
+struct rnp_ffi_lock_t {
+    rnp_ffi_t       ffi;
+    bool            exclusive;
+    bool            locked;  /* whether this one holds the ffi's keylock */
+    bool            upgrade; /* exclusive lock was requested under the shared one */
+    rnp_ffi_lock_t *prev;    /* outer lock, taken by the same thread */
+
+    rnp_ffi_lock_t(rnp_ffi_t lffi, bool lexclusive);
+    ~rnp_ffi_lock_t();
+
+    bool
+    ok() const
+    {
+        return !upgrade;
+    }
+};
+
+static thread_local rnp_ffi_lock_t *ffi_thread_locks;
+
+static rnp_ffi_lock_t *
+ffi_lock_held(rnp_ffi_t ffi)
+{
+    for (rnp_ffi_lock_t *lock = ffi_thread_locks; lock; lock = lock->prev) {
+        if ((lock->ffi == ffi) && lock->locked) {
+            return lock;
+        }
+    }
+    return NULL;
+}
+
+rnp_ffi_lock_t::rnp_ffi_lock_t(rnp_ffi_t lffi, bool lexclusive)
+    : ffi(lffi), exclusive(lexclusive), locked(false), upgrade(false), prev(ffi_thread_locks)
+{
+    rnp_ffi_lock_t *held;
+
+    ffi_thread_locks = this;
+    if (!ffi) {
+        return;
+    }
+    if ((held = ffi_lock_held(ffi))) {
+        if (exclusive && !held->exclusive) {
+            FFI_LOG(ffi, "keys are locked for reading by this thread, cannot change them");
+            upgrade = true;
+        }
+        return;
+    }
+    if (exclusive) {
+        pthread_rwlock_wrlock(&ffi->keylock);
+    } else {
+        pthread_rwlock_rdlock(&ffi->keylock);
+    }
+    locked = true;
+}
+
+rnp_ffi_lock_t::~rnp_ffi_lock_t()
+{
+    if (locked) {
+        pthread_rwlock_unlock(&ffi->keylock);
+    }
+    ffi_thread_locks = prev;
+}
+
+/* DRBG is not thread-safe so each thread has own instance, used by all of the ffi objects */
+struct rnp_thread_rng_t {
+    rng_t rng;
+    bool  ready;
+
+    ~rnp_thread_rng_t()
+    {
+        if (ready) {
+            rng_destroy(&rng);
+        }
+    }
+};
+
+static thread_local rnp_thread_rng_t thread_rng;
+
+static rng_t *
+ffi_rng()
+{
+    if (!thread_rng.ready) {
+        thread_rng.ready = rng_init(&thread_rng.rng, RNG_DRBG);
+    }
+    return thread_rng.ready ? &thread_rng.rng : NULL;
+}
+
 static pgp_key_t *get_key_require_public(rnp_key_handle_t handle);
 static pgp_key_t *get_key_prefer_public(rnp_key_handle_t handle);
 static pgp_key_t *get_key_require_secret(rnp_key_handle_t handle);
@@ -211,11 +328,22 @@ find_key(rnp_ffi_t               ffi,
         const char *identifier_type = NULL;
 
         if (locator_to_str(search, &identifier_type, identifier, sizeof(identifier))) {
+            // callback would load keys, so the shared lock must be released for it
+            rnp_ffi_lock_t *lock = ffi_lock_held(ffi);
+            bool            relock = lock && !lock->exclusive;
+            if (relock) {
+                pthread_rwlock_unlock(&ffi->keylock);
+                lock->locked = false;
+            }
             ffi->getkeycb(ffi,
                           ffi->getkeycb_ctx,
                           identifier_type,
                           identifier,
                           key_type == KEY_TYPE_SECRET);
+            if (relock) {
+                pthread_rwlock_rdlock(&ffi->keylock);
+                lock->locked = true;
+            }
             // recurse and try the store search above once more
             return find_key(ffi, search, key_type, false);
         }
@@ -227,6 +355,11 @@ static pgp_key_t *
 ffi_key_provider(const pgp_key_request_ctx_t *ctx, void *userdata)
 {
     rnp_ffi_t ffi = (rnp_ffi_t) userdata;
+
+    if (ctx->enumcb) {
+        /* enumerating keys, so no need to call the application's key callback */
+        return rnp_key_provider_store(ctx, ctx->secret ? ffi->secring : ffi->pubring);
+    }
     return find_key(ffi, &ctx->search, ctx->secret ? KEY_TYPE_SECRET : KEY_TYPE_PUBLIC, true);
 }
 
@@ -234,8 +367,9 @@ static void
 rnp_ctx_init_ffi(rnp_ctx_t *ctx, rnp_ffi_t ffi)
 {
     memset(ctx, 0, sizeof(*ctx));
-    ctx->rng = &ffi->rng;
+    ctx->rng = ffi_rng();
     ctx->ealg = DEFAULT_PGP_SYMM_ALG;
+    ctx->abits = DEFAULT_AEAD_CHUNK_BITS;
 }
 
 static const pgp_map_t sig_type_map[] = {{PGP_SIG_BINARY, "binary"},
@@ -278,6 +412,9 @@ static const pgp_map_t symm_alg_map[] = {{PGP_SA_IDEA, "IDEA"},
                                          {PGP_SA_CAMELLIA_256, "CAMELLIA256"},
                                          {PGP_SA_SM4, "SM4"}};
 
+static const pgp_map_t aead_alg_map[] = {
+  {PGP_AEAD_NONE, "None"}, {PGP_AEAD_EAX, "EAX"}, {PGP_AEAD_OCB, "OCB"}};
+
 static const pgp_map_t cipher_mode_map[] = {
   {PGP_CIPHER_MODE_CFB, "CFB"}, {PGP_CIPHER_MODE_CBC, "CBC"}, {PGP_CIPHER_MODE_OCB, "OCB"}};
 
@@ -366,7 +503,17 @@ rnp_ffi_create(rnp_ffi_t *ffi, const char *pub_format, const char *sec_format)
     ob->key_provider = (pgp_key_provider_t){.callback = ffi_key_provider, .userdata = ob};
     ob->pass_provider =
       (pgp_password_provider_t){.callback = rnp_password_cb_bounce, .userdata = ob};
-    if (!rng_init(&ob->rng, RNG_DRBG)) {
+    if (pthread_rwlock_init(&ob->keylock, NULL)) {
+        ret = RNP_ERROR_GENERIC;
+        goto done;
+    }
+    ob->keylock_init = true;
+    ob->pool = rnp_worker_pool_create(0);
+    if (!ob->pool) {
+        ret = RNP_ERROR_OUT_OF_MEMORY;
+        goto done;
+    }
+    if (!ffi_rng()) {
         ret = RNP_ERROR_RNG;
         goto done;
     }
@@ -408,10 +555,15 @@ rnp_result_t
 rnp_ffi_destroy(rnp_ffi_t ffi)
 {
     if (ffi) {
+        /* pending asynchronous operations still use keys and log */
+        rnp_worker_pool_destroy(ffi->pool);
         close_io(&ffi->io);
         rnp_key_store_free(ffi->pubring);
         rnp_key_store_free(ffi->secring);
-        rng_destroy(&ffi->rng);
+        if (ffi->keylock_init) {
+            pthread_rwlock_destroy(&ffi->keylock);
+        }
+        pgp_s2k_cache_destroy(ffi->pass_provider.s2k_cache);
         free(ffi);
     }
     return RNP_SUCCESS;
@@ -449,6 +601,82 @@ rnp_ffi_set_log_fd(rnp_ffi_t ffi, int fd)
     return RNP_SUCCESS;
 }
 
+rnp_result_t
+rnp_ffi_set_s2k_cache(rnp_ffi_t ffi, bool enable)
+{
+    if (!ffi) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_ffi_lock_t lock(ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
+    if (!enable) {
+        pgp_s2k_cache_destroy(ffi->pass_provider.s2k_cache);
+        ffi->pass_provider.s2k_cache = NULL;
+        return RNP_SUCCESS;
+    }
+    if (!ffi->pass_provider.s2k_cache &&
+        !(ffi->pass_provider.s2k_cache = pgp_s2k_cache_create())) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_ffi_set_worker_threads(rnp_ffi_t ffi, size_t threads)
+{
+    if (!ffi) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (!rnp_worker_pool_set_threads(ffi->pool, threads)) {
+        FFI_LOG(ffi, "Worker threads are already started");
+        return RNP_ERROR_BAD_STATE;
+    }
+    return RNP_SUCCESS;
+}
+
+typedef rnp_result_t rnp_async_execute_t(void *op);
+
+typedef struct rnp_async_job_t {
+    rnp_async_execute_t *execute;
+    void *               op;
+    rnp_op_complete_cb   cb;
+    void *               app_ctx;
+} rnp_async_job_t;
+
+static void
+rnp_async_job(void *param)
+{
+    rnp_async_job_t *job = (rnp_async_job_t *) param;
+    rnp_result_t     ret = job->execute(job->op);
+
+    if (job->cb) {
+        job->cb(job->app_ctx, ret);
+    }
+    free(job);
+}
+
+static rnp_result_t
+rnp_execute_async(
+  rnp_ffi_t ffi, rnp_async_execute_t *execute, void *op, rnp_op_complete_cb cb, void *app_ctx)
+{
+    rnp_async_job_t *job = (rnp_async_job_t *) calloc(1, sizeof(*job));
+    if (!job) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    job->execute = execute;
+    job->op = op;
+    job->cb = cb;
+    job->app_ctx = app_ctx;
+    if (!rnp_worker_pool_submit(ffi->pool, rnp_async_job, job)) {
+        FFI_LOG(ffi, "Failed to queue operation");
+        free(job);
+        return RNP_ERROR_GENERIC;
+    }
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_ffi_set_key_provider(rnp_ffi_t ffi, rnp_get_key_cb getkeycb, void *getkeycb_ctx)
 {
@@ -748,6 +976,39 @@ done:
     return ret;
 }
 
+rnp_result_t
+rnp_calculate_iterations(const char *hash, size_t msec, size_t *iterations)
+{
+    if (!hash || !iterations) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    pgp_hash_alg_t halg = PGP_HASH_UNKNOWN;
+    ARRAY_LOOKUP_BY_STRCASE(hash_alg_map, string, type, hash, halg);
+    if (halg == PGP_HASH_UNKNOWN) {
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    *iterations = pgp_s2k_compute_iters(halg, msec, DEFAULT_S2K_TUNE_MSEC);
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_s2k_calibration_load(const char *path)
+{
+    if (!path) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return pgp_s2k_calibration_load(path) ? RNP_SUCCESS : RNP_ERROR_READ;
+}
+
+rnp_result_t
+rnp_s2k_calibration_save(const char *path)
+{
+    if (!path) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return pgp_s2k_calibration_save(path) ? RNP_SUCCESS : RNP_ERROR_WRITE;
+}
+
 rnp_result_t
 rnp_detect_key_format(const uint8_t buf[], size_t buf_len, char **format)
 {
@@ -1007,6 +1268,10 @@ rnp_load_keys(rnp_ffi_t ffi, const char *format, rnp_input_t input, uint32_t fla
         FFI_LOG(ffi, "unexpected flags remaining: 0x%X", flags);
         return RNP_ERROR_BAD_PARAMETERS;
     }
+    rnp_ffi_lock_t lock(ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
     return do_load_keys(ffi, input, format, type);
 }
 
@@ -1111,6 +1376,7 @@ rnp_save_keys(rnp_ffi_t ffi, const char *format, rnp_output_t output, uint32_t f
         FFI_LOG(ffi, "unexpected flags remaining: 0x%X", flags);
         return RNP_ERROR_BAD_PARAMETERS;
     }
+    rnp_ffi_lock_t lock(ffi, false);
 
     return do_save_keys(ffi, output, format, type);
 }
@@ -1121,6 +1387,7 @@ rnp_get_public_key_count(rnp_ffi_t ffi, size_t *count)
     if (!ffi || !count) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(ffi, false);
     *count = list_length(ffi->pubring->keys);
     return RNP_SUCCESS;
 }
@@ -1131,6 +1398,7 @@ rnp_get_secret_key_count(rnp_ffi_t ffi, size_t *count)
     if (!ffi || !count) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(ffi, false);
     *count = list_length(ffi->secring->keys);
     return RNP_SUCCESS;
 }
@@ -1337,6 +1605,58 @@ rnp_output_memory_get_buf(rnp_output_t output, uint8_t **buf, size_t *len, bool
     return RNP_SUCCESS;
 }
 
+rnp_result_t
+rnp_output_to_buffer(rnp_output_t *output, uint8_t *buf, size_t len)
+{
+    // checks
+    if (!output || !buf) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (!len || (len > UINT_MAX)) {
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    *output = (rnp_output_t) calloc(1, sizeof(**output));
+    if (!*output) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    rnp_result_t ret = init_mem_dest(&(*output)->dst, buf, len);
+    if (ret) {
+        free(*output);
+        *output = NULL;
+        return ret;
+    }
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_output_memory_reserve(rnp_output_t output, size_t size)
+{
+    if (!output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (output->dst.type != PGP_STREAM_MEMORY) {
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    return mem_dest_reserve(&output->dst, output->dst.writeb + size);
+}
+
+rnp_result_t
+rnp_output_memory_take_buf(rnp_output_t output, uint8_t **buf, size_t *len)
+{
+    if (!output || !buf || !len) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (output->dst.type != PGP_STREAM_MEMORY) {
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    void *       mem = NULL;
+    rnp_result_t ret = mem_dest_release_memory(&output->dst, &mem, len);
+    *buf = (uint8_t *) mem;
+    return ret;
+}
+
 static rnp_result_t
 output_writer_bounce(pgp_dest_t *dst, const void *buf, size_t len)
 {
@@ -1420,6 +1740,20 @@ rnp_output_destroy(rnp_output_t output)
     return RNP_SUCCESS;
 }
 
+static pgp_key_t *
+rnp_op_find_signing_key(rnp_key_handle_t key)
+{
+    pgp_key_t *signer = find_suitable_key(
+      PGP_OP_SIGN, get_key_prefer_public(key), &key->ffi->key_provider, PGP_KF_SIGN);
+    if (signer && !pgp_is_key_secret(signer)) {
+        pgp_key_request_ctx_t ctx = {.op = PGP_OP_SIGN, .secret = true};
+        ctx.search.type = PGP_KEY_SEARCH_GRIP;
+        memcpy(ctx.search.by.grip, signer->grip, PGP_FINGERPRINT_SIZE);
+        signer = pgp_request_key(&key->ffi->key_provider, &ctx);
+    }
+    return signer;
+}
+
 static rnp_result_t
 rnp_op_add_signature(list *signatures, rnp_key_handle_t key, rnp_op_sign_signature_t *sig)
 {
@@ -1433,14 +1767,7 @@ rnp_op_add_signature(list *signatures, rnp_key_handle_t key, rnp_op_sign_signatu
     if (!newsig) {
         return RNP_ERROR_OUT_OF_MEMORY;
     }
-    newsig->key = find_suitable_key(
-      PGP_OP_SIGN, get_key_prefer_public(key), &key->ffi->key_provider, PGP_KF_SIGN);
-    if (newsig->key && !pgp_is_key_secret(newsig->key)) {
-        pgp_key_request_ctx_t ctx = {.op = PGP_OP_SIGN, .secret = true};
-        ctx.search.type = PGP_KEY_SEARCH_GRIP;
-        memcpy(ctx.search.by.grip, newsig->key->grip, PGP_FINGERPRINT_SIZE);
-        newsig->key = pgp_request_key(&key->ffi->key_provider, &ctx);
-    }
+    newsig->key = rnp_op_find_signing_key(key);
     if (!newsig->key) {
         list_remove((list_item *) newsig);
         return RNP_ERROR_NO_SUITABLE_KEY;
@@ -1546,8 +1873,8 @@ rnp_op_encrypt_create(rnp_op_encrypt_t *op,
                       rnp_input_t       input,
                       rnp_output_t      output)
 {
-    // checks
-    if (!op || !ffi || !input || !output) {
+    // checks, input and output may be bound later
+    if (!op || !ffi || (!input != !output)) {
         return RNP_ERROR_NULL_POINTER;
     }
 
@@ -1570,6 +1897,7 @@ rnp_op_encrypt_add_recipient(rnp_op_encrypt_t op, rnp_key_handle_t handle)
     if (!op || !handle) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, false);
 
     pgp_key_t *key = find_suitable_key(PGP_OP_ENCRYPT,
                                        get_key_prefer_public(handle),
@@ -1589,6 +1917,7 @@ rnp_op_encrypt_add_signature(rnp_op_encrypt_t         op,
     if (!op) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(op->ffi, false);
     return rnp_op_add_signature(&op->signatures, key, sig);
 }
 
@@ -1684,6 +2013,16 @@ rnp_op_encrypt_set_armor(rnp_op_encrypt_t op, bool armored)
     return rnp_op_set_armor(&op->rnpctx, armored);
 }
 
+rnp_result_t
+rnp_op_encrypt_set_textmode(rnp_op_encrypt_t op, bool textmode)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->rnpctx.textmode = textmode;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_op_encrypt_set_cipher(rnp_op_encrypt_t op, const char *cipher)
 {
@@ -1700,6 +2039,37 @@ rnp_op_encrypt_set_cipher(rnp_op_encrypt_t op, const char *cipher)
     return RNP_SUCCESS;
 }
 
+rnp_result_t
+rnp_op_encrypt_set_aead(rnp_op_encrypt_t op, const char *alg)
+{
+    // checks
+    if (!op || !alg) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    int aalg = -1;
+    ARRAY_LOOKUP_BY_STRCASE(aead_alg_map, string, type, alg, aalg);
+    if (aalg < 0) {
+        FFI_LOG(op->ffi, "Invalid AEAD algorithm: %s", alg);
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    op->rnpctx.aalg = (pgp_aead_alg_t) aalg;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_encrypt_set_aead_bits(rnp_op_encrypt_t op, int bits)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if ((bits < 0) || (bits > 56)) {
+        FFI_LOG(op->ffi, "Invalid AEAD chunk bits: %d", bits);
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    op->rnpctx.abits = bits;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_op_encrypt_set_compression(rnp_op_encrypt_t op, const char *compression, int level)
 {
@@ -1710,6 +2080,36 @@ rnp_op_encrypt_set_compression(rnp_op_encrypt_t op, const char *compression, int
     return rnp_op_set_compression(op->ffi, &op->rnpctx, compression, level);
 }
 
+rnp_result_t
+rnp_op_encrypt_set_compression_parallel(rnp_op_encrypt_t op, bool parallel)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->rnpctx.zparallel = parallel;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_encrypt_set_compression_adaptive(rnp_op_encrypt_t op, bool adaptive)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->rnpctx.zadaptive = adaptive;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_encrypt_get_compression_skipped(rnp_op_encrypt_t op, bool *skipped)
+{
+    if (!op || !skipped) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    *skipped = op->rnpctx.zskipped;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_op_encrypt_set_file_name(rnp_op_encrypt_t op, const char *filename)
 {
@@ -1743,57 +2143,322 @@ pgp_write_handler(pgp_password_provider_t *pass_provider,
     return handler;
 }
 
-rnp_result_t
-rnp_op_encrypt_execute(rnp_op_encrypt_t op)
-{
-    // checks
-    if (!op || !op->input || !op->output) {
-        return RNP_ERROR_NULL_POINTER;
-    }
+/* preallocation of the memory outputs, prepared once for all of the processed messages */
+typedef struct rnp_reserve_t {
+    bool     enabled;
+    uint64_t sesskeys; /* size of the session key packets, needs the recipients' keys */
+} rnp_reserve_t;
 
-    // set the default hash alg if none was specified
-    if (!op->rnpctx.halg) {
-        op->rnpctx.halg = DEFAULT_PGP_HASH_ALG;
-    }
+static void
+rnp_ctx_prepare_reserve(rnp_ffi_t ffi, rnp_ctx_t *ctx, bool encrypt, rnp_reserve_t *reserve)
+{
     pgp_write_handler_t handler =
-      pgp_write_handler(&op->ffi->pass_provider, &op->rnpctx, NULL, &op->ffi->key_provider);
+      pgp_write_handler(&ffi->pass_provider, ctx, NULL, &ffi->key_provider);
+    bool                exact = false;
 
-    rnp_result_t ret;
-    if (list_length(op->signatures)) {
-        for (list_item *sig = list_front(op->signatures); sig; sig = list_next(sig)) {
-            pgp_key_t *key = ((rnp_op_sign_signature_t) sig)->key;
-            if (!list_append(&op->rnpctx.signers, &key, sizeof(key))) {
-                return RNP_ERROR_OUT_OF_MEMORY;
-            }
-        }
-        ret = rnp_encrypt_sign_src(&handler, &op->input->src, &op->output->dst);
-    } else {
-        ret = rnp_encrypt_src(&handler, &op->input->src, &op->output->dst);
+    /* compressed output is usually much smaller than its upper bound */
+    reserve->enabled = ctx->zlevel <= 0;
+    reserve->sesskeys = 0;
+    /* this is just an optimization so failure doesn't matter */
+    if (reserve->enabled && encrypt) {
+        reserve->enabled = !rnp_write_sesskeys_size(&handler, &reserve->sesskeys, &exact);
     }
-
-    dst_flush(&op->output->dst);
-    op->output->keep = ret == RNP_SUCCESS;
-    op->input = NULL;
-    op->output = NULL;
-    return ret;
 }
 
-rnp_result_t
-rnp_op_encrypt_destroy(rnp_op_encrypt_t op)
+/* preallocate memory output when the input size is known, to avoid reallocations */
+static void
+rnp_ctx_reserve_output(pgp_write_handler_t *handler,
+                       bool                 encrypt,
+                       const rnp_reserve_t *reserve,
+                       pgp_source_t *       src,
+                       pgp_dest_t *         dst)
 {
-    if (op) {
-        rnp_ctx_free(&op->rnpctx);
-        rnp_op_signatures_destroy(&op->signatures);
-        free(op);
+    uint64_t size = 0;
+    bool     exact = false;
+
+    if (!reserve || !reserve->enabled || (dst->type != PGP_STREAM_MEMORY) ||
+        !src->knownsize) {
+        return;
+    }
+    if (rnp_write_output_size(
+          handler, encrypt, src->size, &reserve->sesskeys, &size, &exact) ||
+        (size > SIZE_MAX - dst->writeb)) {
+        return;
+    }
+    (void) mem_dest_reserve(dst, dst->writeb + size);
+}
+
+/* processing of the single stream, shared by execute and batch calls */
+typedef rnp_result_t rnp_batch_process_t(rnp_ffi_t            ffi,
+                                         rnp_ctx_t *          ctx,
+                                         const rnp_reserve_t *reserve,
+                                         pgp_source_t *       src,
+                                         pgp_dest_t *         dst);
+
+typedef struct rnp_batch_t {
+    rnp_ffi_t             ffi;
+    /* prepared context, shallow copied for each of the items: lists of recipients, signers
+     * and passwords are only read during processing, so items share them */
+    const rnp_ctx_t *     ctx;
+    const rnp_reserve_t * reserve;
+    rnp_batch_process_t * process;
+    const uint8_t *const *bufs;
+    const size_t *        lens;
+    uint8_t **            outbufs;
+    size_t *              outlens;
+    rnp_result_t *        results;
+} rnp_batch_t;
+
+static bool
+rnp_batch_job(void *param, size_t idx, size_t worker)
+{
+    rnp_batch_t *batch = (rnp_batch_t *) param;
+    rnp_ctx_t    ctx = *batch->ctx;
+    pgp_source_t src = {0};
+    pgp_dest_t   dst = {0};
+    rnp_result_t ret;
+
+    batch->outbufs[idx] = NULL;
+    batch->outlens[idx] = 0;
+    /* items are processed by the different threads */
+    rnp_ffi_lock_t lock(batch->ffi, false);
+    ctx.rng = ffi_rng();
+
+    if ((ret = init_mem_src(&src, batch->bufs[idx], batch->lens[idx], false))) {
+        goto done;
+    }
+    if ((ret = init_mem_dest(&dst, NULL, 0))) {
+        goto done;
+    }
+    if ((ret = batch->process(batch->ffi, &ctx, batch->reserve, &src, &dst))) {
+        goto done;
+    }
+    batch->outlens[idx] = dst.writeb;
+    batch->outbufs[idx] = (uint8_t *) mem_dest_own_memory(&dst);
+    if (!batch->outbufs[idx] && batch->outlens[idx]) {
+        batch->outlens[idx] = 0;
+        ret = RNP_ERROR_OUT_OF_MEMORY;
+    }
+done:
+    src_close(&src);
+    dst_close(&dst, true);
+    batch->results[idx] = ret;
+    /* failure of the single item doesn't stop the others */
+    return true;
+}
+
+static rnp_result_t
+rnp_batch_execute(rnp_ffi_t             ffi,
+                  const rnp_ctx_t *     ctx,
+                  const rnp_reserve_t * reserve,
+                  rnp_batch_process_t * process,
+                  size_t                count,
+                  const uint8_t *const *bufs,
+                  const size_t *        lens,
+                  uint8_t **            outbufs,
+                  size_t *              outlens,
+                  rnp_result_t *        results)
+{
+    rnp_batch_t batch = {ffi, ctx, reserve, process, bufs, lens, outbufs, outlens, results};
+
+    /* items are run on the same threads as asynchronous operations, see
+     * rnp_ffi_set_worker_threads() */
+    rnp_worker_pool_run(ffi->pool, count, rnp_batch_job, &batch);
+    for (size_t i = 0; i < count; i++) {
+        if (results[i]) {
+            return RNP_ERROR_GENERIC;
+        }
+    }
+    return RNP_SUCCESS;
+}
+
+static rnp_result_t
+rnp_op_encrypt_prepare(rnp_op_encrypt_t op, rnp_reserve_t *reserve)
+{
+    // set the default hash alg if none was specified
+    if (!op->rnpctx.halg) {
+        op->rnpctx.halg = DEFAULT_PGP_HASH_ALG;
+    }
+    // operation may be executed several times, see rnp_op_encrypt_reset
+    list_destroy(&op->rnpctx.signers);
+    for (list_item *sig = list_front(op->signatures); sig; sig = list_next(sig)) {
+        pgp_key_t *key = ((rnp_op_sign_signature_t) sig)->key;
+        if (!list_append(&op->rnpctx.signers, &key, sizeof(key))) {
+            return RNP_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    if (reserve) {
+        rnp_ctx_prepare_reserve(op->ffi, &op->rnpctx, true, reserve);
     }
     return RNP_SUCCESS;
 }
 
+static rnp_result_t
+rnp_encrypt_process(rnp_ffi_t            ffi,
+                    rnp_ctx_t *          ctx,
+                    const rnp_reserve_t *reserve,
+                    pgp_source_t *       src,
+                    pgp_dest_t *         dst)
+{
+    pgp_write_handler_t handler =
+      pgp_write_handler(&ffi->pass_provider, ctx, NULL, &ffi->key_provider);
+
+    rnp_ctx_reserve_output(&handler, true, reserve, src, dst);
+    if (list_length(ctx->signers)) {
+        return rnp_encrypt_sign_src(&handler, src, dst);
+    }
+    return rnp_encrypt_src(&handler, src, dst);
+}
+
 rnp_result_t
-rnp_op_sign_create(rnp_op_sign_t *op, rnp_ffi_t ffi, rnp_input_t input, rnp_output_t output)
+rnp_op_encrypt_execute(rnp_op_encrypt_t op)
 {
     // checks
-    if (!op || !ffi || !input || !output) {
+    if (!op || !op->input || !op->output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_ffi_lock_t lock(op->ffi, false);
+    // operation may be executed by the other thread than one which created it
+    op->rnpctx.rng = ffi_rng();
+
+    rnp_reserve_t reserve = {};
+    rnp_result_t  ret = rnp_op_encrypt_prepare(op, &reserve);
+    if (ret) {
+        return ret;
+    }
+    ret = rnp_encrypt_process(
+      op->ffi, &op->rnpctx, &reserve, &op->input->src, &op->output->dst);
+
+    dst_flush(&op->output->dst);
+    /* report the output's failure, i.e. too small caller-provided buffer, as it is */
+    if (op->output->dst.werr) {
+        ret = op->output->dst.werr;
+    }
+    op->output->keep = ret == RNP_SUCCESS;
+    op->input = NULL;
+    op->output = NULL;
+    return ret;
+}
+
+rnp_result_t
+rnp_op_encrypt_get_output_size(rnp_op_encrypt_t op,
+                               uint64_t         input_len,
+                               uint64_t *       size,
+                               bool *           exact)
+{
+    bool tmp = false;
+
+    if (!op || !size) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_ffi_lock_t lock(op->ffi, false);
+    rnp_result_t   ret = rnp_op_encrypt_prepare(op, NULL);
+    if (ret) {
+        return ret;
+    }
+    pgp_write_handler_t handler =
+      pgp_write_handler(&op->ffi->pass_provider, &op->rnpctx, NULL, &op->ffi->key_provider);
+    return rnp_write_output_size(&handler, true, input_len, NULL, size, exact ? exact : &tmp);
+}
+
+rnp_result_t
+rnp_op_encrypt_execute_batch(rnp_op_encrypt_t      op,
+                             size_t                count,
+                             const uint8_t *const *bufs,
+                             const size_t *        lens,
+                             uint8_t **            outbufs,
+                             size_t *              outlens,
+                             rnp_result_t *        results)
+{
+    if (!op || !bufs || !lens || !outbufs || !outlens || !results) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_reserve_t reserve = {};
+    rnp_result_t  ret = rnp_op_encrypt_prepare(op, &reserve);
+    if (ret) {
+        return ret;
+    }
+    return rnp_batch_execute(op->ffi,
+                             &op->rnpctx,
+                             &reserve,
+                             rnp_encrypt_process,
+                             count,
+                             bufs,
+                             lens,
+                             outbufs,
+                             outlens,
+                             results);
+}
+
+static rnp_result_t
+rnp_op_encrypt_execute_job(void *op)
+{
+    return rnp_op_encrypt_execute((rnp_op_encrypt_t) op);
+}
+
+rnp_result_t
+rnp_op_encrypt_execute_async(rnp_op_encrypt_t op, rnp_op_complete_cb cb, void *app_ctx)
+{
+    if (!op || !op->input || !op->output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return rnp_execute_async(op->ffi, rnp_op_encrypt_execute_job, op, cb, app_ctx);
+}
+
+rnp_result_t
+rnp_op_encrypt_rewrap(rnp_op_encrypt_t op)
+{
+    if (!op || !op->input || !op->output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (list_length(op->signatures)) {
+        FFI_LOG(op->ffi, "Signing is not supported while rewrapping");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    rnp_ffi_lock_t lock(op->ffi, false);
+    // operation may be executed by the other thread than one which created it
+    op->rnpctx.rng = ffi_rng();
+
+    pgp_write_handler_t handler =
+      pgp_write_handler(&op->ffi->pass_provider, &op->rnpctx, NULL, &op->ffi->key_provider);
+
+    rnp_result_t ret = rnp_rewrap_src(&handler, &op->input->src, &op->output->dst);
+
+    dst_flush(&op->output->dst);
+    op->output->keep = ret == RNP_SUCCESS;
+    op->input = NULL;
+    op->output = NULL;
+    return ret;
+}
+
+rnp_result_t
+rnp_op_encrypt_reset(rnp_op_encrypt_t op, rnp_input_t input, rnp_output_t output)
+{
+    if (!op || !input || !output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->input = input;
+    op->output = output;
+    op->rnpctx.zskipped = false;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_encrypt_destroy(rnp_op_encrypt_t op)
+{
+    if (op) {
+        rnp_ctx_free(&op->rnpctx);
+        rnp_op_signatures_destroy(&op->signatures);
+        free(op);
+    }
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_create(rnp_op_sign_t *op, rnp_ffi_t ffi, rnp_input_t input, rnp_output_t output)
+{
+    // checks, input and output may be bound later
+    if (!op || !ffi || (!input != !output)) {
         return RNP_ERROR_NULL_POINTER;
     }
 
@@ -1841,6 +2506,7 @@ rnp_op_sign_add_signature(rnp_op_sign_t op, rnp_key_handle_t key, rnp_op_sign_si
     if (!op) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(op->ffi, false);
     return rnp_op_add_signature(&op->signatures, key, sig);
 }
 
@@ -1871,6 +2537,16 @@ rnp_op_sign_set_armor(rnp_op_sign_t op, bool armored)
     return rnp_op_set_armor(&op->rnpctx, armored);
 }
 
+rnp_result_t
+rnp_op_sign_set_textmode(rnp_op_sign_t op, bool textmode)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->rnpctx.textmode = textmode;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_op_sign_set_compression(rnp_op_sign_t op, const char *compression, int level)
 {
@@ -1880,6 +2556,36 @@ rnp_op_sign_set_compression(rnp_op_sign_t op, const char *compression, int level
     return rnp_op_set_compression(op->ffi, &op->rnpctx, compression, level);
 }
 
+rnp_result_t
+rnp_op_sign_set_compression_parallel(rnp_op_sign_t op, bool parallel)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->rnpctx.zparallel = parallel;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_set_compression_adaptive(rnp_op_sign_t op, bool adaptive)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->rnpctx.zadaptive = adaptive;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_get_compression_skipped(rnp_op_sign_t op, bool *skipped)
+{
+    if (!op || !skipped) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    *skipped = op->rnpctx.zskipped;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_op_sign_set_hash(rnp_op_sign_t op, const char *hash)
 {
@@ -1904,72 +2610,384 @@ rnp_op_sign_set_expiration_time(rnp_op_sign_t op, uint32_t expire)
     if (!op) {
         return RNP_ERROR_NULL_POINTER;
     }
-    return rnp_op_set_expiration_time(&op->rnpctx, expire);
+    return rnp_op_set_expiration_time(&op->rnpctx, expire);
+}
+
+rnp_result_t
+rnp_op_sign_set_file_name(rnp_op_sign_t op, const char *filename)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return rnp_op_set_file_name(&op->rnpctx, filename);
+}
+
+rnp_result_t
+rnp_op_sign_set_file_mtime(rnp_op_sign_t op, uint32_t mtime)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return rnp_op_set_file_mtime(&op->rnpctx, mtime);
+}
+
+static rnp_result_t
+rnp_op_sign_prepare(rnp_op_sign_t op, rnp_reserve_t *reserve)
+{
+    // set the default hash alg if none was specified
+    if (!op->rnpctx.halg) {
+        op->rnpctx.halg = DEFAULT_PGP_HASH_ALG;
+    }
+    // operation may be executed several times, see rnp_op_sign_reset
+    list_destroy(&op->rnpctx.signers);
+    for (list_item *sig = list_front(op->signatures); sig; sig = list_next(sig)) {
+        pgp_key_t *key = ((rnp_op_sign_signature_t) sig)->key;
+        if (!key) {
+            return RNP_ERROR_NO_SUITABLE_KEY;
+        }
+        if (!list_append(&op->rnpctx.signers, &key, sizeof(key))) {
+            return RNP_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    if (reserve) {
+        rnp_ctx_prepare_reserve(op->ffi, &op->rnpctx, false, reserve);
+    }
+    return RNP_SUCCESS;
+}
+
+static rnp_result_t
+rnp_sign_process(rnp_ffi_t            ffi,
+                 rnp_ctx_t *          ctx,
+                 const rnp_reserve_t *reserve,
+                 pgp_source_t *       src,
+                 pgp_dest_t *         dst)
+{
+    pgp_write_handler_t handler =
+      pgp_write_handler(&ffi->pass_provider, ctx, NULL, &ffi->key_provider);
+
+    rnp_ctx_reserve_output(&handler, false, reserve, src, dst);
+    return rnp_sign_src(&handler, src, dst);
+}
+
+rnp_result_t
+rnp_op_sign_execute(rnp_op_sign_t op)
+{
+    // checks
+    if (!op || !op->input || !op->output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_ffi_lock_t lock(op->ffi, false);
+    // operation may be executed by the other thread than one which created it
+    op->rnpctx.rng = ffi_rng();
+
+    rnp_reserve_t reserve = {};
+    rnp_result_t  ret = rnp_op_sign_prepare(op, &reserve);
+    if (ret) {
+        return ret;
+    }
+    ret = rnp_sign_process(op->ffi, &op->rnpctx, &reserve, &op->input->src, &op->output->dst);
+
+    dst_flush(&op->output->dst);
+    /* report the output's failure, i.e. too small caller-provided buffer, as it is */
+    if (op->output->dst.werr) {
+        ret = op->output->dst.werr;
+    }
+    op->output->keep = ret == RNP_SUCCESS;
+    op->input = NULL;
+    op->output = NULL;
+    return ret;
+}
+
+rnp_result_t
+rnp_op_sign_get_output_size(rnp_op_sign_t op, uint64_t input_len, uint64_t *size, bool *exact)
+{
+    bool tmp = false;
+
+    if (!op || !size) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_ffi_lock_t lock(op->ffi, false);
+    rnp_result_t   ret = rnp_op_sign_prepare(op, NULL);
+    if (ret) {
+        return ret;
+    }
+    pgp_write_handler_t handler =
+      pgp_write_handler(&op->ffi->pass_provider, &op->rnpctx, NULL, &op->ffi->key_provider);
+    return rnp_write_output_size(&handler, false, input_len, NULL, size, exact ? exact : &tmp);
+}
+
+rnp_result_t
+rnp_op_sign_execute_batch(rnp_op_sign_t         op,
+                          size_t                count,
+                          const uint8_t *const *bufs,
+                          const size_t *        lens,
+                          uint8_t **            outbufs,
+                          size_t *              outlens,
+                          rnp_result_t *        results)
+{
+    if (!op || !bufs || !lens || !outbufs || !outlens || !results) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_reserve_t reserve = {};
+    rnp_result_t  ret = rnp_op_sign_prepare(op, &reserve);
+    if (ret) {
+        return ret;
+    }
+    return rnp_batch_execute(op->ffi,
+                             &op->rnpctx,
+                             &reserve,
+                             rnp_sign_process,
+                             count,
+                             bufs,
+                             lens,
+                             outbufs,
+                             outlens,
+                             results);
+}
+
+static rnp_result_t
+rnp_op_sign_execute_job(void *op)
+{
+    return rnp_op_sign_execute((rnp_op_sign_t) op);
+}
+
+rnp_result_t
+rnp_op_sign_execute_async(rnp_op_sign_t op, rnp_op_complete_cb cb, void *app_ctx)
+{
+    if (!op || !op->input || !op->output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return rnp_execute_async(op->ffi, rnp_op_sign_execute_job, op, cb, app_ctx);
+}
+
+rnp_result_t
+rnp_op_sign_reset(rnp_op_sign_t op, rnp_input_t input, rnp_output_t output)
+{
+    if (!op || !input || !output) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->input = input;
+    op->output = output;
+    op->rnpctx.zskipped = false;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_destroy(rnp_op_sign_t op)
+{
+    if (op) {
+        rnp_ctx_free(&op->rnpctx);
+        rnp_op_signatures_destroy(&op->signatures);
+        free(op);
+    }
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_digest_create(rnp_op_sign_digest_t *op, rnp_ffi_t ffi, rnp_key_handle_t key)
+{
+    if (!op || !ffi || !key) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_ffi_lock_t lock(ffi, false);
+
+    pgp_key_t *signer = rnp_op_find_signing_key(key);
+    if (!signer) {
+        return RNP_ERROR_NO_SUITABLE_KEY;
+    }
+
+    *op = (rnp_op_sign_digest_t) calloc(1, sizeof(**op));
+    if (!*op) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+
+    (*op)->ffi = ffi;
+    (*op)->key = signer;
+    (*op)->halg = DEFAULT_PGP_HASH_ALG;
+    return RNP_SUCCESS;
+}
+
+static pgp_hash_alg_t
+rnp_op_sign_digest_hash(rnp_op_sign_digest_t op)
+{
+    return pgp_hash_adjust_alg_to_key(op->halg, pgp_get_key_pkt(op->key));
+}
+
+static rnp_result_t
+rnp_op_sign_digest_prepare(rnp_op_sign_digest_t op)
+{
+    pgp_signature_t *sig = &op->sig;
+
+    if (op->prepared) {
+        return RNP_SUCCESS;
+    }
+
+    sig->version = PGP_V4;
+    sig->halg = rnp_op_sign_digest_hash(op);
+    sig->palg = pgp_get_key_alg(op->key);
+    sig->type = PGP_SIG_BINARY;
+
+    if (!signature_set_keyfp(sig, &op->key->fingerprint) ||
+        !signature_set_keyid(sig, op->key->keyid) ||
+        !signature_set_creation(sig, op->create ? op->create : time(NULL)) ||
+        !signature_set_expiration(sig, op->expires) || !signature_fill_hashed_data(sig)) {
+        FFI_LOG(op->ffi, "Failed to fill the signature data");
+        free_signature(sig);
+        memset(sig, 0, sizeof(*sig));
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+
+    op->prepared = true;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_digest_set_hash(rnp_op_sign_digest_t op, const char *hash)
+{
+    if (!op || !hash) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (op->prepared) {
+        FFI_LOG(op->ffi, "Trailer was already retrieved");
+        return RNP_ERROR_BAD_STATE;
+    }
+
+    pgp_hash_alg_t hash_alg = PGP_HASH_UNKNOWN;
+    ARRAY_LOOKUP_BY_STRCASE(hash_alg_map, string, type, hash, hash_alg);
+    if (hash_alg == PGP_HASH_UNKNOWN) {
+        FFI_LOG(op->ffi, "Invalid hash: %s", hash);
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    op->halg = hash_alg;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_digest_set_creation_time(rnp_op_sign_digest_t op, uint32_t create)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (op->prepared) {
+        FFI_LOG(op->ffi, "Trailer was already retrieved");
+        return RNP_ERROR_BAD_STATE;
+    }
+    op->create = create;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_sign_digest_set_expiration_time(rnp_op_sign_digest_t op, uint32_t expire)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (op->prepared) {
+        FFI_LOG(op->ffi, "Trailer was already retrieved");
+        return RNP_ERROR_BAD_STATE;
+    }
+    op->expires = expire;
+    return RNP_SUCCESS;
 }
 
 rnp_result_t
-rnp_op_sign_set_file_name(rnp_op_sign_t op, const char *filename)
+rnp_op_sign_digest_get_hash(rnp_op_sign_digest_t op, char **hash)
 {
-    if (!op) {
+    if (!op || !hash) {
         return RNP_ERROR_NULL_POINTER;
     }
-    return rnp_op_set_file_name(&op->rnpctx, filename);
+
+    const char *hname = NULL;
+    ARRAY_LOOKUP_BY_ID(hash_alg_map, type, string, rnp_op_sign_digest_hash(op), hname);
+    if (!hname) {
+        return RNP_ERROR_BAD_STATE;
+    }
+    *hash = strdup(hname);
+    return *hash ? RNP_SUCCESS : RNP_ERROR_OUT_OF_MEMORY;
 }
 
 rnp_result_t
-rnp_op_sign_set_file_mtime(rnp_op_sign_t op, uint32_t mtime)
+rnp_op_sign_digest_get_trailer(rnp_op_sign_digest_t op, uint8_t **trailer, size_t *len)
 {
-    if (!op) {
+    if (!op || !trailer || !len) {
         return RNP_ERROR_NULL_POINTER;
     }
-    return rnp_op_set_file_mtime(&op->rnpctx, mtime);
+
+    rnp_result_t ret = rnp_op_sign_digest_prepare(op);
+    if (ret) {
+        return ret;
+    }
+    return signature_get_trailer(&op->sig, trailer, len) ? RNP_SUCCESS :
+                                                           RNP_ERROR_OUT_OF_MEMORY;
 }
 
 rnp_result_t
-rnp_op_sign_execute(rnp_op_sign_t op)
+rnp_op_sign_digest_execute(rnp_op_sign_digest_t op,
+                           const uint8_t *      digest,
+                           size_t               len,
+                           rnp_output_t         signature)
 {
-    // checks
-    if (!op || !op->input || !op->output) {
+    pgp_key_pkt_t *deckey = NULL;
+    pgp_key_pkt_t *seckey = NULL;
+    rnp_result_t   ret;
+
+    if (!op || !digest || !signature) {
         return RNP_ERROR_NULL_POINTER;
     }
-
-    // set the default hash alg if none was specified
-    if (!op->rnpctx.halg) {
-        op->rnpctx.halg = DEFAULT_PGP_HASH_ALG;
+    if (!op->prepared) {
+        FFI_LOG(op->ffi, "Trailer must be retrieved first");
+        return RNP_ERROR_BAD_STATE;
+    }
+    if (len != pgp_digest_length(op->sig.halg)) {
+        FFI_LOG(op->ffi, "Invalid digest length: %zu", len);
+        return RNP_ERROR_BAD_PARAMETERS;
     }
-    pgp_write_handler_t handler =
-      pgp_write_handler(&op->ffi->pass_provider, &op->rnpctx, NULL, &op->ffi->key_provider);
 
-    for (list_item *sig = list_front(op->signatures); sig; sig = list_next(sig)) {
-        pgp_key_t *key = ((rnp_op_sign_signature_t) sig)->key;
-        if (!key) {
-            return RNP_ERROR_NO_SUITABLE_KEY;
-        }
-        if (!list_append(&op->rnpctx.signers, &key, sizeof(key))) {
-            return RNP_ERROR_OUT_OF_MEMORY;
+    rnp_ffi_lock_t lock(op->ffi, false);
+    seckey = &op->key->pkt;
+    if (pgp_is_key_encrypted(op->key)) {
+        pgp_password_ctx_t ctx = {.op = PGP_OP_SIGN, .key = op->key};
+        deckey = pgp_decrypt_seckey(op->key, &op->ffi->pass_provider, &ctx);
+        if (!deckey) {
+            return RNP_ERROR_BAD_PASSWORD;
         }
+        seckey = deckey;
     }
 
-    rnp_result_t ret = rnp_sign_src(&handler, &op->input->src, &op->output->dst);
+    ret = signature_calculate_digest(&op->sig, &seckey->material, digest, len, ffi_rng());
+    free_key_pkt(deckey);
+    free(deckey);
 
-    dst_flush(&op->output->dst);
-    op->output->keep = ret == RNP_SUCCESS;
-    op->input = NULL;
-    op->output = NULL;
+    if (!ret && !stream_write_signature(&op->sig, &signature->dst)) {
+        ret = RNP_ERROR_WRITE;
+    }
+    dst_flush(&signature->dst);
+    signature->keep = ret == RNP_SUCCESS;
     return ret;
 }
 
 rnp_result_t
-rnp_op_sign_destroy(rnp_op_sign_t op)
+rnp_op_sign_digest_destroy(rnp_op_sign_digest_t op)
 {
     if (op) {
-        rnp_ctx_free(&op->rnpctx);
-        rnp_op_signatures_destroy(&op->signatures);
+        free_signature(&op->sig);
         free(op);
     }
     return RNP_SUCCESS;
 }
 
+static rnp_result_t
+rnp_verify_status(const pgp_signature_info_t *sinfo)
+{
+    if (sinfo->unknown) {
+        return RNP_ERROR_KEY_NOT_FOUND;
+    }
+    if (sinfo->valid) {
+        return sinfo->expired ? RNP_ERROR_SIGNATURE_EXPIRED : RNP_SUCCESS;
+    }
+    return sinfo->no_signer ? RNP_ERROR_KEY_NOT_FOUND : RNP_ERROR_SIGNATURE_INVALID;
+}
+
 static void
 rnp_op_verify_on_signatures(pgp_parse_handler_t * handler,
                             pgp_signature_info_t *sigs,
@@ -1992,21 +3010,20 @@ rnp_op_verify_on_signatures(pgp_parse_handler_t * handler,
         res.sig_expires = signature_get_expiration(sigs[i].sig);
         signature_get_keyid(sigs[i].sig, res.keyid);
         res.halg = sigs[i].sig->halg;
-
-        if (sigs[i].unknown) {
-            res.verify_status = RNP_ERROR_KEY_NOT_FOUND;
-        } else if (sigs[i].valid) {
-            res.verify_status = sigs[i].expired ? RNP_ERROR_SIGNATURE_EXPIRED : RNP_SUCCESS;
-        } else {
-            res.verify_status =
-              sigs[i].no_signer ? RNP_ERROR_KEY_NOT_FOUND : RNP_ERROR_SIGNATURE_INVALID;
-        }
-
+        res.verify_status = rnp_verify_status(&sigs[i]);
         res.ffi = op->ffi;
         op->signatures[i] = res;
     }
 }
 
+static void
+rnp_op_verify_on_sesskey(pgp_parse_handler_t *handler, const pgp_sesskey_t *key)
+{
+    rnp_op_verify_t op = (rnp_op_verify_t) handler->param;
+    op->sesskey = *key;
+    op->sesskey_valid = true;
+}
+
 static bool
 rnp_verify_src_provider(pgp_parse_handler_t *handler, pgp_source_t *src)
 {
@@ -2038,7 +3055,8 @@ rnp_op_verify_create(rnp_op_verify_t *op,
                      rnp_input_t      input,
                      rnp_output_t     output)
 {
-    if (!op || !ffi || !input) {
+    // input may be bound later
+    if (!op || !ffi || (!input && output)) {
         return RNP_ERROR_NULL_POINTER;
     }
 
@@ -2078,14 +3096,68 @@ rnp_op_verify_detached_create(rnp_op_verify_t *op,
     return RNP_SUCCESS;
 }
 
+static void
+rnp_op_verify_clear_results(rnp_op_verify_t op)
+{
+    free(op->signatures);
+    op->signatures = NULL;
+    op->signature_count = 0;
+    free(op->filename);
+    op->filename = NULL;
+    op->file_mtime = 0;
+    pgp_forget(&op->sesskey, sizeof(op->sesskey));
+    op->sesskey_valid = false;
+}
+
+rnp_result_t
+rnp_op_verify_reset(rnp_op_verify_t op, rnp_input_t input, rnp_output_t output)
+{
+    if (!op || !input) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (op->detached_input) {
+        FFI_LOG(op->ffi, "Use rnp_op_verify_detached_reset for detached verification");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    rnp_op_verify_clear_results(op);
+    op->input = input;
+    op->output = output;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_verify_detached_reset(rnp_op_verify_t op, rnp_input_t input, rnp_input_t signature)
+{
+    if (!op || !input || !signature) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (!op->detached_input) {
+        FFI_LOG(op->ffi, "Use rnp_op_verify_reset for attached verification");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    rnp_op_verify_clear_results(op);
+    op->input = signature;
+    op->detached_input = input;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_op_verify_execute(rnp_op_verify_t op)
 {
     pgp_parse_handler_t handler;
 
+    if (!op || !op->input) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    rnp_ffi_lock_t lock(op->ffi, false);
+    // operation may be executed by the other thread than one which created it
+    op->rnpctx.rng = ffi_rng();
+
+    memset(&handler, 0, sizeof(handler));
     handler.password_provider = &op->ffi->pass_provider;
     handler.key_provider = &op->ffi->key_provider;
     handler.on_signatures = rnp_op_verify_on_signatures;
+    handler.on_sesskey = rnp_op_verify_on_sesskey;
     handler.src_provider = rnp_verify_src_provider;
     handler.dest_provider = rnp_verify_dest_provider;
     handler.param = op;
@@ -2099,6 +3171,102 @@ rnp_op_verify_execute(rnp_op_verify_t op)
     return ret;
 }
 
+static rnp_result_t
+rnp_op_verify_execute_job(void *op)
+{
+    return rnp_op_verify_execute((rnp_op_verify_t) op);
+}
+
+rnp_result_t
+rnp_op_verify_execute_async(rnp_op_verify_t op, rnp_op_complete_cb cb, void *app_ctx)
+{
+    if (!op || !op->input) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return rnp_execute_async(op->ffi, rnp_op_verify_execute_job, op, cb, app_ctx);
+}
+
+/* state of the single item verification in batch */
+typedef struct rnp_verify_item_t {
+    pgp_dest_t * dst;
+    rnp_result_t status; /* first failed signature's status */
+} rnp_verify_item_t;
+
+static void
+rnp_verify_item_on_signatures(pgp_parse_handler_t * handler,
+                              pgp_signature_info_t *sigs,
+                              int                   count)
+{
+    rnp_verify_item_t *item = (rnp_verify_item_t *) handler->param;
+
+    item->status = count ? RNP_SUCCESS : RNP_ERROR_NO_SIGNATURES_FOUND;
+    for (int i = 0; (i < count) && !item->status; i++) {
+        item->status = rnp_verify_status(&sigs[i]);
+    }
+}
+
+static bool
+rnp_verify_item_dest_provider(pgp_parse_handler_t *handler,
+                              pgp_dest_t **        dst,
+                              bool *               closedst,
+                              const char *         filename)
+{
+    *dst = ((rnp_verify_item_t *) handler->param)->dst;
+    *closedst = false;
+    return true;
+}
+
+static rnp_result_t
+rnp_verify_process(rnp_ffi_t            ffi,
+                   rnp_ctx_t *          ctx,
+                   const rnp_reserve_t *reserve,
+                   pgp_source_t *       src,
+                   pgp_dest_t *         dst)
+{
+    rnp_verify_item_t   item = {dst, RNP_ERROR_NO_SIGNATURES_FOUND};
+    pgp_parse_handler_t handler;
+
+    memset(&handler, 0, sizeof(handler));
+    handler.password_provider = &ffi->pass_provider;
+    handler.key_provider = &ffi->key_provider;
+    handler.on_signatures = rnp_verify_item_on_signatures;
+    handler.dest_provider = rnp_verify_item_dest_provider;
+    handler.param = &item;
+    handler.ctx = ctx;
+
+    rnp_result_t ret = process_pgp_source(&handler, src);
+    return ret ? ret : item.status;
+}
+
+rnp_result_t
+rnp_op_verify_execute_batch(rnp_op_verify_t       op,
+                            size_t                count,
+                            const uint8_t *const *bufs,
+                            const size_t *        lens,
+                            uint8_t **            outbufs,
+                            size_t *              outlens,
+                            rnp_result_t *        results)
+{
+    if (!op || !bufs || !lens || !outbufs || !outlens || !results) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (op->detached_input) {
+        FFI_LOG(op->ffi, "Detached verification is not supported in batch");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    /* decrypted data size is not known in advance, so outputs are not preallocated */
+    return rnp_batch_execute(op->ffi,
+                             &op->rnpctx,
+                             NULL,
+                             rnp_verify_process,
+                             count,
+                             bufs,
+                             lens,
+                             outbufs,
+                             outlens,
+                             results);
+}
+
 rnp_result_t
 rnp_op_verify_get_signature_count(rnp_op_verify_t op, size_t *count)
 {
@@ -2140,13 +3308,71 @@ rnp_op_verify_get_file_info(rnp_op_verify_t op, char **filename, uint32_t *mtime
     return RNP_SUCCESS;
 }
 
+rnp_result_t
+rnp_op_verify_set_session_key(rnp_op_verify_t op, const char *sesskey)
+{
+    if (!op || !sesskey) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (!pgp_sesskey_from_str(sesskey, &op->override_key)) {
+        FFI_LOG(op->ffi, "Invalid session key");
+        pgp_forget(&op->override_key, sizeof(op->override_key));
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    op->rnpctx.sesskey = &op->override_key;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_verify_get_session_key(rnp_op_verify_t op, char **sesskey)
+{
+    char keystr[4 + 2 * PGP_MAX_KEY_SIZE + 1];
+
+    if (!op || !sesskey) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (!op->sesskey_valid) {
+        FFI_LOG(op->ffi, "No session key was decrypted");
+        return RNP_ERROR_BAD_STATE;
+    }
+    if (!pgp_sesskey_to_str(&op->sesskey, keystr, sizeof(keystr))) {
+        return RNP_ERROR_BAD_STATE;
+    }
+    *sesskey = strdup(keystr);
+    pgp_forget(keystr, sizeof(keystr));
+    return *sesskey ? RNP_SUCCESS : RNP_ERROR_OUT_OF_MEMORY;
+}
+
+rnp_result_t
+rnp_op_verify_set_password_count(rnp_op_verify_t op, size_t count)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    if (!count || (count > UINT_MAX)) {
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    op->rnpctx.passwordc = count;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_verify_set_decompression_parallel(rnp_op_verify_t op, bool parallel)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    op->rnpctx.zparallel = parallel;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 rnp_op_verify_destroy(rnp_op_verify_t op)
 {
     if (op) {
+        pgp_forget(&op->override_key, sizeof(op->override_key));
+        rnp_op_verify_clear_results(op);
         rnp_ctx_free(&op->rnpctx);
-        free(op->signatures);
-        free(op->filename);
         free(op);
     }
     return RNP_SUCCESS;
@@ -2182,6 +3408,7 @@ rnp_op_verify_signature_get_key(rnp_op_verify_signature_t sig, rnp_key_handle_t
 {
     rnp_ffi_t        ffi = sig->ffi;
     pgp_key_search_t search;
+    rnp_ffi_lock_t   lock(ffi, false);
 
     // create a search (since we'll use this later anyways)
     search.type = PGP_KEY_SEARCH_KEYID;
@@ -2221,6 +3448,121 @@ rnp_op_verify_signature_get_times(rnp_op_verify_signature_t sig,
     return RNP_SUCCESS;
 }
 
+rnp_result_t
+rnp_op_verify_digest_create(rnp_op_verify_digest_t *op, rnp_ffi_t ffi, rnp_input_t signature)
+{
+    pgp_source_t  armorsrc = {0};
+    pgp_source_t *src = NULL;
+    rnp_result_t  ret;
+
+    if (!op || !ffi || !signature) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+
+    *op = (rnp_op_verify_digest_t) calloc(1, sizeof(**op));
+    if (!*op) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    (*op)->ffi = ffi;
+
+    src = &signature->src;
+    if (is_armored_source(src)) {
+        if ((ret = init_armored_src(&armorsrc, src))) {
+            goto done;
+        }
+        src = &armorsrc;
+    }
+    ret = stream_parse_signature(src, &(*op)->sig);
+    if (src == &armorsrc) {
+        src_close(&armorsrc);
+    }
+    if (ret) {
+        FFI_LOG(ffi, "Failed to read the signature");
+        goto done;
+    }
+
+    (*op)->info.ffi = ffi;
+    (*op)->info.halg = (*op)->sig.halg;
+    (*op)->info.sig_create = signature_get_creation(&(*op)->sig);
+    (*op)->info.sig_expires = signature_get_expiration(&(*op)->sig);
+    signature_get_keyid(&(*op)->sig, (*op)->info.keyid);
+    /* not verified yet */
+    (*op)->info.verify_status = RNP_ERROR_BAD_STATE;
+done:
+    if (ret) {
+        rnp_op_verify_digest_destroy(*op);
+        *op = NULL;
+    }
+    return ret;
+}
+
+rnp_result_t
+rnp_op_verify_digest_get_hash(rnp_op_verify_digest_t op, char **hash)
+{
+    if (!op) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return rnp_op_verify_signature_get_hash(&op->info, hash);
+}
+
+rnp_result_t
+rnp_op_verify_digest_get_trailer(rnp_op_verify_digest_t op, uint8_t **trailer, size_t *len)
+{
+    if (!op || !trailer || !len) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    return signature_get_trailer(&op->sig, trailer, len) ? RNP_SUCCESS :
+                                                           RNP_ERROR_OUT_OF_MEMORY;
+}
+
+rnp_result_t
+rnp_op_verify_digest_execute(rnp_op_verify_digest_t op, const uint8_t *digest, size_t len)
+{
+    pgp_signature_info_t sinfo = {0};
+    pgp_key_search_t     search = {.type = PGP_KEY_SEARCH_KEYID};
+
+    if (!op || !digest) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+
+    rnp_ffi_lock_t lock(op->ffi, false);
+    memcpy(search.by.keyid, op->info.keyid, PGP_KEY_ID_SIZE);
+    sinfo.sig = &op->sig;
+    sinfo.signer = find_key(op->ffi, &search, KEY_TYPE_PUBLIC, true);
+    if (!sinfo.signer) {
+        op->info.verify_status = RNP_ERROR_KEY_NOT_FOUND;
+        return op->info.verify_status;
+    }
+
+    signature_check_digest(&sinfo, digest, len, ffi_rng());
+    if (sinfo.valid) {
+        op->info.verify_status = sinfo.expired ? RNP_ERROR_SIGNATURE_EXPIRED : RNP_SUCCESS;
+    } else {
+        op->info.verify_status = RNP_ERROR_SIGNATURE_INVALID;
+    }
+    return op->info.verify_status;
+}
+
+rnp_result_t
+rnp_op_verify_digest_get_signature(rnp_op_verify_digest_t op, rnp_op_verify_signature_t *sig)
+{
+    if (!op || !sig) {
+        return RNP_ERROR_NULL_POINTER;
+    }
+    *sig = &op->info;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_op_verify_digest_destroy(rnp_op_verify_digest_t op)
+{
+    if (op) {
+        free_signature(&op->sig);
+        free(op);
+    }
+    return RNP_SUCCESS;
+}
+
 static bool
 rnp_decrypt_dest_provider(pgp_parse_handler_t *handler,
                           pgp_dest_t **        dst,
@@ -2241,6 +3583,7 @@ rnp_decrypt(rnp_ffi_t ffi, rnp_input_t input, rnp_output_t output)
     if (!ffi || !input || !output) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(ffi, false);
 
     rnp_ctx_init_ffi(&rnpctx, ffi);
     pgp_parse_handler_t handler;
@@ -2378,6 +3721,7 @@ rnp_locate_key(rnp_ffi_t         ffi,
     if (!ffi || !identifier_type || !identifier || !handle) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(ffi, false);
 
     // figure out the identifier type
     pgp_key_search_t locator = {(pgp_key_search_type_t) 0};
@@ -2419,6 +3763,7 @@ rnp_key_export(rnp_key_handle_t handle, rnp_output_t output, uint32_t flags)
     if (!handle || !output) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, false);
     dst = &output->dst;
     if ((flags & RNP_KEY_EXPORT_PUBLIC) && (flags & RNP_KEY_EXPORT_SECRET)) {
         FFI_LOG(handle->ffi, "Invalid export flags, select only public or secret, not both.");
@@ -2881,6 +4226,10 @@ rnp_generate_key_json(rnp_ffi_t ffi, const char *json, char **results)
     if (!ffi || (!ffi->pubring && !ffi->secring) || !json) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
 
     // parse the JSON
     jso = json_tokener_parse(json);
@@ -2923,7 +4272,7 @@ rnp_generate_key_json(rnp_ffi_t ffi, const char *json, char **results)
             ret = RNP_ERROR_BAD_PARAMETERS;
             goto done;
         }
-        if (!pgp_generate_keypair(&ffi->rng,
+        if (!pgp_generate_keypair(ffi_rng(),
                                   &primary_desc,
                                   &sub_desc,
                                   true,
@@ -2963,7 +4312,7 @@ rnp_generate_key_json(rnp_ffi_t ffi, const char *json, char **results)
             sub_sec = (pgp_key_t){0};
         }
     } else if (jsoprimary && !jsosub) { // generating primary only
-        primary_desc.crypto.rng = &ffi->rng;
+        primary_desc.crypto.rng = ffi_rng();
         if (!parse_keygen_primary(jsoprimary, &primary_desc)) {
             ret = RNP_ERROR_BAD_PARAMETERS;
             goto done;
@@ -3030,7 +4379,7 @@ rnp_generate_key_json(rnp_ffi_t ffi, const char *json, char **results)
             ret = RNP_ERROR_BAD_PARAMETERS;
             goto done;
         }
-        sub_desc.crypto.rng = &ffi->rng;
+        sub_desc.crypto.rng = ffi_rng();
         if (!pgp_generate_subkey(&sub_desc,
                                  true,
                                  primary_sec,
@@ -3097,6 +4446,7 @@ get_key_require_public(rnp_key_handle_t handle)
 {
     if (!handle->pub) {
         pgp_key_request_ctx_t request;
+        memset(&request, 0, sizeof(request));
         request.secret = false;
 
         // try fingerprint
@@ -3127,6 +4477,7 @@ get_key_require_secret(rnp_key_handle_t handle)
 {
     if (!handle->sec) {
         pgp_key_request_ctx_t request;
+        memset(&request, 0, sizeof(request));
         request.secret = true;
 
         // try fingerprint
@@ -3182,6 +4533,10 @@ rnp_key_add_uid(rnp_key_handle_t handle,
     if (!handle || !uid || !hash) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
 
     ARRAY_LOOKUP_BY_STRCASE(hash_alg_map, string, type, hash, hash_alg);
     if (hash_alg == PGP_HASH_UNKNOWN) {
@@ -3238,6 +4593,8 @@ rnp_key_get_primary_uid(rnp_key_handle_t handle, char **uid)
     if (handle == NULL || uid == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     pgp_key_t *key = get_key_prefer_public(handle);
     return key_get_uid_at(key, key->uid0_set ? key->uid0 : 0, uid);
 }
@@ -3248,6 +4605,8 @@ rnp_key_get_uid_count(rnp_key_handle_t handle, size_t *count)
     if (handle == NULL || count == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     pgp_key_t *key = get_key_prefer_public(handle);
     *count = key->uidc;
     return RNP_SUCCESS;
@@ -3259,6 +4618,8 @@ rnp_key_get_uid_at(rnp_key_handle_t handle, size_t idx, char **uid)
     if (handle == NULL || uid == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     pgp_key_t *key = get_key_prefer_public(handle);
     return key_get_uid_at(key, idx, uid);
 }
@@ -3269,6 +4630,8 @@ rnp_key_get_fprint(rnp_key_handle_t handle, char **fprint)
     if (handle == NULL || fprint == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     size_t hex_len = PGP_FINGERPRINT_HEX_SIZE + 1;
     *fprint = (char *) malloc(hex_len);
     if (*fprint == NULL)
@@ -3291,6 +4654,8 @@ rnp_key_get_keyid(rnp_key_handle_t handle, char **keyid)
     if (handle == NULL || keyid == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     size_t hex_len = PGP_KEY_ID_SIZE * 2 + 1;
     *keyid = (char *) malloc(hex_len);
     if (*keyid == NULL)
@@ -3309,6 +4674,8 @@ rnp_key_get_grip(rnp_key_handle_t handle, char **grip)
     if (handle == NULL || grip == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     size_t hex_len = PGP_FINGERPRINT_HEX_SIZE + 1;
     *grip = (char *) malloc(hex_len);
     if (*grip == NULL)
@@ -3327,6 +4694,8 @@ rnp_key_is_locked(rnp_key_handle_t handle, bool *result)
     if (handle == NULL || result == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     pgp_key_t *key = get_key_require_secret(handle);
     if (!key) {
         return RNP_ERROR_NO_SUITABLE_KEY;
@@ -3341,6 +4710,11 @@ rnp_key_lock(rnp_key_handle_t handle)
     if (handle == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
+
     pgp_key_t *key = get_key_require_secret(handle);
     if (!key) {
         return RNP_ERROR_NO_SUITABLE_KEY;
@@ -3357,6 +4731,10 @@ rnp_key_unlock(rnp_key_handle_t handle, const char *password)
     if (!handle) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
     pgp_key_t *key = get_key_require_secret(handle);
     if (!key) {
         return RNP_ERROR_NO_SUITABLE_KEY;
@@ -3364,7 +4742,8 @@ rnp_key_unlock(rnp_key_handle_t handle, const char *password)
     bool ok = false;
     if (password) {
         pgp_password_provider_t prov = {.callback = rnp_password_provider_string,
-                                        .userdata = RNP_UNCONST(password)};
+                                        .userdata = RNP_UNCONST(password),
+                                        .s2k_cache = handle->ffi->pass_provider.s2k_cache};
         ok = pgp_key_unlock(key, &prov);
     } else {
         ok = pgp_key_unlock(key, &handle->ffi->pass_provider);
@@ -3382,6 +4761,8 @@ rnp_key_is_protected(rnp_key_handle_t handle, bool *result)
     if (handle == NULL || result == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     pgp_key_t *key = get_key_require_secret(handle);
     if (!key) {
         return RNP_ERROR_NO_SUITABLE_KEY;
@@ -3407,6 +4788,10 @@ rnp_key_protect(rnp_key_handle_t handle,
     if (!handle || !password) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
 
     if (cipher) {
         ARRAY_LOOKUP_BY_STRCASE(symm_alg_map, string, type, cipher, protection.symm_alg);
@@ -3464,6 +4849,10 @@ rnp_key_unprotect(rnp_key_handle_t handle, const char *password)
     if (!handle) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, true);
+    if (!lock.ok()) {
+        return RNP_ERROR_BAD_STATE;
+    }
 
     // get the key
     pgp_key_t *key = get_key_require_secret(handle);
@@ -3473,7 +4862,8 @@ rnp_key_unprotect(rnp_key_handle_t handle, const char *password)
     bool ok = false;
     if (password) {
         pgp_password_provider_t prov = {.callback = rnp_password_provider_string,
-                                        .userdata = RNP_UNCONST(password)};
+                                        .userdata = RNP_UNCONST(password),
+                                        .s2k_cache = handle->ffi->pass_provider.s2k_cache};
         ok = pgp_key_unprotect(key, &prov);
     } else {
         ok = pgp_key_unprotect(key, &handle->ffi->pass_provider);
@@ -3491,6 +4881,8 @@ rnp_key_is_primary(rnp_key_handle_t handle, bool *result)
     if (handle == NULL || result == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     pgp_key_t *key = get_key_prefer_public(handle);
     if (key->format == G10_KEY_STORE) {
         // we can't currently determine this for a G10 secret key
@@ -3506,6 +4898,8 @@ rnp_key_is_sub(rnp_key_handle_t handle, bool *result)
     if (handle == NULL || result == NULL)
         return RNP_ERROR_NULL_POINTER;
 
+    rnp_ffi_lock_t lock(handle->ffi, false);
+
     pgp_key_t *key = get_key_prefer_public(handle);
     if (key->format == G10_KEY_STORE) {
         // we can't currently determine this for a G10 secret key
@@ -3566,6 +4960,7 @@ rnp_get_public_key_data(rnp_key_handle_t handle, uint8_t **buf, size_t *buf_len)
     if (!handle || !buf || !buf_len) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, false);
 
     pgp_key_t *key = handle->pub;
     if (!key) {
@@ -3581,6 +4976,7 @@ rnp_get_secret_key_data(rnp_key_handle_t handle, uint8_t **buf, size_t *buf_len)
     if (!handle || !buf || !buf_len) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, false);
 
     pgp_key_t *key = handle->sec;
     if (!key) {
@@ -4232,6 +5628,7 @@ rnp_key_to_json(rnp_key_handle_t handle, uint32_t flags, char **result)
     if (!handle || !result) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(handle->ffi, false);
     jso = json_object_new_object();
     if (!jso) {
         ret = RNP_ERROR_OUT_OF_MEMORY;
@@ -4396,6 +5793,7 @@ rnp_identifier_iterator_create(rnp_ffi_t                  ffi,
     if (!ffi || !it || !identifier_type) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(ffi, false);
     // create iterator
     obj = (struct rnp_identifier_iterator_st *) calloc(1, sizeof(*obj));
     if (!obj) {
@@ -4435,6 +5833,7 @@ rnp_identifier_iterator_next(rnp_identifier_iterator_t it, const char **identifi
     if (!it || !identifier) {
         return RNP_ERROR_NULL_POINTER;
     }
+    rnp_ffi_lock_t lock(it->ffi, false);
     // initialize the result to NULL
     *identifier = NULL;
     // this means we reached the end of the rings
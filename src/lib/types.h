@@ -341,6 +341,13 @@ typedef struct pgp_pk_sesskey_t {
     pgp_encrypted_material_t material;
 } pgp_pk_sesskey_t;
 
+/** decrypted session key, used to encrypt the data */
+typedef struct pgp_sesskey_t {
+    pgp_symm_alg_t alg;                   /* symmetric algorithm */
+    unsigned       keylen;                /* key length, equals to pgp_key_size(alg) */
+    uint8_t        key[PGP_MAX_KEY_SIZE]; /* key bytes */
+} pgp_sesskey_t;
+
 /** pkp_sk_sesskey_t */
 typedef struct {
     unsigned       version;
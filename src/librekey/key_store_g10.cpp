@@ -83,7 +83,8 @@ static bool    g10_calculated_hash(const pgp_key_pkt_t *key,
 pgp_key_pkt_t *g10_decrypt_seckey(const uint8_t *      data,
                                   size_t               data_len,
                                   const pgp_key_pkt_t *pubkey,
-                                  const char *         password);
+                                  const char *         password,
+                                  pgp_s2k_cache_t *    cache);
 
 static const format_info formats[] = {{PGP_SA_AES_128,
                                        PGP_CIPHER_MODE_CBC,
@@ -485,6 +486,7 @@ decrypt_protected_section(const uint8_t *      encrypted_data,
                           size_t               encrypted_data_len,
                           const pgp_key_pkt_t *seckey,
                           const char *         password,
+                          pgp_s2k_cache_t *    cache,
                           s_exp_t *            r_s_exp)
 {
     const format_info *info = NULL;
@@ -518,12 +520,13 @@ decrypt_protected_section(const uint8_t *      encrypted_data,
     }
 
     // derive the key
-    if (pgp_s2k_iterated(prot->s2k.hash_alg,
-                         derived_key,
-                         keysize,
-                         password,
-                         prot->s2k.salt,
-                         prot->s2k.iterations)) {
+    if (pgp_s2k_iterated_cached(cache,
+                                prot->s2k.hash_alg,
+                                derived_key,
+                                keysize,
+                                password,
+                                prot->s2k.salt,
+                                prot->s2k.iterations)) {
         RNP_LOG("pgp_s2k_iterated failed");
         goto done;
     }
@@ -587,7 +590,10 @@ done:
 }
 
 static bool
-parse_protected_seckey(pgp_key_pkt_t *seckey, s_exp_t *s_exp, const char *password)
+parse_protected_seckey(pgp_key_pkt_t *  seckey,
+                       s_exp_t *        s_exp,
+                       const char *     password,
+                       pgp_s2k_cache_t *cache)
 {
     const format_info *   format;
     bool                  ret = false;
@@ -694,6 +700,7 @@ parse_protected_seckey(pgp_key_pkt_t *seckey, s_exp_t *s_exp, const char *passwo
                                    protected_key->sub_elements[3].block.len,
                                    seckey,
                                    password,
+                                   cache,
                                    &decrypted_s_exp)) {
         goto done;
     }
@@ -775,6 +782,7 @@ g10_parse_seckey(pgp_io_t *                io,
                  const uint8_t *           data,
                  size_t                    data_len,
                  const char *              password,
+                 pgp_s2k_cache_t *         cache,
                  const pgp_key_provider_t *key_provider)
 {
     s_exp_t s_exp = {0};
@@ -910,7 +918,7 @@ g10_parse_seckey(pgp_io_t *                io,
     }
 
     if (is_protected) {
-        if (!parse_protected_seckey(seckey, algorithm_s_exp, password)) {
+        if (!parse_protected_seckey(seckey, algorithm_s_exp, password, cache)) {
             goto done;
         }
     } else {
@@ -945,7 +953,8 @@ pgp_key_pkt_t *
 g10_decrypt_seckey(const uint8_t *      data,
                    size_t               data_len,
                    const pgp_key_pkt_t *pubkey,
-                   const char *         password)
+                   const char *         password,
+                   pgp_s2k_cache_t *    cache)
 {
     pgp_key_pkt_t *seckey = NULL;
     pgp_io_t       io = pgp_io_from_fp(stderr, stdout, stdout);
@@ -959,7 +968,7 @@ g10_decrypt_seckey(const uint8_t *      data,
     if (pubkey && !copy_key_pkt(seckey, pubkey, false)) {
         goto done;
     }
-    if (!g10_parse_seckey(&io, seckey, data, data_len, password, NULL)) {
+    if (!g10_parse_seckey(&io, seckey, data, data_len, password, cache, NULL)) {
         goto done;
     }
     ok = true;
@@ -982,7 +991,8 @@ rnp_key_store_g10_from_mem(pgp_io_t *                io,
     pgp_key_pkt_t keypkt = {0};
     bool          ret = false;
 
-    if (!g10_parse_seckey(io, &keypkt, memory->buf, memory->length, NULL, key_provider)) {
+    if (!g10_parse_seckey(
+          io, &keypkt, memory->buf, memory->length, NULL, NULL, key_provider)) {
         goto done;
     }
     if (!pgp_key_from_keypkt(&key, &keypkt, PGP_PTAG_CT_SECRET_KEY)) {
@@ -40,6 +40,7 @@ bool           g10_write_seckey(pgp_dest_t *dst, pgp_key_pkt_t *seckey, const ch
 pgp_key_pkt_t *g10_decrypt_seckey(const uint8_t *      data,
                                   size_t               data_len,
                                   const pgp_key_pkt_t *pubkey,
-                                  const char *         password);
+                                  const char *         password,
+                                  pgp_s2k_cache_t *    cache);
 
 #endif // RNP_KEY_STORE_G10_H
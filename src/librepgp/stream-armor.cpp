@@ -33,7 +33,6 @@
 #include "stream-def.h"
 #include "stream-armor.h"
 #include "stream-packet.h"
-#include "crypto/hash.h"
 #include "defs.h"
 #include "types.h"
 #include "utils.h"
@@ -55,7 +54,7 @@ typedef struct pgp_source_armored_param_t {
     unsigned brestlen;   /* number of bytes in brest */
     bool     eofb64;     /* end of base64 stream reached */
     uint8_t  readcrc[3]; /* crc-24 from the armored data */
-    pgp_hash_t crc_ctx;  /* CTX used to calculate CRC */
+    uint32_t crc;        /* crc-24 of the decoded data */
 } pgp_source_armored_param_t;
 
 typedef struct pgp_dest_armored_param_t {
@@ -66,7 +65,7 @@ typedef struct pgp_dest_armored_param_t {
     unsigned          llen;    /* length of the base64 line, defaults to 76 as per RFC */
     uint8_t           tail[2]; /* bytes which didn't fit into 3-byte boundary */
     unsigned          tailc;   /* number of bytes in tail */
-    pgp_hash_t        crc_ctx; /* CTX used to calculate CRC */
+    uint32_t          crc;     /* crc-24 of the written data */
 } pgp_dest_armored_param_t;
 
 /*
@@ -96,6 +95,52 @@ static const uint8_t B64DEC[256] = {
   0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
   0xff};
 
+/* CRC-24 as per RFC 4880, section 6.1 */
+#define CRC24_INIT 0xB704CEL
+#define CRC24_POLY 0x1864CFBL
+
+/* Tables for the slicing-by-8 CRC-24 calculation. CRC is kept in the upper 24 bits of the
+ * 32-bit value, and table k contains CRC of the byte followed by k zero bytes. */
+static bool
+armor_crc24_init(uint32_t table[8][256])
+{
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? (CRC24_POLY << 8) : 0);
+        }
+        table[0][i] = crc;
+    }
+    for (unsigned i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][i] = (table[k - 1][i] << 8) ^ table[0][table[k - 1][i] >> 24];
+        }
+    }
+    return true;
+}
+
+static uint32_t
+armor_crc24(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    static uint32_t t[8][256];
+    static bool     inited = armor_crc24_init(t);
+    uint32_t        c = crc << 8;
+
+    (void) inited;
+    while (len >= 8) {
+        c ^= ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) |
+             buf[3];
+        c = t[7][c >> 24] ^ t[6][(c >> 16) & 0xff] ^ t[5][(c >> 8) & 0xff] ^ t[4][c & 0xff] ^
+            t[3][buf[4]] ^ t[2][buf[5]] ^ t[1][buf[6]] ^ t[0][buf[7]];
+        buf += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = (c << 8) ^ t[0][(c >> 24) ^ *buf++];
+    }
+    return c >> 8;
+}
+
 static int
 armor_read_padding(pgp_source_t *src)
 {
@@ -175,188 +220,185 @@ armor_read_trailer(pgp_source_t *src)
     return true;
 }
 
+/** @brief Decode base64 characters, skipping whitespaces and eols. Full 4-char groups are
+ *         decoded to the output, while incomplete one is kept in param->brest. Stops on the
+ *         '=' character, which starts padding or checksum, without consuming it.
+ *  @param in input characters
+ *  @param inlen number of input characters, on return number of consumed ones
+ *  @param out output buffer, must have space for (*inlen + 3) / 4 * 3 bytes
+ *  @return number of bytes written to the output, or -1 if wrong character was met
+ */
 static ssize_t
-armored_src_read(pgp_source_t *src, void *buf, size_t len)
+armor_decode_b64(pgp_source_armored_param_t *param,
+                 const uint8_t *             in,
+                 size_t *                    inlen,
+                 uint8_t *                   out)
 {
-    pgp_source_armored_param_t *param = (pgp_source_armored_param_t *) src->param;
-    uint8_t  b64buf[ARMORED_BLOCK_SIZE];     /* input base64 data with spaces and so on */
-    uint8_t  decbuf[ARMORED_BLOCK_SIZE + 4]; /* decoded 6-bit values */
-    uint8_t *bufptr = (uint8_t *) buf;       /* for better readability below */
-    uint8_t *bptr, *bend;                    /* pointer to input data in b64buf */
-    uint8_t *dptr, *dend, *pend; /* pointers to decoded data in decbuf: working pointer, last
-                                    available byte, last byte to process */
-    uint8_t  bval;
-    uint32_t b24;
-    ssize_t  read;
-    ssize_t  left = len;
-    int      eqcount = 0; /* number of '=' at the end of base64 stream */
-
-    if (!param) {
-        return -1;
-    }
-
-    /* checking whether there are some decoded bytes */
-    if (param->restpos < param->restlen) {
-        if (param->restlen - param->restpos >= len) {
-            memcpy(bufptr, &param->rest[param->restpos], len);
-            param->restpos += len;
-            pgp_hash_add(&param->crc_ctx, bufptr, len);
-            return len;
-        } else {
-            left = len - (param->restlen - param->restpos);
-            memcpy(bufptr, &param->rest[param->restpos], len - left);
-            param->restpos = param->restlen = 0;
-            bufptr += len - left;
-        }
-    }
-
-    if (param->eofb64) {
-        return len - left;
-    }
-
-    memcpy(decbuf, param->brest, param->brestlen);
-    dend = decbuf + param->brestlen;
-
-    do {
-        read = src_peek(param->readsrc, b64buf, sizeof(b64buf));
-        if (read < 0) {
-            return read;
-        }
-
-        dptr = dend;
-        bptr = b64buf;
-        bend = b64buf + read;
-        /* checking input data, stripping away whitespaces, checking for end of the b64 data */
-        while (bptr < bend) {
-            if ((bval = B64DEC[*(bptr++)]) < 64) {
-                *(dptr++) = bval;
-            } else if (bval == 0xfe) {
-                /* '=' means the base64 padding or the beginning of checksum */
-                param->eofb64 = true;
+    const uint8_t *ptr = in;
+    const uint8_t *end = in + *inlen;
+    uint8_t *      optr = out;
+    uint8_t *      quad = param->brest;
+    uint32_t       b24;
+    uint8_t        bval;
+
+    while (ptr < end) {
+        /* fast path: full 4-char groups, which make the most of the input */
+        while (!param->brestlen && (end - ptr >= 4)) {
+            uint32_t v0 = B64DEC[ptr[0]];
+            uint32_t v1 = B64DEC[ptr[1]];
+            uint32_t v2 = B64DEC[ptr[2]];
+            uint32_t v3 = B64DEC[ptr[3]];
+            if ((v0 | v1 | v2 | v3) >= 64) {
                 break;
-            } else if (bval == 0xff) {
-                RNP_LOG("wrong base64 character %c", (char) *(bptr - 1));
-                return -1;
             }
+            b24 = (v0 << 18) | (v1 << 12) | (v2 << 6) | v3;
+            optr[0] = b24 >> 16;
+            optr[1] = b24 >> 8;
+            optr[2] = b24 & 0xff;
+            optr += 3;
+            ptr += 4;
         }
-
-        dend = dptr;
-        dptr = decbuf;
-        /* Processing full 4s which will go directly to the buf.
-           After this left < 3 or decbuf has < 4 bytes */
-        if ((dend - dptr) / 4 * 3 < left) {
-            pend = decbuf + (dend - dptr) / 4 * 4;
-            left -= (dend - dptr) / 4 * 3;
-        } else {
-            pend = decbuf + (left / 3) * 4;
-            left -= left / 3 * 3;
+        if (ptr >= end) {
+            break;
         }
 
-        /* this one would the most performance-consuming part for large chunks */
-        while (dptr < pend) {
-            b24 = *dptr++ << 18;
-            b24 |= *dptr++ << 12;
-            b24 |= *dptr++ << 6;
-            b24 |= *dptr++;
-            *bufptr++ = b24 >> 16;
-            *bufptr++ = b24 >> 8;
-            *bufptr++ = b24 & 0xff;
+        /* slow path: eol, whitespace, group split by eol, or the end of base64 data */
+        if ((bval = B64DEC[*ptr]) < 64) {
+            if (param->brestlen < 3) {
+                quad[param->brestlen++] = bval;
+            } else {
+                b24 = (quad[0] << 18) | (quad[1] << 12) | (quad[2] << 6) | bval;
+                optr[0] = b24 >> 16;
+                optr[1] = b24 >> 8;
+                optr[2] = b24 & 0xff;
+                optr += 3;
+                param->brestlen = 0;
+            }
+        } else if (bval == 0xfe) {
+            /* '=' means the base64 padding or the beginning of checksum */
+            param->eofb64 = true;
+            break;
+        } else if (bval == 0xff) {
+            RNP_LOG("wrong base64 character %c", (char) *ptr);
+            return -1;
         }
+        ptr++;
+    }
 
-        /* moving rest to the beginning of decbuf */
-        memmove(decbuf, dptr, dend - dptr);
-        dend = decbuf + (dend - dptr);
-
-        if (param->eofb64) {
-            /* '=' reached, bptr points on it */
-            src_skip(param->readsrc, bptr - b64buf - 1);
+    *inlen = ptr - in;
+    return optr - out;
+}
 
-            /* reading b64 padding if any */
-            if ((eqcount = armor_read_padding(src)) < 0) {
-                RNP_LOG("wrong padding");
-                return -1;
-            }
+/** @brief Process the end of base64 data: padding, checksum and armor trailer. Decoded tail
+ *         bytes are appended to param->rest.
+ */
+static bool
+armor_read_b64_end(pgp_source_t *src)
+{
+    pgp_source_armored_param_t *param = (pgp_source_armored_param_t *) src->param;
+    uint8_t *                   quad = param->brest;
+    uint8_t *                   tail = &param->rest[param->restlen];
+    int                         eqcount;
 
-            /* reading crc */
-            if (!armor_read_crc(src)) {
-                RNP_LOG("wrong crc line");
-                return -1;
-            }
-            /* reading armor trailing line */
-            if (!armor_read_trailer(src)) {
-                RNP_LOG("wrong armor trailer");
-                return -1;
-            }
+    /* reading b64 padding if any */
+    if ((eqcount = armor_read_padding(src)) < 0) {
+        RNP_LOG("wrong padding");
+        return false;
+    }
+    /* reading crc */
+    if (!armor_read_crc(src)) {
+        RNP_LOG("wrong crc line");
+        return false;
+    }
+    /* reading armor trailing line */
+    if (!armor_read_trailer(src)) {
+        RNP_LOG("wrong armor trailer");
+        return false;
+    }
 
-            break;
-        } else {
-            /* all input is base64 data or eol/spaces, so skipping it */
-            src_skip(param->readsrc, read);
-        }
-    } while (left >= 3);
+    if ((param->brestlen + eqcount) % 4 != 0) {
+        RNP_LOG("wrong b64 padding");
+        return false;
+    }
+    if (eqcount == 1) {
+        uint32_t b24 = (quad[0] << 10) | (quad[1] << 4) | (quad[2] >> 2);
+        tail[0] = b24 >> 8;
+        tail[1] = b24 & 0xff;
+    } else if (eqcount == 2) {
+        tail[0] = (quad[0] << 2) | (quad[1] >> 4);
+    }
+    param->crc = armor_crc24(param->crc, tail, param->brestlen ? param->brestlen - 1 : 0);
+    param->restlen += param->brestlen ? param->brestlen - 1 : 0;
+    param->brestlen = 0;
+
+    if ((param->readcrc[0] != ((param->crc >> 16) & 0xff)) ||
+        (param->readcrc[1] != ((param->crc >> 8) & 0xff)) ||
+        (param->readcrc[2] != (param->crc & 0xff))) {
+        RNP_LOG("CRC mismatch");
+        return false;
+    }
+    return true;
+}
 
-    /* process bytes left in decbuf */
+static ssize_t
+armored_src_read(pgp_source_t *src, void *buf, size_t len)
+{
+    pgp_source_armored_param_t *param = (pgp_source_armored_param_t *) src->param;
+    uint8_t  b64buf[ARMORED_BLOCK_SIZE]; /* input base64 data with spaces and so on */
+    uint8_t *bufptr = (uint8_t *) buf;   /* for better readability below */
+    uint8_t *out;
+    size_t   left = len;
+    size_t   inlen;
+    size_t   rest;
+    ssize_t  read;
+    ssize_t  declen;
 
-    dptr = decbuf;
-    pend = decbuf + (dend - decbuf) / 4 * 4;
-    bptr = param->rest;
-    while (dptr < pend) {
-        b24 = *dptr++ << 18;
-        b24 |= *dptr++ << 12;
-        b24 |= *dptr++ << 6;
-        b24 |= *dptr++;
-        *bptr++ = b24 >> 16;
-        *bptr++ = b24 >> 8;
-        *bptr++ = b24 & 0xff;
+    if (!param) {
+        return -1;
     }
 
-    pgp_hash_add(&param->crc_ctx, buf, bufptr - (uint8_t *) buf);
-
-    if (param->eofb64) {
-        if ((dend - dptr + eqcount) % 4 != 0) {
-            RNP_LOG("wrong b64 padding");
-            return -1;
+    while (true) {
+        /* checking whether there are some decoded bytes */
+        if (param->restpos < param->restlen) {
+            rest = param->restlen - param->restpos;
+            rest = rest < left ? rest : left;
+            memcpy(bufptr, &param->rest[param->restpos], rest);
+            param->restpos += rest;
+            bufptr += rest;
+            left -= rest;
         }
-
-        if (eqcount == 1) {
-            b24 = (*dptr << 10) | (*(dptr + 1) << 4) | (*(dptr + 2) >> 2);
-            *bptr++ = b24 >> 8;
-            *bptr++ = b24 & 0xff;
-        } else if (eqcount == 2) {
-            *bptr++ = (*dptr << 2) | (*(dptr + 1) >> 4);
+        if (!left || param->eofb64) {
+            break;
         }
+        param->restpos = param->restlen = 0;
 
-        uint8_t crc_fin[5];
-        /* Calculate CRC after reading whole input stream */
-        pgp_hash_add(&param->crc_ctx, param->rest, bptr - param->rest);
-        if (!pgp_hash_finish(&param->crc_ctx, crc_fin)) {
-            RNP_LOG("Can't finalize RNP ctx");
+        read = src_peek(param->readsrc, b64buf, sizeof(b64buf));
+        if (read < 0) {
+            return read;
+        }
+        if (!read) {
+            RNP_LOG("unexpected end of base64 data");
             return -1;
         }
 
-        if (memcmp(param->readcrc, crc_fin, 3)) {
-            RNP_LOG("CRC mismatch");
+        /* decode directly to the caller's buffer if there is enough space */
+        out = (left >= ((size_t) read + 3) / 4 * 3) ? bufptr : param->rest;
+        inlen = read;
+        if ((declen = armor_decode_b64(param, b64buf, &inlen, out)) < 0) {
             return -1;
         }
-    } else {
-        /* few bytes which do not fit to 4 boundary */
-        for (int i = 0; i < dend - dptr; i++) {
-            param->brest[i] = *(dptr + i);
+        src_skip(param->readsrc, inlen);
+        param->crc = armor_crc24(param->crc, out, declen);
+        if (out == bufptr) {
+            bufptr += declen;
+            left -= declen;
+        } else {
+            param->restlen = declen;
         }
-        param->brestlen = dend - dptr;
-    }
-
-    param->restlen = bptr - param->rest;
 
-    /* check whether we have some bytes to add */
-    if ((left > 0) && (param->restlen > 0)) {
-        read = left > param->restlen ? param->restlen : left;
-        memcpy(bufptr, param->rest, read);
-        if (!param->eofb64) {
-            pgp_hash_add(&param->crc_ctx, bufptr, read);
+        if (param->eofb64 && !armor_read_b64_end(src)) {
+            return -1;
         }
-        left -= read;
-        param->restpos += read;
     }
 
     return len - left;
@@ -368,7 +410,6 @@ armored_src_close(pgp_source_t *src)
     pgp_source_armored_param_t *param = (pgp_source_armored_param_t *) src->param;
 
     if (param) {
-        (void) pgp_hash_finish(&param->crc_ctx, NULL);
         free(param->armorhdr);
         free(param->version);
         free(param->comment);
@@ -574,11 +615,7 @@ init_armored_src(pgp_source_t *src, pgp_source_t *readsrc)
 
     param = (pgp_source_armored_param_t *) src->param;
     param->readsrc = readsrc;
-
-    if (!pgp_hash_create(&param->crc_ctx, PGP_HASH_CRC24)) {
-        RNP_LOG("Internal error");
-        return RNP_ERROR_GENERIC;
-    }
+    param->crc = CRC24_INIT;
 
     src->read = armored_src_read;
     src->close = armored_src_close;
@@ -675,13 +712,44 @@ static const uint8_t B64ENC[256] = {
   'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '0', '1', '2', '3', '4', '5', '6', '7',
   '8', '9', '+', '/'};
 
-static void
-armored_encode3(uint8_t *out, uint8_t *in)
+/* Pairs of base64 chars for each 12-bit value, so 3 bytes are encoded with two lookups */
+static bool
+armored_enc12_init(uint8_t table[4096][2])
 {
-    out[0] = B64ENC[in[0] >> 2];
-    out[1] = B64ENC[((in[0] << 4) | (in[1] >> 4)) & 0xff];
-    out[2] = B64ENC[((in[1] << 2) | (in[2] >> 6)) & 0xff];
-    out[3] = B64ENC[in[2] & 0xff];
+    for (unsigned i = 0; i < 4096; i++) {
+        table[i][0] = B64ENC[i >> 6];
+        table[i][1] = B64ENC[i & 0x3f];
+    }
+    return true;
+}
+
+/* encode all whole 3-byte groups of the input, returning pointer to the end of output */
+static uint8_t *
+armored_encode_groups(uint8_t *out, const uint8_t *in, size_t len)
+{
+    static uint8_t enc12[4096][2];
+    static bool    inited = armored_enc12_init(enc12);
+    const uint8_t *end = in + len - len % 3;
+    uint32_t       t;
+
+    (void) inited;
+    while (in + 6 <= end) {
+        t = (in[0] << 16) | (in[1] << 8) | in[2];
+        memcpy(out, enc12[t >> 12], 2);
+        memcpy(out + 2, enc12[t & 0xfff], 2);
+        t = (in[3] << 16) | (in[4] << 8) | in[5];
+        memcpy(out + 4, enc12[t >> 12], 2);
+        memcpy(out + 6, enc12[t & 0xfff], 2);
+        in += 6;
+        out += 8;
+    }
+    if (in < end) {
+        t = (in[0] << 16) | (in[1] << 8) | in[2];
+        memcpy(out, enc12[t >> 12], 2);
+        memcpy(out + 2, enc12[t & 0xfff], 2);
+        out += 4;
+    }
+    return out;
 }
 
 static rnp_result_t
@@ -691,11 +759,9 @@ armored_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
     uint8_t *                 encptr = encbuf;
     uint8_t *                 enclast;
     uint8_t                   dec3[3];
-    uint8_t *                 bufptr = (uint8_t *) buf;
-    uint8_t *                 bufend = bufptr + len;
-    uint8_t *                 inlend;
-    uint32_t                  t;
-    unsigned                  inllen;
+    const uint8_t *           bufptr = (const uint8_t *) buf;
+    const uint8_t *           bufend = bufptr + len;
+    size_t                    inlen;
     pgp_dest_armored_param_t *param = (pgp_dest_armored_param_t *) dst->param;
 
     if (!param) {
@@ -704,7 +770,7 @@ armored_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
     }
 
     /* update crc */
-    pgp_hash_add(&param->crc_ctx, buf, len);
+    param->crc = armor_crc24(param->crc, bufptr, len);
 
     /* processing tail if any */
     if (len + param->tailc < 3) {
@@ -716,8 +782,7 @@ armored_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
         memcpy(&dec3[param->tailc], bufptr, 3 - param->tailc);
         bufptr += 3 - param->tailc;
         param->tailc = 0;
-        armored_encode3(encptr, dec3);
-        encptr += 4;
+        encptr = armored_encode_groups(encptr, dec3, 3);
         param->lout += 4;
         if (param->lout == param->llen) {
             if (param->usecrlf) {
@@ -728,8 +793,6 @@ armored_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
         }
     }
 
-    /* number of input bytes to form a whole line of output, param->llen / 4 * 3 */
-    inllen = (param->llen >> 2) + (param->llen >> 1);
     /* pointer to the last full line space in encbuf */
     enclast = encbuf + sizeof(encbuf) - param->llen - 2;
 
@@ -740,35 +803,25 @@ armored_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
             dst_write(param->writedst, encbuf, encptr - encbuf);
             encptr = encbuf;
         }
-        /* setup length of the input to process in this iteration */
-        inlend =
-          param->lout == 0 ? bufptr + inllen : bufptr + ((param->llen - param->lout) >> 2) * 3;
-        if (inlend > bufend) {
+        /* number of input bytes to complete the current line */
+        inlen = ((param->llen - param->lout) >> 2) * 3;
+        if ((size_t)(bufend - bufptr) < inlen) {
             /* no enough input for the full line */
-            inlend = bufptr + (bufend - bufptr) / 3 * 3;
-            param->lout += (inlend - bufptr) / 3 * 4;
-        } else {
-            /* we have full line of input */
-            param->lout = 0;
-        }
-
-        /* processing one line */
-        while (bufptr < inlend) {
-            t = (bufptr[0] << 16) | (bufptr[1] << 8) | (bufptr[2]);
-            bufptr += 3;
-            *encptr++ = B64ENC[(t >> 18) & 0xff];
-            *encptr++ = B64ENC[(t >> 12) & 0xff];
-            *encptr++ = B64ENC[(t >> 6) & 0xff];
-            *encptr++ = B64ENC[t & 0xff];
+            inlen = bufend - bufptr;
+            encptr = armored_encode_groups(encptr, bufptr, inlen);
+            param->lout += inlen / 3 * 4;
+            bufptr += inlen - inlen % 3;
+            break;
         }
 
-        /* adding line ending */
-        if (param->lout == 0) {
-            if (param->usecrlf) {
-                *encptr++ = CH_CR;
-            }
-            *encptr++ = CH_LF;
+        /* we have full line of input */
+        encptr = armored_encode_groups(encptr, bufptr, inlen);
+        bufptr += inlen;
+        if (param->usecrlf) {
+            *encptr++ = CH_CR;
         }
+        *encptr++ = CH_LF;
+        param->lout = 0;
     }
 
     dst_write(param->writedst, encbuf, encptr - encbuf);
@@ -810,9 +863,10 @@ armored_dst_finish(pgp_dest_t *dst)
     /* writing CRC and EOL */
     buf[0] = CH_EQ;
 
-    // At this point crc_ctx is initialized, so call can't fail
-    (void) pgp_hash_finish(&param->crc_ctx, crcbuf);
-    armored_encode3(&buf[1], crcbuf);
+    crcbuf[0] = (param->crc >> 16) & 0xff;
+    crcbuf[1] = (param->crc >> 8) & 0xff;
+    crcbuf[2] = param->crc & 0xff;
+    armored_encode_groups(&buf[1], crcbuf, 3);
     dst_write(param->writedst, buf, 5);
     armor_write_eol(param);
 
@@ -833,8 +887,6 @@ armored_dst_close(pgp_dest_t *dst, bool discard)
         return;
     }
 
-    /* dst_close may be called without dst_finish on error */
-    (void) pgp_hash_finish(&param->crc_ctx, NULL);
     free(param);
     dst->param = NULL;
 }
@@ -859,15 +911,11 @@ init_armored_dst(pgp_dest_t *dst, pgp_dest_t *writedst, pgp_armored_msg_t msgtyp
     dst->clen = 0;
     dst->param = param;
 
-    if (!pgp_hash_create(&param->crc_ctx, PGP_HASH_CRC24)) {
-        RNP_LOG("Internal error");
-        return RNP_ERROR_GENERIC;
-    }
-
     param->writedst = writedst;
     param->type = msgtype;
     param->usecrlf = true;
     param->llen = 76; /* must be multiple of 4 */
+    param->crc = CRC24_INIT;
 
     if (!armor_message_header(param->type, false, hdr)) {
         RNP_LOG("unknown data type");
@@ -894,6 +942,29 @@ finish:
     return ret;
 }
 
+uint64_t
+armored_dst_size(pgp_armored_msg_t msgtype, uint64_t len)
+{
+    char     hdr[64];
+    uint64_t chars = (len + 2) / 3 * 4;
+    uint64_t size;
+
+    /* armor header and tail, the same as init_armored_dst/armored_dst_finish write */
+    if (!armor_message_header(msgtype, false, hdr)) {
+        return 0;
+    }
+    size = strlen(hdr) + 2;
+    armor_message_header(msgtype, true, hdr);
+    size += strlen(hdr) + 2;
+    /* version string and empty line */
+    strncpy(hdr, "Version: " PACKAGE_STRING, sizeof(hdr));
+    hdr[sizeof(hdr) - 1] = '\0';
+    size += strlen(hdr) + 2 + 2;
+    /* base64 lines of 76 characters, each followed by \r\n, and the crc line */
+    size += chars + (chars + 75) / 76 * 2;
+    return size + 5 + 2;
+}
+
 bool
 is_armored_source(pgp_source_t *src)
 {
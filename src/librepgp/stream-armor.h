@@ -55,6 +55,13 @@ rnp_result_t init_armored_dst(pgp_dest_t *      dst,
                               pgp_dest_t *      writedst,
                               pgp_armored_msg_t msgtype);
 
+/* @brief Get the exact size of the armored output, produced by the armoring stream
+ * @param msgtype type of the message (see pgp_armored_msg_t)
+ * @param len number of bytes which will be written to the armoring stream
+ * @return number of bytes in the armored output, or 0 for unknown message type
+ **/
+uint64_t armored_dst_size(pgp_armored_msg_t msgtype, uint64_t len);
+
 /* @brief Dearmor the source, outputing binary data
  * @param src initialized source with armored data
  * @param dst initialized dest to write binary data to
@@ -0,0 +1,713 @@
+/*
+ * Copyright (c) 2018, [Ribose Inc](https://www.ribose.com).
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1.  Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ * 2.  Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "config.h"
+#ifdef HAVE_BZLIB_H
+#include <stdlib.h>
+#include <string.h>
+#include <bzlib.h>
+#include <rnp/rnp_def.h>
+#include "stream-bzip2.h"
+#include "utils.h"
+#include "parallel.h"
+
+#define BZ2_BLOCK_MAGIC 0x314159265359ULL
+#define BZ2_EOS_MAGIC 0x177245385090ULL
+#define BZ2_READ_SIZE (64 * 1024)
+#define BZ2_PLAIN_SIZE (1024 * 1024)
+/* compressed block could not be larger, so data with the missing magic is surely corrupted */
+#define BZ2_MAX_BLOCK_SIZE (2 * 1024 * 1024)
+/* maximum number of false magics, found inside of the single block */
+#define BZ2_MAX_SKIPS 16
+/* each block's data is kept in memory, so limit the number of blocks decoded at once */
+#define BZ2_MAX_READ_THREADS 8
+/* initial run-length encoding expands 5 bytes to at most 255, so block of level * 100000
+ * bytes could not give more data */
+#define BZ2_MAX_PLAIN_SIZE(level) ((size_t)((level) - '0') * 100000 * 51)
+
+typedef struct pgp_bz2_block_t {
+    uint8_t *plain;     /* uncompressed data */
+    size_t   plainlen;  /* number of bytes in plain */
+    size_t   plaincap;  /* allocated size of plain */
+    uint8_t *packed;    /* standalone bzip2 stream with this block only */
+    size_t   packedlen; /* number of bytes in packed */
+    size_t   packedcap; /* allocated size of packed */
+    size_t   from;      /* bit position of the block's magic in the compressed data */
+    size_t   to;        /* bit position right after the block's end */
+    uint32_t crc;       /* block crc, stored after the magic */
+    bool     ok;        /* block was successfully processed */
+    bool     nomem;     /* block processing failed due to the allocation failure */
+} pgp_bz2_block_t;
+
+/* MSB-first bit writer, bzip2 streams are not byte-aligned */
+typedef struct pgp_bz2_bits_t {
+    uint8_t *buf;     /* output buffer, must be large enough */
+    size_t   len;     /* number of complete bytes in buf */
+    uint64_t acc;     /* pending bits */
+    unsigned accbits; /* number of pending bits, always less than 8 between calls */
+} pgp_bz2_bits_t;
+
+struct pgp_bz2_writer_t {
+    pgp_dest_t *     writedst;
+    int              level;
+    size_t           threads; /* number of blocks compressed at once */
+    size_t           chunk;   /* number of input bytes in the full block */
+    pgp_bz2_block_t *blocks;  /* blocks of the current batch */
+    size_t           blockc;  /* number of full blocks in the current batch */
+    uint32_t         crc;     /* combined crc of the stream */
+    pgp_bz2_bits_t   out;     /* output bits which were not written to writedst yet */
+};
+
+struct pgp_bz2_reader_t {
+    pgp_source_t *   readsrc;
+    size_t           threads;  /* number of blocks decompressed at once */
+    uint8_t *        in;       /* compressed data, starting from the current block */
+    size_t           inlen;    /* number of bytes in in */
+    size_t           incap;    /* allocated size of in */
+    char             level;    /* level from the stream header, '1'..'9' */
+    bool             header;   /* stream header was read */
+    size_t           start;    /* bit position of the first block which is not decoded yet */
+    size_t *         starts;   /* block magic positions, found by the last scan */
+    size_t           startc;   /* number of items in starts */
+    bool             eos;      /* end of stream magic was found at eospos by the last scan */
+    size_t           eospos;   /* bit position of the end of stream magic */
+    size_t           skips[BZ2_MAX_SKIPS]; /* positions of false magics, in increasing order */
+    size_t           skipc;    /* number of items in skips */
+    pgp_bz2_block_t *blocks;   /* decoded blocks of the current batch */
+    size_t           blockc;   /* number of decoded blocks in the current batch */
+    size_t           blockidx; /* index of the block to read data from */
+    size_t           blockpos; /* position of the data to read within the block */
+    uint32_t         crc;      /* combined crc of the decoded blocks */
+    bool             done;     /* whole stream is decoded */
+    bool             error;    /* error occurred, stream cannot be read further */
+};
+
+/* get n <= 57 bits, starting from the bit position pos */
+static uint64_t
+bz2_get_bits(const uint8_t *buf, size_t pos, unsigned n)
+{
+    unsigned shift = pos % 8;
+    unsigned bytes = (shift + n + 7) / 8;
+    uint64_t val = 0;
+
+    buf += pos / 8;
+    for (unsigned i = 0; i < bytes; i++) {
+        val = (val << 8) | buf[i];
+    }
+    return (val >> (bytes * 8 - shift - n)) & ((1ULL << n) - 1);
+}
+
+/* put n <= 48 bits */
+static void
+bz2_put_bits(pgp_bz2_bits_t *bits, uint64_t val, unsigned n)
+{
+    if (n > 24) {
+        bz2_put_bits(bits, val >> 24, n - 24);
+        n = 24;
+    }
+    bits->acc = (bits->acc << n) | (val & ((1ULL << n) - 1));
+    bits->accbits += n;
+    while (bits->accbits >= 8) {
+        bits->accbits -= 8;
+        bits->buf[bits->len++] = (bits->acc >> bits->accbits) & 0xff;
+    }
+}
+
+/* copy bits [from, to) of the buffer */
+static void
+bz2_copy_bits(pgp_bz2_bits_t *bits, const uint8_t *buf, size_t from, size_t to)
+{
+    if ((from % 8) && (from < to)) {
+        unsigned n = 8 - from % 8;
+        if (n > to - from) {
+            n = to - from;
+        }
+        bz2_put_bits(bits, bz2_get_bits(buf, from, n), n);
+        from += n;
+    }
+    if (!bits->accbits) {
+        memcpy(bits->buf + bits->len, buf + from / 8, (to - from) / 8);
+        bits->len += (to - from) / 8;
+        from += (to - from) / 8 * 8;
+    }
+    for (; from + 8 <= to; from += 8) {
+        bz2_put_bits(bits, buf[from / 8], 8);
+    }
+    if (from < to) {
+        bz2_put_bits(bits, bz2_get_bits(buf, from, to - from), to - from);
+    }
+}
+
+/* pad the last byte with zero bits */
+static void
+bz2_flush_bits(pgp_bz2_bits_t *bits)
+{
+    if (bits->accbits) {
+        bz2_put_bits(bits, 0, 8 - bits->accbits);
+    }
+}
+
+static uint32_t
+bz2_combine_crc(uint32_t crc, uint32_t blockcrc)
+{
+    return ((crc << 1) | (crc >> 31)) ^ blockcrc;
+}
+
+static void
+bz2_free_blocks(pgp_bz2_block_t *blocks, size_t count)
+{
+    if (!blocks) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(blocks[i].plain);
+        free(blocks[i].packed);
+    }
+    free(blocks);
+}
+
+/* find the block's bits within the standalone stream, produced by libbz2 */
+static bool
+bz2_locate_block(pgp_bz2_block_t *blk)
+{
+    size_t bits = blk->packedlen * 8;
+
+    /* header, block magic with crc, and end of stream magic with crc */
+    if ((bits < 32 + 80 + 80) || (bz2_get_bits(blk->packed, 32, 48) != BZ2_BLOCK_MAGIC)) {
+        return false;
+    }
+    blk->from = 32;
+    blk->crc = bz2_get_bits(blk->packed, 80, 32);
+    for (size_t pad = 0; pad < 8; pad++) {
+        size_t pos = bits - pad - 80;
+        if (bz2_get_bits(blk->packed, pos, 48) != BZ2_EOS_MAGIC) {
+            continue;
+        }
+        blk->to = pos;
+        /* stream crc will differ from the block's one if there is more than one block */
+        return bz2_get_bits(blk->packed, pos + 48, 32) == blk->crc;
+    }
+    return false;
+}
+
+static bool
+bz2_compress_job(void *param, size_t idx, size_t worker)
+{
+    pgp_bz2_writer_t *bz = (pgp_bz2_writer_t *) param;
+    pgp_bz2_block_t * blk = &bz->blocks[idx];
+    bz_stream         bzs;
+    int               ret;
+
+    memset(&bzs, 0, sizeof(bzs));
+    if ((ret = BZ2_bzCompressInit(&bzs, bz->level, 0, 0)) != BZ_OK) {
+        RNP_LOG("failed to init bz, error %d", ret);
+        return false;
+    }
+    bzs.next_in = (char *) blk->plain;
+    bzs.avail_in = blk->plainlen;
+    bzs.next_out = (char *) blk->packed;
+    bzs.avail_out = blk->packedcap;
+    ret = BZ2_bzCompress(&bzs, BZ_FINISH);
+    blk->packedlen = blk->packedcap - bzs.avail_out;
+    BZ2_bzCompressEnd(&bzs);
+
+    if (ret != BZ_STREAM_END) {
+        RNP_LOG("bzip2 compression failed, error %d", ret);
+        return false;
+    }
+    if (!bz2_locate_block(blk)) {
+        RNP_LOG("unexpected bzip2 block layout");
+        return false;
+    }
+    return true;
+}
+
+static rnp_result_t
+bz2_writer_flush(pgp_bz2_writer_t *bz, size_t count)
+{
+    if (!rnp_parallel_for(count, bz->threads, bz2_compress_job, bz)) {
+        return RNP_ERROR_BAD_STATE;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        pgp_bz2_block_t *blk = &bz->blocks[i];
+        bz2_copy_bits(&bz->out, blk->packed, blk->from, blk->to);
+        dst_write(bz->writedst, bz->out.buf, bz->out.len);
+        bz->out.len = 0;
+        bz->crc = bz2_combine_crc(bz->crc, blk->crc);
+        blk->plainlen = 0;
+    }
+    bz->blockc = 0;
+    return bz->writedst->werr;
+}
+
+rnp_result_t
+bz2_writer_create(pgp_bz2_writer_t **bz, pgp_dest_t *writedst, int level, size_t threads)
+{
+    pgp_bz2_writer_t *writer;
+    uint8_t           hdr[4] = {'B', 'Z', 'h', 0};
+
+    if ((level < 1) || (level > 9) || !threads) {
+        RNP_LOG("wrong bzip2 parameters");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    if (!(writer = (pgp_bz2_writer_t *) calloc(1, sizeof(*writer)))) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    *bz = writer;
+    writer->writedst = writedst;
+    writer->level = level;
+    writer->threads = threads;
+    /* run-length encoding, done before the BWT, may expand data up to 5/4 times, so this
+     * makes sure that libbz2 always outputs a single block */
+    writer->chunk = (level * 100000 - 19) / 5 * 4;
+    if (!(writer->blocks = (pgp_bz2_block_t *) calloc(threads, sizeof(*writer->blocks)))) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    for (size_t i = 0; i < threads; i++) {
+        pgp_bz2_block_t *blk = &writer->blocks[i];
+        blk->plaincap = writer->chunk;
+        blk->packedcap = writer->chunk + writer->chunk / 100 + 600;
+        blk->plain = (uint8_t *) malloc(blk->plaincap);
+        blk->packed = (uint8_t *) malloc(blk->packedcap);
+        if (!blk->plain || !blk->packed) {
+            return RNP_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    if (!(writer->out.buf = (uint8_t *) malloc(writer->blocks[0].packedcap + 16))) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+
+    hdr[3] = '0' + level;
+    dst_write(writedst, hdr, sizeof(hdr));
+    return writedst->werr;
+}
+
+rnp_result_t
+bz2_writer_write(pgp_bz2_writer_t *bz, const void *buf, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *) buf;
+    rnp_result_t   ret;
+
+    while (len) {
+        pgp_bz2_block_t *blk = &bz->blocks[bz->blockc];
+        size_t           part = bz->chunk - blk->plainlen;
+
+        if (part > len) {
+            part = len;
+        }
+        memcpy(blk->plain + blk->plainlen, bytes, part);
+        blk->plainlen += part;
+        bytes += part;
+        len -= part;
+
+        if (blk->plainlen < bz->chunk) {
+            break;
+        }
+        if ((++bz->blockc == bz->threads) && (ret = bz2_writer_flush(bz, bz->blockc))) {
+            return ret;
+        }
+    }
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+bz2_writer_finish(pgp_bz2_writer_t *bz)
+{
+    size_t       count = bz->blockc;
+    rnp_result_t ret;
+
+    if (bz->blocks[count].plainlen) {
+        count++;
+    }
+    if (count && (ret = bz2_writer_flush(bz, count))) {
+        return ret;
+    }
+
+    bz2_put_bits(&bz->out, BZ2_EOS_MAGIC, 48);
+    bz2_put_bits(&bz->out, bz->crc, 32);
+    bz2_flush_bits(&bz->out);
+    dst_write(bz->writedst, bz->out.buf, bz->out.len);
+    bz->out.len = 0;
+    return bz->writedst->werr;
+}
+
+void
+bz2_writer_destroy(pgp_bz2_writer_t *bz)
+{
+    if (!bz) {
+        return;
+    }
+    bz2_free_blocks(bz->blocks, bz->threads);
+    free(bz->out.buf);
+    free(bz);
+}
+
+static bool
+bz2_decompress_job(void *param, size_t idx, size_t worker)
+{
+    pgp_bz2_reader_t *bz = (pgp_bz2_reader_t *) param;
+    pgp_bz2_block_t * blk = &bz->blocks[idx];
+    pgp_bz2_bits_t    bits = {};
+    size_t            need = (blk->to - blk->from) / 8 + 32;
+    size_t            maxplain = BZ2_MAX_PLAIN_SIZE(bz->level);
+    bz_stream         bzs;
+    int               ret = BZ_OK;
+
+    /* wrap the block into the standalone stream, so libbz2 checks the block's crc */
+    if (blk->packedcap < need) {
+        uint8_t *packed = (uint8_t *) realloc(blk->packed, need);
+        if (!packed) {
+            blk->nomem = true;
+            return false;
+        }
+        blk->packed = packed;
+        blk->packedcap = need;
+    }
+    blk->crc = bz2_get_bits(bz->in, blk->from + 48, 32);
+    bits.buf = blk->packed;
+    bz2_put_bits(&bits, ('B' << 16) | ('Z' << 8) | 'h', 24);
+    bz2_put_bits(&bits, bz->level, 8);
+    bz2_copy_bits(&bits, bz->in, blk->from, blk->to);
+    bz2_put_bits(&bits, BZ2_EOS_MAGIC, 48);
+    bz2_put_bits(&bits, blk->crc, 32);
+    bz2_flush_bits(&bits);
+    blk->packedlen = bits.len;
+
+    memset(&bzs, 0, sizeof(bzs));
+    if (BZ2_bzDecompressInit(&bzs, 0, 0) != BZ_OK) {
+        blk->nomem = true;
+        return false;
+    }
+    bzs.next_in = (char *) blk->packed;
+    bzs.avail_in = blk->packedlen;
+    blk->plainlen = 0;
+    do {
+        if (blk->plainlen == blk->plaincap) {
+            size_t   cap = blk->plaincap ? blk->plaincap * 2 : BZ2_PLAIN_SIZE;
+            uint8_t *plain;
+
+            /* valid block could not be that large, so magic is a false one */
+            if (blk->plaincap >= maxplain) {
+                break;
+            }
+            if (cap > maxplain) {
+                cap = maxplain;
+            }
+            if (!(plain = (uint8_t *) realloc(blk->plain, cap))) {
+                blk->nomem = true;
+                break;
+            }
+            blk->plain = plain;
+            blk->plaincap = cap;
+        }
+        bzs.next_out = (char *) (blk->plain + blk->plainlen);
+        bzs.avail_out = blk->plaincap - blk->plainlen;
+        ret = BZ2_bzDecompress(&bzs);
+        blk->plainlen = blk->plaincap - bzs.avail_out;
+        blk->ok = ret == BZ_STREAM_END;
+    } while ((ret == BZ_OK) && !bzs.avail_out);
+    BZ2_bzDecompressEnd(&bzs);
+    /* failure is not an error yet: magic could be found inside of the block's data */
+    return blk->ok;
+}
+
+/* find the block or end of stream magic, starting from the bit position from */
+static bool
+bz2_find_magic(pgp_bz2_reader_t *bz, size_t from, size_t *pos, bool *eos)
+{
+    size_t   skip = 0;
+    uint64_t reg = 0;
+
+    while ((skip < bz->skipc) && (bz->skips[skip] < from)) {
+        skip++;
+    }
+    /* register keeps the last 64 bits, ending at the current byte */
+    for (size_t byte = from / 8; byte < bz->inlen; byte++) {
+        reg = (reg << 8) | bz->in[byte];
+        for (int shift = 7; shift >= 0; shift--) {
+            size_t   end = (byte + 1) * 8 - shift;
+            uint64_t val = (reg >> shift) & 0xffffffffffffULL;
+
+            if ((end < from + 48) || ((val != BZ2_BLOCK_MAGIC) && (val != BZ2_EOS_MAGIC))) {
+                continue;
+            }
+            while ((skip < bz->skipc) && (bz->skips[skip] < end - 48)) {
+                skip++;
+            }
+            if ((skip < bz->skipc) && (bz->skips[skip] == end - 48)) {
+                continue;
+            }
+            *pos = end - 48;
+            *eos = val == BZ2_EOS_MAGIC;
+            return true;
+        }
+    }
+    return false;
+}
+
+static rnp_result_t
+bz2_reader_more(pgp_bz2_reader_t *bz)
+{
+    ssize_t read;
+
+    if (bz->incap - bz->inlen < BZ2_READ_SIZE) {
+        size_t   cap = bz->incap ? bz->incap * 2 : 4 * BZ2_READ_SIZE;
+        uint8_t *in = (uint8_t *) realloc(bz->in, cap);
+        if (!in) {
+            return RNP_ERROR_OUT_OF_MEMORY;
+        }
+        bz->in = in;
+        bz->incap = cap;
+    }
+
+    read = src_read(bz->readsrc, bz->in + bz->inlen, BZ2_READ_SIZE);
+    if (read < 0) {
+        RNP_LOG("failed to read data");
+        return RNP_ERROR_READ;
+    }
+    if (!read) {
+        RNP_LOG("unexpected end of bzip stream");
+        return RNP_ERROR_BAD_FORMAT;
+    }
+    bz->inlen += read;
+    return RNP_SUCCESS;
+}
+
+/* find the starts of up to threads + 1 blocks, or the end of stream */
+static rnp_result_t
+bz2_reader_scan(pgp_bz2_reader_t *bz)
+{
+    size_t       from = bz->start;
+    size_t       pos = 0;
+    bool         eos = false;
+    rnp_result_t ret;
+
+    bz->startc = 0;
+    bz->eos = false;
+    while (true) {
+        size_t last = bz->startc ? bz->starts[bz->startc - 1] : bz->start;
+
+        if (!bz2_find_magic(bz, from, &pos, &eos)) {
+            if (bz->inlen * 8 - last > BZ2_MAX_BLOCK_SIZE * 8) {
+                RNP_LOG("too large or corrupted bzip2 block");
+                return RNP_ERROR_BAD_FORMAT;
+            }
+            if (bz->inlen * 8 > from + 47) {
+                from = bz->inlen * 8 - 47;
+            }
+            if ((ret = bz2_reader_more(bz))) {
+                return ret;
+            }
+            continue;
+        }
+        if (!bz->startc && (pos != bz->start)) {
+            RNP_LOG("wrong bzip2 block");
+            return RNP_ERROR_BAD_FORMAT;
+        }
+        if (eos) {
+            break;
+        }
+        bz->starts[bz->startc++] = pos;
+        if (bz->startc > bz->threads) {
+            return RNP_SUCCESS;
+        }
+        from = pos + 48;
+    }
+
+    /* end of stream magic is followed by the combined crc */
+    bz->eos = true;
+    bz->eospos = pos;
+    while (bz->inlen * 8 < pos + 80) {
+        if ((ret = bz2_reader_more(bz))) {
+            return ret;
+        }
+    }
+    return RNP_SUCCESS;
+}
+
+/* decode the next batch of blocks */
+static rnp_result_t
+bz2_reader_fill(pgp_bz2_reader_t *bz)
+{
+    size_t       drop;
+    size_t       count;
+    size_t       skipc = 0;
+    rnp_result_t ret;
+
+    if (!bz->header) {
+        while (bz->inlen < 4) {
+            if ((ret = bz2_reader_more(bz))) {
+                return ret;
+            }
+        }
+        if (memcmp(bz->in, "BZh", 3) || (bz->in[3] < '1') || (bz->in[3] > '9')) {
+            RNP_LOG("wrong bzip2 header");
+            return RNP_ERROR_BAD_FORMAT;
+        }
+        bz->level = bz->in[3];
+        bz->start = 32;
+        bz->header = true;
+    }
+
+    /* drop the data of already decoded blocks */
+    drop = bz->start / 8;
+    for (size_t i = 0; i < bz->skipc; i++) {
+        if (bz->skips[i] >= bz->start) {
+            bz->skips[skipc++] = bz->skips[i] - drop * 8;
+        }
+    }
+    bz->skipc = skipc;
+    memmove(bz->in, bz->in + drop, bz->inlen - drop);
+    bz->inlen -= drop;
+    bz->start -= drop * 8;
+
+    if ((ret = bz2_reader_scan(bz))) {
+        return ret;
+    }
+    count = bz->eos ? bz->startc : bz->startc - 1;
+    for (size_t i = 0; i < count; i++) {
+        bz->blocks[i].from = bz->starts[i];
+        bz->blocks[i].to = (i + 1 < bz->startc) ? bz->starts[i + 1] : bz->eospos;
+        bz->blocks[i].ok = false;
+        bz->blocks[i].nomem = false;
+    }
+    rnp_parallel_for(count, bz->threads, bz2_decompress_job, bz);
+    for (size_t i = 0; i < count; i++) {
+        if (bz->blocks[i].nomem) {
+            RNP_LOG("allocation failed");
+            return RNP_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    bz->blockidx = 0;
+    bz->blockpos = 0;
+    for (size_t i = 0; i < count; i++) {
+        pgp_bz2_block_t *blk = &bz->blocks[i];
+        if (blk->ok) {
+            bz->crc = bz2_combine_crc(bz->crc, blk->crc);
+            continue;
+        }
+        /* merge block with the next one and try again on the next call */
+        if (bz->skipc == BZ2_MAX_SKIPS) {
+            RNP_LOG("bzip2 block decompression failed");
+            return RNP_ERROR_BAD_FORMAT;
+        }
+        bz->skips[bz->skipc++] = blk->to;
+        bz->blockc = i;
+        bz->start = blk->from;
+        return RNP_SUCCESS;
+    }
+
+    bz->blockc = count;
+    if (!bz->eos) {
+        bz->start = bz->starts[bz->startc - 1];
+        return RNP_SUCCESS;
+    }
+    if (bz2_get_bits(bz->in, bz->eospos + 48, 32) != bz->crc) {
+        RNP_LOG("bzip2 stream crc mismatch");
+        return RNP_ERROR_BAD_FORMAT;
+    }
+    bz->done = true;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+bz2_reader_create(pgp_bz2_reader_t **bz, pgp_source_t *readsrc, size_t threads)
+{
+    pgp_bz2_reader_t *reader;
+
+    if (!threads) {
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    if (threads > BZ2_MAX_READ_THREADS) {
+        threads = BZ2_MAX_READ_THREADS;
+    }
+    if (!(reader = (pgp_bz2_reader_t *) calloc(1, sizeof(*reader)))) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    *bz = reader;
+    reader->readsrc = readsrc;
+    reader->threads = threads;
+    reader->starts = (size_t *) calloc(threads + 1, sizeof(*reader->starts));
+    reader->blocks = (pgp_bz2_block_t *) calloc(threads, sizeof(*reader->blocks));
+    if (!reader->starts || !reader->blocks) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    return RNP_SUCCESS;
+}
+
+ssize_t
+bz2_reader_read(pgp_bz2_reader_t *bz, void *buf, size_t len)
+{
+    uint8_t *bytes = (uint8_t *) buf;
+    size_t   read = 0;
+
+    if (bz->error) {
+        return -1;
+    }
+
+    while (read < len) {
+        if (bz->blockidx < bz->blockc) {
+            pgp_bz2_block_t *blk = &bz->blocks[bz->blockidx];
+            size_t           part = blk->plainlen - bz->blockpos;
+
+            if (part > len - read) {
+                part = len - read;
+            }
+            memcpy(bytes + read, blk->plain + bz->blockpos, part);
+            bz->blockpos += part;
+            read += part;
+            if (bz->blockpos == blk->plainlen) {
+                bz->blockidx++;
+                bz->blockpos = 0;
+            }
+            continue;
+        }
+        if (bz->done) {
+            break;
+        }
+        if (bz2_reader_fill(bz)) {
+            bz->error = true;
+            return -1;
+        }
+    }
+    return read;
+}
+
+void
+bz2_reader_destroy(pgp_bz2_reader_t *bz)
+{
+    if (!bz) {
+        return;
+    }
+    bz2_free_blocks(bz->blocks, bz->threads);
+    free(bz->starts);
+    free(bz->in);
+    free(bz);
+}
+#endif
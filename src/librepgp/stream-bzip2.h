@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018, [Ribose Inc](https://www.ribose.com).
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1.  Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ * 2.  Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef STREAM_BZIP2_H_
+#define STREAM_BZIP2_H_
+
+#include <stdint.h>
+#include <rnp/rnp_def.h>
+#include "stream-common.h"
+
+/* Multi-threaded BZip2 compression and decompression.
+ * BZip2 stream is a sequence of independently compressed blocks, each starting with the
+ * 48-bit magic and storing CRC of the block's data, so blocks may be processed in parallel.
+ * Blocks are not byte-aligned, so they are located by the bit-level search for the magic. */
+
+typedef struct pgp_bz2_writer_t pgp_bz2_writer_t;
+typedef struct pgp_bz2_reader_t pgp_bz2_reader_t;
+
+/** @brief Create the writer which compresses data to the bzip2 stream, written to writedst.
+ *         Stream header is written immediately.
+ *  @param bz pointer to the created writer will be stored here
+ *  @param writedst destination for the compressed stream
+ *  @param level compression level, 1..9
+ *  @param threads number of blocks, compressed at once
+ *  @return RNP_SUCCESS or error code. On error writer should still be destroyed.
+ */
+rnp_result_t bz2_writer_create(pgp_bz2_writer_t **bz,
+                               pgp_dest_t *       writedst,
+                               int                level,
+                               size_t             threads);
+
+/** @brief Add data to the stream. Data is compressed once there are threads full blocks.
+ *  @return RNP_SUCCESS or error code
+ */
+rnp_result_t bz2_writer_write(pgp_bz2_writer_t *bz, const void *buf, size_t len);
+
+/** @brief Compress the remaining data and write the end of stream marker.
+ *  @return RNP_SUCCESS or error code
+ */
+rnp_result_t bz2_writer_finish(pgp_bz2_writer_t *bz);
+
+void bz2_writer_destroy(pgp_bz2_writer_t *bz);
+
+/** @brief Create the reader which decompresses bzip2 stream from the readsrc. Reading stops at
+ *         the end of the first stream, like in BZ2_bzDecompress.
+ *  @param bz pointer to the created reader will be stored here
+ *  @param readsrc source of the compressed stream
+ *  @param threads number of blocks, decompressed at once
+ *  @return RNP_SUCCESS or error code. On error reader should still be destroyed.
+ */
+rnp_result_t bz2_reader_create(pgp_bz2_reader_t **bz, pgp_source_t *readsrc, size_t threads);
+
+/** @brief Read decompressed data.
+ *  @return number of bytes read, 0 at the end of the stream, or -1 on error
+ */
+ssize_t bz2_reader_read(pgp_bz2_reader_t *bz, void *buf, size_t len);
+
+void bz2_reader_destroy(pgp_bz2_reader_t *bz);
+
+#endif
@@ -40,6 +40,7 @@
 #endif
 #include <rnp/rnp_def.h>
 #include "stream-common.h"
+#include "stream-def.h"
 #include "defs.h"
 #include "types.h"
 #include "utils.h"
@@ -484,6 +485,107 @@ init_mem_src(pgp_source_t *src, const void *mem, size_t len, bool free)
     return RNP_SUCCESS;
 }
 
+size_t
+text_to_crlf(const uint8_t *buf, size_t len, uint8_t *out, bool *cr)
+{
+    const uint8_t *end = buf + len;
+    const uint8_t *lf;
+    uint8_t *      outp = out;
+    bool           prevcr = *cr;
+
+    if (!len) {
+        return 0;
+    }
+
+    /* copy runs of data between LFs, inserting CR before LF if it's not there */
+    while ((lf = (const uint8_t *) memchr(buf, CH_LF, end - buf))) {
+        memcpy(outp, buf, lf - buf);
+        outp += lf - buf;
+        if (lf > buf) {
+            prevcr = *(lf - 1) == CH_CR;
+        }
+        if (!prevcr) {
+            *outp++ = CH_CR;
+        }
+        *outp++ = CH_LF;
+        prevcr = false;
+        buf = lf + 1;
+    }
+    memcpy(outp, buf, end - buf);
+    outp += end - buf;
+    *cr = (end > buf) ? *(end - 1) == CH_CR : prevcr;
+    return outp - out;
+}
+
+typedef struct pgp_source_text_param_t {
+    pgp_source_t *readsrc;                      /* source to read the text from */
+    bool          cr;                           /* last read byte was CR */
+    uint8_t       out[PGP_INPUT_CACHE_SIZE];    /* converted data */
+    size_t        outlen;                       /* number of bytes in out */
+    size_t        outpos;                       /* first unread byte in out */
+    uint8_t       in[PGP_INPUT_CACHE_SIZE / 2]; /* buffer for the source text */
+} pgp_source_text_param_t;
+
+static ssize_t
+text_src_read(pgp_source_t *src, void *buf, size_t len)
+{
+    pgp_source_text_param_t *param = (pgp_source_text_param_t *) src->param;
+    size_t                   left = len;
+    ssize_t                  read;
+
+    if (!param) {
+        return -1;
+    }
+
+    while (left) {
+        if (param->outpos < param->outlen) {
+            read = param->outlen - param->outpos;
+            read = (size_t) read > left ? left : read;
+            memcpy(buf, param->out + param->outpos, read);
+            param->outpos += read;
+            buf = (uint8_t *) buf + read;
+            left -= read;
+            continue;
+        }
+
+        read = src_read(param->readsrc, param->in, sizeof(param->in));
+        if (read < 0) {
+            return -1;
+        }
+        if (!read) {
+            break;
+        }
+        param->outlen = text_to_crlf(param->in, read, param->out, &param->cr);
+        param->outpos = 0;
+    }
+
+    return len - left;
+}
+
+static void
+text_src_close(pgp_source_t *src)
+{
+    free(src->param);
+    src->param = NULL;
+}
+
+rnp_result_t
+init_text_src(pgp_source_t *src, pgp_source_t *readsrc)
+{
+    pgp_source_text_param_t *param;
+
+    if (!init_src_common(src, sizeof(*param))) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+
+    param = (pgp_source_text_param_t *) src->param;
+    param->readsrc = readsrc;
+    src->read = text_src_read;
+    src->close = text_src_close;
+    src->type = PGP_STREAM_TEXT;
+    return RNP_SUCCESS;
+}
+
 rnp_result_t
 read_mem_src(pgp_source_t *src, pgp_source_t *readsrc)
 {
@@ -766,6 +868,11 @@ mem_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
 
     /* checking whether we need to realloc */
     if (dst->writeb + len > param->allocated) {
+        /* caller-provided buffer cannot be grown */
+        if (!param->free) {
+            RNP_LOG("output buffer is too small");
+            return RNP_ERROR_SHORT_BUFFER;
+        }
         if ((param->maxalloc > 0) && (dst->writeb + len > param->maxalloc)) {
             RNP_LOG("attempt to alloc more then allowed");
             return RNP_ERROR_OUT_OF_MEMORY;
@@ -879,6 +986,67 @@ mem_dest_own_memory(pgp_dest_t *dst)
     return res;
 }
 
+rnp_result_t
+mem_dest_reserve(pgp_dest_t *dst, size_t size)
+{
+    if (dst->type != PGP_STREAM_MEMORY) {
+        RNP_LOG("wrong function call");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    pgp_dest_mem_param_t *param = (pgp_dest_mem_param_t *) dst->param;
+
+    if (!param) {
+        RNP_LOG("null param");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    /* caller-provided buffer is already allocated */
+    if (!param->free || (size <= param->allocated)) {
+        return RNP_SUCCESS;
+    }
+    if (size > UINT_MAX) {
+        size = UINT_MAX;
+    }
+    if ((param->maxalloc > 0) && (size > param->maxalloc)) {
+        size = param->maxalloc;
+    }
+
+    void *newalloc = realloc(param->memory, size);
+    if (!newalloc) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    param->memory = newalloc;
+    param->allocated = size;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+mem_dest_release_memory(pgp_dest_t *dst, void **buf, size_t *len)
+{
+    if (dst->type != PGP_STREAM_MEMORY) {
+        RNP_LOG("wrong function call");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    pgp_dest_mem_param_t *param = (pgp_dest_mem_param_t *) dst->param;
+
+    if (!param || !param->free) {
+        RNP_LOG("memory is not owned by the dest");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    dst_flush(dst);
+
+    /* buffer is not allocated yet if nothing was written or reserved */
+    *buf = param->memory;
+    *len = dst->writeb;
+    /* dest starts over with the empty buffer */
+    param->memory = NULL;
+    param->allocated = 0;
+    dst->writeb = 0;
+    return RNP_SUCCESS;
+}
+
 static rnp_result_t
 null_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
 {
@@ -48,7 +48,8 @@ typedef enum {
     PGP_STREAM_ENCRYPTED,
     PGP_STREAM_SIGNED,
     PGP_STREAM_ARMORED,
-    PGP_STREAM_CLEARTEXT
+    PGP_STREAM_CLEARTEXT,
+    PGP_STREAM_TEXT
 } pgp_stream_type_t;
 
 typedef struct pgp_source_t pgp_source_t;
@@ -197,6 +198,23 @@ rnp_result_t read_mem_src(pgp_source_t *src, pgp_source_t *readsrc);
  **/
 const void *mem_src_get_memory(pgp_source_t *src);
 
+/** @brief init source which converts line endings of the text read from readsrc to the
+ *         canonical CRLF form. Readsrc is not closed on the source close.
+ *  @param src pre-allocated source structure
+ *  @param readsrc opened source with the text data
+ *  @return RNP_SUCCESS or error code
+ **/
+rnp_result_t init_text_src(pgp_source_t *src, pgp_source_t *readsrc);
+
+/** @brief convert line endings of the text chunk to the canonical CRLF form
+ *  @param buf text data
+ *  @param len number of bytes in buf
+ *  @param out output buffer, must have space for 2 * len bytes
+ *  @param cr whether the previous chunk ended with CR. Will be updated for the next chunk
+ *  @return number of bytes written to out
+ **/
+size_t text_to_crlf(const uint8_t *buf, size_t len, uint8_t *out, bool *cr);
+
 typedef struct pgp_dest_t {
     pgp_dest_write_func_t * write;
     pgp_dest_finish_func_t *finish;
@@ -299,6 +317,24 @@ void *mem_dest_get_memory(pgp_dest_t *dst);
  **/
 void *mem_dest_own_memory(pgp_dest_t *dst);
 
+/** @brief preallocate the memory dest's buffer, so subsequent writes up to size bytes will
+ *         not need to realloc. Does nothing for the caller-provided buffer
+ *  @param dst pre-allocated and initialized memory dest
+ *  @param size number of bytes to allocate, limited by the dest's maximum allocation
+ *  @return RNP_SUCCESS or error code
+ **/
+rnp_result_t mem_dest_reserve(pgp_dest_t *dst, size_t size);
+
+/** @brief hand over the memory dest's buffer to the caller without copying. Dest stays
+ *         usable and continues with the empty buffer.
+ *  @param dst pre-allocated and initialized memory dest, not using the caller's buffer
+ *  @param buf pointer to the memory area, which must be freed by the caller, will be stored
+ *         here. It is NULL if nothing was written or reserved.
+ *  @param len number of bytes written to the buffer will be stored here
+ *  @return RNP_SUCCESS or error code if dest doesn't own the memory
+ **/
+rnp_result_t mem_dest_release_memory(pgp_dest_t *dst, void **buf, size_t *len);
+
 /** @brief init null destination which silently discards all the output
  *  @param dst pre-allocated dest structure
  *  @return RNP_SUCCESS or error code
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2018, [Ribose Inc](https://www.ribose.com).
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1.  Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ * 2.  Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "config.h"
+#include <stdlib.h>
+#include <limits.h>
+#ifdef HAVE_ZLIB_NG_H
+#include <zlib-ng.h>
+#else
+#include <zlib.h>
+#endif
+#include "stream-deflate.h"
+#include "utils.h"
+
+#ifdef HAVE_ZLIB_NG_H
+typedef zng_stream pgp_zstate_t;
+#define PGP_ZAPI(func) zng_##func
+#else
+typedef z_stream pgp_zstate_t;
+#define PGP_ZAPI(func) func
+#endif
+
+/* both zlib and zlib-ng use 32-bit counters in the stream */
+#define PGP_ZMAX_CHUNK ((size_t) UINT_MAX)
+
+static pgp_zstate_t *
+pgp_zstream_alloc(pgp_zstream_t *z, bool deflate)
+{
+    pgp_zstate_t *st = (pgp_zstate_t *) calloc(1, sizeof(*st));
+    if (!st) {
+        RNP_LOG("allocation failed");
+        return NULL;
+    }
+    z->handle = st;
+    z->deflate = deflate;
+    return st;
+}
+
+static pgp_zret_t
+pgp_zstream_process(pgp_zstream_t *z, int flush)
+{
+    pgp_zstate_t *st = (pgp_zstate_t *) z->handle;
+    size_t        inlen = z->avail_in > PGP_ZMAX_CHUNK ? PGP_ZMAX_CHUNK : z->avail_in;
+    size_t        outlen = z->avail_out > PGP_ZMAX_CHUNK ? PGP_ZMAX_CHUNK : z->avail_out;
+    int           ret;
+
+    st->next_in = (uint8_t *) z->next_in;
+    st->avail_in = inlen;
+    st->next_out = z->next_out;
+    st->avail_out = outlen;
+    ret = z->deflate ? PGP_ZAPI(deflate)(st, flush) : PGP_ZAPI(inflate)(st, flush);
+    z->next_in += inlen - st->avail_in;
+    z->avail_in -= inlen - st->avail_in;
+    z->next_out += outlen - st->avail_out;
+    z->avail_out -= outlen - st->avail_out;
+
+    switch (ret) {
+    case Z_OK:
+    case Z_BUF_ERROR:
+        return PGP_ZRET_OK;
+    case Z_STREAM_END:
+        return PGP_ZRET_END;
+    default:
+        RNP_LOG("%s error %d", z->deflate ? "deflate" : "inflate", ret);
+        return PGP_ZRET_ERROR;
+    }
+}
+
+bool
+pgp_deflate_init(pgp_zstream_t *z, int level, bool zlib)
+{
+    pgp_zstate_t *st = pgp_zstream_alloc(z, true);
+    int           ret;
+
+    if (!st) {
+        return false;
+    }
+    ret = PGP_ZAPI(deflateInit2)(
+      st, level, Z_DEFLATED, zlib ? 15 : -15, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+        RNP_LOG("failed to init zlib, error %d", ret);
+        free(st);
+        z->handle = NULL;
+        return false;
+    }
+    return true;
+}
+
+pgp_zret_t
+pgp_deflate(pgp_zstream_t *z, pgp_zflush_t flush)
+{
+    switch (flush) {
+    case PGP_ZFLUSH_SYNC:
+        return pgp_zstream_process(z, Z_SYNC_FLUSH);
+    case PGP_ZFLUSH_FINISH:
+        return pgp_zstream_process(z, Z_FINISH);
+    default:
+        return pgp_zstream_process(z, Z_NO_FLUSH);
+    }
+}
+
+bool
+pgp_deflate_reset(pgp_zstream_t *z)
+{
+    return PGP_ZAPI(deflateReset)((pgp_zstate_t *) z->handle) == Z_OK;
+}
+
+bool
+pgp_deflate_set_dictionary(pgp_zstream_t *z, const uint8_t *dict, size_t len)
+{
+    return PGP_ZAPI(deflateSetDictionary)((pgp_zstate_t *) z->handle, dict, len) == Z_OK;
+}
+
+size_t
+pgp_deflate_bound(pgp_zstream_t *z, size_t len)
+{
+    return PGP_ZAPI(deflateBound)((pgp_zstate_t *) z->handle, len);
+}
+
+bool
+pgp_inflate_init(pgp_zstream_t *z, bool zlib)
+{
+    pgp_zstate_t *st = pgp_zstream_alloc(z, false);
+    int           ret;
+
+    if (!st) {
+        return false;
+    }
+    ret = PGP_ZAPI(inflateInit2)(st, zlib ? 15 : -15);
+    if (ret != Z_OK) {
+        RNP_LOG("failed to init zlib, error %d", ret);
+        free(st);
+        z->handle = NULL;
+        return false;
+    }
+    return true;
+}
+
+pgp_zret_t
+pgp_inflate(pgp_zstream_t *z)
+{
+    return pgp_zstream_process(z, Z_SYNC_FLUSH);
+}
+
+void
+pgp_zstream_destroy(pgp_zstream_t *z)
+{
+    pgp_zstate_t *st = (pgp_zstate_t *) z->handle;
+
+    if (!st) {
+        return;
+    }
+    if (z->deflate) {
+        PGP_ZAPI(deflateEnd)(st);
+    } else {
+        PGP_ZAPI(inflateEnd)(st);
+    }
+    free(st);
+    z->handle = NULL;
+}
+
+uint32_t
+pgp_adler32(uint32_t adler, const uint8_t *buf, size_t len)
+{
+    while (len) {
+        size_t part = len > PGP_ZMAX_CHUNK ? PGP_ZMAX_CHUNK : len;
+        adler = PGP_ZAPI(adler32)(adler, buf, part);
+        buf += part;
+        len -= part;
+    }
+    return adler;
+}
+
+uint32_t
+pgp_adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2)
+{
+    return PGP_ZAPI(adler32_combine)(adler1, adler2, len2);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2018, [Ribose Inc](https://www.ribose.com).
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1.  Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *
+ * 2.  Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef STREAM_DEFLATE_H_
+#define STREAM_DEFLATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Deflate backend, used for the ZIP and ZLIB compression algorithms. This is zlib by default,
+ * or the native API of zlib-ng if rnp is built with ENABLE_ZLIB_NG. Fields and return codes
+ * follow zlib semantics, however sizes are not limited to 32 bits. */
+
+typedef enum pgp_zflush_t {
+    PGP_ZFLUSH_NONE = 0, /* accumulate data to get better compression */
+    PGP_ZFLUSH_SYNC,     /* output all pending data, aligned to the byte boundary */
+    PGP_ZFLUSH_FINISH    /* finish the stream */
+} pgp_zflush_t;
+
+typedef enum pgp_zret_t {
+    PGP_ZRET_OK = 0, /* progress was made, or more input or output space is needed */
+    PGP_ZRET_END,    /* end of the stream was reached */
+    PGP_ZRET_ERROR   /* stream or data error, details are logged */
+} pgp_zret_t;
+
+typedef struct pgp_zstream_t {
+    const uint8_t *next_in;   /* next input byte */
+    size_t         avail_in;  /* number of bytes available at next_in */
+    uint8_t *      next_out;  /* next output byte will go here */
+    size_t         avail_out; /* remaining free space at next_out */
+    void *         handle;    /* backend's stream, NULL if not initialized */
+    bool           deflate;   /* compression or decompression stream */
+} pgp_zstream_t;
+
+/** @brief Initialize stream for compression. Stream must be zeroed before the call.
+ *  @param z stream, on success should be released with pgp_zstream_destroy
+ *  @param level compression level, 0..9 or -1 for the default one
+ *  @param zlib true to write zlib (RFC 1950) stream, or false for the raw deflate
+ *  @return true on success or false otherwise
+ */
+bool pgp_deflate_init(pgp_zstream_t *z, int level, bool zlib);
+
+pgp_zret_t pgp_deflate(pgp_zstream_t *z, pgp_zflush_t flush);
+
+/** @brief Start the new stream, keeping the parameters and allocated memory */
+bool pgp_deflate_reset(pgp_zstream_t *z);
+
+/** @brief Set the preset dictionary, must be called right after init or reset */
+bool pgp_deflate_set_dictionary(pgp_zstream_t *z, const uint8_t *dict, size_t len);
+
+/** @brief Upper bound of the compressed size for len bytes of input */
+size_t pgp_deflate_bound(pgp_zstream_t *z, size_t len);
+
+/** @brief Initialize stream for decompression. Stream must be zeroed before the call.
+ *  @param z stream, on success should be released with pgp_zstream_destroy
+ *  @param zlib true to read zlib (RFC 1950) stream, or false for the raw deflate
+ *  @return true on success or false otherwise
+ */
+bool pgp_inflate_init(pgp_zstream_t *z, bool zlib);
+
+/** @brief Decompress as much data as possible, flushing the output */
+pgp_zret_t pgp_inflate(pgp_zstream_t *z);
+
+/** @brief Release the stream. Safe to call for the zeroed stream. */
+void pgp_zstream_destroy(pgp_zstream_t *z);
+
+/** @brief Update adler32 checksum with data. Checksum of the empty data is 1. */
+uint32_t pgp_adler32(uint32_t adler, const uint8_t *buf, size_t len);
+
+/** @brief Get adler32 of the concatenated data from checksums of its parts */
+uint32_t pgp_adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2);
+
+#endif
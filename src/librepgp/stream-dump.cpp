@@ -981,7 +981,7 @@ stream_dump_compressed(rnp_dump_ctx_t *ctx, pgp_source_t *src, pgp_dest_t *dst)
     uint8_t      zalg;
     rnp_result_t ret;
 
-    if ((ret = init_compressed_src(&zsrc, src))) {
+    if ((ret = init_compressed_src(&zsrc, src, false))) {
         return ret;
     }
 
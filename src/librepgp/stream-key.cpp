@@ -957,6 +957,12 @@ parse_secret_key_mpis(pgp_key_pkt_t *key, const uint8_t *mpis, size_t len)
 
 rnp_result_t
 decrypt_secret_key(pgp_key_pkt_t *key, const char *password)
+{
+    return decrypt_secret_key_cached(key, password, NULL);
+}
+
+rnp_result_t
+decrypt_secret_key_cached(pgp_key_pkt_t *key, const char *password, pgp_s2k_cache_t *cache)
 {
     size_t       keysize;
     uint8_t      keybuf[PGP_MAX_KEY_SIZE];
@@ -986,7 +992,9 @@ decrypt_secret_key(pgp_key_pkt_t *key, const char *password)
     }
 
     keysize = pgp_key_size(key->sec_protection.symm_alg);
-    if (!keysize || !pgp_s2k_derive_key(&key->sec_protection.s2k, password, keybuf, keysize)) {
+    if (!keysize ||
+        !pgp_s2k_derive_key_cached(
+          cache, &key->sec_protection.s2k, password, keybuf, keysize)) {
         RNP_LOG("failed to derive key");
         return RNP_ERROR_BAD_PARAMETERS;
     }
@@ -129,6 +129,13 @@ rnp_result_t write_pgp_keys(pgp_key_sequence_t *keys, pgp_dest_t *dst, bool armo
 
 rnp_result_t decrypt_secret_key(pgp_key_pkt_t *key, const char *password);
 
+/** @brief same as decrypt_secret_key(), but looks up the derived key in the S2K cache first.
+ *  @param cache S2K cache, may be NULL
+ */
+rnp_result_t decrypt_secret_key_cached(pgp_key_pkt_t *  key,
+                                       const char *     password,
+                                       pgp_s2k_cache_t *cache);
+
 rnp_result_t encrypt_secret_key(pgp_key_pkt_t *key, const char *password, rng_t *rng);
 
 void forget_secret_key_fields(pgp_key_material_t *key);
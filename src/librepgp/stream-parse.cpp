@@ -44,11 +44,11 @@
 #include "fingerprint.h"
 #include "pgp-key.h"
 #include "list.h"
+#include "parallel.h"
+#include "stream-bzip2.h"
+#include "stream-deflate.h"
 #include "utils.h"
 
-#ifdef HAVE_ZLIB_H
-#include <zlib.h>
-#endif
 #ifdef HAVE_BZLIB_H
 #include <bzlib.h>
 #endif
@@ -67,8 +67,18 @@ typedef struct pgp_processing_ctx_t {
     pgp_message_t       msg_type;
     pgp_dest_t          output;
     list                sources;
+    list                seckeys; /* keyid -> secret key map, list of pgp_dec_key_t */
+    bool                allkeys; /* all of the secret keys were loaded to seckeys */
 } pgp_processing_ctx_t;
 
+/* secret key, used to decrypt the pk-encrypted session keys */
+typedef struct pgp_dec_key_t {
+    uint8_t        keyid[PGP_KEY_ID_SIZE]; /* key id used for the lookup */
+    pgp_key_t *    key;                    /* secret key, or NULL if it was not found */
+    pgp_key_pkt_t *decrypted;              /* decrypted secret key packet */
+    bool           tried;                  /* whether key decryption was already attempted */
+} pgp_dec_key_t;
+
 /* common fields for encrypted, compressed and literal data */
 typedef struct pgp_source_packet_param_t {
     pgp_source_t *readsrc;                  /* source to read from, could be partial*/
@@ -97,6 +107,7 @@ typedef struct pgp_source_encrypted_param_t {
     size_t                    cachelen;                  /* number of bytes in the cache */
     size_t                    cachepos;    /* index of first unread byte in the cache */
     pgp_aead_params_t         aead_params; /* AEAD encryption parameters */
+    pgp_sesskey_t             sesskey;     /* session key, used to decrypt the data */
 } pgp_source_encrypted_param_t;
 
 typedef struct pgp_source_signed_param_t {
@@ -110,9 +121,15 @@ typedef struct pgp_source_signed_param_t {
     uint8_t               out[CT_BUF_LEN]; /* cleartext output cache for easier parsing */
     size_t                outlen;          /* total bytes in out */
     size_t                outpos;          /* offset of first available byte in out */
+    uint8_t               clr_hash[CT_BUF_LEN]; /* cleartext data, waiting to be hashed */
+    size_t                clr_hashlen;          /* total bytes in clr_hash */
     list                  onepasses;       /* list of one-pass singatures */
     list                  sigs;            /* list of signatures */
     list                  hashes;          /* hash contexts */
+    list                  txt_hashes;      /* hash contexts for the text signatures */
+    bool                  txt_cr;          /* last hashed byte of the text was CR */
+    pgp_hash_workers_t *  hash_workers;    /* parallel workers for hashes, if any */
+    pgp_hash_workers_t *  txt_workers;     /* parallel workers for txt_hashes, if any */
     list                  siginfos;        /* signature validation info */
 } pgp_source_signed_param_t;
 
@@ -120,13 +137,15 @@ typedef struct pgp_source_compressed_param_t {
     pgp_source_packet_param_t pkt; /* underlying packet-related params */
     pgp_compression_type_t    alg;
     union {
-        z_stream  z;
-        bz_stream bz;
+        pgp_zstream_t z;
+        bz_stream     bz;
     };
     uint8_t in[PGP_INPUT_CACHE_SIZE / 2];
     size_t  inpos;
     size_t  inlen;
     bool    zend;
+    /* parallel bzip2 reader, NULL if it is not used */
+    pgp_bz2_reader_t *bzreader;
 } pgp_source_compressed_param_t;
 
 typedef struct pgp_source_literal_param_t {
@@ -306,7 +325,7 @@ compressed_src_read(pgp_source_t *src, void *buf, size_t len)
     }
 
     if ((param->alg == PGP_C_ZIP) || (param->alg == PGP_C_ZLIB)) {
-        param->z.next_out = (Bytef *) buf;
+        param->z.next_out = (uint8_t *) buf;
         param->z.avail_out = len;
         param->z.next_in = param->in + param->inpos;
         param->z.avail_in = param->inlen - param->inpos;
@@ -323,16 +342,15 @@ compressed_src_read(pgp_source_t *src, void *buf, size_t len)
                 param->inlen = read;
                 param->inpos = 0;
             }
-            ret = inflate(&param->z, Z_SYNC_FLUSH);
-            if (ret == Z_STREAM_END) {
+            ret = pgp_inflate(&param->z);
+            if (ret == PGP_ZRET_END) {
                 param->zend = true;
                 if (param->z.avail_in > 0) {
                     RNP_LOG("data beyond the end of z stream");
                 }
                 break;
             }
-            if (ret != Z_OK) {
-                RNP_LOG("inflate error %d", ret);
+            if (ret != PGP_ZRET_OK) {
                 return -1;
             }
             if (!param->z.avail_in && src_eof(param->pkt.readsrc)) {
@@ -345,6 +363,11 @@ compressed_src_read(pgp_source_t *src, void *buf, size_t len)
         return len - param->z.avail_out;
     }
 #ifdef HAVE_BZLIB_H
+    if (param->bzreader) {
+        read = bz2_reader_read(param->bzreader, buf, len);
+        param->zend = !read;
+        return read;
+    }
     if (param->alg == PGP_C_BZIP2) {
         param->bz.next_out = (char *) buf;
         param->bz.avail_out = len;
@@ -403,12 +426,14 @@ compressed_src_close(pgp_source_t *src)
     }
 
 #ifdef HAVE_BZLIB_H
-    if (param->alg == PGP_C_BZIP2) {
+    if (param->bzreader) {
+        bz2_reader_destroy(param->bzreader);
+    } else if (param->alg == PGP_C_BZIP2) {
         BZ2_bzDecompressEnd(&param->bz);
     }
 #endif
     if ((param->alg == PGP_C_ZIP) || (param->alg == PGP_C_ZLIB)) {
-        inflateEnd(&param->z);
+        pgp_zstream_destroy(&param->z);
     }
 
     free(src->param);
@@ -735,7 +760,12 @@ signed_validate_signature(pgp_source_signed_param_t *param, pgp_signature_info_t
     pgp_hash_t shash = {};
 
     /* Get the hash context and clone it */
-    if (!pgp_hash_copy(&shash, pgp_hash_list_get(param->hashes, sinfo->sig->halg))) {
+    /* text signatures of the non-cleartext data are calculated over the canonical text */
+    bool text = (sinfo->sig->type == PGP_SIG_TEXT) && !param->cleartext;
+    list hashes = text ? param->txt_hashes : param->hashes;
+
+    pgp_hash_workers_wait(text ? param->txt_workers : param->hash_workers);
+    if (!pgp_hash_copy(&shash, pgp_hash_list_get(hashes, sinfo->sig->halg))) {
         RNP_LOG("failed to clone hash context");
         sinfo->valid = false;
         return;
@@ -749,7 +779,30 @@ static void
 signed_src_update(pgp_source_t *src, const void *buf, size_t len)
 {
     pgp_source_signed_param_t *param = (pgp_source_signed_param_t *) src->param;
-    pgp_hash_list_update(param->hashes, buf, len);
+    uint8_t                    txt[CT_BUF_LEN * 2];
+    const uint8_t *            ptr = (const uint8_t *) buf;
+    size_t                     chunk;
+
+    if (param->hash_workers) {
+        pgp_hash_workers_update(param->hash_workers, buf, len);
+    } else {
+        pgp_hash_list_update(param->hashes, buf, len);
+    }
+    if (!list_length(param->txt_hashes)) {
+        return;
+    }
+    /* line endings of the text data are hashed as CRLF */
+    while (len) {
+        chunk = len > CT_BUF_LEN ? CT_BUF_LEN : len;
+        size_t txtlen = text_to_crlf(ptr, chunk, txt, &param->txt_cr);
+        if (param->txt_workers) {
+            pgp_hash_workers_update(param->txt_workers, txt, txtlen);
+        } else {
+            pgp_hash_list_update(param->txt_hashes, txt, txtlen);
+        }
+        ptr += chunk;
+        len -= chunk;
+    }
 }
 
 static ssize_t
@@ -774,7 +827,10 @@ signed_src_close(pgp_source_t *src)
     }
 
     list_destroy(&param->onepasses);
+    pgp_hash_workers_stop(param->hash_workers);
+    pgp_hash_workers_stop(param->txt_workers);
     pgp_hash_list_free(&param->hashes);
+    pgp_hash_list_free(&param->txt_hashes);
     list_destroy(&param->siginfos);
     for (list_item *sig = list_front(param->sigs); sig; sig = list_next(sig)) {
         free_signature((pgp_signature_t *) sig);
@@ -912,6 +968,7 @@ signed_src_finish(pgp_source_t *src)
     }
 
     /* validating signatures */
+    memset(&keyctx, 0, sizeof(keyctx));
     keyctx.op = PGP_OP_VERIFY;
     keyctx.secret = false;
     keyctx.search.type = PGP_KEY_SEARCH_KEYID;
@@ -1019,6 +1076,35 @@ cleartext_parse_headers(pgp_source_t *src)
     return src_skip_eol(param->readsrc);
 }
 
+/* hash cleartext data in batches instead of doing it per each line */
+static void
+cleartext_hash_update(pgp_source_t *src, const void *buf, size_t len)
+{
+    pgp_source_signed_param_t *param = (pgp_source_signed_param_t *) src->param;
+
+    if (param->clr_hashlen + len > sizeof(param->clr_hash)) {
+        signed_src_update(src, param->clr_hash, param->clr_hashlen);
+        param->clr_hashlen = 0;
+    }
+    if (len > sizeof(param->clr_hash)) {
+        signed_src_update(src, buf, len);
+        return;
+    }
+    memcpy(param->clr_hash + param->clr_hashlen, buf, len);
+    param->clr_hashlen += len;
+}
+
+static void
+cleartext_hash_flush(pgp_source_t *src)
+{
+    pgp_source_signed_param_t *param = (pgp_source_signed_param_t *) src->param;
+
+    if (param->clr_hashlen) {
+        signed_src_update(src, param->clr_hash, param->clr_hashlen);
+        param->clr_hashlen = 0;
+    }
+}
+
 static void
 cleartext_process_line(pgp_source_t *src, const uint8_t *buf, size_t len, bool eol)
 {
@@ -1041,7 +1127,7 @@ cleartext_process_line(pgp_source_t *src, const uint8_t *buf, size_t len, bool e
     /* hash eol if it is not the first line and we are not in the middle */
     if (!param->clr_fline && !param->clr_mline) {
         /* we hash \r\n after the previous line to not hash the last eol before the sig */
-        signed_src_update(src, ST_CRLF, 2);
+        cleartext_hash_update(src, ST_CRLF, 2);
     }
 
     if (!len) {
@@ -1062,7 +1148,7 @@ cleartext_process_line(pgp_source_t *src, const uint8_t *buf, size_t len, bool e
     if ((len = bufen + 1 - buf)) {
         memcpy(param->out + param->outlen, buf, len);
         param->outlen += len;
-        signed_src_update(src, buf, len);
+        cleartext_hash_update(src, buf, len);
     }
 }
 
@@ -1070,7 +1156,7 @@ static ssize_t
 cleartext_src_read(pgp_source_t *src, void *buf, size_t len)
 {
     uint8_t                    srcb[CT_BUF_LEN];
-    uint8_t *                  cur, *en, *bg;
+    uint8_t *                  cur, *en, *bg, *eolbg;
     ssize_t                    read = 0;
     ssize_t                    origlen = len;
     pgp_source_signed_param_t *param = (pgp_source_signed_param_t *) src->param;
@@ -1107,24 +1193,23 @@ cleartext_src_read(pgp_source_t *src, void *buf, size_t len)
         }
 
         /* processing data line by line, eol could be \n or \r\n */
-        for (cur = srcb, bg = srcb, en = cur + read; cur < en; cur++) {
-            if ((*cur == CH_LF) ||
-                ((*cur == CH_CR) && (cur + 1 < en) && (*(cur + 1) == CH_LF))) {
-                cleartext_process_line(src, bg, cur - bg, true);
-                /* processing eol */
-                if (param->clr_eod) {
-                    break;
-                }
+        for (bg = srcb, en = srcb + read; bg < en; bg = cur + 1) {
+            if (!(cur = (uint8_t *) memchr(bg, CH_LF, en - bg))) {
+                break;
+            }
+            eolbg = (cur > bg) && (*(cur - 1) == CH_CR) ? cur - 1 : cur;
+            cleartext_process_line(src, bg, eolbg - bg, true);
+            if (param->clr_eod) {
+                break;
+            }
 
-                /* processing eol */
-                param->clr_fline = false;
-                param->clr_mline = false;
-                if (*cur == CH_CR) {
-                    param->out[param->outlen++] = *cur++;
-                }
-                param->out[param->outlen++] = *cur;
-                bg = cur + 1;
+            /* processing eol */
+            param->clr_fline = false;
+            param->clr_mline = false;
+            if (eolbg < cur) {
+                param->out[param->outlen++] = CH_CR;
             }
+            param->out[param->outlen++] = CH_LF;
         }
 
         /* if line is larger then 4k then just dump it out */
@@ -1157,6 +1242,7 @@ cleartext_src_read(pgp_source_t *src, void *buf, size_t len)
         }
     } while (1);
 
+    cleartext_hash_flush(src);
     return origlen - len;
 }
 
@@ -1241,21 +1327,27 @@ encrypted_start_aead(pgp_source_encrypted_param_t *param, pgp_symm_alg_t alg, ui
     return encrypted_start_aead_chunk(param, 0, false);
 }
 
+/** @brief decrypt the session key, without touching the encrypted source, so it may be
+ *         called concurrently with the different rngs.
+ *  @param salg on success symmetric algorithm will be stored here
+ *  @param key on success session key will be stored here, must be PGP_MAX_KEY_SIZE bytes
+ *  @return true if session key was decrypted and checksum matched, false otherwise
+ **/
 static bool
-encrypted_try_key(pgp_source_encrypted_param_t *param,
-                  pgp_pk_sesskey_t *            sesskey,
-                  pgp_key_pkt_t *               seckey,
-                  rng_t *                       rng)
+encrypted_decrypt_sesskey(const pgp_pk_sesskey_t *sesskey,
+                          const pgp_key_pkt_t *   seckey,
+                          rng_t *                 rng,
+                          pgp_symm_alg_t *        salg,
+                          uint8_t *               key)
 {
-    uint8_t             decbuf[PGP_MPINT_SIZE];
-    rnp_result_t        err;
-    size_t              declen;
-    size_t              keylen;
-    pgp_fingerprint_t   fingerprint;
-    pgp_symm_alg_t      salg;
-    unsigned            checksum = 0;
-    bool                res = false;
-    pgp_key_material_t *keymaterial = &seckey->material;
+    uint8_t                   decbuf[PGP_MPINT_SIZE];
+    rnp_result_t              err;
+    size_t                    declen;
+    size_t                    keylen;
+    pgp_fingerprint_t         fingerprint;
+    unsigned                  checksum = 0;
+    bool                      res = false;
+    const pgp_key_material_t *keymaterial = &seckey->material;
 
     /* Decrypting session key value */
     switch (sesskey->alg) {
@@ -1304,16 +1396,16 @@ encrypted_try_key(pgp_source_encrypted_param_t *param,
     }
 
     /* Check algorithm and key length */
-    salg = (pgp_symm_alg_t) decbuf[0];
-    if (!pgp_is_sa_supported(salg)) {
-        RNP_LOG("unsupported symmetric algorithm %d", (int) salg);
-        return false;
+    *salg = (pgp_symm_alg_t) decbuf[0];
+    if (!pgp_is_sa_supported(*salg)) {
+        RNP_LOG("unsupported symmetric algorithm %d", (int) *salg);
+        goto finish;
     }
 
-    keylen = pgp_key_size(salg);
+    keylen = pgp_key_size(*salg);
     if (declen != keylen + 3) {
         RNP_LOG("invalid symmetric key length");
-        return false;
+        goto finish;
     }
 
     /* Validate checksum */
@@ -1326,18 +1418,55 @@ encrypted_try_key(pgp_source_encrypted_param_t *param,
         goto finish;
     }
 
+    memcpy(key, &decbuf[1], keylen);
+    res = true;
+finish:
+    pgp_forget(&checksum, sizeof(checksum));
+    pgp_forget(decbuf, sizeof(decbuf));
+
+    return res;
+}
+
+static bool
+encrypted_start_sesskey(pgp_source_encrypted_param_t *param, pgp_symm_alg_t salg, uint8_t *key)
+{
+    unsigned keylen = pgp_key_size(salg);
+
+    if (!keylen) {
+        return false;
+    }
+
     if (!param->aead) {
         /* Decrypt header */
-        res = encrypted_decrypt_cfb_header(param, salg, &decbuf[1]);
-    } else {
+        if (!encrypted_decrypt_cfb_header(param, salg, key)) {
+            return false;
+        }
+    } else if (!encrypted_start_aead(param, salg, key)) {
         /* Start AEAD decrypting, assuming we have correct key */
-        res = encrypted_start_aead(param, salg, &decbuf[1]);
+        return false;
     }
 
-finish:
-    pgp_forget(&checksum, sizeof(checksum));
-    pgp_forget(decbuf, sizeof(decbuf));
+    /* Remember the key so it may be reported via the on_sesskey handler */
+    param->sesskey.alg = salg;
+    param->sesskey.keylen = keylen;
+    memcpy(param->sesskey.key, key, keylen);
+    return true;
+}
 
+static bool
+encrypted_try_key(pgp_source_encrypted_param_t *param,
+                  pgp_pk_sesskey_t *            sesskey,
+                  pgp_key_pkt_t *               seckey,
+                  rng_t *                       rng)
+{
+    uint8_t        key[PGP_MAX_KEY_SIZE];
+    pgp_symm_alg_t salg;
+    bool           res = false;
+
+    if (encrypted_decrypt_sesskey(sesskey, seckey, rng, &salg, key)) {
+        res = encrypted_start_sesskey(param, salg, key);
+    }
+    pgp_forget(key, sizeof(key));
     return res;
 }
 
@@ -1359,125 +1488,260 @@ encrypted_sesk_set_ad(pgp_crypt_t *crypt, pgp_sk_sesskey_t *skey)
     pgp_cipher_aead_set_ad(crypt, ad_data, 4);
 }
 
+/** @brief Derive key from the password and decrypt the session key of the SKESK packet.
+ *         Doesn't touch the source params, so may be called from the worker threads.
+ *  @param salg on success symmetric algorithm of the session key will be stored here
+ *  @param key on success session key will be stored here, must be PGP_MAX_KEY_SIZE bytes
+ *  @return 1 if key was decrypted (however this doesn't yet mean that it is correct), 0 if
+ *          password is wrong, or -1 if SKESK packet is not supported
+ */
 static int
-encrypted_try_password(pgp_source_encrypted_param_t *param, const char *password)
+encrypted_sk_decrypt_key(const pgp_sk_sesskey_t *skey,
+                         const char *            password,
+                         pgp_s2k_cache_t *       cache,
+                         pgp_symm_alg_t *        salg,
+                         uint8_t *               key)
 {
     pgp_crypt_t    crypt;
     pgp_symm_alg_t alg;
     uint8_t        keybuf[PGP_MAX_KEY_SIZE + 1];
     uint8_t        nonce[PGP_AEAD_MAX_NONCE_LEN];
     size_t         keysize;
-    size_t         blsize;
-    bool           keyavail = false; /* tried password at least once */
     bool           decres;
-    int            res;
+    int            res = -1;
 
-    for (list_item *se = list_front(param->symencs); se; se = list_next(se)) {
-        /* deriving symmetric key from password */
-        pgp_sk_sesskey_t *skey = (pgp_sk_sesskey_t *) se;
-
-        keysize = pgp_key_size(skey->alg);
-        if (!keysize || !pgp_s2k_derive_key(&skey->s2k, password, keybuf, keysize)) {
-            continue;
-        }
-
-        if (rnp_get_debug(__FILE__)) {
-            hexdump(stderr, "derived key: ", keybuf, keysize);
-        }
-
-        if (skey->version == PGP_SKSK_V4) {
-            /* v4 symmetrically-encrypted session key */
-            if (skey->enckeylen > 0) {
-                /* decrypting session key */
-                if (!pgp_cipher_cfb_start(&crypt, skey->alg, keybuf, NULL)) {
-                    continue;
-                }
-
-                pgp_cipher_cfb_decrypt(&crypt, keybuf, skey->enckey, skey->enckeylen);
-                pgp_cipher_cfb_finish(&crypt);
+    /* deriving symmetric key from password */
+    keysize = pgp_key_size(skey->alg);
+    if (!keysize ||
+        !pgp_s2k_derive_key_cached(
+          cache, (pgp_s2k_t *) &skey->s2k, password, keybuf, keysize)) {
+        goto finish;
+    }
 
-                alg = (pgp_symm_alg_t) keybuf[0];
-                keysize = pgp_key_size(alg);
-                if (!keysize || (keysize + 1 != skey->enckeylen)) {
-                    continue;
-                }
-                memmove(keybuf, keybuf + 1, keysize);
-            } else {
-                alg = (pgp_symm_alg_t) skey->alg;
-            }
+    if (rnp_get_debug(__FILE__)) {
+        hexdump(stderr, "derived key: ", keybuf, keysize);
+    }
 
-            if (!(blsize = pgp_block_size(alg))) {
-                continue;
+    if (skey->version == PGP_SKSK_V4) {
+        /* v4 symmetrically-encrypted session key */
+        if (skey->enckeylen > 0) {
+            /* decrypting session key */
+            if (!pgp_cipher_cfb_start(&crypt, skey->alg, keybuf, NULL)) {
+                goto finish;
             }
 
-            keyavail = true;
-        } else if (skey->version == PGP_SKSK_V5) {
-            /* v5 AEAD-encrypted session key */
-            size_t taglen = pgp_cipher_aead_tag_len(skey->aalg);
-            size_t noncelen;
+            pgp_cipher_cfb_decrypt(&crypt, keybuf, skey->enckey, skey->enckeylen);
+            pgp_cipher_cfb_finish(&crypt);
 
-            if (!taglen || (keysize != skey->enckeylen - taglen)) {
-                continue;
+            alg = (pgp_symm_alg_t) keybuf[0];
+            keysize = pgp_key_size(alg);
+            if (!keysize || (keysize + 1 != skey->enckeylen)) {
+                goto finish;
             }
-            alg = skey->alg;
+            memmove(keybuf, keybuf + 1, keysize);
+        } else {
+            alg = (pgp_symm_alg_t) skey->alg;
+        }
 
-            /* initialize cipher */
-            if (!pgp_cipher_aead_init(&crypt, skey->alg, skey->aalg, keybuf, true)) {
-                continue;
-            }
+        if (!pgp_block_size(alg)) {
+            goto finish;
+        }
+        res = 0;
+    } else if (skey->version == PGP_SKSK_V5) {
+        /* v5 AEAD-encrypted session key */
+        size_t taglen = pgp_cipher_aead_tag_len(skey->aalg);
+        size_t noncelen;
 
-            /* set additional data */
-            encrypted_sesk_set_ad(&crypt, skey);
+        if (!taglen || (keysize != skey->enckeylen - taglen)) {
+            goto finish;
+        }
+        alg = skey->alg;
 
-            /* calculate nonce */
-            noncelen = pgp_cipher_aead_nonce(skey->aalg, skey->iv, nonce, 0);
+        /* initialize cipher */
+        if (!pgp_cipher_aead_init(&crypt, skey->alg, skey->aalg, keybuf, true)) {
+            goto finish;
+        }
 
-            if (rnp_get_debug(__FILE__)) {
-                hexdump(stderr, "nonce: ", nonce, noncelen);
-                hexdump(stderr, "encrypted key: ", skey->enckey, skey->enckeylen);
-            }
+        /* set additional data */
+        encrypted_sesk_set_ad(&crypt, (pgp_sk_sesskey_t *) skey);
 
-            /* start cipher, decrypt key and verify tag */
-            keyavail = pgp_cipher_aead_start(&crypt, nonce, noncelen);
-            decres = keyavail &&
-                     pgp_cipher_aead_finish(&crypt, keybuf, skey->enckey, skey->enckeylen);
+        /* calculate nonce */
+        noncelen = pgp_cipher_aead_nonce(skey->aalg, skey->iv, nonce, 0);
 
-            if (decres && rnp_get_debug(__FILE__)) {
-                hexdump(
-                  stderr, "decrypted key: ", keybuf, pgp_key_size(param->aead_params.ealg));
-            }
+        if (rnp_get_debug(__FILE__)) {
+            hexdump(stderr, "nonce: ", nonce, noncelen);
+            hexdump(stderr, "encrypted key: ", skey->enckey, skey->enckeylen);
+        }
 
+        /* start cipher, decrypt key and verify tag */
+        if (!pgp_cipher_aead_start(&crypt, nonce, noncelen)) {
             pgp_cipher_aead_destroy(&crypt);
+            goto finish;
+        }
+        res = 0;
+        decres = pgp_cipher_aead_finish(&crypt, keybuf, skey->enckey, skey->enckeylen);
 
-            /* we have decrypted key so let's start decryption */
-            if (!keyavail || !decres) {
-                continue;
-            }
-        } else {
-            continue;
+        if (decres && rnp_get_debug(__FILE__)) {
+            hexdump(stderr, "decrypted key: ", keybuf, keysize);
         }
 
-        /* Decrypt header for CFB */
-        if (!param->aead && !encrypted_decrypt_cfb_header(param, alg, keybuf)) {
-            continue;
+        pgp_cipher_aead_destroy(&crypt);
+
+        /* we have decrypted key so let's start decryption */
+        if (!decres) {
+            goto finish;
         }
-        if (param->aead && !encrypted_start_aead(param, param->aead_params.ealg, keybuf)) {
+    } else {
+        goto finish;
+    }
+
+    *salg = alg;
+    memcpy(key, keybuf, keysize);
+    res = 1;
+finish:
+    pgp_forget(keybuf, sizeof(keybuf));
+    return res;
+}
+
+static int
+encrypted_try_password(pgp_source_encrypted_param_t *param,
+                       const char *                  password,
+                       pgp_s2k_cache_t *             cache)
+{
+    pgp_symm_alg_t alg;
+    uint8_t        keybuf[PGP_MAX_KEY_SIZE];
+    bool           keyavail = false; /* tried password at least once */
+    int            decres;
+    int            res = 0;
+
+    for (list_item *se = list_front(param->symencs); se; se = list_next(se)) {
+        decres =
+          encrypted_sk_decrypt_key((pgp_sk_sesskey_t *) se, password, cache, &alg, keybuf);
+        keyavail = keyavail || (decres >= 0);
+        if (decres <= 0) {
             continue;
         }
 
-        res = 1;
-        goto finish;
+        /* Decrypt header for CFB or start AEAD decryption */
+        if (encrypted_start_sesskey(
+              param, param->aead ? param->aead_params.ealg : alg, keybuf)) {
+            res = 1;
+            break;
+        }
     }
 
-    if (!keyavail) {
+    if (!res && !keyavail) {
         RNP_LOG("no supported sk available");
         res = -1;
+    }
+
+    pgp_forget(keybuf, sizeof(keybuf));
+    return res;
+}
+
+typedef struct pgp_password_job_t {
+    const char **             passwords; /* candidate passwords */
+    const pgp_sk_sesskey_t ** skeys;     /* SKESK packets */
+    size_t                    skcount;   /* number of SKESK packets */
+    pgp_s2k_cache_t *         cache;     /* S2K cache of the password provider, may be NULL */
+    int *   results; /* 0 - not tried, 1 - decrypted, -1 - wrong password, -2 - unsupported */
+    pgp_symm_alg_t *salgs; /* decrypted symmetric algorithms */
+    uint8_t *       keys;  /* decrypted session keys, PGP_MAX_KEY_SIZE each */
+} pgp_password_job_t;
+
+static bool
+encrypted_password_job(void *param, size_t idx, size_t worker)
+{
+    pgp_password_job_t *    job = (pgp_password_job_t *) param;
+    const pgp_sk_sesskey_t *skey = job->skeys[idx % job->skcount];
+    int                     decres;
+
+    decres = encrypted_sk_decrypt_key(skey,
+                                      job->passwords[idx / job->skcount],
+                                      job->cache,
+                                      &job->salgs[idx],
+                                      &job->keys[idx * PGP_MAX_KEY_SIZE]);
+    job->results[idx] = decres > 0 ? 1 : decres - 1;
+    /* stop only on the verified success: v4 SKESK without the encrypted session key is
+     * "decrypted" with any password, so the rest of candidates are still needed */
+    return (job->results[idx] < 0) ||
+           ((skey->version == PGP_SKSK_V4) && !skey->enckeylen);
+}
+
+/** @brief try each of the passwords against each of the SKESK packets. Key derivations are
+ *         run in parallel, stopping on the first verified session key.
+ *  @param passwords list of MAX_PASSWORD_LENGTH-sized password buffers
+ *  @return the same as encrypted_try_password()
+ **/
+static int
+encrypted_try_passwords(pgp_source_encrypted_param_t *param,
+                        list                          passwords,
+                        pgp_s2k_cache_t *             cache)
+{
+    pgp_password_job_t job = {0};
+    size_t             pcount = list_length(passwords);
+    size_t             count = 0;
+    size_t             idx = 0;
+    bool               keyavail = false;
+    int                res = 0;
+
+    job.skcount = list_length(param->symencs);
+    if ((pcount == 1) || (rnp_parallel_threads(pcount * job.skcount) < 2)) {
+        for (list_item *li = list_front(passwords); li && !res; li = list_next(li)) {
+            res = encrypted_try_password(param, (const char *) li, cache);
+        }
+        return res;
+    }
+
+    count = pcount * job.skcount;
+    job.cache = cache;
+    job.passwords = (const char **) calloc(pcount, sizeof(*job.passwords));
+    job.skeys = (const pgp_sk_sesskey_t **) calloc(job.skcount, sizeof(*job.skeys));
+    job.results = (int *) calloc(count, sizeof(*job.results));
+    job.salgs = (pgp_symm_alg_t *) calloc(count, sizeof(*job.salgs));
+    job.keys = (uint8_t *) calloc(count, PGP_MAX_KEY_SIZE);
+    if (!job.passwords || !job.skeys || !job.results || !job.salgs || !job.keys) {
+        RNP_LOG("allocation failed");
+        res = -1;
         goto finish;
     }
-    res = 0;
+    for (list_item *li = list_front(passwords); li; li = list_next(li)) {
+        job.passwords[idx++] = (const char *) li;
+    }
+    idx = 0;
+    for (list_item *se = list_front(param->symencs); se; se = list_next(se)) {
+        job.skeys[idx++] = (const pgp_sk_sesskey_t *) se;
+    }
+
+    rnp_parallel_for(count, rnp_parallel_threads(count), encrypted_password_job, &job);
 
+    /* the same result as serial processing: first decrypting password and SKESK are used */
+    for (size_t i = 0; (i < count) && !res; i++) {
+        if (!job.results[i]) {
+            encrypted_password_job(&job, i, 0);
+        }
+        keyavail = keyavail || (job.results[i] > -2);
+        if ((job.results[i] > 0) &&
+            encrypted_start_sesskey(param,
+                                    param->aead ? param->aead_params.ealg : job.salgs[i],
+                                    &job.keys[i * PGP_MAX_KEY_SIZE])) {
+            res = 1;
+        }
+    }
+
+    if (!res && !keyavail) {
+        RNP_LOG("no supported sk available");
+        res = -1;
+    }
 finish:
-    pgp_forget(keybuf, sizeof(keybuf));
+    if (job.keys) {
+        pgp_forget(job.keys, count * PGP_MAX_KEY_SIZE);
+    }
+    free(job.passwords);
+    free(job.skeys);
+    free(job.results);
+    free(job.salgs);
+    free(job.keys);
     return res;
 }
 
@@ -1622,12 +1886,13 @@ get_literal_src_hdr(pgp_source_t *src, pgp_literal_hdr_t *hdr)
 }
 
 rnp_result_t
-init_compressed_src(pgp_source_t *src, pgp_source_t *readsrc)
+init_compressed_src(pgp_source_t *src, pgp_source_t *readsrc, bool parallel)
 {
     rnp_result_t                   errcode = RNP_ERROR_GENERIC;
     pgp_source_compressed_param_t *param;
     uint8_t                        alg;
     int                            zret;
+    size_t                         threads;
 
     if (!init_src_common(src, sizeof(*param))) {
         return RNP_ERROR_OUT_OF_MEMORY;
@@ -1657,16 +1922,21 @@ init_compressed_src(pgp_source_t *src, pgp_source_t *readsrc)
     case PGP_C_ZIP:
     case PGP_C_ZLIB:
         (void) memset(&param->z, 0x0, sizeof(param->z));
-        zret =
-          alg == PGP_C_ZIP ? (int) inflateInit2(&param->z, -15) : (int) inflateInit(&param->z);
-        if (zret != Z_OK) {
-            RNP_LOG("failed to init zlib, error %d", zret);
+        if (!pgp_inflate_init(&param->z, alg == PGP_C_ZLIB)) {
             errcode = RNP_ERROR_READ;
             goto finish;
         }
         break;
 #ifdef HAVE_BZLIB_H
     case PGP_C_BZIP2:
+        /* output doesn't depend on the number of threads, but each one keeps a whole block */
+        if (parallel && ((threads = rnp_parallel_threads(0)) > 1)) {
+            errcode = bz2_reader_create(&param->bzreader, param->pkt.readsrc, threads);
+            if (errcode) {
+                goto finish;
+            }
+            break;
+        }
         (void) memset(&param->bz, 0x0, sizeof(param->bz));
         zret = BZ2_bzDecompressInit(&param->bz, 0, 0);
         if (zret != BZ_OK) {
@@ -1708,27 +1978,26 @@ get_compressed_src_alg(pgp_source_t *src, uint8_t *alg)
     return true;
 }
 
+/** @brief Read pk/sk-encrypted session key packets, stopping on the encrypted data packet
+ *  @param ptype type of the encrypted data packet will be stored here
+ */
 static rnp_result_t
-encrypted_read_packet_data(pgp_source_encrypted_param_t *param)
+encrypted_read_sesskeys(pgp_source_encrypted_param_t *param, int *ptype)
 {
     rnp_result_t     errcode = RNP_ERROR_GENERIC;
     uint8_t          ptag;
-    uint8_t          mdcver;
-    uint8_t          hdr[4];
-    int              ptype;
     pgp_sk_sesskey_t skey = {0};
     pgp_pk_sesskey_t pkey = {0};
 
-    /* Reading pk/sk encrypted session key(s) */
     while (true) {
         if (src_peek(param->pkt.readsrc, &ptag, 1) < 1) {
             RNP_LOG("failed to read packet header");
             return RNP_ERROR_READ;
         }
 
-        ptype = get_packet_type(ptag);
+        *ptype = get_packet_type(ptag);
 
-        if (ptype == PGP_PTAG_CT_SK_SESSION_KEY) {
+        if (*ptype == PGP_PTAG_CT_SK_SESSION_KEY) {
             if ((errcode = stream_parse_sk_sesskey(param->pkt.readsrc, &skey))) {
                 return errcode;
             }
@@ -1736,7 +2005,7 @@ encrypted_read_packet_data(pgp_source_encrypted_param_t *param)
             if (!list_append(&param->symencs, &skey, sizeof(skey))) {
                 return RNP_ERROR_OUT_OF_MEMORY;
             }
-        } else if (ptype == PGP_PTAG_CT_PK_SESSION_KEY) {
+        } else if (*ptype == PGP_PTAG_CT_PK_SESSION_KEY) {
             if ((errcode = stream_parse_pk_sesskey(param->pkt.readsrc, &pkey))) {
                 return errcode;
             }
@@ -1744,14 +2013,28 @@ encrypted_read_packet_data(pgp_source_encrypted_param_t *param)
             if (!list_append(&param->pubencs, &pkey, sizeof(pkey))) {
                 return RNP_ERROR_OUT_OF_MEMORY;
             }
-        } else if ((ptype == PGP_PTAG_CT_SE_DATA) || (ptype == PGP_PTAG_CT_SE_IP_DATA) ||
-                   (ptype == PGP_PTAG_CT_AEAD_ENCRYPTED)) {
-            break;
+        } else if ((*ptype == PGP_PTAG_CT_SE_DATA) || (*ptype == PGP_PTAG_CT_SE_IP_DATA) ||
+                   (*ptype == PGP_PTAG_CT_AEAD_ENCRYPTED)) {
+            return RNP_SUCCESS;
         } else {
-            RNP_LOG("unknown packet type: %d", ptype);
+            RNP_LOG("unknown packet type: %d", *ptype);
             return RNP_ERROR_BAD_FORMAT;
         }
     }
+}
+
+static rnp_result_t
+encrypted_read_packet_data(pgp_source_encrypted_param_t *param)
+{
+    rnp_result_t errcode = RNP_ERROR_GENERIC;
+    uint8_t      mdcver;
+    uint8_t      hdr[4];
+    int          ptype;
+
+    /* Reading pk/sk encrypted session key(s) */
+    if ((errcode = encrypted_read_sesskeys(param, &ptype))) {
+        return errcode;
+    }
 
     /* Reading packet length/checking whether it is partial */
     if ((errcode = init_packet_params(&param->pkt))) {
@@ -1817,37 +2100,320 @@ encrypted_read_packet_data(pgp_source_encrypted_param_t *param)
     return RNP_SUCCESS;
 }
 
-static rnp_result_t
-init_encrypted_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *readsrc)
+static bool
+encrypted_is_wildcard_keyid(const uint8_t *keyid)
 {
-    rnp_result_t                  errcode = RNP_ERROR_GENERIC;
-    pgp_source_encrypted_param_t *param;
-    pgp_key_t *                   seckey = NULL;
-    pgp_key_request_ctx_t         keyctx;
-    pgp_key_pkt_t *               decrypted_seckey = NULL;
-    char                          password[MAX_PASSWORD_LENGTH] = {0};
-    int                           intres;
-    bool                          have_key = false;
+    for (unsigned i = 0; i < PGP_KEY_ID_SIZE; i++) {
+        if (keyid[i]) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (!init_src_common(src, sizeof(*param))) {
-        return RNP_ERROR_OUT_OF_MEMORY;
+static pgp_dec_key_t *
+encrypted_add_seckey(pgp_processing_ctx_t *ctx, const uint8_t *keyid, pgp_key_t *key)
+{
+    pgp_dec_key_t dkey = {{0}};
+
+    memcpy(dkey.keyid, keyid, PGP_KEY_ID_SIZE);
+    dkey.key = key;
+    return (pgp_dec_key_t *) list_append(&ctx->seckeys, &dkey, sizeof(dkey));
+}
+
+/** @brief get the secret key by keyid, requesting it from the key provider only once per
+ *         processing, so further lookups for the same keyid do not call the provider.
+ *  @return map entry, with key field set to NULL if key was not found, or NULL on error.
+ **/
+static pgp_dec_key_t *
+encrypted_get_seckey(pgp_processing_ctx_t *ctx, const uint8_t *keyid)
+{
+    pgp_key_request_ctx_t keyctx;
+
+    for (list_item *li = list_front(ctx->seckeys); li; li = list_next(li)) {
+        pgp_dec_key_t *dkey = (pgp_dec_key_t *) li;
+        if (!memcmp(dkey->keyid, keyid, PGP_KEY_ID_SIZE)) {
+            return dkey;
+        }
     }
-    param = (pgp_source_encrypted_param_t *) src->param;
-    param->pkt.readsrc = readsrc;
 
-    /* Read the packet-related information */
-    errcode = encrypted_read_packet_data(param);
-    if (errcode != RNP_SUCCESS) {
+    if (ctx->allkeys) {
+        return encrypted_add_seckey(ctx, keyid, NULL);
+    }
+
+    memset(&keyctx, 0, sizeof(keyctx));
+    keyctx.op = PGP_OP_DECRYPT_SYM;
+    keyctx.secret = true;
+    keyctx.search.type = PGP_KEY_SEARCH_KEYID;
+    memcpy(keyctx.search.by.keyid, keyid, PGP_KEY_ID_SIZE);
+    pgp_key_t *key = pgp_request_key(ctx->handler.key_provider, &keyctx);
+    return encrypted_add_seckey(ctx, keyid, key);
+}
+
+typedef struct pgp_seckeys_enum_t {
+    pgp_processing_ctx_t *ctx;
+    list_item *           last;   /* last entry of the map before the enumeration */
+    bool                  failed; /* allocation failed */
+} pgp_seckeys_enum_t;
+
+static bool
+encrypted_enum_seckey(pgp_key_t *key, void *param)
+{
+    pgp_seckeys_enum_t *en = (pgp_seckeys_enum_t *) param;
+
+    /* only keys, requested by keyid before, may be already in the map */
+    for (list_item *li = en->last ? list_front(en->ctx->seckeys) : NULL; li;
+         li = list_next(li)) {
+        if (((pgp_dec_key_t *) li)->key == key) {
+            return true;
+        }
+        if (li == en->last) {
+            break;
+        }
+    }
+    if (!encrypted_add_seckey(en->ctx, key->keyid, key)) {
+        RNP_LOG("allocation failed");
+        en->failed = true;
+        return false;
+    }
+    return true;
+}
+
+/* load all of the secret keys from the provider in a single pass, required for the wildcard
+ * keyids */
+static void
+encrypted_load_seckeys(pgp_processing_ctx_t *ctx)
+{
+    pgp_key_request_ctx_t keyctx;
+    pgp_seckeys_enum_t    en = {0};
+
+    if (ctx->allkeys) {
+        return;
+    }
+
+    en.ctx = ctx;
+    en.last = list_back(ctx->seckeys);
+    memset(&keyctx, 0, sizeof(keyctx));
+    keyctx.op = PGP_OP_DECRYPT_SYM;
+    keyctx.secret = true;
+    keyctx.search.type = PGP_KEY_SEARCH_ANY;
+    keyctx.enumcb = encrypted_enum_seckey;
+    keyctx.enumparam = &en;
+
+    pgp_request_key(ctx->handler.key_provider, &keyctx);
+    ctx->allkeys = !en.failed;
+}
+
+/* get the decrypted secret key packet, asking for the password only once per key */
+static pgp_key_pkt_t *
+encrypted_unlock_seckey(pgp_processing_ctx_t *ctx, pgp_dec_key_t *dkey)
+{
+    if (dkey->tried || !dkey->key) {
+        return dkey->decrypted;
+    }
+    dkey->tried = true;
+
+    if (!pgp_is_key_encrypted(dkey->key)) {
+        dkey->decrypted = &dkey->key->pkt;
+        return dkey->decrypted;
+    }
+
+    pgp_password_ctx_t pass_ctx{.op = PGP_OP_DECRYPT, .key = dkey->key};
+    dkey->decrypted = pgp_decrypt_seckey(dkey->key, ctx->handler.password_provider, &pass_ctx);
+    return dkey->decrypted;
+}
+
+/* destroy decrypted secret keys, leaving the keyid map itself */
+static void
+encrypted_forget_seckeys(pgp_processing_ctx_t *ctx)
+{
+    for (list_item *li = list_front(ctx->seckeys); li; li = list_next(li)) {
+        pgp_dec_key_t *dkey = (pgp_dec_key_t *) li;
+        if (dkey->decrypted && (dkey->decrypted != &dkey->key->pkt)) {
+            free_key_pkt(dkey->decrypted);
+            free(dkey->decrypted);
+        }
+        dkey->decrypted = NULL;
+        dkey->tried = false;
+    }
+}
+
+typedef struct pgp_trial_job_t {
+    const pgp_pk_sesskey_t *sesskey; /* pk-encrypted session key with wildcard keyid */
+    pgp_key_pkt_t **        seckeys; /* decrypted secret keys to try */
+    int *                   results; /* 0 - not tried, 1 - decrypted, -1 - failed */
+    pgp_symm_alg_t *        salgs;   /* decrypted symmetric algorithms */
+    uint8_t *               keys;    /* decrypted session keys, PGP_MAX_KEY_SIZE each */
+    rng_t *                 rngs;    /* per-worker RNGs, worker 0 uses the ctx's one */
+    rng_t *                 ctxrng;  /* RNG of the operation context */
+} pgp_trial_job_t;
+
+static bool
+encrypted_trial_job(void *param, size_t idx, size_t worker)
+{
+    pgp_trial_job_t *job = (pgp_trial_job_t *) param;
+    rng_t *          rng = worker ? &job->rngs[worker] : job->ctxrng;
+
+    job->results[idx] = encrypted_decrypt_sesskey(job->sesskey,
+                                                  job->seckeys[idx],
+                                                  rng,
+                                                  &job->salgs[idx],
+                                                  &job->keys[idx * PGP_MAX_KEY_SIZE]) ?
+                          1 :
+                          -1;
+    /* stop on the first success */
+    return job->results[idx] < 0;
+}
+
+static bool
+encrypted_wildcard_suitable(const pgp_dec_key_t *dkey, const pgp_pk_sesskey_t *sesskey)
+{
+    return dkey->key && (dkey->key->pkt.alg == sesskey->alg) && pgp_key_can_encrypt(dkey->key);
+}
+
+/** @brief try to decrypt pk-encrypted session key with wildcard (anonymous) keyid. Secret
+ *         keys which do not need a password (unprotected, or already unlocked) are tried
+ *         first, in parallel, stopping on the first success. Then the rest of keys are
+ *         unlocked and tried one by one, so password is requested only when needed.
+ **/
+static bool
+encrypted_try_wildcard(pgp_processing_ctx_t *        ctx,
+                       pgp_source_encrypted_param_t *param,
+                       pgp_pk_sesskey_t *            sesskey)
+{
+    pgp_trial_job_t job = {0};
+    size_t          count = 0;
+    size_t          threads = 0;
+    bool            res = false;
+    size_t          keyscount;
+
+    encrypted_load_seckeys(ctx);
+    keyscount = list_length(ctx->seckeys);
+    if (!keyscount) {
+        return false;
+    }
+
+    job.sesskey = sesskey;
+    job.ctxrng = rnp_ctx_rng_handle(ctx->handler.ctx);
+    job.seckeys = (pgp_key_pkt_t **) calloc(keyscount, sizeof(*job.seckeys));
+    job.results = (int *) calloc(keyscount, sizeof(*job.results));
+    job.salgs = (pgp_symm_alg_t *) calloc(keyscount, sizeof(*job.salgs));
+    job.keys = (uint8_t *) calloc(keyscount, PGP_MAX_KEY_SIZE);
+    if (!job.seckeys || !job.results || !job.salgs || !job.keys) {
+        RNP_LOG("allocation failed");
         goto finish;
     }
 
-    src->read = param->aead ? encrypted_src_read_aead : encrypted_src_read_cfb;
-    src->close = encrypted_src_close;
-    src->finish = encrypted_src_finish;
-    src->type = PGP_STREAM_ENCRYPTED;
+    /* keys which are available without the password */
+    for (list_item *li = list_front(ctx->seckeys); li; li = list_next(li)) {
+        pgp_dec_key_t *dkey = (pgp_dec_key_t *) li;
+        pgp_key_pkt_t *seckey = NULL;
 
-    /* Obtaining the symmetric key */
-    have_key = false;
+        if (!encrypted_wildcard_suitable(dkey, sesskey)) {
+            continue;
+        }
+        if (!dkey->tried && pgp_is_key_encrypted(dkey->key)) {
+            continue;
+        }
+        if (!(seckey = encrypted_unlock_seckey(ctx, dkey))) {
+            continue;
+        }
+        job.seckeys[count++] = seckey;
+    }
+
+    if (count) {
+        threads = rnp_parallel_threads(count);
+        job.rngs = (rng_t *) calloc(threads, sizeof(*job.rngs));
+        if (!job.rngs) {
+            RNP_LOG("allocation failed");
+            goto finish;
+        }
+        for (size_t i = 1; i < threads; i++) {
+            if (!rng_init(&job.rngs[i], RNG_DRBG)) {
+                RNP_LOG("failed to init worker rng");
+                goto finish;
+            }
+        }
+
+        rnp_parallel_for(count, threads, encrypted_trial_job, &job);
+    }
+
+    /* the same result as serial processing: first key which decrypts the message is used */
+    for (size_t i = 0; (i < count) && !res; i++) {
+        if (!job.results[i]) {
+            encrypted_trial_job(&job, i, 0);
+        }
+        if (job.results[i] > 0) {
+            res = encrypted_start_sesskey(
+              param, job.salgs[i], &job.keys[i * PGP_MAX_KEY_SIZE]);
+        }
+    }
+
+    /* password-protected keys, unlocked lazily, one at a time */
+    for (list_item *li = list_front(ctx->seckeys); li && !res; li = list_next(li)) {
+        pgp_dec_key_t *dkey = (pgp_dec_key_t *) li;
+
+        if (!encrypted_wildcard_suitable(dkey, sesskey) || dkey->tried) {
+            continue;
+        }
+        if (!(job.seckeys[count] = encrypted_unlock_seckey(ctx, dkey))) {
+            continue;
+        }
+        encrypted_trial_job(&job, count, 0);
+        if (job.results[count] > 0) {
+            res = encrypted_start_sesskey(
+              param, job.salgs[count], &job.keys[count * PGP_MAX_KEY_SIZE]);
+        }
+        count++;
+    }
+finish:
+    if (job.rngs) {
+        for (size_t i = 1; i < threads; i++) {
+            rng_destroy(&job.rngs[i]);
+        }
+    }
+    if (job.keys) {
+        pgp_forget(job.keys, keyscount * PGP_MAX_KEY_SIZE);
+    }
+    free(job.seckeys);
+    free(job.results);
+    free(job.salgs);
+    free(job.keys);
+    free(job.rngs);
+    return res;
+}
+
+/** @brief Decrypt the session key and start the data decryption. On success decrypted
+ *         session key is stored in param->sesskey, and caller should wipe it afterwards.
+ */
+static rnp_result_t
+encrypted_obtain_sesskey(pgp_processing_ctx_t *ctx, pgp_source_encrypted_param_t *param)
+{
+    rnp_result_t   errcode = RNP_ERROR_GENERIC;
+    pgp_dec_key_t *dkey = NULL;
+    pgp_key_pkt_t *decrypted_seckey = NULL;
+    char           password[MAX_PASSWORD_LENGTH] = {0};
+    list           passwords = NULL;
+    int            intres;
+    bool           have_key = false;
+    bool           have_wildcard = false;
+
+    /* Session key is supplied by the caller, so no need to decrypt PKESK/SKESK packets */
+    if (ctx->handler.ctx && ctx->handler.ctx->sesskey) {
+        pgp_sesskey_t *sesskey = ctx->handler.ctx->sesskey;
+        if (sesskey->keylen != pgp_key_size(sesskey->alg)) {
+            RNP_LOG("wrong session key length");
+            errcode = RNP_ERROR_BAD_PARAMETERS;
+            goto finish;
+        }
+        if (!encrypted_start_sesskey(param, sesskey->alg, sesskey->key)) {
+            RNP_LOG("failed to decrypt with the supplied session key");
+            errcode = RNP_ERROR_DECRYPT_FAILED;
+            goto finish;
+        }
+        have_key = true;
+        goto finish;
+    }
 
     if (!ctx->handler.password_provider) {
         RNP_LOG("no password provider");
@@ -1863,30 +2429,22 @@ init_encrypted_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *r
             goto finish;
         }
 
-        keyctx.op = PGP_OP_DECRYPT_SYM;
-        keyctx.secret = true;
-        keyctx.search.type = PGP_KEY_SEARCH_KEYID;
-
         for (list_item *pe = list_front(param->pubencs); pe; pe = list_next(pe)) {
-            memcpy(keyctx.search.by.keyid,
-                   ((pgp_pk_sesskey_t *) pe)->key_id,
-                   sizeof(keyctx.search.by.keyid));
+            const uint8_t *keyid = ((pgp_pk_sesskey_t *) pe)->key_id;
+            /* Wildcard keyids are processed after all others */
+            if (encrypted_is_wildcard_keyid(keyid)) {
+                have_wildcard = true;
+                continue;
+            }
             /* Get the key if any */
-            if (!(seckey = pgp_request_key(ctx->handler.key_provider, &keyctx))) {
+            if (!(dkey = encrypted_get_seckey(ctx, keyid)) || !dkey->key) {
                 errcode = RNP_ERROR_NO_SUITABLE_KEY;
                 continue;
             }
             /* Decrypt key */
-            if (pgp_is_key_encrypted(seckey)) {
-                pgp_password_ctx_t pass_ctx{.op = PGP_OP_DECRYPT, .key = seckey};
-                decrypted_seckey =
-                  pgp_decrypt_seckey(seckey, ctx->handler.password_provider, &pass_ctx);
-                if (!decrypted_seckey) {
-                    errcode = RNP_ERROR_BAD_PASSWORD;
-                    continue;
-                }
-            } else {
-                decrypted_seckey = &(seckey->pkt);
+            if (!(decrypted_seckey = encrypted_unlock_seckey(ctx, dkey))) {
+                errcode = RNP_ERROR_BAD_PASSWORD;
+                continue;
             }
 
             /* Try to initialize the decryption */
@@ -1895,31 +2453,53 @@ init_encrypted_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *r
                                   decrypted_seckey,
                                   rnp_ctx_rng_handle(ctx->handler.ctx))) {
                 have_key = true;
+                break;
             }
+        }
 
-            /* Destroy decrypted key */
-            if (pgp_is_key_encrypted(seckey)) {
-                free_key_pkt(decrypted_seckey);
-                free(decrypted_seckey);
-                decrypted_seckey = NULL;
+        for (list_item *pe = list_front(param->pubencs); pe && have_wildcard && !have_key;
+             pe = list_next(pe)) {
+            if (!encrypted_is_wildcard_keyid(((pgp_pk_sesskey_t *) pe)->key_id)) {
+                continue;
             }
-
-            if (have_key) {
-                break;
+            if (!(have_key = encrypted_try_wildcard(ctx, param, (pgp_pk_sesskey_t *) pe))) {
+                errcode = RNP_ERROR_NO_SUITABLE_KEY;
             }
         }
+
+        /* Destroy decrypted keys */
+        encrypted_forget_seckeys(ctx);
     }
 
     /* Trying password-based decryption */
     if (!have_key && (list_length(param->symencs) > 0)) {
         pgp_password_ctx_t pass_ctx{.op = PGP_OP_DECRYPT_SYM, .key = NULL};
-        if (!pgp_request_password(
-              ctx->handler.password_provider, &pass_ctx, password, sizeof(password))) {
+        unsigned           passwordc = ctx->handler.ctx ? ctx->handler.ctx->passwordc : 0;
+
+        /* password provider is not thread-safe, so requesting all candidates beforehand */
+        for (unsigned i = 0; i < (passwordc ? passwordc : 1); i++) {
+            if (!pgp_request_password(
+                  ctx->handler.password_provider, &pass_ctx, password, sizeof(password))) {
+                break;
+            }
+            bool dup = false;
+            for (list_item *li = list_front(passwords); li && !dup; li = list_next(li)) {
+                dup = !strcmp((char *) li, password);
+            }
+            if (!dup && !list_append(&passwords, password, sizeof(password))) {
+                RNP_LOG("allocation failed");
+                errcode = RNP_ERROR_OUT_OF_MEMORY;
+                goto finish;
+            }
+            pgp_forget(password, sizeof(password));
+        }
+        if (!list_length(passwords)) {
             errcode = RNP_ERROR_BAD_PASSWORD;
             goto finish;
         }
 
-        intres = encrypted_try_password(param, password);
+        intres =
+          encrypted_try_passwords(param, passwords, ctx->handler.password_provider->s2k_cache);
         if (intres > 0) {
             have_key = true;
         } else if (intres < 0) {
@@ -1937,16 +2517,58 @@ init_encrypted_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *r
         goto finish;
     }
 
-    errcode = RNP_SUCCESS;
 finish:
-    if (errcode != RNP_SUCCESS) {
-        src_close(src);
+    if (have_key) {
+        errcode = RNP_SUCCESS;
     }
     pgp_forget(password, sizeof(password));
+    for (list_item *li = list_front(passwords); li; li = list_next(li)) {
+        pgp_forget(li, MAX_PASSWORD_LENGTH);
+    }
+    list_destroy(&passwords);
 
     return errcode;
 }
 
+static rnp_result_t
+init_encrypted_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *readsrc)
+{
+    rnp_result_t                  errcode = RNP_ERROR_GENERIC;
+    pgp_source_encrypted_param_t *param;
+
+    if (!init_src_common(src, sizeof(*param))) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    param = (pgp_source_encrypted_param_t *) src->param;
+    param->pkt.readsrc = readsrc;
+
+    /* Read the packet-related information */
+    errcode = encrypted_read_packet_data(param);
+    if (errcode != RNP_SUCCESS) {
+        goto finish;
+    }
+
+    src->read = param->aead ? encrypted_src_read_aead : encrypted_src_read_cfb;
+    src->close = encrypted_src_close;
+    src->finish = encrypted_src_finish;
+    src->type = PGP_STREAM_ENCRYPTED;
+
+    /* Obtaining the symmetric key */
+    if ((errcode = encrypted_obtain_sesskey(ctx, param))) {
+        goto finish;
+    }
+
+    if (ctx->handler.on_sesskey) {
+        ctx->handler.on_sesskey(&ctx->handler, &param->sesskey);
+    }
+    pgp_forget(&param->sesskey, sizeof(param->sesskey));
+finish:
+    if (errcode != RNP_SUCCESS) {
+        src_close(src);
+    }
+    return errcode;
+}
+
 static rnp_result_t
 init_cleartext_signed_src(pgp_source_t *src)
 {
@@ -2045,7 +2667,9 @@ init_signed_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *read
             }
 
             /* adding hash context */
-            pgp_hash_list_add(&param->hashes, onepass.halg);
+            pgp_hash_list_add(onepass.type == PGP_SIG_TEXT ? &param->txt_hashes :
+                                                             &param->hashes,
+                              onepass.halg);
 
             if (onepass.nested) {
                 /* despite the name non-zero value means that it is the last one-pass */
@@ -2056,7 +2680,9 @@ init_signed_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *read
             signed_read_single_signature(param, readsrc, &sig);
             /* adding hash context */
             if (sig) {
-                pgp_hash_list_add(&param->hashes, sig->halg);
+                pgp_hash_list_add(sig->type == PGP_SIG_TEXT ? &param->txt_hashes :
+                                                              &param->hashes,
+                                  sig->halg);
             }
         } else {
             break;
@@ -2083,8 +2709,12 @@ init_signed_src(pgp_processing_ctx_t *ctx, pgp_source_t *src, pgp_source_t *read
 finish:
     if (errcode != RNP_SUCCESS) {
         src_close(src);
+        return errcode;
     }
 
+    /* hash lists are complete now, so data may be hashed in parallel */
+    param->hash_workers = pgp_hash_workers_start(param->hashes);
+    param->txt_workers = pgp_hash_workers_start(param->txt_hashes);
     return errcode;
 }
 
@@ -2101,6 +2731,8 @@ free_processing_ctx(pgp_processing_ctx_t *ctx)
         src_close((pgp_source_t *) src);
     }
     list_destroy(&ctx->sources);
+    encrypted_forget_seckeys(ctx);
+    list_destroy(&ctx->seckeys);
 }
 
 /** @brief build PGP source sequence down to the literal data packet
@@ -2141,7 +2773,8 @@ init_packet_sequence(pgp_processing_ctx_t *ctx, pgp_source_t *src)
             ret = init_signed_src(ctx, &psrc, lsrc);
             break;
         case PGP_PTAG_CT_COMPRESSED:
-            ret = init_compressed_src(&psrc, lsrc);
+            ret = init_compressed_src(
+              &psrc, lsrc, ctx->handler.ctx && ctx->handler.ctx->zparallel);
             break;
         case PGP_PTAG_CT_LITDATA:
             if ((lsrc->type != PGP_STREAM_ENCRYPTED) && (lsrc->type != PGP_STREAM_SIGNED) &&
@@ -2337,3 +2970,109 @@ finish:
     free(readbuf);
     return res;
 }
+
+rnp_result_t
+pgp_decrypt_sesskey_src(pgp_parse_handler_t *handler,
+                        pgp_source_t *       src,
+                        pgp_sesskey_t *      key,
+                        pgp_aead_alg_t *     aalg)
+{
+    pgp_processing_ctx_t          ctx;
+    pgp_source_t                  encsrc = {0};
+    pgp_source_t                  hdrsrc = {0};
+    pgp_source_encrypted_param_t *param = NULL;
+    uint8_t                       hdr[64]; /* packet header with AEAD or CFB prefix */
+    ssize_t                       hdrlen;
+    int                           ptype;
+    rnp_result_t                  ret = RNP_ERROR_GENERIC;
+
+    init_processing_ctx(&ctx);
+    ctx.handler = *handler;
+
+    if (!init_src_common(&encsrc, sizeof(*param))) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+    param = (pgp_source_encrypted_param_t *) encsrc.param;
+    encsrc.close = encrypted_src_close;
+
+    /* session key packets are consumed from the source */
+    param->pkt.readsrc = src;
+    if ((ret = encrypted_read_sesskeys(param, &ptype))) {
+        goto finish;
+    }
+
+    /* while the encrypted data packet is only peeked, so it may be copied as it is */
+    if ((hdrlen = src_peek(src, hdr, sizeof(hdr))) <= 0) {
+        RNP_LOG("failed to read encrypted data packet");
+        ret = RNP_ERROR_READ;
+        goto finish;
+    }
+    if ((ret = init_mem_src(&hdrsrc, hdr, hdrlen, false))) {
+        goto finish;
+    }
+    param->pkt.readsrc = &hdrsrc;
+    if ((ret = encrypted_read_packet_data(param))) {
+        goto finish;
+    }
+    if (param->pkt.partial) {
+        /* partial chunk is larger than the peeked header, so do not read ahead */
+        param->pkt.readsrc->cache->readahead = false;
+    }
+
+    if ((ret = encrypted_obtain_sesskey(&ctx, param))) {
+        goto finish;
+    }
+
+    *key = param->sesskey;
+    *aalg = param->aead ? param->aead_params.aalg : PGP_AEAD_NONE;
+finish:
+    pgp_forget(&param->sesskey, sizeof(param->sesskey));
+    src_close(&encsrc);
+    src_close(&hdrsrc);
+    pgp_forget(hdr, sizeof(hdr));
+    free_processing_ctx(&ctx);
+    return ret;
+}
+
+bool
+pgp_sesskey_to_str(const pgp_sesskey_t *key, char *buf, size_t len)
+{
+    int hdrlen;
+
+    if (!key->keylen || (key->keylen != pgp_key_size(key->alg))) {
+        return false;
+    }
+    hdrlen = snprintf(buf, len, "%d:", (int) key->alg);
+    if ((hdrlen < 0) || ((size_t) hdrlen >= len)) {
+        return false;
+    }
+    return rnp_hex_encode(
+      key->key, key->keylen, buf + hdrlen, len - hdrlen, RNP_HEX_UPPERCASE);
+}
+
+bool
+pgp_sesskey_from_str(const char *str, pgp_sesskey_t *key)
+{
+    char *        end = NULL;
+    unsigned long alg;
+    size_t        keylen;
+
+    alg = strtoul(str, &end, 10);
+    if ((end == str) || (*end != ':') || (alg > 255)) {
+        RNP_LOG("wrong session key format");
+        return false;
+    }
+    keylen = pgp_key_size((pgp_symm_alg_t) alg);
+    if (!keylen) {
+        RNP_LOG("unsupported session key algorithm %lu", alg);
+        return false;
+    }
+    end++;
+    if ((strlen(end) != keylen * 2) || (rnp_hex_decode(end, key->key, keylen) != keylen)) {
+        RNP_LOG("wrong session key length");
+        return false;
+    }
+    key->alg = (pgp_symm_alg_t) alg;
+    key->keylen = keylen;
+    return true;
+}
@@ -44,6 +44,7 @@ typedef bool pgp_source_func_t(pgp_parse_handler_t *handler, pgp_source_t *src);
 typedef void pgp_signatures_func_t(pgp_parse_handler_t * handler,
                                    pgp_signature_info_t *sigs,
                                    int                   count);
+typedef void pgp_sesskey_func_t(pgp_parse_handler_t *handler, const pgp_sesskey_t *key);
 
 /* handler used to return needed information during pgp source processing */
 typedef struct pgp_parse_handler_t {
@@ -55,6 +56,7 @@ typedef struct pgp_parse_handler_t {
     pgp_source_func_t *     src_provider;  /* required to provider source during the detached
                                               signature verification */
     pgp_signatures_func_t *on_signatures;  /* for signature verification results */
+    pgp_sesskey_func_t *   on_sesskey;     /* called with the decrypted session key */
 
     rnp_ctx_t *ctx;   /* operation context */
     void *     param; /* additional parameters */
@@ -72,9 +74,10 @@ rnp_result_t process_pgp_source(pgp_parse_handler_t *handler, pgp_source_t *src)
 /* @brief Init source with OpenPGP compressed data packet
  * @param src allocated pgp_source_t structure
  * @param readsrc source to read compressed data from
+ * @param parallel decompress BZip2 blocks on the worker threads
  * @return RNP_SUCCESS on success or error code otherwise
  */
-rnp_result_t init_compressed_src(pgp_source_t *src, pgp_source_t *readsrc);
+rnp_result_t init_compressed_src(pgp_source_t *src, pgp_source_t *readsrc, bool parallel);
 
 /* @brief Get compression algorithm used in compressed source
  * @param src compressed source, initialized with init_compressed_src
@@ -97,4 +100,35 @@ rnp_result_t init_literal_src(pgp_source_t *src, pgp_source_t *readsrc);
  */
 bool get_literal_src_hdr(pgp_source_t *src, pgp_literal_hdr_t *hdr);
 
+/* @brief Read the pk/sk-encrypted session key packets from the source and decrypt the
+ *        session key, without decrypting the data itself. Session key packets are consumed
+ *        from the source while the encrypted data packet is left in it untouched.
+ * @param handler handler with key and password providers, used to decrypt the session key
+ * @param src binary (not armored) source, positioned on the first session key packet
+ * @param key decrypted session key will be stored here on success
+ * @param aalg AEAD algorithm of the encrypted data packet, or PGP_AEAD_NONE, will be stored
+ *        here on success
+ * @return RNP_SUCCESS on success or error code otherwise
+ */
+rnp_result_t pgp_decrypt_sesskey_src(pgp_parse_handler_t *handler,
+                                     pgp_source_t *       src,
+                                     pgp_sesskey_t *      key,
+                                     pgp_aead_alg_t *     aalg);
+
+/* @brief Print the session key in the 'algorithm:hex key' form, as GnuPG does
+ * @param key decrypted session key
+ * @param buf buffer to write the nul-terminated string to
+ * @param len length of the buffer, should be at least 4 + 2 * PGP_MAX_KEY_SIZE + 1 bytes
+ * @return true on success or false otherwise
+ */
+bool pgp_sesskey_to_str(const pgp_sesskey_t *key, char *buf, size_t len);
+
+/* @brief Parse the session key from the 'algorithm:hex key' form, where algorithm is the
+ *        OpenPGP numeric id of the symmetric cipher, i.e. '9' for AES256.
+ * @param str nul-terminated string with session key
+ * @param key parsed key will be stored here
+ * @return true on success or false if string is malformed or key length is wrong
+ */
+bool pgp_sesskey_from_str(const char *str, pgp_sesskey_t *key);
+
 #endif
@@ -988,6 +988,34 @@ signature_hash_direct(const pgp_signature_t *sig, const pgp_key_pkt_t *key, pgp_
     return res;
 }
 
+bool
+signature_get_trailer(const pgp_signature_t *sig, uint8_t **buf, size_t *len)
+{
+    size_t   tlen;
+    uint8_t *tbuf;
+
+    if (!sig || !buf || !len || !sig->hashed_data) {
+        return false;
+    }
+
+    tlen = sig->hashed_len + (sig->version > PGP_V3 ? 6 : 0);
+    if (!(tbuf = (uint8_t *) malloc(tlen))) {
+        RNP_LOG("allocation failed");
+        return false;
+    }
+
+    memcpy(tbuf, sig->hashed_data, sig->hashed_len);
+    if (sig->version > PGP_V3) {
+        tbuf[sig->hashed_len] = 0x04;
+        tbuf[sig->hashed_len + 1] = 0xff;
+        STORE32BE(&tbuf[sig->hashed_len + 2], sig->hashed_len);
+    }
+
+    *buf = tbuf;
+    *len = tlen;
+    return true;
+}
+
 bool
 signature_hash_finish(const pgp_signature_t *sig,
                       pgp_hash_t *           hash,
@@ -1023,21 +1051,35 @@ signature_validate(const pgp_signature_t *   sig,
                    pgp_hash_t *              hash,
                    rng_t *                   rng)
 {
-    uint8_t      hval[PGP_MAX_HASH_SIZE];
-    size_t       len;
-    rnp_result_t ret = RNP_ERROR_GENERIC;
-
-    pgp_hash_alg_t hash_alg = pgp_hash_alg_type(hash);
+    uint8_t hval[PGP_MAX_HASH_SIZE];
+    size_t  len;
 
     /* Finalize hash */
     if (!signature_hash_finish(sig, hash, hval, &len)) {
         return RNP_ERROR_BAD_FORMAT;
     }
 
-    if (!key) {
+    return signature_validate_digest(sig, key, hval, len, rng);
+}
+
+rnp_result_t
+signature_validate_digest(const pgp_signature_t *   sig,
+                          const pgp_key_material_t *key,
+                          const uint8_t *           hval,
+                          size_t                    len,
+                          rng_t *                   rng)
+{
+    rnp_result_t ret = RNP_ERROR_GENERIC;
+
+    if (!sig || !key || !hval) {
         return RNP_ERROR_NULL_POINTER;
     }
 
+    if (len != pgp_digest_length(sig->halg)) {
+        RNP_LOG("wrong digest length");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
     /* compare lbits */
     if (memcmp(hval, sig->lbits, 2)) {
         RNP_LOG("wrong lbits");
@@ -1060,7 +1102,7 @@ signature_validate(const pgp_signature_t *   sig,
         ret = rsa_verify_pkcs1(rng, &sig->material.rsa, sig->halg, hval, len, &key->rsa);
         break;
     case PGP_PKA_ECDSA:
-        ret = ecdsa_verify(&sig->material.ecc, hash_alg, hval, len, &key->ec);
+        ret = ecdsa_verify(&sig->material.ecc, sig->halg, hval, len, &key->ec);
         break;
     default:
         RNP_LOG("Unknown algorithm");
@@ -1155,6 +1197,22 @@ signature_validate_direct(const pgp_signature_t *   sig,
 
 rnp_result_t
 signature_check(pgp_signature_info_t *sinfo, pgp_hash_t *hash, rng_t *rng)
+{
+    uint8_t hval[PGP_MAX_HASH_SIZE];
+    size_t  hlen = 0;
+
+    /* NULL digest marks the failed hash, so only the other checks are done */
+    if (!signature_hash_finish(sinfo->sig, hash, hval, &hlen)) {
+        return signature_check_digest(sinfo, NULL, 0, rng);
+    }
+    return signature_check_digest(sinfo, hval, hlen, rng);
+}
+
+rnp_result_t
+signature_check_digest(pgp_signature_info_t *sinfo,
+                       const uint8_t *       hval,
+                       size_t                hlen,
+                       rng_t *               rng)
 {
     time_t            now;
     uint32_t          create, expiry, kcreate;
@@ -1177,8 +1235,8 @@ signature_check(pgp_signature_info_t *sinfo, pgp_hash_t *hash, rng_t *rng)
 
     /* Validate signature itself */
     if (sinfo->signer->valid) {
-        sinfo->valid =
-          !signature_validate(sinfo->sig, pgp_get_key_material(sinfo->signer), hash, rng);
+        const pgp_key_material_t *key = pgp_get_key_material(sinfo->signer);
+        sinfo->valid = hval && !signature_validate_digest(sinfo->sig, key, hval, hlen, rng);
     } else {
         sinfo->valid = false;
         RNP_LOG("invalid or untrusted key");
@@ -1225,7 +1283,6 @@ signature_check(pgp_signature_info_t *sinfo, pgp_hash_t *hash, rng_t *rng)
         ret = sinfo->valid ? RNP_SUCCESS : RNP_ERROR_SIGNATURE_INVALID;
     }
 finish:
-    pgp_hash_finish(hash, NULL);
     return ret;
 }
 
@@ -1347,19 +1404,33 @@ signature_calculate(pgp_signature_t *         sig,
                     pgp_hash_t *              hash,
                     rng_t *                   rng)
 {
-    uint8_t      hval[PGP_MAX_HASH_SIZE];
-    size_t       hlen;
-    rnp_result_t ret = RNP_ERROR_GENERIC;
-    pgp_hash_alg_t hash_alg = pgp_hash_alg_type(hash);
+    uint8_t hval[PGP_MAX_HASH_SIZE];
+    size_t  hlen;
 
     /* Finalize hash first, since function is required to do this */
     if (!signature_hash_finish(sig, hash, hval, &hlen)) {
         return RNP_ERROR_BAD_PARAMETERS;
     }
 
-    if (!seckey) {
+    return signature_calculate_digest(sig, seckey, hval, hlen, rng);
+}
+
+rnp_result_t
+signature_calculate_digest(pgp_signature_t *         sig,
+                           const pgp_key_material_t *seckey,
+                           const uint8_t *           hval,
+                           size_t                    hlen,
+                           rng_t *                   rng)
+{
+    rnp_result_t ret = RNP_ERROR_GENERIC;
+
+    if (!sig || !seckey || !hval) {
         return RNP_ERROR_NULL_POINTER;
     }
+    if (hlen != pgp_digest_length(sig->halg)) {
+        RNP_LOG("wrong digest length");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
     if (!seckey->secret) {
         return RNP_ERROR_BAD_PARAMETERS;
     }
@@ -1428,7 +1499,7 @@ signature_calculate(pgp_signature_t *         sig,
             ret = RNP_ERROR_BAD_PARAMETERS;
             break;
         }
-        ret = ecdsa_sign(rng, &sig->material.ecc, hash_alg, hval, hlen, &seckey->ec);
+        ret = ecdsa_sign(rng, &sig->material.ecc, sig->halg, hval, hlen, &seckey->ec);
         if (ret) {
             RNP_LOG("ECDSA signing failed");
             break;
@@ -322,6 +322,17 @@ bool signature_hash_direct(const pgp_signature_t *sig,
                            const pgp_key_pkt_t *  key,
                            pgp_hash_t *           hash);
 
+/**
+ * @brief Get the signature fields and trailer, which are hashed after the signed data. Hashing
+ *        the data followed by this buffer gives the digest which is signed or verified.
+ * @param sig populated or loaded signature, hashed data must be already filled.
+ * @param buf on success pointer to the allocated buffer will be stored here. Caller must free
+ *            it.
+ * @param len on success length of the buffer will be stored here.
+ * @return true on success or false otherwise
+ */
+bool signature_get_trailer(const pgp_signature_t *sig, uint8_t **buf, size_t *len);
+
 /**
  * @brief Add signature fields to the hash context and finish it.
  * @param hash initialized hash context feeded with signed data (document, key, etc).
@@ -352,6 +363,22 @@ rnp_result_t signature_validate(const pgp_signature_t *   sig,
                                 pgp_hash_t *              hash,
                                 rng_t *                   rng);
 
+/**
+ * @brief Validate a signature against the final digest, i.e. hash of the signed data followed
+ *        by the signature trailer, as returned by signature_get_trailer().
+ * @param sig signature to validate
+ * @param key public key material of the verifying key
+ * @param hval digest value, must be of the signature's hash algorithm length
+ * @param len length of the digest
+ * @param rng random number generator
+ * @return RNP_SUCCESS if signature was successfully validated or error code otherwise.
+ */
+rnp_result_t signature_validate_digest(const pgp_signature_t *   sig,
+                                       const pgp_key_material_t *key,
+                                       const uint8_t *           hval,
+                                       size_t                    len,
+                                       rng_t *                   rng);
+
 rnp_result_t signature_validate_certification(const pgp_signature_t *   sig,
                                               const pgp_key_pkt_t *     key,
                                               const pgp_userid_pkt_t *  uid,
@@ -379,6 +406,21 @@ rnp_result_t signature_validate_direct(const pgp_signature_t *   sig,
  */
 rnp_result_t signature_check(pgp_signature_info_t *sinfo, pgp_hash_t *hash, rng_t *rng);
 
+/**
+ * @brief Check signature against the final digest, see signature_check() for the details.
+ *
+ * @param sinfo populated signature info structure.
+ * @param hval digest of the signed data and signature trailer. If NULL then signature is
+ *             considered as invalid, but the rest of checks are still done.
+ * @param hlen length of the digest
+ * @param rng random number generator
+ * @return rnp_result_t RNP_SUCCESS if all checks were passed, or error code otherwise.
+ */
+rnp_result_t signature_check_digest(pgp_signature_info_t *sinfo,
+                                    const uint8_t *       hval,
+                                    size_t                hlen,
+                                    rng_t *               rng);
+
 rnp_result_t signature_check_certification(pgp_signature_info_t *  sinfo,
                                            const pgp_key_pkt_t *   key,
                                            const pgp_userid_pkt_t *uid,
@@ -407,6 +449,22 @@ rnp_result_t signature_calculate(pgp_signature_t *         sig,
                                  pgp_hash_t *              hash,
                                  rng_t *                   rng);
 
+/**
+ * @brief Calculate signature over the final digest, i.e. hash of the signed data followed by
+ *        the signature trailer, as returned by signature_get_trailer().
+ * @param sig signature to calculate, hashed data must be already filled.
+ * @param seckey signing secret key material
+ * @param hval digest value, must be of the signature's hash algorithm length
+ * @param hlen length of the digest
+ * @param rng random number generator
+ * @return RNP_SUCCESS if signature was successfully calculated or error code otherwise
+ */
+rnp_result_t signature_calculate_digest(pgp_signature_t *         sig,
+                                        const pgp_key_material_t *seckey,
+                                        const uint8_t *           hval,
+                                        size_t                    hlen,
+                                        rng_t *                   rng);
+
 /**
  * @brief Check whether signatures info structure has all correct signatures.
  *
@@ -30,18 +30,19 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
-#ifdef HAVE_ZLIB_H
-#include <zlib.h>
-#endif
 #ifdef HAVE_BZLIB_H
 #include <bzlib.h>
 #endif
 #include <rnp/rnp_def.h>
 #include "stream-def.h"
 #include "stream-write.h"
+#include "stream-parse.h"
 #include "stream-packet.h"
 #include "stream-armor.h"
 #include "stream-sig.h"
+#include "stream-bzip2.h"
+#include "packet-show.h"
+#include "stream-deflate.h"
 #include "list.h"
 #include "utils.h"
 #include "pgp-key.h"
@@ -50,6 +51,7 @@
 #include "types.h"
 #include "crypto/common.h"
 #include "crypto.h"
+#include "parallel.h"
 
 /* 8192 bytes, as GnuPG */
 #define PGP_PARTIAL_PKT_SIZE_BITS (13)
@@ -66,16 +68,52 @@ typedef struct pgp_dest_packet_param_t {
     size_t      hdrlen;                   /* number of bytes in hdr */
 } pgp_dest_packet_param_t;
 
+/* Parallel deflate: input is split into blocks, compressed independently on the worker
+ * threads with the previous 32KB of input as a dictionary, like pigz does. Blocks are ended
+ * with the sync flush, so concatenated output is a single valid deflate stream. */
+#define PGP_ZBLOCK_SIZE (128 * 1024)
+#define PGP_ZDICT_SIZE (32 * 1024)
+
+/* Adaptive compression: first block of data is compressed with the fastest deflate level, and
+ * if it doesn't shrink at least by 1/16 then the compression layer is omitted. */
+#define PGP_ZSAMPLE_SIZE (64 * 1024)
+
+typedef struct pgp_zblock_t {
+    uint8_t *in;     /* input data, PGP_ZBLOCK_SIZE bytes */
+    size_t   inlen;  /* number of input bytes */
+    uint8_t *out;    /* compressed data */
+    size_t   outlen; /* number of compressed bytes */
+    uint32_t adler;  /* adler32 of the input, for zlib */
+    bool     last;   /* last block of the stream */
+} pgp_zblock_t;
+
 typedef struct pgp_dest_compressed_param_t {
     pgp_dest_packet_param_t pkt;
     pgp_compression_type_t  alg;
     union {
-        z_stream  z;
-        bz_stream bz;
+        pgp_zstream_t z;
+        bz_stream     bz;
     };
     bool    zstarted;                        /* whether we initialize zlib/bzip2  */
     uint8_t cache[PGP_INPUT_CACHE_SIZE / 2]; /* pre-allocated cache for compression */
     size_t  len;                             /* number of bytes cached */
+    /* parallel deflate fields, zthreads is 0 if it is not used */
+    size_t         zthreads;              /* number of blocks compressed at once */
+    pgp_zstream_t *zworkers;              /* raw deflate stream for each of the workers */
+    pgp_zblock_t * zblocks;               /* blocks of the current batch */
+    size_t         zblockc;               /* number of full blocks in the current batch */
+    size_t         zoutcap;               /* allocated size of the block's output */
+    uint8_t        zdict[PGP_ZDICT_SIZE]; /* tail of the previous batch's input */
+    size_t         zdictlen;              /* number of bytes in zdict */
+    uint32_t       zadler;                /* adler32 of the whole input, for zlib */
+    /* parallel bzip2 writer, NULL if it is not used */
+    pgp_bz2_writer_t *bzwriter;
+    /* adaptive compression fields, zsample is NULL if there is nothing to sample */
+    rnp_ctx_t * ctx;        /* operation context with compression parameters */
+    pgp_dest_t *zrawdst;    /* destination for the packet, or for the data if it is skipped */
+    uint8_t *   zsample;    /* first PGP_ZSAMPLE_SIZE bytes of data */
+    size_t      zsamplelen; /* number of bytes in zsample */
+    bool        zskipped;   /* data is incompressible, so it is written as is */
 } pgp_dest_compressed_param_t;
 
 typedef struct pgp_dest_encrypted_param_t {
@@ -103,6 +141,7 @@ typedef struct pgp_dest_signed_param_t {
     list                     onepasses; /* one-pass entries written to the stream begin */
     list                     keys;   /* signing keys in the same order as onepasses (if any) */
     list                     hashes; /* hashes to pass raw data through and then sign */
+    pgp_hash_workers_t *     hash_workers; /* parallel workers for hashes, if any */
     bool                     clr_start;           /* we are on the start of the line */
     uint8_t                  clr_buf[CT_BUF_LEN]; /* buffer to hold partial line data */
     size_t                   clr_buflen;          /* number of bytes in buffer */
@@ -138,8 +177,9 @@ partial_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
         len -= wrlen;
         param->len = 0;
 
-        /* writing all full parts directly from buf */
-        while (len >= param->partlen) {
+        /* writing all full parts directly from buf. The last part is always kept, so
+         * framing doesn't depend on the write sizes, see partial_pkt_size() */
+        while (len > param->partlen) {
             dst_write(param->writedst, &param->parthdr, 1);
             dst_write(param->writedst, buf, param->partlen);
             buf = (uint8_t *) buf + param->partlen;
@@ -477,42 +517,28 @@ encrypted_dst_close(pgp_dest_t *dst, bool discard)
 }
 
 static rnp_result_t
-encrypted_add_recipient(pgp_write_handler_t *handler,
-                        pgp_dest_t *         dst,
-                        pgp_key_t *          userkey,
-                        const uint8_t *      key,
-                        const unsigned       keylen)
-{
-    const pgp_key_pkt_t *       keypkt;
-    uint8_t                     enckey[PGP_MAX_KEY_SIZE + 3];
-    unsigned                    checksum = 0;
-    pgp_pk_sesskey_t            pkey = {0};
-    pgp_dest_encrypted_param_t *param = (pgp_dest_encrypted_param_t *) dst->param;
-    rnp_result_t                ret = RNP_ERROR_GENERIC;
-
-    /* Use primary key if good for encryption, otherwise look in subkey list */
-    userkey =
-      find_suitable_key(PGP_OP_ENCRYPT_SYM, userkey, handler->key_provider, PGP_KF_ENCRYPT);
-    if (!userkey) {
-        return RNP_ERROR_NO_SUITABLE_KEY;
-    }
-    if (!userkey->valid) {
-        RNP_LOG("attempt to use invalid key as recipient");
-        return RNP_ERROR_NO_SUITABLE_KEY;
-    }
-    keypkt = pgp_get_key_pkt(userkey);
+encrypted_build_pk_sesskey(const pgp_key_pkt_t *keypkt,
+                           pgp_symm_alg_t       ealg,
+                           const uint8_t *      key,
+                           const unsigned       keylen,
+                           rng_t *              rng,
+                           pgp_pk_sesskey_t *   pkey)
+{
+    uint8_t      enckey[PGP_MAX_KEY_SIZE + 3];
+    unsigned     checksum = 0;
+    rnp_result_t ret = RNP_ERROR_GENERIC;
 
     /* Fill pkey */
-    pkey.version = PGP_PKSK_V3;
-    pkey.alg = keypkt->alg;
-    rnp_result_t tmpret;
-    if ((tmpret = pgp_keyid(pkey.key_id, PGP_KEY_ID_SIZE, keypkt))) {
+    memset(pkey, 0, sizeof(*pkey));
+    pkey->version = PGP_PKSK_V3;
+    pkey->alg = keypkt->alg;
+    if ((ret = pgp_keyid(pkey->key_id, PGP_KEY_ID_SIZE, keypkt))) {
         RNP_LOG("key id calculation failed");
-        return tmpret;
+        return ret;
     }
 
     /* Encrypt the session key */
-    enckey[0] = param->ctx->ealg;
+    enckey[0] = ealg;
     memcpy(&enckey[1], key, keylen);
 
     /* Calculate checksum */
@@ -525,11 +551,8 @@ encrypted_add_recipient(pgp_write_handler_t *handler,
     switch (keypkt->alg) {
     case PGP_PKA_RSA:
     case PGP_PKA_RSA_ENCRYPT_ONLY: {
-        ret = rsa_encrypt_pkcs1(rnp_ctx_rng_handle(handler->ctx),
-                                &pkey.material.rsa,
-                                enckey,
-                                keylen + 3,
-                                &keypkt->material.rsa);
+        ret = rsa_encrypt_pkcs1(
+          rng, &pkey->material.rsa, enckey, keylen + 3, &keypkt->material.rsa);
         if (ret) {
             RNP_LOG("rsa_encrypt_pkcs1 failed");
             goto finish;
@@ -537,8 +560,8 @@ encrypted_add_recipient(pgp_write_handler_t *handler,
         break;
     }
     case PGP_PKA_SM2: {
-        ret = sm2_encrypt(rnp_ctx_rng_handle(handler->ctx),
-                          &pkey.material.sm2,
+        ret = sm2_encrypt(rng,
+                          &pkey->material.sm2,
                           enckey,
                           keylen + 3,
                           PGP_HASH_SM3,
@@ -557,8 +580,8 @@ encrypted_add_recipient(pgp_write_handler_t *handler,
             RNP_LOG("ECDH fingerprint calculation failed");
             goto finish;
         }
-        ret = ecdh_encrypt_pkcs5(rnp_ctx_rng_handle(handler->ctx),
-                                 &pkey.material.ecdh,
+        ret = ecdh_encrypt_pkcs5(rng,
+                                 &pkey->material.ecdh,
                                  enckey,
                                  keylen + 3,
                                  &keypkt->material.ec,
@@ -570,11 +593,8 @@ encrypted_add_recipient(pgp_write_handler_t *handler,
         break;
     }
     case PGP_PKA_ELGAMAL: {
-        ret = elgamal_encrypt_pkcs1(rnp_ctx_rng_handle(handler->ctx),
-                                    &pkey.material.eg,
-                                    enckey,
-                                    keylen + 3,
-                                    &keypkt->material.eg);
+        ret = elgamal_encrypt_pkcs1(
+          rng, &pkey->material.eg, enckey, keylen + 3, &keypkt->material.eg);
         if (ret) {
             RNP_LOG("pgp_elgamal_public_encrypt failed");
             goto finish;
@@ -583,19 +603,118 @@ encrypted_add_recipient(pgp_write_handler_t *handler,
     }
     default:
         RNP_LOG("unsupported alg: %d", keypkt->alg);
+        ret = RNP_ERROR_GENERIC;
         goto finish;
     }
 
-    /* Writing symmetric key encrypted session key packet */
-    if (!stream_write_pk_sesskey(&pkey, param->pkt.origdst)) {
-        ret = RNP_ERROR_WRITE;
+    ret = RNP_SUCCESS;
+finish:
+    pgp_forget(enckey, sizeof(enckey));
+    pgp_forget(&checksum, sizeof(checksum));
+    return ret;
+}
+
+typedef struct pgp_pk_sesskey_job_t {
+    const pgp_key_pkt_t **keypkts; /* recipient's key packets */
+    pgp_pk_sesskey_t *    pkeys;   /* resulting pk-encrypted session keys */
+    rnp_result_t *        results; /* result for each of the recipients */
+    rng_t *               rngs;    /* per-worker RNGs, worker 0 uses the ctx's one */
+    rng_t *               ctxrng;  /* rng of the operation context */
+    pgp_symm_alg_t        ealg;    /* symmetric algorithm of the session key */
+    const uint8_t *       key;     /* session key */
+    unsigned              keylen;  /* length of the session key */
+} pgp_pk_sesskey_job_t;
+
+static bool
+encrypted_pk_sesskey_job(void *param, size_t idx, size_t worker)
+{
+    pgp_pk_sesskey_job_t *job = (pgp_pk_sesskey_job_t *) param;
+    rng_t *               rng = worker ? &job->rngs[worker] : job->ctxrng;
+
+    job->results[idx] = encrypted_build_pk_sesskey(
+      job->keypkts[idx], job->ealg, job->key, job->keylen, rng, &job->pkeys[idx]);
+    return job->results[idx] == RNP_SUCCESS;
+}
+
+/* Public-key encryption of the session key is the most expensive part for the large recipient
+ * lists, so it is done in parallel. Packets are written afterwards in the recipients order. */
+static rnp_result_t
+encrypted_add_recipients(pgp_write_handler_t *       handler,
+                         pgp_dest_encrypted_param_t *param,
+                         const uint8_t *             key,
+                         const unsigned              keylen)
+{
+    pgp_pk_sesskey_job_t job = {0};
+    size_t               count = list_length(handler->ctx->recipients);
+    size_t               threads = rnp_parallel_threads(count);
+    size_t               idx = 0;
+    rnp_result_t         ret = RNP_ERROR_GENERIC;
+
+    job.keypkts = (const pgp_key_pkt_t **) calloc(count, sizeof(*job.keypkts));
+    job.pkeys = (pgp_pk_sesskey_t *) calloc(count, sizeof(*job.pkeys));
+    job.results = (rnp_result_t *) calloc(count, sizeof(*job.results));
+    job.rngs = (rng_t *) calloc(threads, sizeof(*job.rngs));
+    if (!job.keypkts || !job.pkeys || !job.results || !job.rngs) {
+        ret = RNP_ERROR_OUT_OF_MEMORY;
         goto finish;
     }
+    job.ctxrng = rnp_ctx_rng_handle(handler->ctx);
+    job.ealg = param->ctx->ealg;
+    job.key = key;
+    job.keylen = keylen;
+
+    /* key provider is not thread-safe, so looking for the suitable keys beforehand */
+    for (list_item *recipient = list_front(handler->ctx->recipients); recipient;
+         recipient = list_next(recipient)) {
+        /* Use primary key if good for encryption, otherwise look in subkey list */
+        pgp_key_t *userkey = find_suitable_key(PGP_OP_ENCRYPT_SYM,
+                                               *(pgp_key_t **) recipient,
+                                               handler->key_provider,
+                                               PGP_KF_ENCRYPT);
+        if (!userkey) {
+            ret = RNP_ERROR_NO_SUITABLE_KEY;
+            goto finish;
+        }
+        if (!userkey->valid) {
+            RNP_LOG("attempt to use invalid key as recipient");
+            ret = RNP_ERROR_NO_SUITABLE_KEY;
+            goto finish;
+        }
+        job.keypkts[idx++] = pgp_get_key_pkt(userkey);
+    }
+
+    for (size_t i = 1; i < threads; i++) {
+        if (!rng_init(&job.rngs[i], RNG_DRBG)) {
+            RNP_LOG("failed to init worker rng");
+            ret = RNP_ERROR_RNG;
+            goto finish;
+        }
+    }
+
+    rnp_parallel_for(count, threads, encrypted_pk_sesskey_job, &job);
+
+    /* Writing public key encrypted session key packets */
+    for (size_t i = 0; i < count; i++) {
+        if ((ret = job.results[i])) {
+            goto finish;
+        }
+        if (!stream_write_pk_sesskey(&job.pkeys[i], param->pkt.origdst)) {
+            ret = RNP_ERROR_WRITE;
+            goto finish;
+        }
+    }
 
     ret = RNP_SUCCESS;
 finish:
-    pgp_forget(enckey, sizeof(enckey));
-    pgp_forget(&checksum, sizeof(checksum));
+    if (job.rngs) {
+        for (size_t i = 1; i < threads; i++) {
+            rng_destroy(&job.rngs[i]);
+        }
+    }
+    free(job.keypkts);
+    free(job.pkeys);
+    free(job.results);
+    free(job.rngs);
     return ret;
 }
 
@@ -859,15 +978,9 @@ init_encrypted_dst(pgp_write_handler_t *handler, pgp_dest_t *dst, pgp_dest_t *wr
     }
 
     /* Configuring and writing pk-encrypted session keys */
-    if (pkeycount > 0) {
-        for (list_item *recipient = list_front(handler->ctx->recipients); recipient;
-             recipient = list_next(recipient)) {
-            ret =
-              encrypted_add_recipient(handler, dst, *(pgp_key_t **) recipient, enckey, keylen);
-            if (ret != RNP_SUCCESS) {
-                goto finish;
-            }
-        }
+    if ((pkeycount > 0) &&
+        (ret = encrypted_add_recipients(handler, param, enckey, keylen)) != RNP_SUCCESS) {
+        goto finish;
     }
 
     /* Configuring and writing sk-encrypted session key(s) */
@@ -905,11 +1018,6 @@ init_encrypted_dst(pgp_write_handler_t *handler, pgp_dest_t *dst, pgp_dest_t *wr
     }
 
 finish:
-    for (list_item *pi = list_front(handler->ctx->passwords); pi; pi = list_next(pi)) {
-        rnp_symmetric_pass_info_t *pass = (rnp_symmetric_pass_info_t *) pi;
-        pgp_forget(pass, sizeof(*pass));
-    }
-    list_destroy(&handler->ctx->passwords);
     pgp_forget(enckey, sizeof(enckey));
     if (ret != RNP_SUCCESS) {
         encrypted_dst_close(dst, true);
@@ -918,6 +1026,48 @@ finish:
     return ret;
 }
 
+/* Write pk/sk-encrypted session key packets for the already existing session key */
+static rnp_result_t
+encrypted_rewrap_sesskeys(pgp_write_handler_t *handler,
+                          const pgp_sesskey_t *key,
+                          pgp_aead_alg_t       aalg,
+                          pgp_dest_t *         dst)
+{
+    pgp_dest_encrypted_param_t param = {0};
+    rnp_result_t               ret = RNP_ERROR_GENERIC;
+
+    if (!list_length(handler->ctx->recipients) && !list_length(handler->ctx->passwords)) {
+        RNP_LOG("no recipients");
+        ret = RNP_ERROR_BAD_PARAMETERS;
+        goto finish;
+    }
+
+    /* session key packets must match the data algorithms */
+    handler->ctx->ealg = key->alg;
+    handler->ctx->aalg = aalg;
+    param.ctx = handler->ctx;
+    param.aead = aalg != PGP_AEAD_NONE;
+    param.aalg = aalg;
+    param.pkt.origdst = dst;
+
+    if (list_length(handler->ctx->recipients) &&
+        (ret = encrypted_add_recipients(handler, &param, key->key, key->keylen))) {
+        goto finish;
+    }
+
+    for (list_item *pi = list_front(handler->ctx->passwords); pi; pi = list_next(pi)) {
+        ret = encrypted_add_password(
+          (rnp_symmetric_pass_info_t *) pi, &param, (uint8_t *) key->key, key->keylen, false);
+        if (ret != RNP_SUCCESS) {
+            goto finish;
+        }
+    }
+
+    ret = RNP_SUCCESS;
+finish:
+    return ret;
+}
+
 static rnp_result_t
 signed_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
 {
@@ -926,6 +1076,16 @@ signed_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
     return RNP_SUCCESS;
 }
 
+static void
+signed_dst_hash(pgp_dest_signed_param_t *param, const void *buf, size_t len)
+{
+    if (param->hash_workers) {
+        pgp_hash_workers_update(param->hash_workers, buf, len);
+    } else {
+        pgp_hash_list_update(param->hashes, buf, len);
+    }
+}
+
 static void
 cleartext_dst_writeline(pgp_dest_signed_param_t *param,
                         const uint8_t *          buf,
@@ -962,34 +1122,85 @@ cleartext_dst_writeline(pgp_dest_signed_param_t *param,
         }
 
         /* hashing line body and \r\n */
-        pgp_hash_list_update(param->hashes, buf, ptr + 1 - buf);
+        signed_dst_hash(param, buf, ptr + 1 - buf);
         if (hashcrlf) {
-            pgp_hash_list_update(param->hashes, ST_CRLF, 2);
+            signed_dst_hash(param, ST_CRLF, 2);
         }
         param->clr_start = hashcrlf;
     } else if (len > 0) {
         /* hashing just line's data */
-        pgp_hash_list_update(param->hashes, buf, len);
+        signed_dst_hash(param, buf, len);
         param->clr_start = false;
     }
 }
 
-static size_t
-cleartext_dst_scanline(const uint8_t *buf, size_t len, bool *eol)
+/* write a run of whole lines, each ending with \n, batching output and hash updates */
+static void
+cleartext_dst_writelines(pgp_dest_signed_param_t *param, const uint8_t *buf, size_t len)
 {
-    for (const uint8_t *ptr = buf, *end = buf + len; ptr < end; ptr++) {
-        if (*ptr == CH_LF) {
-            if (eol) {
-                *eol = true;
-            }
-            return ptr - buf + 1;
+    uint8_t        hbuf[CT_BUF_LEN];
+    size_t         hlen = 0;
+    size_t         blen;
+    const uint8_t *runbg = buf;
+    const uint8_t *end = buf + len;
+    const uint8_t *lf;
+    const uint8_t *ptr;
+
+    while (buf < end) {
+        /* buffer always ends with \n so memchr will succeed */
+        lf = (const uint8_t *) memchr(buf, CH_LF, end - buf);
+
+        /* dash-escaping line if needed, flushing output before the escape */
+        if (param->clr_start &&
+            ((buf[0] == CH_DASH) ||
+             ((lf - buf >= 4) && !strncmp((const char *) buf, ST_FROM, 4)))) {
+            dst_write(param->writedst, runbg, buf - runbg);
+            dst_write(param->writedst, ST_DASHSP, 2);
+            runbg = buf;
+        }
+
+        /* skipping eol and trailing spaces */
+        ptr = lf;
+        if ((ptr > buf) && (*(ptr - 1) == CH_CR)) {
+            ptr--;
+        }
+        while ((ptr > buf) && ((*(ptr - 1) == CH_SPACE) || (*(ptr - 1) == CH_TAB))) {
+            ptr--;
+        }
+
+        /* collecting line body and \r\n for the hashing */
+        blen = ptr - buf;
+        if (hlen + blen + 2 > sizeof(hbuf)) {
+            signed_dst_hash(param, hbuf, hlen);
+            hlen = 0;
+        }
+        if (blen + 2 > sizeof(hbuf)) {
+            signed_dst_hash(param, buf, blen);
+            signed_dst_hash(param, ST_CRLF, 2);
+        } else {
+            memcpy(hbuf + hlen, buf, blen);
+            memcpy(hbuf + hlen + blen, ST_CRLF, 2);
+            hlen += blen + 2;
         }
+        param->clr_start = true;
+        buf = lf + 1;
     }
 
+    dst_write(param->writedst, runbg, end - runbg);
+    if (hlen) {
+        signed_dst_hash(param, hbuf, hlen);
+    }
+}
+
+static size_t
+cleartext_dst_scanline(const uint8_t *buf, size_t len, bool *eol)
+{
+    const uint8_t *ptr = (const uint8_t *) memchr(buf, CH_LF, len);
+
     if (eol) {
-        *eol = false;
+        *eol = ptr;
     }
-    return len;
+    return ptr ? ptr - buf + 1 : len;
 }
 
 static rnp_result_t
@@ -1037,31 +1248,50 @@ cleartext_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
     }
 
     /* if we get here then we don't have data in param->clr_buf */
-    while (len > 0) {
-        linelen = cleartext_dst_scanline(linebg, len, &eol);
-
-        if (!eol && (linelen < sizeof(param->clr_buf))) {
-            memcpy(param->clr_buf, linebg, linelen);
-            param->clr_buflen = linelen;
-            return RNP_SUCCESS;
-        }
+    if (!len) {
+        return RNP_SUCCESS;
+    }
 
-        cleartext_dst_writeline(param, linebg, linelen, eol);
+    /* process all whole lines at once */
+    for (linelen = len; linelen && (linebg[linelen - 1] != CH_LF); linelen--)
+        ;
+    if (linelen) {
+        cleartext_dst_writelines(param, linebg, linelen);
         linebg += linelen;
         len -= linelen;
     }
 
+    /* partial line, which is kept until the eol unless it is too long */
+    if (len < sizeof(param->clr_buf)) {
+        memcpy(param->clr_buf, linebg, len);
+        param->clr_buflen = len;
+    } else {
+        cleartext_dst_writeline(param, linebg, len, false);
+    }
     return RNP_SUCCESS;
 }
 
 static rnp_result_t
-signed_fill_signature(pgp_dest_signed_param_t *param, pgp_signature_t *sig, pgp_key_t *seckey)
+signed_prepare_signature(pgp_dest_signed_param_t *param,
+                         pgp_one_pass_sig_t *     onepass,
+                         pgp_key_t *              seckey,
+                         pgp_signature_t *        sig,
+                         pgp_key_pkt_t **         deckey)
 {
-    pgp_key_pkt_t *    deckey = NULL;
-    pgp_hash_t         hash;
     pgp_password_ctx_t ctx = {.op = PGP_OP_SIGN, .key = seckey};
     bool               res;
-    rnp_result_t       ret = RNP_ERROR_GENERIC;
+
+    sig->version = (pgp_version_t) 4;
+    if (onepass) {
+        sig->halg = onepass->halg;
+        sig->palg = onepass->palg;
+        sig->type = onepass->type;
+    } else {
+        sig->halg = pgp_hash_adjust_alg_to_key(param->ctx->halg, pgp_get_key_pkt(seckey));
+        sig->palg = pgp_get_key_alg(seckey);
+        sig->type =
+          param->ctx->detached && !param->ctx->textmode ? PGP_SIG_BINARY : PGP_SIG_TEXT;
+    }
 
     /* fill signature fields */
     res = signature_set_keyfp(sig, &seckey->fingerprint) &&
@@ -1076,101 +1306,146 @@ signed_fill_signature(pgp_dest_signed_param_t *param, pgp_signature_t *sig, pgp_
         return RNP_ERROR_OUT_OF_MEMORY;
     }
 
-    if (!pgp_hash_copy(&hash, pgp_hash_list_get(param->hashes, sig->halg))) {
-        RNP_LOG("failed to obtain hash");
-        return RNP_ERROR_BAD_PARAMETERS;
-    }
-
     /* decrypt the secret key if needed */
     if (pgp_is_key_encrypted(seckey)) {
-        deckey = pgp_decrypt_seckey(seckey, param->password_provider, &ctx);
-        if (!deckey) {
+        *deckey = pgp_decrypt_seckey(seckey, param->password_provider, &ctx);
+        if (!*deckey) {
             RNP_LOG("wrong secret key password");
-            pgp_hash_finish(&hash, NULL);
             return RNP_ERROR_BAD_PASSWORD;
         }
     } else {
-        deckey = &(seckey->pkt);
+        *deckey = &(seckey->pkt);
     }
 
-    /* calculate the signature */
-    ret = signature_calculate(sig, &deckey->material, &hash, rnp_ctx_rng_handle(param->ctx));
+    return RNP_SUCCESS;
+}
 
-    /* destroy decrypted secret key */
-    if (pgp_is_key_encrypted(seckey)) {
-        free_key_pkt(deckey);
-        free(deckey);
-        deckey = NULL;
+typedef struct pgp_sign_job_t {
+    pgp_dest_signed_param_t *param;
+    pgp_signature_t *        sigs;    /* signatures to calculate, in the output order */
+    pgp_key_pkt_t **         deckeys; /* decrypted secret keys for each of the signatures */
+    rnp_result_t *           results; /* result for each of the signatures */
+    rng_t *                  rngs;    /* per-worker RNGs, worker 0 uses the ctx's one */
+} pgp_sign_job_t;
+
+static bool
+signed_calculate_job(void *param, size_t idx, size_t worker)
+{
+    pgp_sign_job_t * job = (pgp_sign_job_t *) param;
+    rng_t *          rng = worker ? &job->rngs[worker] : rnp_ctx_rng_handle(job->param->ctx);
+    pgp_signature_t *sig = &job->sigs[idx];
+    pgp_hash_t       hash;
+
+    /* hash list is not changed anymore, so it is safe to clone contexts concurrently */
+    if (!pgp_hash_copy(&hash, pgp_hash_list_get(job->param->hashes, sig->halg))) {
+        RNP_LOG("failed to obtain hash");
+        job->results[idx] = RNP_ERROR_BAD_PARAMETERS;
+        return false;
     }
 
-    return ret;
+    job->results[idx] = signature_calculate(sig, &job->deckeys[idx]->material, &hash, rng);
+    return job->results[idx] == RNP_SUCCESS;
 }
 
+/* Secret key operation is the most expensive part for the multiple signers, so signatures are
+ * calculated in parallel. Keys are decrypted beforehand since password provider may be
+ * interactive, and signatures are written afterwards in the one-pass (signers) order. */
 static rnp_result_t
-signed_write_signature(pgp_dest_signed_param_t *param,
-                       pgp_one_pass_sig_t *     onepass,
-                       pgp_key_t *              seckey,
-                       pgp_dest_t *             writedst)
+signed_write_signatures(pgp_dest_signed_param_t *param, pgp_dest_t *writedst)
 {
-    pgp_signature_t sig = {(pgp_version_t) 0};
-    rnp_result_t    ret;
+    pgp_sign_job_t job = {0};
+    size_t         count = list_length(param->keys);
+    size_t         threads = rnp_parallel_threads(count);
+    size_t         prepared = 0;
+    list_item *    op = list_front(param->onepasses);
+    list_item *    key = NULL;
+    rnp_result_t   ret = RNP_ERROR_GENERIC;
+
+    job.param = param;
+    job.sigs = (pgp_signature_t *) calloc(count, sizeof(*job.sigs));
+    job.deckeys = (pgp_key_pkt_t **) calloc(count, sizeof(*job.deckeys));
+    job.results = (rnp_result_t *) calloc(count, sizeof(*job.results));
+    job.rngs = (rng_t *) calloc(threads, sizeof(*job.rngs));
+    if (!job.sigs || !job.deckeys || !job.results || !job.rngs) {
+        ret = RNP_ERROR_OUT_OF_MEMORY;
+        goto finish;
+    }
 
-    sig.version = (pgp_version_t) 4;
-    if (onepass) {
-        sig.halg = onepass->halg;
-        sig.palg = onepass->palg;
-        sig.type = onepass->type;
-    } else {
-        sig.halg = pgp_hash_adjust_alg_to_key(param->ctx->halg, pgp_get_key_pkt(seckey));
-        sig.palg = pgp_get_key_alg(seckey);
-        sig.type = param->ctx->detached ? PGP_SIG_BINARY : PGP_SIG_TEXT;
+    for (key = list_front(param->keys); key; key = list_next(key)) {
+        ret = signed_prepare_signature(param,
+                                       (pgp_one_pass_sig_t *) op,
+                                       *(pgp_key_t **) key,
+                                       &job.sigs[prepared],
+                                       &job.deckeys[prepared]);
+        if (ret) {
+            /* signature fields could be partially filled */
+            prepared++;
+            goto finish;
+        }
+        prepared++;
+        op = op ? list_next(op) : NULL;
+    }
+
+    for (size_t i = 1; i < threads; i++) {
+        if (!rng_init(&job.rngs[i], RNG_DRBG)) {
+            RNP_LOG("failed to init worker rng");
+            ret = RNP_ERROR_RNG;
+            goto finish;
+        }
     }
 
-    if (!(ret = signed_fill_signature(param, &sig, seckey))) {
-        ret = stream_write_signature(&sig, writedst) ? RNP_SUCCESS : RNP_ERROR_WRITE;
+    pgp_hash_workers_wait(param->hash_workers);
+    rnp_parallel_for(count, threads, signed_calculate_job, &job);
+
+    for (size_t i = 0; i < count; i++) {
+        if ((ret = job.results[i])) {
+            goto finish;
+        }
+        if (!stream_write_signature(&job.sigs[i], writedst)) {
+            ret = RNP_ERROR_WRITE;
+            goto finish;
+        }
     }
 
-    free_signature(&sig);
+    ret = RNP_SUCCESS;
+finish:
+    key = list_front(param->keys);
+    for (size_t i = 0; i < prepared; i++, key = list_next(key)) {
+        free_signature(&job.sigs[i]);
+        /* destroy decrypted secret key */
+        if (job.deckeys[i] && pgp_is_key_encrypted(*(pgp_key_t **) key)) {
+            free_key_pkt(job.deckeys[i]);
+            free(job.deckeys[i]);
+        }
+    }
+    if (job.rngs) {
+        for (size_t i = 1; i < threads; i++) {
+            rng_destroy(&job.rngs[i]);
+        }
+    }
+    free(job.sigs);
+    free(job.deckeys);
+    free(job.results);
+    free(job.rngs);
     return ret;
 }
 
 static rnp_result_t
 signed_dst_finish(pgp_dest_t *dst)
 {
-    rnp_result_t             ret;
     pgp_dest_signed_param_t *param = (pgp_dest_signed_param_t *) dst->param;
-    list_item *              op = list_front(param->onepasses);
-    list_item *              key = list_front(param->keys);
 
     /* attached signature, we keep onepasses in order of signatures */
-    for (; op && key; op = list_next(op), key = list_next(key)) {
-        pgp_one_pass_sig_t *onepass = (pgp_one_pass_sig_t *) op;
-        pgp_key_t *         seckey = *(pgp_key_t **) key;
-
-        if ((ret = signed_write_signature(param, onepass, seckey, param->writedst))) {
-            return ret;
-        }
-    }
-
-    return RNP_SUCCESS;
+    return signed_write_signatures(param, param->writedst);
 }
 
 static rnp_result_t
 signed_detached_dst_finish(pgp_dest_t *dst)
 {
-    rnp_result_t             ret;
     pgp_dest_signed_param_t *param = (pgp_dest_signed_param_t *) dst->param;
 
     /* just calculating and writing signatures to the output */
-    for (list_item *key = list_front(param->keys); key; key = list_next(key)) {
-        pgp_key_t *seckey = *(pgp_key_t **) key;
-
-        if ((ret = signed_write_signature(param, NULL, seckey, param->writedst))) {
-            return ret;
-        }
-    }
-
-    return RNP_SUCCESS;
+    return signed_write_signatures(param, param->writedst);
 }
 
 static rnp_result_t
@@ -1192,14 +1467,7 @@ cleartext_dst_finish(pgp_dest_t *dst)
         return ret;
     }
 
-    for (list_item *key = list_front(param->keys); key; key = list_next(key)) {
-        pgp_key_t *seckey = *(pgp_key_t **) key;
-
-        if ((ret = signed_write_signature(param, NULL, seckey, &armordst))) {
-            break;
-        }
-    }
-
+    ret = signed_write_signatures(param, &armordst);
     if (ret == RNP_SUCCESS) {
         ret = dst_finish(&armordst);
     }
@@ -1217,6 +1485,7 @@ signed_dst_close(pgp_dest_t *dst, bool discard)
         return;
     }
 
+    pgp_hash_workers_stop(param->hash_workers);
     pgp_hash_list_free(&param->hashes);
     list_destroy(&param->onepasses);
     list_destroy(&param->keys);
@@ -1229,7 +1498,7 @@ static void
 signed_dst_update(pgp_dest_t *dst, const void *buf, size_t len)
 {
     pgp_dest_signed_param_t *param = (pgp_dest_signed_param_t *) dst->param;
-    pgp_hash_list_update(param->hashes, buf, len);
+    signed_dst_hash(param, buf, len);
 }
 
 static rnp_result_t
@@ -1252,7 +1521,7 @@ signed_add_signer(pgp_dest_signed_param_t *param, pgp_key_t *key, bool last)
 
     // Add onepass
     onepass.version = 3;
-    onepass.type = PGP_SIG_BINARY;
+    onepass.type = param->ctx->textmode ? PGP_SIG_TEXT : PGP_SIG_BINARY;
     onepass.halg = halg;
     onepass.palg = pgp_get_key_alg(key);
     memcpy(onepass.keyid, key->keyid, PGP_KEY_ID_SIZE);
@@ -1327,6 +1596,9 @@ init_signed_dst(pgp_write_handler_t *handler, pgp_dest_t *dst, pgp_dest_t *write
         goto finish;
     }
 
+    /* Hash the data in parallel if there are several hash algorithms */
+    param->hash_workers = pgp_hash_workers_start(param->hashes);
+
     /* Writing headers for cleartext signed document */
     if (param->ctx->clearsign) {
         dst_write(param->writedst, ST_CLEAR_BEGIN, strlen(ST_CLEAR_BEGIN));
@@ -1353,91 +1625,408 @@ finish:
     return ret;
 }
 
-static rnp_result_t
-compressed_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
+static bool
+compressed_deflate_job(void *param, size_t idx, size_t worker)
 {
-    pgp_dest_compressed_param_t *param = (pgp_dest_compressed_param_t *) dst->param;
-    int                          zret;
+    pgp_dest_compressed_param_t *zparam = (pgp_dest_compressed_param_t *) param;
+    pgp_zblock_t *               blk = &zparam->zblocks[idx];
+    pgp_zstream_t *              z = &zparam->zworkers[worker];
+    const uint8_t *              dict = zparam->zdict;
+    size_t                       dictlen = zparam->zdictlen;
+    pgp_zret_t                   zret;
 
-    if (!param) {
-        RNP_LOG("wrong param");
-        return RNP_ERROR_BAD_PARAMETERS;
+    /* previous block of the batch is always full */
+    if (idx) {
+        dict = zparam->zblocks[idx - 1].in + PGP_ZBLOCK_SIZE - PGP_ZDICT_SIZE;
+        dictlen = PGP_ZDICT_SIZE;
     }
 
-    if ((param->alg == PGP_C_ZIP) || (param->alg == PGP_C_ZLIB)) {
-        param->z.next_in = (unsigned char *) buf;
-        param->z.avail_in = len;
-        param->z.next_out = param->cache + param->len;
-        param->z.avail_out = sizeof(param->cache) - param->len;
-
-        while (param->z.avail_in > 0) {
-            zret = deflate(&param->z, Z_NO_FLUSH);
-            /* Z_OK, Z_BUF_ERROR are ok for us, Z_STREAM_END will not happen here */
-            if (zret == Z_STREAM_ERROR) {
-                RNP_LOG("wrong deflate state");
-                return RNP_ERROR_BAD_STATE;
-            }
+    if (!pgp_deflate_reset(z)) {
+        RNP_LOG("failed to reset deflate");
+        return false;
+    }
+    if (dictlen && !pgp_deflate_set_dictionary(z, dict, dictlen)) {
+        RNP_LOG("failed to set deflate dictionary");
+        return false;
+    }
 
-            /* writing only full blocks, the rest will be written in close */
-            if (param->z.avail_out == 0) {
-                dst_write(param->pkt.writedst, param->cache, sizeof(param->cache));
-                param->len = 0;
-                param->z.next_out = param->cache;
-                param->z.avail_out = sizeof(param->cache);
-            }
-        }
+    z->next_in = blk->in;
+    z->avail_in = blk->inlen;
+    z->next_out = blk->out;
+    z->avail_out = zparam->zoutcap;
+    zret = pgp_deflate(z, blk->last ? PGP_ZFLUSH_FINISH : PGP_ZFLUSH_SYNC);
+    if (blk->last ? (zret != PGP_ZRET_END) : (zret != PGP_ZRET_OK || z->avail_out == 0)) {
+        RNP_LOG("deflate failed");
+        return false;
+    }
+    blk->outlen = zparam->zoutcap - z->avail_out;
 
-        param->len = sizeof(param->cache) - param->z.avail_out;
-        return RNP_SUCCESS;
-    } else if (param->alg == PGP_C_BZIP2) {
-#ifdef HAVE_BZLIB_H
-        param->bz.next_in = (char *) buf;
-        param->bz.avail_in = len;
-        param->bz.next_out = (char *) (param->cache + param->len);
-        param->bz.avail_out = sizeof(param->cache) - param->len;
+    if (zparam->alg == PGP_C_ZLIB) {
+        blk->adler = pgp_adler32(1, blk->in, blk->inlen);
+    }
+    return true;
+}
 
-        while (param->bz.avail_in > 0) {
-            zret = BZ2_bzCompress(&param->bz, BZ_RUN);
-            if (zret < 0) {
-                RNP_LOG("error %d", zret);
-                return RNP_ERROR_BAD_STATE;
-            }
+/* compress count blocks of the batch on the worker threads and write them in order */
+static rnp_result_t
+compressed_dst_deflate_blocks(pgp_dest_compressed_param_t *param, size_t count, bool last)
+{
+    param->zblocks[count - 1].last = last;
+    if (!rnp_parallel_for(count, param->zthreads, compressed_deflate_job, param)) {
+        return RNP_ERROR_BAD_STATE;
+    }
 
-            /* writing only full blocks, the rest will be written in close */
-            if (param->bz.avail_out == 0) {
-                dst_write(param->pkt.writedst, param->cache, sizeof(param->cache));
-                param->len = 0;
-                param->bz.next_out = (char *) param->cache;
-                param->bz.avail_out = sizeof(param->cache);
-            }
+    for (size_t i = 0; i < count; i++) {
+        pgp_zblock_t *blk = &param->zblocks[i];
+        dst_write(param->pkt.writedst, blk->out, blk->outlen);
+        if (param->alg == PGP_C_ZLIB) {
+            param->zadler = pgp_adler32_combine(param->zadler, blk->adler, blk->inlen);
         }
+    }
 
-        param->len = sizeof(param->cache) - param->bz.avail_out;
-        return RNP_SUCCESS;
-#else
-        return RNP_ERROR_NOT_IMPLEMENTED;
-#endif
-    } else {
-        RNP_LOG("unknown algorithm");
-        return RNP_ERROR_BAD_PARAMETERS;
+    if (!last) {
+        memcpy(param->zdict,
+               param->zblocks[count - 1].in + PGP_ZBLOCK_SIZE - PGP_ZDICT_SIZE,
+               PGP_ZDICT_SIZE);
+        param->zdictlen = PGP_ZDICT_SIZE;
+    }
+    for (size_t i = 0; i < count; i++) {
+        param->zblocks[i].inlen = 0;
     }
+    param->zblockc = 0;
+    return param->pkt.writedst->werr;
 }
 
 static rnp_result_t
-compressed_dst_finish(pgp_dest_t *dst)
+compressed_dst_write_blocks(pgp_dest_compressed_param_t *param, const uint8_t *buf, size_t len)
 {
-    int                          zret;
-    pgp_dest_compressed_param_t *param = (pgp_dest_compressed_param_t *) dst->param;
+    rnp_result_t ret;
 
-    if ((param->alg == PGP_C_ZIP) || (param->alg == PGP_C_ZLIB)) {
-        param->z.next_in = Z_NULL;
-        param->z.avail_in = 0;
-        param->z.next_out = param->cache + param->len;
-        param->z.avail_out = sizeof(param->cache) - param->len;
+    while (len) {
+        pgp_zblock_t *blk = &param->zblocks[param->zblockc];
+        size_t        part = PGP_ZBLOCK_SIZE - blk->inlen;
+
+        if (part > len) {
+            part = len;
+        }
+        memcpy(blk->in + blk->inlen, buf, part);
+        blk->inlen += part;
+        buf += part;
+        len -= part;
+
+        if (blk->inlen < PGP_ZBLOCK_SIZE) {
+            break;
+        }
+        if ((++param->zblockc == param->zthreads) &&
+            (ret = compressed_dst_deflate_blocks(param, param->zblockc, false))) {
+            return ret;
+        }
+    }
+    return RNP_SUCCESS;
+}
+
+static rnp_result_t
+init_compressed_blocks(pgp_dest_compressed_param_t *param, int level, size_t threads)
+{
+    param->zthreads = threads;
+    param->zworkers = (pgp_zstream_t *) calloc(threads, sizeof(*param->zworkers));
+    param->zblocks = (pgp_zblock_t *) calloc(threads, sizeof(*param->zblocks));
+    if (!param->zworkers || !param->zblocks) {
+        return RNP_ERROR_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        if (!pgp_deflate_init(&param->zworkers[i], level, false)) {
+            return RNP_ERROR_NOT_SUPPORTED;
+        }
+    }
+
+    /* sync flush marker and some slack above the deflate's worst case */
+    param->zoutcap = pgp_deflate_bound(&param->zworkers[0], PGP_ZBLOCK_SIZE) + 64;
+    for (size_t i = 0; i < threads; i++) {
+        param->zblocks[i].in = (uint8_t *) malloc(PGP_ZBLOCK_SIZE);
+        param->zblocks[i].out = (uint8_t *) malloc(param->zoutcap);
+        if (!param->zblocks[i].in || !param->zblocks[i].out) {
+            return RNP_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    /* zlib stream header, the same as deflate() would write for this level: deflate method
+     * with 32KB window, and compression level hint */
+    if (param->alg == PGP_C_ZLIB) {
+        unsigned hdr = (8 + ((15 - 8) << 4)) << 8;
+        uint8_t  buf[2];
+
+        if (level < 0) {
+            level = 6;
+        }
+        hdr |= (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+        hdr += 31 - (hdr % 31);
+        buf[0] = hdr >> 8;
+        buf[1] = hdr & 0xff;
+        dst_write(param->pkt.writedst, buf, 2);
+        param->zadler = 1; /* adler32 of the empty data */
+    }
+    return RNP_SUCCESS;
+}
+
+/* write the packet header and initialize the compression */
+static rnp_result_t
+compressed_dst_start(pgp_dest_compressed_param_t *param, pgp_dest_t *writedst)
+{
+    rnp_result_t ret;
+    uint8_t      buf;
+    int          zret;
+    size_t       threads;
+
+    /* initializing partial length or indeterminate packet, writing header */
+    if (!init_streamed_packet(&param->pkt, writedst)) {
+        RNP_LOG("failed to init streamed packet");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    /* compression algorithm */
+    buf = param->alg;
+    dst_write(param->pkt.writedst, &buf, 1);
+
+    /* initializing compression */
+    switch (param->alg) {
+    case PGP_C_ZIP:
+    case PGP_C_ZLIB:
+        if (param->ctx->zparallel && ((threads = rnp_parallel_threads(0)) > 1)) {
+            ret = init_compressed_blocks(param, param->ctx->zlevel, threads);
+            if (ret) {
+                return ret;
+            }
+            break;
+        }
+        (void) memset(&param->z, 0x0, sizeof(param->z));
+        if (!pgp_deflate_init(&param->z, param->ctx->zlevel, param->alg == PGP_C_ZLIB)) {
+            return RNP_ERROR_NOT_SUPPORTED;
+        }
+        break;
+#ifdef HAVE_BZLIB_H
+    case PGP_C_BZIP2:
+        if (param->ctx->zparallel && ((threads = rnp_parallel_threads(0)) > 1)) {
+            ret = bz2_writer_create(
+              &param->bzwriter, param->pkt.writedst, param->ctx->zlevel, threads);
+            if (ret) {
+                return ret;
+            }
+            break;
+        }
+        (void) memset(&param->bz, 0x0, sizeof(param->bz));
+        zret = BZ2_bzCompressInit(&param->bz, param->ctx->zlevel, 0, 0);
+        if (zret != BZ_OK) {
+            RNP_LOG("failed to init bz, error %d", zret);
+            return RNP_ERROR_NOT_SUPPORTED;
+        }
+        break;
+#endif
+    default:
+        RNP_LOG("unknown compression algorithm");
+        return RNP_ERROR_NOT_SUPPORTED;
+    }
+    param->zstarted = true;
+    return RNP_SUCCESS;
+}
+
+/* check whether data is compressible with the trial deflate */
+static bool
+compressed_sample_incompressible(const uint8_t *sample, size_t len)
+{
+    pgp_zstream_t z = {};
+    uint8_t *     out = NULL;
+    size_t        outcap;
+    bool          res = false;
+
+    if (!pgp_deflate_init(&z, 1, false)) {
+        return false;
+    }
+    outcap = pgp_deflate_bound(&z, len);
+    if (!(out = (uint8_t *) malloc(outcap))) {
+        goto done;
+    }
+    z.next_in = sample;
+    z.avail_in = len;
+    z.next_out = out;
+    z.avail_out = outcap;
+    if (pgp_deflate(&z, PGP_ZFLUSH_FINISH) != PGP_ZRET_END) {
+        goto done;
+    }
+    res = (outcap - z.avail_out) * 16 > len * 15;
+done:
+    free(out);
+    pgp_zstream_destroy(&z);
+    return res;
+}
+
+/* start the compression or skip it, depending on the sampled data */
+static rnp_result_t
+compressed_dst_decide(pgp_dest_compressed_param_t *param)
+{
+    bool skip = compressed_sample_incompressible(param->zsample, param->zsamplelen);
+
+    param->zsample = NULL;
+    if (!skip) {
+        return compressed_dst_start(param, param->zrawdst);
+    }
+    param->zskipped = true;
+    param->ctx->zskipped = true;
+    return RNP_SUCCESS;
+}
+
+static rnp_result_t
+compressed_dst_write(pgp_dest_t *dst, const void *buf, size_t len)
+{
+    pgp_dest_compressed_param_t *param = (pgp_dest_compressed_param_t *) dst->param;
+    int                          zret;
+    rnp_result_t                 ret;
+
+    if (!param) {
+        RNP_LOG("wrong param");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    if (param->zsample) {
+        uint8_t *sample = param->zsample;
+        size_t   part = PGP_ZSAMPLE_SIZE - param->zsamplelen;
+
+        if (part > len) {
+            part = len;
+        }
+        memcpy(sample + param->zsamplelen, buf, part);
+        param->zsamplelen += part;
+        buf = (const uint8_t *) buf + part;
+        len -= part;
+        if (param->zsamplelen < PGP_ZSAMPLE_SIZE) {
+            return RNP_SUCCESS;
+        }
+
+        ret = compressed_dst_decide(param);
+        if (!ret) {
+            ret = compressed_dst_write(dst, sample, param->zsamplelen);
+        }
+        free(sample);
+        if (ret || !len) {
+            return ret;
+        }
+    }
+
+    if (param->zskipped) {
+        dst_write(param->zrawdst, buf, len);
+        return param->zrawdst->werr;
+    }
+
+    if (param->zthreads) {
+        return compressed_dst_write_blocks(param, (const uint8_t *) buf, len);
+    }
+#ifdef HAVE_BZLIB_H
+    if (param->bzwriter) {
+        return bz2_writer_write(param->bzwriter, buf, len);
+    }
+#endif
+
+    if ((param->alg == PGP_C_ZIP) || (param->alg == PGP_C_ZLIB)) {
+        param->z.next_in = (const uint8_t *) buf;
+        param->z.avail_in = len;
+        param->z.next_out = param->cache + param->len;
+        param->z.avail_out = sizeof(param->cache) - param->len;
+
+        while (param->z.avail_in > 0) {
+            /* stream end will not happen here */
+            if (pgp_deflate(&param->z, PGP_ZFLUSH_NONE) == PGP_ZRET_ERROR) {
+                RNP_LOG("wrong deflate state");
+                return RNP_ERROR_BAD_STATE;
+            }
+
+            /* writing only full blocks, the rest will be written in close */
+            if (param->z.avail_out == 0) {
+                dst_write(param->pkt.writedst, param->cache, sizeof(param->cache));
+                param->len = 0;
+                param->z.next_out = param->cache;
+                param->z.avail_out = sizeof(param->cache);
+            }
+        }
+
+        param->len = sizeof(param->cache) - param->z.avail_out;
+        return RNP_SUCCESS;
+    } else if (param->alg == PGP_C_BZIP2) {
+#ifdef HAVE_BZLIB_H
+        param->bz.next_in = (char *) buf;
+        param->bz.avail_in = len;
+        param->bz.next_out = (char *) (param->cache + param->len);
+        param->bz.avail_out = sizeof(param->cache) - param->len;
+
+        while (param->bz.avail_in > 0) {
+            zret = BZ2_bzCompress(&param->bz, BZ_RUN);
+            if (zret < 0) {
+                RNP_LOG("error %d", zret);
+                return RNP_ERROR_BAD_STATE;
+            }
+
+            /* writing only full blocks, the rest will be written in close */
+            if (param->bz.avail_out == 0) {
+                dst_write(param->pkt.writedst, param->cache, sizeof(param->cache));
+                param->len = 0;
+                param->bz.next_out = (char *) param->cache;
+                param->bz.avail_out = sizeof(param->cache);
+            }
+        }
+
+        param->len = sizeof(param->cache) - param->bz.avail_out;
+        return RNP_SUCCESS;
+#else
+        return RNP_ERROR_NOT_IMPLEMENTED;
+#endif
+    } else {
+        RNP_LOG("unknown algorithm");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+}
+
+static rnp_result_t
+compressed_dst_finish(pgp_dest_t *dst)
+{
+    int                          zret;
+    pgp_dest_compressed_param_t *param = (pgp_dest_compressed_param_t *) dst->param;
+
+    if (param->zsample) {
+        /* stream is shorter than the sample */
+        uint8_t *    sample = param->zsample;
+        rnp_result_t ret = compressed_dst_decide(param);
+        if (!ret) {
+            ret = compressed_dst_write(dst, sample, param->zsamplelen);
+        }
+        free(sample);
+        if (ret) {
+            return ret;
+        }
+    }
+    if (param->zskipped) {
+        return param->zrawdst->werr;
+    }
+
+    if (param->zthreads) {
+        /* current block is not full and may be empty, it is the last one */
+        rnp_result_t ret = compressed_dst_deflate_blocks(param, param->zblockc + 1, true);
+        if (ret) {
+            return ret;
+        }
+        if (param->alg == PGP_C_ZLIB) {
+            uint8_t trailer[4];
+            STORE32BE(trailer, param->zadler);
+            dst_write(param->pkt.writedst, trailer, sizeof(trailer));
+        }
+    } else if ((param->alg == PGP_C_ZIP) || (param->alg == PGP_C_ZLIB)) {
+        param->z.next_in = NULL;
+        param->z.avail_in = 0;
+        param->z.next_out = param->cache + param->len;
+        param->z.avail_out = sizeof(param->cache) - param->len;
         do {
-            zret = deflate(&param->z, Z_FINISH);
+            zret = pgp_deflate(&param->z, PGP_ZFLUSH_FINISH);
 
-            if (zret == Z_STREAM_ERROR) {
+            if (zret == PGP_ZRET_ERROR) {
                 RNP_LOG("wrong deflate state");
                 return RNP_ERROR_BAD_STATE;
             }
@@ -1448,13 +2037,18 @@ compressed_dst_finish(pgp_dest_t *dst)
                 param->z.next_out = param->cache;
                 param->z.avail_out = sizeof(param->cache);
             }
-        } while (zret != Z_STREAM_END);
+        } while (zret != PGP_ZRET_END);
 
         param->len = sizeof(param->cache) - param->z.avail_out;
         dst_write(param->pkt.writedst, param->cache, param->len);
     }
 #ifdef HAVE_BZLIB_H
-    if (param->alg == PGP_C_BZIP2) {
+    if (param->bzwriter) {
+        rnp_result_t ret = bz2_writer_finish(param->bzwriter);
+        if (ret) {
+            return ret;
+        }
+    } else if (param->alg == PGP_C_BZIP2) {
         param->bz.next_in = NULL;
         param->bz.avail_in = 0;
         param->bz.next_out = (char *) (param->cache + param->len);
@@ -1497,9 +2091,9 @@ compressed_dst_close(pgp_dest_t *dst, bool discard)
         return;
     }
 
-    if (param->zstarted) {
+    if (param->zstarted && !param->zthreads) {
         if ((param->alg == PGP_C_ZIP) || (param->alg == PGP_C_ZLIB)) {
-            deflateEnd(&param->z);
+            pgp_zstream_destroy(&param->z);
         }
 #ifdef HAVE_BZLIB_H
         if (param->alg == PGP_C_BZIP2) {
@@ -1508,7 +2102,29 @@ compressed_dst_close(pgp_dest_t *dst, bool discard)
 #endif
     }
 
-    close_streamed_packet(&param->pkt, discard);
+    if (param->zworkers) {
+        /* not initialized streams are zeroed, so they are safe to destroy */
+        for (size_t i = 0; i < param->zthreads; i++) {
+            pgp_zstream_destroy(&param->zworkers[i]);
+        }
+        free(param->zworkers);
+    }
+    if (param->zblocks) {
+        for (size_t i = 0; i < param->zthreads; i++) {
+            free(param->zblocks[i].in);
+            free(param->zblocks[i].out);
+        }
+        free(param->zblocks);
+    }
+#ifdef HAVE_BZLIB_H
+    bz2_writer_destroy(param->bzwriter);
+#endif
+    free(param->zsample);
+
+    /* packet is not started if compression was skipped or not decided yet */
+    if (param->pkt.writedst) {
+        close_streamed_packet(&param->pkt, discard);
+    }
     free(param);
     dst->param = NULL;
 }
@@ -1517,9 +2133,7 @@ static rnp_result_t
 init_compressed_dst(pgp_write_handler_t *handler, pgp_dest_t *dst, pgp_dest_t *writedst)
 {
     pgp_dest_compressed_param_t *param;
-    rnp_result_t                 ret = RNP_ERROR_GENERIC;
-    uint8_t                      buf;
-    int                          zret;
+    rnp_result_t                 ret;
 
     if (!init_dst_common(dst, sizeof(*param))) {
         return RNP_ERROR_OUT_OF_MEMORY;
@@ -1531,57 +2145,23 @@ init_compressed_dst(pgp_write_handler_t *handler, pgp_dest_t *dst, pgp_dest_t *w
     dst->close = compressed_dst_close;
     dst->type = PGP_STREAM_COMPRESSED;
     param->alg = (pgp_compression_type_t) handler->ctx->zalg;
+    param->ctx = handler->ctx;
     param->pkt.partial = true;
     param->pkt.indeterminate = false;
     param->pkt.tag = PGP_PTAG_CT_COMPRESSED;
+    handler->ctx->zskipped = false;
 
-    /* initializing partial length or indeterminate packet, writing header */
-    if (!init_streamed_packet(&param->pkt, writedst)) {
-        RNP_LOG("failed to init streamed packet");
-        ret = RNP_ERROR_BAD_PARAMETERS;
-        goto finish;
-    }
-
-    /* compression algorithm */
-    buf = param->alg;
-    dst_write(param->pkt.writedst, &buf, 1);
-
-    /* initializing compression */
-    switch (param->alg) {
-    case PGP_C_ZIP:
-    case PGP_C_ZLIB:
-        (void) memset(&param->z, 0x0, sizeof(param->z));
-        if (param->alg == PGP_C_ZIP) {
-            zret = deflateInit2(
-              &param->z, handler->ctx->zlevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
-        } else {
-            zret = deflateInit(&param->z, handler->ctx->zlevel);
-        }
-
-        if (zret != Z_OK) {
-            RNP_LOG("failed to init zlib, error %d", zret);
-            ret = RNP_ERROR_NOT_SUPPORTED;
+    if (handler->ctx->zadaptive) {
+        /* decision is made once the sample is collected or the stream is finished */
+        param->zrawdst = writedst;
+        if (!(param->zsample = (uint8_t *) malloc(PGP_ZSAMPLE_SIZE))) {
+            ret = RNP_ERROR_OUT_OF_MEMORY;
             goto finish;
         }
-        break;
-#ifdef HAVE_BZLIB_H
-    case PGP_C_BZIP2:
-        (void) memset(&param->bz, 0x0, sizeof(param->bz));
-        zret = BZ2_bzCompressInit(&param->bz, handler->ctx->zlevel, 0, 0);
-        if (zret != BZ_OK) {
-            RNP_LOG("failed to init bz, error %d", zret);
-            ret = RNP_ERROR_NOT_SUPPORTED;
-            goto finish;
-        }
-        break;
-#endif
-    default:
-        RNP_LOG("unknown compression algorithm");
-        ret = RNP_ERROR_NOT_SUPPORTED;
-        goto finish;
+        return RNP_SUCCESS;
     }
-    param->zstarted = true;
-    ret = RNP_SUCCESS;
+
+    ret = compressed_dst_start(param, writedst);
 finish:
     if (ret != RNP_SUCCESS) {
         compressed_dst_close(dst, true);
@@ -1651,8 +2231,8 @@ init_literal_dst(pgp_write_handler_t *handler, pgp_dest_t *dst, pgp_dest_t *writ
         ret = RNP_ERROR_BAD_PARAMETERS;
         goto finish;
     }
-    /* content type - forcing binary now */
-    buf[0] = (uint8_t) 'b';
+    /* content type, text data is converted to the canonical form in the source */
+    buf[0] = (uint8_t)(handler->ctx->textmode ? 't' : 'b');
     /* filename */
     if (handler->ctx->filename) {
         flen = strlen(handler->ctx->filename);
@@ -1757,8 +2337,17 @@ rnp_encrypt_src(pgp_write_handler_t *handler, pgp_source_t *src, pgp_dest_t *dst
     */
     pgp_dest_t   dests[4];
     int          destc = 0;
+    pgp_source_t textsrc = {0};
     rnp_result_t ret = RNP_ERROR_GENERIC;
 
+    /* converting the text input to the canonical form */
+    if (handler->ctx->textmode) {
+        if ((ret = init_text_src(&textsrc, src))) {
+            return ret;
+        }
+        src = &textsrc;
+    }
+
     /* pushing armoring stream, which will write to the output */
     if (handler->ctx->armor) {
         if ((ret = init_armored_dst(&dests[destc], dst, PGP_ARMORED_MESSAGE))) {
@@ -1793,7 +2382,7 @@ finish:
     for (int i = destc - 1; i >= 0; i--) {
         dst_close(&dests[i], ret != RNP_SUCCESS);
     }
-
+    src_close(&textsrc);
     return ret;
 }
 
@@ -1808,8 +2397,17 @@ rnp_sign_src(pgp_write_handler_t *handler, pgp_source_t *src, pgp_dest_t *dst)
     */
     pgp_dest_t   dests[4];
     unsigned     destc = 0;
+    pgp_source_t textsrc = {0};
     rnp_result_t ret = RNP_ERROR_GENERIC;
 
+    /* converting the text input to the canonical form, cleartext signature does it itself */
+    if (handler->ctx->textmode && !handler->ctx->clearsign) {
+        if ((ret = init_text_src(&textsrc, src))) {
+            return ret;
+        }
+        src = &textsrc;
+    }
+
     /* pushing armoring stream, which will write to the output */
     if (handler->ctx->armor && !handler->ctx->clearsign) {
         ret = init_armored_dst(&dests[destc], dst, PGP_ARMORED_MESSAGE);
@@ -1849,6 +2447,7 @@ finish:
     for (int i = destc - 1; i >= 0; i--) {
         dst_close(&dests[i], ret != RNP_SUCCESS);
     }
+    src_close(&textsrc);
     return ret;
 }
 
@@ -1864,6 +2463,7 @@ rnp_encrypt_sign_src(pgp_write_handler_t *handler, pgp_source_t *src, pgp_dest_t
     */
     pgp_dest_t   dests[5];
     unsigned     destc = 0;
+    pgp_source_t textsrc = {0};
     rnp_result_t ret = RNP_SUCCESS;
 
     /* we may use only attached signatures here */
@@ -1872,6 +2472,14 @@ rnp_encrypt_sign_src(pgp_write_handler_t *handler, pgp_source_t *src, pgp_dest_t
         return RNP_ERROR_BAD_PARAMETERS;
     }
 
+    /* converting the text input to the canonical form */
+    if (handler->ctx->textmode) {
+        if ((ret = init_text_src(&textsrc, src))) {
+            return ret;
+        }
+        src = &textsrc;
+    }
+
     /* pushing armoring stream, which will write to the output */
     if (handler->ctx->armor) {
         ret = init_armored_dst(&dests[destc], dst, PGP_ARMORED_MESSAGE);
@@ -1913,5 +2521,402 @@ finish:
     for (int i = destc - 1; i >= 0; i--) {
         dst_close(&dests[i], ret != RNP_SUCCESS);
     }
+    src_close(&textsrc);
+    return ret;
+}
+
+/* size of the packet with the new format length header */
+static uint64_t
+pkt_size(uint64_t len)
+{
+    uint8_t hdr[5];
+    return 1 + write_packet_len(hdr, len) + len;
+}
+
+/* size of the streamed packet written via init_partial_pkt_dst() */
+static uint64_t
+partial_pkt_size(uint64_t len)
+{
+    uint64_t parts = len ? (len - 1) >> PGP_PARTIAL_PKT_SIZE_BITS : 0;
+    uint8_t  hdr[5];
+
+    /* tag, header byte for each of the full parts, and the last part's length */
+    return 1 + parts + write_packet_len(hdr, len - (parts << PGP_PARTIAL_PKT_SIZE_BITS)) +
+           len;
+}
+
+/* upper bound for the compressed data size, including the algorithm byte */
+static uint64_t
+compressed_data_size(pgp_compression_type_t alg, uint64_t len)
+{
+    /* deflateBound() for the default parameters, zlib wrapper, and sync flush marker after
+     * each of the parallel blocks */
+    uint64_t zsize = len + (len >> 12) + (len >> 14) + (len >> 25) + 13 + 6 +
+                     6 * (len / PGP_ZBLOCK_SIZE + 1);
+    if (alg == PGP_C_BZIP2) {
+        /* 1% plus 600 bytes, as per bzip2 docs, for each of the parallel streams */
+        zsize = len + len / 100 + 600 * (len / PGP_ZBLOCK_SIZE + 1);
+    }
+    return 1 + zsize;
+}
+
+/* size of the literal data packet's body */
+static uint64_t
+literal_data_size(rnp_ctx_t *ctx, uint64_t len)
+{
+    size_t flen = ctx->filename ? strlen(ctx->filename) : 0;
+    /* content type, filename, timestamp and data */
+    return 2 + MIN(flen, 255) + 4 + len;
+}
+
+/* upper bound for the signature packet size, MPIs may be shorter because of leading zeroes */
+static rnp_result_t
+signed_signature_size(pgp_key_t *key, uint64_t *size)
+{
+    const pgp_key_material_t *material = &pgp_get_key_pkt(key)->material;
+    const ec_curve_desc_t *   curve = NULL;
+    /* version, type and algorithms, hashed subpackets length */
+    uint64_t len = 4 + 2;
+
+    /* issuer fingerprint, creation and expiration time subpackets */
+    len += 3 + key->fingerprint.length + 6 + 6;
+    /* unhashed subpackets length, issuer key id, left 16 bits of the hash */
+    len += 2 + 10 + 2;
+
+    switch (pgp_get_key_alg(key)) {
+    case PGP_PKA_RSA:
+        len += 2 + mpi_bytes(&material->rsa.n);
+        break;
+    case PGP_PKA_DSA:
+        len += 2 * (2 + mpi_bytes(&material->dsa.q));
+        break;
+    case PGP_PKA_EDDSA:
+    case PGP_PKA_ECDSA:
+    case PGP_PKA_SM2:
+        if (!(curve = get_curve_desc(material->ec.curve))) {
+            return RNP_ERROR_BAD_PARAMETERS;
+        }
+        len += 2 * (2 + BITS_TO_BYTES(curve->bitlen));
+        break;
+    default:
+        RNP_LOG("unsupported signing algorithm %d", (int) pgp_get_key_alg(key));
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    *size = pkt_size(len);
+    return RNP_SUCCESS;
+}
+
+/* size of the public key encrypted session key packet */
+static rnp_result_t
+encrypted_pk_sesskey_size(const pgp_key_pkt_t *keypkt,
+                          unsigned             keylen,
+                          uint64_t *           size,
+                          bool *               exact)
+{
+    const ec_curve_desc_t *curve = NULL;
+    /* version, key id and algorithm */
+    uint64_t len = 1 + PGP_KEY_ID_SIZE + 1;
+    /* algorithm, session key and checksum */
+    size_t mlen = 1 + keylen + 2;
+
+    switch (keypkt->alg) {
+    case PGP_PKA_RSA:
+    case PGP_PKA_RSA_ENCRYPT_ONLY:
+        len += 2 + mpi_bytes(&keypkt->material.rsa.n);
+        *exact = false;
+        break;
+    case PGP_PKA_ELGAMAL:
+        len += 2 * (2 + mpi_bytes(&keypkt->material.eg.p));
+        *exact = false;
+        break;
+    case PGP_PKA_SM2:
+        if (!(curve = get_curve_desc(keypkt->material.ec.curve))) {
+            return RNP_ERROR_BAD_PARAMETERS;
+        }
+        /* point, encrypted data and hash, followed by the hash algorithm byte */
+        len += 2 + 2 * BITS_TO_BYTES(curve->bitlen) + 1 + mlen +
+               pgp_digest_length(PGP_HASH_SM3) + 1;
+        break;
+    case PGP_PKA_ECDH:
+        /* uncompressed ephemeral point, as the recipient's one, then key wrapped session
+         * key, padded to 8 bytes */
+        len += 2 + mpi_bytes(&keypkt->material.ec.p) + 1 + (mlen / 8 + 1) * 8 + 8;
+        break;
+    default:
+        RNP_LOG("unsupported alg: %d", keypkt->alg);
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    *size = pkt_size(len);
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_write_sesskeys_size(pgp_write_handler_t *handler, uint64_t *size, bool *exact)
+{
+    rnp_ctx_t *ctx = handler->ctx;
+    unsigned   keylen = pgp_key_size(ctx->ealg);
+    size_t     pkeycount = list_length(ctx->recipients);
+    size_t     skeycount = list_length(ctx->passwords);
+    bool       singlepass = !pkeycount && (skeycount == 1) && !ctx->aalg;
+    uint64_t   total = 0;
+
+    *exact = true;
+    if (!keylen) {
+        RNP_LOG("unknown symmetric algorithm");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    if (!pkeycount && !skeycount) {
+        RNP_LOG("no recipients");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    if (ctx->aalg && (ctx->aalg != PGP_AEAD_EAX) && (ctx->aalg != PGP_AEAD_OCB)) {
+        RNP_LOG("unknown AEAD algorithm");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    for (list_item *recipient = list_front(ctx->recipients); recipient;
+         recipient = list_next(recipient)) {
+        pgp_key_t *userkey = find_suitable_key(PGP_OP_ENCRYPT_SYM,
+                                               *(pgp_key_t **) recipient,
+                                               handler->key_provider,
+                                               PGP_KF_ENCRYPT);
+        uint64_t   pksize = 0;
+        if (!userkey) {
+            return RNP_ERROR_NO_SUITABLE_KEY;
+        }
+        rnp_result_t ret =
+          encrypted_pk_sesskey_size(pgp_get_key_pkt(userkey), keylen, &pksize, exact);
+        if (ret) {
+            return ret;
+        }
+        total += pksize;
+    }
+
+    for (list_item *pi = list_front(ctx->passwords); pi; pi = list_next(pi)) {
+        rnp_symmetric_pass_info_t *pass = (rnp_symmetric_pass_info_t *) pi;
+        /* version, algorithm, s2k specifier and hash */
+        uint64_t sklen = 2 + 2;
+
+        if (pass->s2k.specifier != PGP_S2KS_SIMPLE) {
+            sklen += PGP_SALT_SIZE;
+        }
+        if (pass->s2k.specifier == PGP_S2KS_ITERATED_AND_SALTED) {
+            sklen++;
+        }
+        if (ctx->aalg) {
+            /* AEAD algorithm, iv, encrypted key and tag */
+            sklen += 1 + pgp_cipher_aead_nonce_len(ctx->aalg) + keylen +
+                     pgp_cipher_aead_tag_len(ctx->aalg);
+        } else if (!singlepass) {
+            sklen += 1 + keylen;
+        }
+        total += pkt_size(sklen);
+    }
+
+    *size = total;
+    return RNP_SUCCESS;
+}
+
+/* size of the session key packets and encrypted data packet, see init_encrypted_dst() */
+static rnp_result_t
+encrypted_dst_size(rnp_ctx_t *ctx, uint64_t sesskeys, uint64_t len, uint64_t *size)
+{
+    uint64_t body = 0;
+
+    if (ctx->aalg && (ctx->aalg != PGP_AEAD_EAX) && (ctx->aalg != PGP_AEAD_OCB)) {
+        RNP_LOG("unknown AEAD algorithm");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    if (ctx->aalg && ((ctx->abits < 0) || (ctx->abits > 56))) {
+        RNP_LOG("wrong AEAD chunk bits");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    if (ctx->aalg) {
+        uint64_t chunklen = (uint64_t) 1 << (ctx->abits + 6);
+        uint64_t chunks = (len + chunklen - 1) / chunklen;
+        /* header and iv, data and tag of each chunk, and the final tag */
+        body = 4 + pgp_cipher_aead_nonce_len(ctx->aalg) + len +
+               (chunks + 1) * pgp_cipher_aead_tag_len(ctx->aalg);
+    } else {
+        /* version, prefix and its repeated last two bytes, data and MDC packet */
+        body = 1 + pgp_block_size(ctx->ealg) + 2 + len + MDC_V1_SIZE;
+    }
+
+    *size = sesskeys + partial_pkt_size(body);
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_write_output_size(pgp_write_handler_t *handler,
+                      bool                 encrypt,
+                      uint64_t             len,
+                      const uint64_t *     sesskeys,
+                      uint64_t *           size,
+                      bool *               exact)
+{
+    rnp_ctx_t *  ctx = handler->ctx;
+    bool         sign = list_length(ctx->signers) > 0;
+    bool         attached = !ctx->detached && !ctx->clearsign;
+    uint64_t     sigs = 0;
+    uint64_t     data = 0;
+    rnp_result_t ret;
+
+    *exact = true;
+    if (!encrypt && !sign) {
+        RNP_LOG("no signers");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+    if (encrypt && !attached) {
+        RNP_LOG("cannot clearsign or sign detached together with encryption");
+        return RNP_ERROR_BAD_PARAMETERS;
+    }
+
+    /* text data is converted to the canonical form with \r\n line endings */
+    if (ctx->textmode && len) {
+        len *= 2;
+        *exact = false;
+    }
+
+    /* signatures, and one-pass signatures for the attached ones */
+    for (list_item *sg = list_front(ctx->signers); sg; sg = list_next(sg)) {
+        uint64_t sigsize = 0;
+        if ((ret = signed_signature_size(*(pgp_key_t **) sg, &sigsize))) {
+            return ret;
+        }
+        sigs += sigsize + (attached ? pkt_size(13) : 0);
+        *exact = false;
+    }
+
+    if (ctx->clearsign) {
+        /* headers, dash-escaped lines, trailing \r\n and armored signatures */
+        data = strlen(ST_CLEAR_BEGIN) + strlen(ST_CRLF) + strlen(ST_HEADER_HASH) +
+               strlen(ST_CRLFCRLF);
+        for (list_item *sg = list_front(ctx->signers); sg; sg = list_next(sg)) {
+            pgp_key_t *    key = *(pgp_key_t **) sg;
+            pgp_hash_alg_t halg = pgp_hash_adjust_alg_to_key(ctx->halg, pgp_get_key_pkt(key));
+            const char *   hname = pgp_show_hash_alg(halg);
+            /* hash names are listed once, so this is an upper bound */
+            data += (hname ? strlen(hname) : 0) + 1;
+        }
+        data += 2 * len + 2 + armored_dst_size(PGP_ARMORED_SIGNATURE, sigs);
+        *size = data;
+        return RNP_SUCCESS;
+    }
+
+    if (ctx->detached) {
+        data = sigs;
+    } else {
+        data = partial_pkt_size(literal_data_size(ctx, len)) + sigs;
+        if (ctx->zlevel > 0) {
+            /* skipped compression is never larger than the compressed packet */
+            data = partial_pkt_size(
+              compressed_data_size((pgp_compression_type_t) ctx->zalg, data));
+            *exact = false;
+        }
+    }
+
+    if (encrypt) {
+        uint64_t skeys = 0;
+        bool     skexact = true;
+
+        if (sesskeys) {
+            skeys = *sesskeys;
+        } else if ((ret = rnp_write_sesskeys_size(handler, &skeys, &skexact))) {
+            return ret;
+        }
+        *exact = *exact && skexact;
+        if ((ret = encrypted_dst_size(ctx, skeys, data, &data))) {
+            return ret;
+        }
+    }
+    if (ctx->armor) {
+        data = armored_dst_size(PGP_ARMORED_MESSAGE, data);
+    }
+    *size = data;
+    return RNP_SUCCESS;
+}
+
+rnp_result_t
+rnp_rewrap_src(pgp_write_handler_t *handler, pgp_source_t *src, pgp_dest_t *dst)
+{
+    pgp_parse_handler_t phandler = {0};
+    pgp_source_t        armorsrc = {0};
+    pgp_dest_t          armordst = {0};
+    pgp_sesskey_t       key = {};
+    pgp_aead_alg_t      aalg = PGP_AEAD_NONE;
+    uint8_t *           readbuf = NULL;
+    ssize_t             read;
+    rnp_result_t        ret = RNP_ERROR_GENERIC;
+
+    /* dearmor the input if needed, encrypted data itself is copied as it is */
+    if (is_armored_source(src)) {
+        if ((ret = init_armored_src(&armorsrc, src))) {
+            return ret;
+        }
+        src = &armorsrc;
+    }
+
+    /* decrypt the session key */
+    phandler.password_provider = handler->password_provider;
+    phandler.key_provider = handler->key_provider;
+    phandler.ctx = handler->ctx;
+    if ((ret = pgp_decrypt_sesskey_src(&phandler, src, &key, &aalg))) {
+        goto finish;
+    }
+
+    if (handler->ctx->armor) {
+        if ((ret = init_armored_dst(&armordst, dst, PGP_ARMORED_MESSAGE))) {
+            goto finish;
+        }
+        dst = &armordst;
+    }
+
+    /* write the new session key packets */
+    if ((ret = encrypted_rewrap_sesskeys(handler, &key, aalg, dst))) {
+        goto finish;
+    }
+
+    /* copy the encrypted data packet(s), avoiding the intermediate buffer if possible */
+    if (src->type == PGP_STREAM_MEMORY) {
+        const uint8_t *mem = (const uint8_t *) mem_src_get_memory(src);
+        dst_write(dst, mem + src->readb, src->size - src->readb);
+    } else {
+        if (!(readbuf = (uint8_t *) malloc(PGP_INPUT_CACHE_SIZE))) {
+            ret = RNP_ERROR_OUT_OF_MEMORY;
+            goto finish;
+        }
+        while (!src->eof) {
+            read = src_read(src, readbuf, PGP_INPUT_CACHE_SIZE);
+            if (read < 0) {
+                RNP_LOG("failed to read from source");
+                ret = RNP_ERROR_READ;
+                goto finish;
+            }
+            dst_write(dst, readbuf, read);
+            if (dst->werr) {
+                break;
+            }
+        }
+    }
+
+    if ((ret = dst->werr)) {
+        RNP_LOG("failed to write data");
+        goto finish;
+    }
+    if (dst == &armordst) {
+        ret = dst_finish(&armordst);
+    }
+finish:
+    if (armordst.param) {
+        dst_close(&armordst, ret != RNP_SUCCESS);
+    }
+    if (src == &armorsrc) {
+        src_close(&armorsrc);
+    }
+    pgp_forget(&key, sizeof(key));
+    free(readbuf);
     return ret;
 }
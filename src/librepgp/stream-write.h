@@ -69,4 +69,49 @@ rnp_result_t rnp_encrypt_sign_src(pgp_write_handler_t *handler,
                                   pgp_source_t *       src,
                                   pgp_dest_t *         dst);
 
+/** @brief Calculate size of the session key packets written by rnp_encrypt_src and
+ *         rnp_encrypt_sign_src. It doesn't depend on the input length, so may be calculated
+ *         once for several messages.
+ *  @param handler write handler with the operation's ctx, key provider is used to look for
+ *         the recipients' encryption subkeys
+ *  @param size size of the session key packets will be stored here
+ *  @param exact will be set to false if size is an upper bound, since session key MPIs may
+ *         be shorter
+ *  @return RNP_SUCCESS on success or error code otherwise
+ **/
+rnp_result_t rnp_write_sesskeys_size(pgp_write_handler_t *handler,
+                                     uint64_t *           size,
+                                     bool *               exact);
+
+/** @brief Calculate size of the output of rnp_encrypt_src/rnp_sign_src/rnp_encrypt_sign_src,
+ *         without doing the actual processing.
+ *  @param handler write handler with the operation's ctx
+ *  @param encrypt true for encryption (with signing if ctx has signers) or false for signing
+ *  @param len length of the input data
+ *  @param sesskeys size of the session key packets, calculated by rnp_write_sesskeys_size(),
+ *         or NULL to calculate it here
+ *  @param size output size will be stored here
+ *  @param exact will be set to false if size is an upper bound: with compression, text mode,
+ *         cleartext signing or when signature/session key MPIs may be shorter. Exactness of
+ *         the given sesskeys is not taken into account.
+ *  @return RNP_SUCCESS on success or error code otherwise
+ **/
+rnp_result_t rnp_write_output_size(pgp_write_handler_t *handler,
+                                   bool                 encrypt,
+                                   uint64_t             len,
+                                   const uint64_t *     sesskeys,
+                                   uint64_t *           size,
+                                   bool *               exact);
+
+/** @brief Change recipients of the encrypted message without re-encrypting the data.
+ *         Session key is decrypted with the handler's key and password providers (or taken
+ *         from ctx->sesskey), then new session key packets are written for the ctx recipients
+ *         and passwords, while the encrypted data packet is copied byte for byte.
+ *  @param handler write handler, ctx->armor specifies whether output should be armored
+ *  @param src source with encrypted message, may be armored
+ *  @param dst destination to write the rewrapped message to
+ *  @return RNP_SUCCESS on success or error code otherwise
+ */
+rnp_result_t rnp_rewrap_src(pgp_write_handler_t *handler, pgp_source_t *src, pgp_dest_t *dst);
+
 #endif
@@ -72,6 +72,8 @@ static const char *usage = "--help OR\n"
                            "\t--cat [--output=file] [options] files... OR\n"
                            "\t--clearsign [--output=file] [options] files... OR\n"
                            "\t--list-packets [options] OR\n"
+                           "\t--rewrap [-r recipient] [--passwords=n] [--output=file]\n"
+                           "\t\t[options] files... OR\n"
                            "\t--dearmor [--output=file] file OR\n"
                            "\t--enarmor=<msg|pubkey|seckey|sign> \n"
                            "\t\t[--output=file] file OR\n"
@@ -80,10 +82,16 @@ static const char *usage = "--help OR\n"
                            "\t[-r, --recipient] AND/OR\n"
                            "\t[--passwords] AND/OR\n"
                            "\t[--armor] AND/OR\n"
+                           "\t[--textmode] AND/OR\n"
                            "\t[--cipher=<ciphername>] AND/OR\n"
                            "\t[--zip, --zlib, --bzip, -z 0..9] AND/OR\n"
+                           "\t[--zparallel] AND/OR\n"
+                           "\t[--zadaptive] AND/OR\n"
                            "\t[--aead[=EAX, OCB]] AND/OR\n"
                            "\t[--aead-chunk-bits=0..56] AND/OR\n"
+                           "\t[--show-session-key] AND/OR\n"
+                           "\t[--override-session-key=<alg:hexkey>] AND/OR\n"
+                           "\t[--s2k-calibration] AND/OR\n"
                            "\t[--coredumps] AND/OR\n"
                            "\t[--homedir=<homedir>] AND/OR\n"
                            "\t[--keyring=<keyring>] AND/OR\n"
@@ -104,6 +112,7 @@ enum optdefs {
     CMD_SYM_ENCRYPT,
     CMD_DEARMOR,
     CMD_ENARMOR,
+    CMD_REWRAP,
     CMD_LIST_PACKETS,
     CMD_SHOW_KEYS,
     CMD_VERSION,
@@ -121,6 +130,7 @@ enum optdefs {
     OPT_ARMOR,
     OPT_HOMEDIR,
     OPT_DETACHED,
+    OPT_TEXTMODE,
     OPT_HASH_ALG,
     OPT_OUTPUT,
     OPT_RESULTS,
@@ -137,9 +147,14 @@ enum optdefs {
     OPT_ZALG_ZLIB,
     OPT_ZALG_BZIP,
     OPT_ZLEVEL,
+    OPT_ZPARALLEL,
+    OPT_ZADAPTIVE,
     OPT_OVERWRITE,
     OPT_AEAD,
     OPT_AEAD_CHUNK,
+    OPT_SHOW_SESSKEY,
+    OPT_SESSKEY,
+    OPT_S2K_CALIBRATION,
 
     /* debug */
     OPT_DEBUG
@@ -162,6 +177,7 @@ static struct option options[] = {
   {"symmetric", no_argument, NULL, CMD_SYM_ENCRYPT},
   {"dearmor", no_argument, NULL, CMD_DEARMOR},
   {"enarmor", required_argument, NULL, CMD_ENARMOR},
+  {"rewrap", no_argument, NULL, CMD_REWRAP},
   /* file listing commands */
   {"list-packets", no_argument, NULL, CMD_LIST_PACKETS},
   /* debugging commands */
@@ -183,6 +199,8 @@ static struct option options[] = {
   {"armour", no_argument, NULL, OPT_ARMOR},
   {"detach", no_argument, NULL, OPT_DETACHED},
   {"detached", no_argument, NULL, OPT_DETACHED},
+  {"text", no_argument, NULL, OPT_TEXTMODE},
+  {"textmode", no_argument, NULL, OPT_TEXTMODE},
   {"hash-alg", required_argument, NULL, OPT_HASH_ALG},
   {"hash", required_argument, NULL, OPT_HASH_ALG},
   {"algorithm", required_argument, NULL, OPT_HASH_ALG},
@@ -203,9 +221,14 @@ static struct option options[] = {
   {"zlib", no_argument, NULL, OPT_ZALG_ZLIB},
   {"bzip", no_argument, NULL, OPT_ZALG_BZIP},
   {"bzip2", no_argument, NULL, OPT_ZALG_BZIP},
+  {"zparallel", no_argument, NULL, OPT_ZPARALLEL},
+  {"zadaptive", no_argument, NULL, OPT_ZADAPTIVE},
   {"overwrite", no_argument, NULL, OPT_OVERWRITE},
   {"aead", optional_argument, NULL, OPT_AEAD},
   {"aead-chunk-bits", required_argument, NULL, OPT_AEAD_CHUNK},
+  {"show-session-key", no_argument, NULL, OPT_SHOW_SESSKEY},
+  {"override-session-key", required_argument, NULL, OPT_SESSKEY},
+  {"s2k-calibration", no_argument, NULL, OPT_S2K_CALIBRATION},
 
   {NULL, 0, NULL, 0},
 };
@@ -301,6 +324,17 @@ rnp_on_signatures(pgp_parse_handler_t *handler, pgp_signature_info_t *sigs, int
     }
 }
 
+static void
+rnp_on_sesskey(pgp_parse_handler_t *handler, const pgp_sesskey_t *key)
+{
+    char keystr[4 + 2 * PGP_MAX_KEY_SIZE + 1];
+
+    if (pgp_sesskey_to_str(key, keystr, sizeof(keystr))) {
+        fprintf(handler->ctx->rnp->io->res, "session key: %s\n", keystr);
+    }
+    pgp_forget(keystr, sizeof(keystr));
+}
+
 static bool
 setup_ctx(rnp_cfg_t *cfg, rnp_t *rnp, rnp_ctx_t *ctx)
 {
@@ -318,6 +352,7 @@ setup_ctx(rnp_cfg_t *cfg, rnp_t *rnp, rnp_ctx_t *ctx)
     rnp_ctx_init(ctx, rnp);
     ctx->armor = rnp_cfg_getint(cfg, CFG_ARMOR);
     ctx->overwrite = rnp_cfg_getbool(cfg, CFG_OVERWRITE);
+    ctx->textmode = rnp_cfg_getbool(cfg, CFG_TEXTMODE);
     if ((fname = rnp_cfg_getstr(cfg, CFG_INFILE))) {
         ctx->filename = strdup(rnp_filename(fname));
         ctx->filemtime = rnp_filemtime(fname);
@@ -330,6 +365,8 @@ setup_ctx(rnp_cfg_t *cfg, rnp_t *rnp, rnp_ctx_t *ctx)
     if (cmd == CMD_PROTECT) {
         ctx->zalg = rnp_cfg_getint(cfg, CFG_ZALG);
         ctx->zlevel = rnp_cfg_getint(cfg, CFG_ZLEVEL);
+        ctx->zparallel = rnp_cfg_getbool(cfg, CFG_ZPARALLEL);
+        ctx->zadaptive = rnp_cfg_getbool(cfg, CFG_ZADAPTIVE);
 
         /* setting signing parameters if needed */
         if (rnp_cfg_getbool(cfg, CFG_SIGN_NEEDED)) {
@@ -389,6 +426,8 @@ setup_ctx(rnp_cfg_t *cfg, rnp_t *rnp, rnp_ctx_t *ctx)
             ctx->halg = pgp_str_to_hash_alg(rnp_cfg_getstr(cfg, CFG_HASH));
             ctx->zalg = rnp_cfg_getint(cfg, CFG_ZALG);
             ctx->zlevel = rnp_cfg_getint(cfg, CFG_ZLEVEL);
+            ctx->zparallel = rnp_cfg_getbool(cfg, CFG_ZPARALLEL);
+            ctx->zadaptive = rnp_cfg_getbool(cfg, CFG_ZADAPTIVE);
             ctx->aalg = (pgp_aead_alg_t) rnp_cfg_getint(cfg, CFG_AEAD);
             ctx->abits = rnp_cfg_getint_default(cfg, CFG_AEAD_CHUNK, DEFAULT_AEAD_CHUNK_BITS);
 
@@ -430,7 +469,10 @@ setup_ctx(rnp_cfg_t *cfg, rnp_t *rnp, rnp_ctx_t *ctx)
                 }
                 list_destroy(&recipients);
 
-                if (!list_length(ctx->recipients)) {
+                /* rewrapping to the passwords only must not add the default key */
+                bool pswdonly =
+                  rnp_cfg_getbool(cfg, CFG_REWRAP) && rnp_cfg_getbool(cfg, CFG_ENCRYPT_SK);
+                if (!list_length(ctx->recipients) && !pswdonly) {
                     if (!rnp->defkey) {
                         fprintf(stderr, "No userid or default key for encryption\n");
                         return false;
@@ -455,6 +497,24 @@ setup_ctx(rnp_cfg_t *cfg, rnp_t *rnp, rnp_ctx_t *ctx)
         ctx->discard =
           rnp_cfg_getbool(cfg, CFG_NO_OUTPUT) && !rnp_cfg_getstr(cfg, CFG_OUTFILE);
         ctx->on_signatures = (void *) rnp_on_signatures;
+        ctx->passwordc = rnp_cfg_getint_default(cfg, CFG_PASSWORDC, 1);
+        ctx->zparallel = rnp_cfg_getbool(cfg, CFG_ZPARALLEL);
+        if (rnp_cfg_getbool(cfg, CFG_SHOW_SESSKEY)) {
+            ctx->on_sesskey = (void *) rnp_on_sesskey;
+        }
+    }
+
+    /* session key to decrypt data with, used by decryption and rewrapping */
+    if (rnp_cfg_getstr(cfg, CFG_SESSKEY)) {
+        ctx->sesskey = (pgp_sesskey_t *) calloc(1, sizeof(*ctx->sesskey));
+        if (!ctx->sesskey) {
+            RNP_LOG("allocation failed");
+            return false;
+        }
+        if (!pgp_sesskey_from_str(rnp_cfg_getstr(cfg, CFG_SESSKEY), ctx->sesskey)) {
+            fprintf(stderr, "Invalid session key\n");
+            return false;
+        }
     }
 
     return true;
@@ -478,7 +538,11 @@ rnp_cmd(rnp_cfg_t *cfg, rnp_t *rnp)
 
     switch (rnp_cfg_getint(cfg, CFG_COMMAND)) {
     case CMD_PROTECT:
-        ret = rnp_protect_file(&ctx, infile, outfile) == RNP_SUCCESS;
+        if (rnp_cfg_getbool(cfg, CFG_REWRAP)) {
+            ret = rnp_rewrap_file(&ctx, infile, outfile) == RNP_SUCCESS;
+        } else {
+            ret = rnp_protect_file(&ctx, infile, outfile) == RNP_SUCCESS;
+        }
         break;
     case CMD_PROCESS:
         ret = rnp_process_file(&ctx, infile, outfile) == RNP_SUCCESS;
@@ -506,6 +570,10 @@ rnp_cmd(rnp_cfg_t *cfg, rnp_t *rnp)
     }
 
 done:
+    if (ctx.sesskey) {
+        pgp_forget(ctx.sesskey, sizeof(*ctx.sesskey));
+        free(ctx.sesskey);
+    }
     rnp_ctx_free(&ctx);
     return ret;
 }
@@ -538,6 +606,13 @@ setcmd(rnp_cfg_t *cfg, int cmd, const char *arg)
         rnp_cfg_setbool(cfg, CFG_NEEDSSECKEY, true);
         newcmd = CMD_PROCESS;
         break;
+    case CMD_REWRAP:
+        /* decrypt the session key and encrypt it to the new recipients */
+        rnp_cfg_setbool(cfg, CFG_REWRAP, true);
+        rnp_cfg_setbool(cfg, CFG_NEEDSSECKEY, true);
+        rnp_cfg_setbool(cfg, CFG_ENCRYPT_PK, true);
+        newcmd = CMD_PROTECT;
+        break;
     case CMD_VERIFY:
         /* single verify will discard output, decrypt will not */
         rnp_cfg_setbool(cfg, CFG_NO_OUTPUT, true);
@@ -602,6 +677,7 @@ setoption(rnp_cfg_t *cfg, int val, char *arg)
     case CMD_SHOW_KEYS:
     case CMD_DEARMOR:
     case CMD_ENARMOR:
+    case CMD_REWRAP:
     case CMD_HELP:
     case CMD_VERSION:
         if (!setcmd(cfg, val, arg)) {
@@ -646,6 +722,9 @@ setoption(rnp_cfg_t *cfg, int val, char *arg)
     case OPT_DETACHED:
         rnp_cfg_setbool(cfg, CFG_DETACHED, true);
         break;
+    case OPT_TEXTMODE:
+        rnp_cfg_setbool(cfg, CFG_TEXTMODE, true);
+        break;
     case OPT_VERBOSE:
         rnp_cfg_setint(cfg, CFG_VERBOSE, rnp_cfg_getint(cfg, CFG_VERBOSE) + 1);
         break;
@@ -731,6 +810,12 @@ setoption(rnp_cfg_t *cfg, int val, char *arg)
     case OPT_ZALG_BZIP:
         rnp_cfg_setint(cfg, CFG_ZALG, PGP_C_BZIP2);
         break;
+    case OPT_ZPARALLEL:
+        rnp_cfg_setbool(cfg, CFG_ZPARALLEL, true);
+        break;
+    case OPT_ZADAPTIVE:
+        rnp_cfg_setbool(cfg, CFG_ZADAPTIVE, true);
+        break;
     case OPT_AEAD: {
         pgp_aead_alg_t alg = PGP_AEAD_NONE;
         if (!arg || !strcmp(arg, "1") || !rnp_strcasecmp(arg, "eax")) {
@@ -765,6 +850,19 @@ setoption(rnp_cfg_t *cfg, int val, char *arg)
     case OPT_OVERWRITE:
         rnp_cfg_setbool(cfg, CFG_OVERWRITE, true);
         break;
+    case OPT_SHOW_SESSKEY:
+        rnp_cfg_setbool(cfg, CFG_SHOW_SESSKEY, true);
+        break;
+    case OPT_SESSKEY:
+        if (!arg) {
+            (void) fprintf(stderr, "Option override-session-key requires parameter\n");
+            return false;
+        }
+        rnp_cfg_setstr(cfg, CFG_SESSKEY, arg);
+        break;
+    case OPT_S2K_CALIBRATION:
+        rnp_cfg_setbool(cfg, CFG_S2K_CALIBRATION, true);
+        break;
     case OPT_DEBUG:
         rnp_set_debug(arg);
         break;
@@ -602,6 +602,7 @@ rnp_cfg_get_ks_info(rnp_cfg_t *cfg, rnp_params_t *params)
     const char *ks_format;
     char        pubpath[MAXPATHLEN] = {0};
     char        secpath[MAXPATHLEN] = {0};
+    char        s2kpath[MAXPATHLEN] = {0};
     struct stat st;
 
     /* getting path to keyrings. If it is specified by user in 'homedir' param then it is
@@ -693,6 +694,12 @@ rnp_cfg_get_ks_info(rnp_cfg_t *cfg, rnp_params_t *params)
         return false;
     }
 
+    /* S2K calibration data is stored along with the keyrings, if requested */
+    if (rnp_cfg_getbool(cfg, CFG_S2K_CALIBRATION) &&
+        rnp_path_compose(homedir, subdir, S2K_CALIBRATION, s2kpath, sizeof(s2kpath))) {
+        params->s2kpath = strdup(s2kpath);
+    }
+
     return true;
 }
 
@@ -37,6 +37,7 @@
 #define CFG_COMMAND "command"            /* command to execute over input data */
 #define CFG_DETACHED "detached"          /* produce the detached signature */
 #define CFG_CLEARTEXT "cleartext"        /* cleartext signing should be used */
+#define CFG_TEXTMODE "textmode"          /* canonical text data and text signatures */
 #define CFG_SIGN_NEEDED "sign_needed"    /* signing is needed during data protection */
 #define CFG_OUTFILE "outfile"            /* name/path of the output file */
 #define CFG_NO_OUTPUT "no_output"        /* do not output any data - just verify or process */
@@ -54,7 +55,7 @@
 #define CFG_HOMEDIR "homedir"       /* home directory - folder with keyrings and so on */
 #define CFG_PASSFD "pass-fd"        /* password file descriptor */
 #define CFG_PASSWD "password"       /* password as command-line constant */
-#define CFG_PASSWORDC "passwordc"   /* number of passwords for symmetric encryption */
+#define CFG_PASSWORDC "passwordc"   /* number of passwords for encryption/decryption */
 #define CFG_USERINPUTFD "user-input-fd" /* user input file descriptor */
 #define CFG_NUMTRIES "numtries"         /* number of password request tries, or 'unlimited' */
 #define CFG_EXPIRATION "expiration"     /* signature expiration time */
@@ -63,6 +64,7 @@
 #define CFG_HASH "hash"                 /* hash algorithm used, string like 'SHA1'*/
 #define CFG_S2K_ITER "s2k-iter"         /* number of S2K hash iterations to perform */
 #define CFG_S2K_MSEC "s2k-msec"         /* number of milliseconds S2K should target */
+#define CFG_S2K_CALIBRATION "s2k-calibration" /* keep S2K calibration data in the homedir */
 #define CFG_ENCRYPT_PK "encrypt_pk"     /* public key should be used during encryption */
 #define CFG_ENCRYPT_SK "encrypt_sk"     /* password encryption should be used */
 #define CFG_IO_OUTS "outs"              /* output stream */
@@ -73,8 +75,13 @@
 #define CFG_EXPERT "expert"             /* expert key generation mode */
 #define CFG_ZLEVEL "zlevel"             /* compression level: 0..9 (0 for no compression) */
 #define CFG_ZALG "zalg"                 /* compression algorithm: zip, zlib or bzip2 */
+#define CFG_ZPARALLEL "zparallel"       /* (de)compress data blocks on the worker threads */
+#define CFG_ZADAPTIVE "zadaptive"       /* skip compression of the incompressible data */
 #define CFG_AEAD "aead"                 /* if nonzero then AEAD enryption mode, int */
 #define CFG_AEAD_CHUNK "aead_chunk"     /* AEAD chunk size bits, int from 0 to 56 */
+#define CFG_SHOW_SESSKEY "show_sesskey" /* print the decrypted session key */
+#define CFG_SESSKEY "sesskey"           /* session key to decrypt data with, 'alg:hex' */
+#define CFG_REWRAP "rewrap"             /* change recipients of the encrypted data */
 #define CFG_KEYSTORE_DISABLED \
     "disable_keystore"      /* indicates wether keystore must be initialized */
 #define CFG_FORCE "force"   /* force command to succeed operation */
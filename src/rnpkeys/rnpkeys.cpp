@@ -100,6 +100,7 @@ struct option options[] = {
   {"numbits", required_argument, NULL, OPT_NUMBITS},
   {"s2k-iterations", required_argument, NULL, OPT_S2K_ITER},
   {"s2k-msec", required_argument, NULL, OPT_S2K_MSEC},
+  {"s2k-calibration", no_argument, NULL, OPT_S2K_CALIBRATION},
   {"verbose", no_argument, NULL, OPT_VERBOSE},
   {"pass-fd", required_argument, NULL, OPT_PASSWDFD},
   {"results", required_argument, NULL, OPT_RESULTS},
@@ -345,6 +346,9 @@ setoption(rnp_cfg_t *cfg, optdefs_t *cmd, int val, char *arg)
         }
         rnp_cfg_setint(cfg, CFG_S2K_MSEC, atoi(arg));
         break;
+    case OPT_S2K_CALIBRATION:
+        rnp_cfg_setbool(cfg, CFG_S2K_CALIBRATION, true);
+        break;
     case OPT_PASSWDFD:
         if (arg == NULL) {
             (void) fprintf(stderr, "no pass-fd argument provided\n");
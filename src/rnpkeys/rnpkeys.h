@@ -39,6 +39,7 @@ typedef enum {
     OPT_SECRET,
     OPT_S2K_ITER,
     OPT_S2K_MSEC,
+    OPT_S2K_CALIBRATION,
 
     /* debug */
     OPT_DEBUG
@@ -90,6 +90,62 @@ hash_test_success(void **state)
     }
 }
 
+void
+hash_workers_test(void **state)
+{
+    const pgp_hash_alg_t algs[] = {PGP_HASH_SHA1, PGP_HASH_SHA256, PGP_HASH_SHA512};
+    list                 serial = NULL;
+    list                 parallel = NULL;
+    uint8_t              buf[10000];
+    uint8_t              out1[PGP_MAX_HASH_SIZE];
+    uint8_t              out2[PGP_MAX_HASH_SIZE];
+
+    for (auto alg : algs) {
+        assert_true(pgp_hash_list_add(&serial, alg));
+        assert_true(pgp_hash_list_add(&parallel, alg));
+    }
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = i * 13 + (i >> 8);
+    }
+
+    /* single hash is not worth running on the thread */
+    list single = NULL;
+    assert_true(pgp_hash_list_add(&single, PGP_HASH_SHA256));
+    assert_null(pgp_hash_workers_start(single));
+    pgp_hash_list_free(&single);
+
+    pgp_hash_workers_t *workers = pgp_hash_workers_start(parallel);
+    for (size_t i = 0; i < 100; i++) {
+        size_t len = (i * 997) % sizeof(buf);
+        pgp_hash_list_update(serial, buf, len);
+        if (workers) {
+            pgp_hash_workers_update(workers, buf, len);
+        } else {
+            pgp_hash_list_update(parallel, buf, len);
+        }
+        /* intermediate state must match as well */
+        if (i == 50) {
+            pgp_hash_workers_wait(workers);
+            pgp_hash_t copy1 = {0}, copy2 = {0};
+            assert_true(pgp_hash_copy(&copy1, pgp_hash_list_get(serial, PGP_HASH_SHA512)));
+            assert_true(pgp_hash_copy(&copy2, pgp_hash_list_get(parallel, PGP_HASH_SHA512)));
+            assert_int_equal(pgp_hash_finish(&copy1, out1), pgp_hash_finish(&copy2, out2));
+            assert_memory_equal(out1, out2, pgp_digest_length(PGP_HASH_SHA512));
+        }
+    }
+    pgp_hash_workers_stop(workers);
+
+    for (auto alg : algs) {
+        pgp_hash_t copy1 = {0}, copy2 = {0};
+        assert_true(pgp_hash_copy(&copy1, pgp_hash_list_get(serial, alg)));
+        assert_true(pgp_hash_copy(&copy2, pgp_hash_list_get(parallel, alg)));
+        assert_int_equal(pgp_hash_finish(&copy1, out1), pgp_hash_finish(&copy2, out2));
+        assert_memory_equal(out1, out2, pgp_digest_length(alg));
+    }
+    pgp_hash_list_free(&serial);
+    pgp_hash_list_free(&parallel);
+}
+
 void
 cipher_test_success(void **state)
 {
@@ -623,3 +679,144 @@ void s2k_iteration_tuning(void **state) {
 
     /// TODO test that hashing iters_xx data takes roughly requested time
 }
+
+void s2k_calibration_persistence(void **state) {
+    size_t iters;
+    FILE * f;
+
+    pgp_s2k_calibration_reset();
+    iters = pgp_s2k_compute_iters(PGP_HASH_SHA256, 100, 20);
+    /* subsequent calls must use the cached value */
+    assert_int_equal(pgp_s2k_compute_iters(PGP_HASH_SHA256, 100, 20), iters);
+    assert_int_equal(pgp_s2k_compute_iters(PGP_HASH_SHA256, 100, 10), iters);
+    /* save and load it back */
+    assert_false(pgp_s2k_calibration_load("s2k-calibration"));
+    assert_true(pgp_s2k_calibration_save("s2k-calibration"));
+    pgp_s2k_calibration_reset();
+    assert_true(pgp_s2k_calibration_load("s2k-calibration"));
+    assert_int_equal(pgp_s2k_compute_iters(PGP_HASH_SHA256, 100, 20), iters);
+    /* data from the other machine must be ignored */
+    pgp_s2k_calibration_reset();
+    assert_non_null(f = fopen("s2k-calibration", "w"));
+    fprintf(f, "# rnp s2k calibration data\ncpu 00112233445566778899aabbccddeeff\n");
+    fprintf(f, "hash 8 1000 1000\n");
+    fclose(f);
+    assert_false(pgp_s2k_calibration_load("s2k-calibration"));
+    /* stored rate would give the minimum iterations number */
+    assert_true(pgp_s2k_compute_iters(PGP_HASH_SHA256, 100, 20) >
+                pgp_s2k_decode_iterations(96));
+    pgp_s2k_calibration_reset();
+    unlink("s2k-calibration");
+}
+
+void s2k_native_vs_botan(void **state) {
+    const pgp_hash_alg_t algs[] = {
+      PGP_HASH_MD5, PGP_HASH_SHA1, PGP_HASH_SHA256, PGP_HASH_SHA512};
+    const char *passwords[] = {
+      "", "p", "password", "rather long password, which is longer than the hash block itself"};
+    const size_t         iterations[] = {1, 7, 1024, 65536, 65011712};
+    const size_t         keysizes[] = {16, 24, 32};
+    const uint8_t        salt[PGP_SALT_SIZE] = {0xde, 0xad, 0xbe, 0xef, 1, 2, 3, 4};
+    uint8_t              native[PGP_MAX_KEY_SIZE];
+    uint8_t              botan[PGP_MAX_KEY_SIZE];
+
+    for (auto alg : algs) {
+        for (auto password : passwords) {
+            for (auto iters : iterations) {
+                for (auto keysize : keysizes) {
+                    /* huge iterations number is checked only once per hash */
+                    if ((iters > 65536) && (strcmp(password, "password") || (keysize != 32))) {
+                        continue;
+                    }
+                    memset(native, 0, sizeof(native));
+                    memset(botan, 0xff, sizeof(botan));
+                    assert_int_equal(
+                      pgp_s2k_iterated(alg, native, keysize, password, salt, iters), 0);
+                    assert_int_equal(
+                      pgp_s2k_iterated_botan(alg, botan, keysize, password, salt, iters), 0);
+                    assert_memory_equal(native, botan, keysize);
+                    /* simple s2k, without salt */
+                    if ((iters == 1) && strlen(password)) {
+                        memset(native, 0, sizeof(native));
+                        memset(botan, 0xff, sizeof(botan));
+                        assert_int_equal(
+                          pgp_s2k_iterated(alg, native, keysize, password, NULL, 1), 0);
+                        assert_int_equal(
+                          pgp_s2k_iterated_botan(alg, botan, keysize, password, NULL, 1), 0);
+                        assert_memory_equal(native, botan, keysize);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void s2k_derived_key_cache(void **state) {
+    pgp_s2k_t        s2k = {};
+    uint8_t          key[PGP_MAX_KEY_SIZE];
+    uint8_t          cached[PGP_MAX_KEY_SIZE];
+    uint8_t          other[PGP_MAX_KEY_SIZE];
+    pgp_s2k_cache_t *cache = NULL;
+    pgp_s2k_cache_t *cache2 = NULL;
+
+    s2k.usage = PGP_S2KU_ENCRYPTED_AND_HASHED;
+    s2k.specifier = PGP_S2KS_ITERATED_AND_SALTED;
+    s2k.hash_alg = PGP_HASH_SHA256;
+    s2k.iterations = pgp_s2k_encode_iterations(65536);
+    memcpy(s2k.salt, "\x01\x02\x03\x04\x05\x06\x07\x08", PGP_SALT_SIZE);
+
+    assert_non_null(cache = pgp_s2k_cache_create());
+    assert_non_null(cache2 = pgp_s2k_cache_create());
+    assert_true(pgp_s2k_derive_key(&s2k, "password", key, sizeof(key)));
+    /* first call stores key in the cache, second one takes it from there */
+    for (int i = 0; i < 2; i++) {
+        memset(cached, 0, sizeof(cached));
+        assert_true(
+          pgp_s2k_derive_key_cached(cache, &s2k, "password", cached, sizeof(cached)));
+        assert_memory_equal(key, cached, sizeof(key));
+    }
+    /* without the cache key is just derived */
+    memset(cached, 0, sizeof(cached));
+    assert_true(pgp_s2k_derive_key_cached(NULL, &s2k, "password", cached, sizeof(cached)));
+    assert_memory_equal(key, cached, sizeof(key));
+    /* G10 path uses the decoded iterations */
+    memset(cached, 0, sizeof(cached));
+    assert_int_equal(pgp_s2k_iterated_cached(cache,
+                                             PGP_HASH_SHA256,
+                                             cached,
+                                             sizeof(cached),
+                                             "password",
+                                             s2k.salt,
+                                             pgp_s2k_decode_iterations(s2k.iterations)),
+                     0);
+    assert_memory_equal(key, cached, sizeof(key));
+    /* any parameter change must produce a different key */
+    assert_true(pgp_s2k_derive_key_cached(cache, &s2k, "passwore", other, sizeof(other)));
+    assert_memory_not_equal(key, other, sizeof(key));
+    s2k.salt[0] ^= 0xff;
+    assert_true(pgp_s2k_derive_key_cached(cache, &s2k, "password", other, sizeof(other)));
+    assert_memory_not_equal(key, other, sizeof(key));
+    s2k.salt[0] ^= 0xff;
+    s2k.hash_alg = PGP_HASH_SHA1;
+    assert_true(pgp_s2k_derive_key_cached(cache, &s2k, "password", other, sizeof(other)));
+    assert_memory_not_equal(key, other, sizeof(key));
+    s2k.hash_alg = PGP_HASH_SHA256;
+    s2k.specifier = PGP_S2KS_SALTED;
+    assert_true(pgp_s2k_derive_key_cached(cache, &s2k, "password", other, sizeof(other)));
+    assert_memory_not_equal(key, other, sizeof(key));
+    s2k.specifier = PGP_S2KS_ITERATED_AND_SALTED;
+    /* shorter key is the prefix of the longer one */
+    assert_true(pgp_s2k_derive_key_cached(cache, &s2k, "password", other, 16));
+    assert_memory_equal(key, other, 16);
+    /* caches are independent, and may be wiped explicitly */
+    memset(cached, 0, sizeof(cached));
+    assert_true(pgp_s2k_derive_key_cached(cache2, &s2k, "password", cached, sizeof(cached)));
+    assert_memory_equal(key, cached, sizeof(key));
+    pgp_s2k_cache_clear(cache);
+    memset(cached, 0, sizeof(cached));
+    assert_true(pgp_s2k_derive_key_cached(cache, &s2k, "password", cached, sizeof(cached)));
+    assert_memory_equal(key, cached, sizeof(key));
+    pgp_s2k_cache_destroy(cache);
+    pgp_s2k_cache_destroy(cache2);
+    pgp_s2k_cache_destroy(NULL);
+}
@@ -33,6 +33,8 @@ SMALLSIZE = 0
 SMALLFILE = 'smalltest.txt'
 LARGEFILE = 'largetest.txt'
 PASSWORD = 'password'
+RECIPIENTS = []
+RECIPIENT_COUNTS = [1, 100, 1000]
 
 def setup(workdir):
     # Searching for rnp and gnupg
@@ -82,6 +84,26 @@ def setup(workdir):
         for i in range(0, LARGESIZE / 1024 - 1):
             fd.write(st)
 
+def setup_recipients(count):
+    # Generating recipient keys lazily since it takes a while
+    global RECIPIENTS
+    if len(RECIPIENTS) >= count:
+        return RECIPIENTS[:count]
+
+    logging.info('Generating {} recipient keys'.format(count - len(RECIPIENTS)))
+    for i in range(len(RECIPIENTS), count):
+        userid = 'recipient{}@rnp'.format(i)
+        pipe = pswd_pipe(PASSWORD)
+        params = ['--numbits', '2048', '--homedir', RNPDIR, '--pass-fd', str(pipe), '--userid', userid, '--generate-key']
+        ret, out, err = run_proc(RNPK, params)
+        os.close(pipe)
+        if ret != 0:
+            raise_err('recipient key generation failed', err)
+        RECIPIENTS.append(userid)
+
+    ret, out, err = run_proc(GPG, ['--batch', '--passphrase', '', '--homedir', GPGDIR, '--import', path.join(RNPDIR, 'pubring.gpg')])
+    return RECIPIENTS[:count]
+
 def run_iterated(iterations, func, src, dst, *args):
     runtime = 0
 
@@ -95,19 +117,32 @@ def run_iterated(iterations, func, src, dst, *args):
     #print '{} average run time: {}'.format(func.__name__, res)
     return res
 
-def rnp_symencrypt_file(src, dst, cipher, zlevel = 6, zalgo = 'zip', armor = False):
+def rnp_symencrypt_file(src, dst, cipher, zlevel = 6, zalgo = 'zip', armor = False, zparallel = False):
     params = ['--homedir', RNPDIR, '--password', PASSWORD, '--cipher', cipher, '-z', str(zlevel), '--' + zalgo, '-c', src, '--output', dst]
     if armor:
         params += ['--armor']
+    if zparallel:
+        params += ['--zparallel']
     ret = run_proc_fast(RNP, params)
     if ret != 0:
         raise_err('rnp symmetric encryption failed')
 
-def rnp_decrypt_file(src, dst):
-    ret = run_proc_fast(RNP, ['--homedir', RNPDIR, '--password', PASSWORD, '--decrypt', src, '--output', dst])
+def rnp_decrypt_file(src, dst, zparallel = False):
+    params = ['--homedir', RNPDIR, '--password', PASSWORD, '--decrypt', src, '--output', dst]
+    if zparallel:
+        params += ['--zparallel']
+    ret = run_proc_fast(RNP, params)
     if ret != 0:
         raise_err('rnp decryption failed')
 
+def rnp_encrypt_file(src, dst, recipients):
+    params = ['--homedir', RNPDIR, '-z', '0', '--encrypt', src, '--output', dst]
+    for userid in recipients:
+        params += ['-r', userid]
+    ret = run_proc_fast(RNP, params)
+    if ret != 0:
+        raise_err('rnp encryption failed')
+
 def gpg_symencrypt_file(src, dst, cipher = 'AES', zlevel = 6, zalgo = 1, armor = False):
     params = ['--homedir', GPGDIR, '-c', '-z', str(zlevel), '--s2k-count', '524288', '--compress-algo', str(zalgo), '--batch', '--passphrase', PASSWORD, '--cipher-algo', cipher, '--output', dst, src]
     if armor:
@@ -116,6 +151,14 @@ def gpg_symencrypt_file(src, dst, cipher = 'AES', zlevel = 6, zalgo = 1, armor =
     if ret != 0:
         raise_err('gpg symmetric encryption failed for cipher ' + cipher)
 
+def gpg_encrypt_file(src, dst, recipients):
+    params = ['--homedir', GPGDIR, '-e', '-z', '0', '--batch', '--trust-model', 'always', '--output', dst, src]
+    for userid in recipients:
+        params[2:2] = ['-r', userid]
+    ret = run_proc_fast(GPG, params)
+    if ret != 0:
+        raise_err('gpg encryption failed')
+
 def gpg_decrypt_file(src, dst, keypass):
     ret = run_proc_fast(GPG, ['--homedir', GPGDIR, '--pinentry-mode=loopback', '--batch', '--yes', '--passphrase', keypass, '--trust-model', 'always', '-o', dst, '-d', src])
     if ret != 0:
@@ -197,6 +240,19 @@ class Benchmark(object):
         tmgpg = run_iterated(iterations, gpg_symencrypt_file, infile, gpgout, 'AES128', 0, 1, True)
         print_test_results(fsize, tmrnp, tmgpg, 'ENCRYPT-LARGE-ARMOR')
 
+    def small_file_multiple_recipients_encryption(self):
+        '''
+        Small file encryption to multiple recipients
+        '''
+        infile, rnpout, gpgout, iterations, fsize = get_file_params('small')
+        for count in RECIPIENT_COUNTS:
+            recipients = setup_recipients(count)
+            iters = max(1, min(iterations, 1000 / count))
+            tmrnp = run_iterated(iters, rnp_encrypt_file, infile, rnpout, recipients)
+            tmgpg = run_iterated(iters, gpg_encrypt_file, infile, gpgout, recipients)
+            testname = 'ENCRYPT-{}-RECIPIENTS'.format(count)
+            print_test_results(fsize, tmrnp, tmgpg, testname)
+
     def small_file_symmetric_decryption(self):
         '''
         Small file symmetric decryption
@@ -237,6 +293,33 @@ class Benchmark(object):
         print_test_results(fsize, tmrnp, tmgpg, 'DECRYPT-LARGE-ARMOR')
         os.remove(inenc)
 
+    def large_file_compression(self):
+        '''
+        Large file compression, single- and multi-threaded
+        '''
+        infile, rnpout, gpgout, iterations, fsize = get_file_params('large')
+        for zalgo, gpgalgo in [('zip', 1), ('zlib', 2), ('bzip2', 3)]:
+            tmgpg = run_iterated(iterations, gpg_symencrypt_file, infile, gpgout, 'AES128', 6, gpgalgo, False)
+            for zparallel in [False, True]:
+                tmrnp = run_iterated(iterations, rnp_symencrypt_file, infile, rnpout, 'AES128', 6, zalgo, False, zparallel)
+                testname = 'COMPRESS-{}{}'.format(zalgo.upper(), '-PARALLEL' if zparallel else '')
+                print_test_results(fsize, tmrnp, tmgpg, testname)
+
+    def large_file_decompression(self):
+        '''
+        Large file decompression, single- and multi-threaded
+        '''
+        infile, rnpout, gpgout, iterations, fsize = get_file_params('large')
+        inenc = infile + '.enc'
+        for zalgo, gpgalgo in [('zip', 1), ('zlib', 2), ('bzip2', 3)]:
+            gpg_symencrypt_file(infile, inenc, 'AES128', 6, gpgalgo, False)
+            tmgpg = run_iterated(iterations, gpg_decrypt_file, inenc, gpgout, PASSWORD)
+            for zparallel in [False, True]:
+                tmrnp = run_iterated(iterations, rnp_decrypt_file, inenc, rnpout, zparallel)
+                testname = 'DECOMPRESS-{}{}'.format(zalgo.upper(), '-PARALLEL' if zparallel else '')
+                print_test_results(fsize, tmrnp, tmgpg, testname)
+            os.remove(inenc)
+
         # 3. Signing
         #print '\n#3. Signing\n'
         # 4. Verification
@@ -256,6 +339,10 @@ class Benchmark(object):
 # sudo mount -t tmpfs -o size=512m tmpfs /tmp/working
 # ./cli_perf.py -w /tmp/working
 # sudo umount /tmp/working
+#
+# To compare deflate backends run compression benchmarks against the builds with and
+# without ENABLE_ZLIB_NG, GnuPG results are the common baseline:
+# ./cli_perf.py -b large_file_compression,large_file_decompression
 
 
 if __name__ == '__main__':
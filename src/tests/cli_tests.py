@@ -942,6 +942,27 @@ class Misc(unittest.TestCase):
             rnp_encryption_s2k_gpg(ciphers[i % len(ciphers)], hashes[
                                 i % len(hashes)], s2kmodes[i % len(s2kmodes)])
 
+    def test_s2k_calibration_file(self):
+        # Calibration data is stored in the homedir only when asked to
+        src, dst = reg_workfiles('cleartext', '.txt', '.rnp')
+        random_text(src, 1000)
+        calfile = os.path.join(RNPDIR, 's2k-calibration')
+        if os.path.isfile(calfile):
+            os.remove(calfile)
+        for calibrate in [False, True]:
+            pipe = pswd_pipe(PASSWORD)
+            params = ['--homedir', RNPDIR, '-c', '--pass-fd', str(pipe), src, '--output', dst]
+            if calibrate:
+                params += ['--s2k-calibration']
+            ret, _, err = run_proc(RNP, params)
+            os.close(pipe)
+            if ret != 0:
+                raise_err('rnp symmetric encryption failed', err)
+            if os.path.isfile(calfile) != calibrate:
+                raise_err('unexpected s2k calibration file state')
+            remove_files(dst)
+        os.remove(calfile)
+
     def test_armor(self):
         src_beg, dst_beg, dst_mid, dst_fin = reg_workfiles('beg','.src','.dst', '.mid.dst', '.fin.dst')
 
@@ -1005,6 +1026,99 @@ class Encryption(unittest.TestCase):
         for size in Encryption.SIZES:
             file_encryption_rnp_to_gpg(size)
 
+    def test_file_encryption__gpg_to_rnp_hidden_recipient(self):
+        # Encrypt with GPG to the anonymous (wildcard keyid) recipient and decrypt with RNP
+        src, dst, dec = reg_workfiles('cleartext', '.txt', '.gpg', '.rnp')
+        random_text(src, 20000)
+        params = ['--homedir', GPGDIR, '-e', '--throw-keyids', '-r', KEY_ENCRYPT, '--batch', '--trust-model', 'always', '--output', dst, src]
+        ret, _, err = run_proc(GPG, params)
+        if ret != 0:
+            raise_err('gpg encryption failed', err)
+        # RNP asks for the password of each protected secret key, in keyring order, only until
+        # the one which decrypts the message is found
+        rnp_decrypt_file(dst, dec, '\n'.join([PASSWORD] * 20))
+        compare_files(src, dec, 'rnp decrypted data differs')
+        clear_workfiles()
+
+    def test_file_encryption__session_key(self):
+        # Export session key with RNP and use it to decrypt with GPG and RNP without secret key
+        src, enc, dec = reg_workfiles('cleartext', '.txt', '.gpg', '.rnp')
+        random_text(src, 20000)
+        rnp_encrypt_file_ex(src, enc, [KEY_ENCRYPT], cipher='AES256')
+        pipe = pswd_pipe(PASSWORD)
+        ret, out, err = run_proc(RNP, ['--homedir', RNPDIR, '--pass-fd', str(pipe), '--decrypt',
+                                       '--show-session-key', enc, '--output', dec])
+        os.close(pipe)
+        if ret != 0:
+            raise_err('rnp decryption failed', out + err)
+        compare_files(src, dec, 'rnp decrypted data differs')
+        match = re.search(r'session key: (9:[0-9A-F]{64})', out + err)
+        if not match:
+            raise_err('no session key printed', out + err)
+        sesskey = match.group(1)
+        remove_files(dec)
+        # GnuPG should accept the same session key
+        ret, _, err = run_proc(GPG, ['--homedir', GPGDIR, '--batch', '--yes', '--override-session-key',
+                                     sesskey, '-o', dec, '-d', enc])
+        if ret != 0:
+            raise_err('gpg decryption with session key failed', err)
+        compare_files(src, dec, 'gpg decrypted data differs')
+        remove_files(dec)
+        # RNP should not need the secret key password
+        ret, out, err = run_proc(RNP, ['--homedir', RNPDIR, '--password', 'wrong', '--decrypt',
+                                       '--override-session-key', sesskey, enc, '--output', dec])
+        if ret != 0:
+            raise_err('rnp decryption with session key failed', out + err)
+        compare_files(src, dec, 'rnp decrypted data differs')
+        clear_workfiles()
+
+    def test_file_encryption__rewrap(self):
+        # Change recipient of the RNP-encrypted message to the password, and decrypt with GPG
+        src, enc, rewr, dec = reg_workfiles('cleartext', '.txt', '.gpg', '.rewrap', '.dec')
+        random_text(src, 100000)
+        rnp_encrypt_file_ex(src, enc, [KEY_ENCRYPT], armor=True)
+        # New password is requested first, then the one for the secret key
+        pipe = pswd_pipe('\n'.join(['newpassword', PASSWORD]))
+        ret, out, err = run_proc(RNP, ['--homedir', RNPDIR, '--pass-fd', str(pipe), '--rewrap',
+                                       '--passwords', '1', enc, '--output', rewr])
+        os.close(pipe)
+        if ret != 0:
+            raise_err('rnp rewrap failed', out + err)
+        ret, out, err = run_proc(RNP, ['--list-packets', rewr])
+        if ret != 0 or 'Public-key encrypted' in out or not 'Symmetric-key encrypted' in out:
+            raise_err('wrong rewrapped packets', out + err)
+        gpg_decrypt_file(rewr, dec, 'newpassword')
+        compare_files(src, dec, 'gpg decrypted data differs')
+        clear_workfiles()
+
+    def test_file_encryption__rewrap_passwords_only(self):
+        # Rewrap the password-encrypted message to the new passwords, without any recipient
+        src, enc, rewr, dec = reg_workfiles('cleartext', '.txt', '.gpg', '.rewrap', '.dec')
+        random_text(src, 20000)
+        rnp_encrypt_file_ex(src, enc, None, ['oldpassword'])
+        # New passwords are requested first, then the one for the message
+        pipe = pswd_pipe('\n'.join(['newpassword1', 'newpassword2', 'oldpassword']))
+        ret, out, err = run_proc(RNP, ['--homedir', RNPDIR, '--pass-fd', str(pipe), '--rewrap',
+                                       '--passwords', '2', enc, '--output', rewr])
+        os.close(pipe)
+        if ret != 0:
+            raise_err('rnp rewrap failed', out + err)
+        ret, out, err = run_proc(RNP, ['--list-packets', rewr])
+        if ret != 0 or 'Public-key encrypted' in out or out.count('Symmetric-key encrypted') != 2:
+            raise_err('wrong rewrapped packets', out + err)
+        for pswd in ['newpassword1', 'newpassword2']:
+            rnp_decrypt_file(rewr, dec, pswd)
+            compare_files(src, dec, 'rnp decrypted data differs')
+            remove_files(dec)
+        # The old password must not work anymore
+        pipe = pswd_pipe('oldpassword')
+        ret, _, _ = run_proc(RNP, ['--homedir', RNPDIR, '--pass-fd', str(pipe), '--decrypt',
+                                   rewr, '--output', dec])
+        os.close(pipe)
+        if ret == 0:
+            raise_err('rewrapped message decrypted with the old password')
+        clear_workfiles()
+
     def test_sym_encryption__gpg_to_rnp(self):
         # Encrypt cleartext with GPG and decrypt with RNP
         for size, cipher, z in zip(Encryption.SIZES_R, Encryption.CIPHERS_R, Encryption.Z_R):
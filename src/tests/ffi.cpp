@@ -25,6 +25,9 @@
  */
 
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <vector>
 #include <string>
 
@@ -32,6 +35,7 @@
 #include "rnp_tests.h"
 #include "support.h"
 #include "utils.h"
+#include "crypto/hash.h"
 #include <json.h>
 #include <vector>
 #include <string>
@@ -654,6 +658,23 @@ getpasscb_once(rnp_ffi_t        ffi,
     return true;
 }
 
+static bool
+getpasscb_seq(rnp_ffi_t        ffi,
+              void *           app_ctx,
+              rnp_key_handle_t key,
+              const char *     pgp_context,
+              char *           buf,
+              size_t           buf_len)
+{
+    const char ***pass = (const char ***) app_ctx;
+    if (!**pass) {
+        return false;
+    }
+    strcpy(buf, **pass);
+    (*pass)++;
+    return true;
+}
+
 static void
 check_key_properties(rnp_key_handle_t key,
                      bool             primary_exptected,
@@ -1273,10 +1294,183 @@ test_ffi_encrypt_pass(void **state)
     // cleanup
     pgp_memory_release(&mem);
 
+    // decrypt with the S2K cache enabled: cached key must not be used for other password
+    assert_rnp_success(rnp_ffi_set_s2k_cache(ffi, true));
+    const char *passwords[] = {"pass1", "pass1", "wrong1", "pass2"};
+    for (size_t i = 0; i < ARRAY_SIZE(passwords); i++) {
+        assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+        assert_rnp_success(rnp_output_to_null(&output));
+        assert_rnp_success(
+          rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) passwords[i]));
+        if (!strcmp(passwords[i], "wrong1")) {
+            assert_rnp_failure(rnp_decrypt(ffi, input, output));
+        } else {
+            assert_rnp_success(rnp_decrypt(ffi, input, output));
+        }
+        rnp_input_destroy(input);
+        input = NULL;
+        rnp_output_destroy(output);
+        output = NULL;
+    }
+    assert_rnp_success(rnp_ffi_set_s2k_cache(ffi, false));
+    assert_rnp_success(rnp_ffi_set_s2k_cache(ffi, false));
+
     // final cleanup
     rnp_ffi_destroy(ffi);
 }
 
+void
+test_ffi_encrypt_compression_parallel(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_op_encrypt_t op = NULL;
+    rnp_op_verify_t  verify = NULL;
+    uint8_t *        encrypted = NULL;
+    size_t           enclen = 0;
+    uint8_t *        decrypted = NULL;
+    size_t           declen = 0;
+    const size_t     datalen = 3 * 1024 * 1024 + 123;
+    const char *     algs[] = {"ZIP", "ZLIB", "BZip2"};
+
+    // text-like data, spanning several compression blocks and batches
+    std::vector<uint8_t> data(datalen);
+    for (size_t i = 0; i < datalen; i++) {
+        data[i] = "abcdefgh \n"[(i * 7 + i / 13) % 10];
+    }
+
+    assert_rnp_success(rnp_ffi_create(&ffi, "GPG", "GPG"));
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+
+    for (size_t i = 0; i < ARRAY_SIZE(algs); i++) {
+        assert_rnp_success(rnp_input_from_memory(&input, data.data(), datalen, false));
+        assert_rnp_success(rnp_output_to_memory(&output, 0));
+        assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+        assert_rnp_success(rnp_op_encrypt_add_password(op, "password", NULL, 0, NULL));
+        assert_rnp_success(rnp_op_encrypt_set_compression(op, algs[i], 6));
+        assert_rnp_success(rnp_op_encrypt_set_compression_parallel(op, true));
+        assert_rnp_success(rnp_op_encrypt_execute(op));
+        assert_rnp_success(rnp_output_memory_get_buf(output, &encrypted, &enclen, true));
+        assert_rnp_success(rnp_op_encrypt_destroy(op));
+        assert_rnp_success(rnp_input_destroy(input));
+        assert_rnp_success(rnp_output_destroy(output));
+        assert_true(enclen < datalen / 4);
+
+        // output is a single usual compressed stream
+        assert_rnp_success(rnp_input_from_memory(&input, encrypted, enclen, false));
+        assert_rnp_success(rnp_output_to_memory(&output, 0));
+        assert_rnp_success(rnp_decrypt(ffi, input, output));
+        assert_rnp_success(rnp_output_memory_get_buf(output, &decrypted, &declen, false));
+        assert_int_equal(declen, datalen);
+        assert_memory_equal(decrypted, data.data(), datalen);
+        assert_rnp_success(rnp_input_destroy(input));
+        assert_rnp_success(rnp_output_destroy(output));
+
+        // parallel decompression gives the same data
+        assert_rnp_success(rnp_input_from_memory(&input, encrypted, enclen, false));
+        assert_rnp_success(rnp_output_to_memory(&output, 0));
+        assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+        assert_rnp_success(rnp_op_verify_set_decompression_parallel(verify, true));
+        assert_rnp_success(rnp_op_verify_execute(verify));
+        assert_rnp_success(rnp_output_memory_get_buf(output, &decrypted, &declen, false));
+        assert_int_equal(declen, datalen);
+        assert_memory_equal(decrypted, data.data(), datalen);
+        assert_rnp_success(rnp_op_verify_destroy(verify));
+        assert_rnp_success(rnp_input_destroy(input));
+        assert_rnp_success(rnp_output_destroy(output));
+        rnp_buffer_destroy(encrypted);
+    }
+
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
+static size_t
+ffi_encrypt_compressed(rnp_ffi_t                   ffi,
+                       const std::vector<uint8_t> &data,
+                       bool                        adaptive,
+                       bool *                      skipped)
+{
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_output_t     decout = NULL;
+    rnp_op_encrypt_t op = NULL;
+    uint8_t *        encrypted = NULL;
+    size_t           enclen = 0;
+    uint8_t *        decrypted = NULL;
+    size_t           declen = 0;
+
+    assert_rnp_success(rnp_input_from_memory(&input, data.data(), data.size(), false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    assert_rnp_success(rnp_op_encrypt_add_password(op, "password", NULL, 0, NULL));
+    assert_rnp_success(rnp_op_encrypt_set_compression(op, "ZLIB", 6));
+    assert_rnp_success(rnp_op_encrypt_set_compression_adaptive(op, adaptive));
+    assert_rnp_success(rnp_op_encrypt_execute(op));
+    assert_rnp_success(rnp_op_encrypt_get_compression_skipped(op, skipped));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &encrypted, &enclen, false));
+    assert_rnp_success(rnp_op_encrypt_destroy(op));
+    assert_rnp_success(rnp_input_destroy(input));
+
+    // decrypted data must match the original
+    assert_rnp_success(rnp_input_from_memory(&input, encrypted, enclen, false));
+    assert_rnp_success(rnp_output_to_memory(&decout, 0));
+    assert_rnp_success(rnp_decrypt(ffi, input, decout));
+    assert_rnp_success(rnp_output_memory_get_buf(decout, &decrypted, &declen, false));
+    assert_int_equal(declen, data.size());
+    assert_memory_equal(decrypted, data.data(), declen);
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(decout));
+    assert_rnp_success(rnp_output_destroy(output));
+    return enclen;
+}
+
+void
+test_ffi_encrypt_compression_adaptive(void **state)
+{
+    rnp_ffi_t ffi = NULL;
+    bool      skipped = true;
+    size_t    adaptive_len = 0;
+    size_t    usual_len = 0;
+    uint32_t  seed = 1;
+
+    std::vector<uint8_t> text(200000);
+    std::vector<uint8_t> small(1000);
+    std::vector<uint8_t> random(200000);
+    for (size_t i = 0; i < text.size(); i++) {
+        text[i] = "abcdefgh \n"[(i * 7 + i / 13) % 10];
+    }
+    for (size_t i = 0; i < small.size(); i++) {
+        small[i] = text[i];
+    }
+    // xorshift output, which is not compressible by deflate
+    for (size_t i = 0; i < random.size(); i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        random[i] = seed & 0xff;
+    }
+
+    assert_rnp_success(rnp_ffi_create(&ffi, "GPG", "GPG"));
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+
+    // compressible data, larger and smaller than the sample
+    ffi_encrypt_compressed(ffi, text, true, &skipped);
+    assert_false(skipped);
+    skipped = true;
+    ffi_encrypt_compressed(ffi, small, true, &skipped);
+    assert_false(skipped);
+
+    // incompressible data: compression layer is omitted, so output is smaller
+    usual_len = ffi_encrypt_compressed(ffi, random, false, &skipped);
+    assert_false(skipped);
+    adaptive_len = ffi_encrypt_compressed(ffi, random, true, &skipped);
+    assert_true(skipped);
+    assert_true(adaptive_len < usual_len);
+
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
 void
 test_ffi_encrypt_pk(void **state)
 {
@@ -1699,6 +1893,285 @@ test_ffi_encrypt_and_sign(void **state)
     rnp_ffi_destroy(ffi);
 }
 
+/* cmocka asserts may not be used outside of the main thread, so just report the failure */
+static bool
+ffi_thread_encrypt_decrypt(rnp_ffi_t ffi, size_t idx)
+{
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_output_t     decout = NULL;
+    rnp_op_encrypt_t op = NULL;
+    rnp_key_handle_t key = NULL;
+    uint8_t *        buf = NULL;
+    size_t           len = 0;
+    bool             res = false;
+    std::string      data = "thread data " + std::to_string(idx);
+
+    if (rnp_input_from_memory(&input, (const uint8_t *) data.data(), data.size(), false) ||
+        rnp_output_to_memory(&output, 0) || rnp_op_encrypt_create(&op, ffi, input, output)) {
+        goto done;
+    }
+    if (rnp_locate_key(ffi, "userid", "key0-uid2", &key) ||
+        rnp_op_encrypt_add_recipient(op, key) || rnp_key_handle_destroy(key)) {
+        goto done;
+    }
+    key = NULL;
+    if (rnp_locate_key(ffi, "userid", "key0-uid0", &key) ||
+        rnp_op_encrypt_add_signature(op, key, NULL) || rnp_op_encrypt_execute(op)) {
+        goto done;
+    }
+    rnp_input_destroy(input);
+    input = NULL;
+
+    if (rnp_output_memory_get_buf(output, &buf, &len, false) ||
+        rnp_input_from_memory(&input, buf, len, false) || rnp_output_to_memory(&decout, 0) ||
+        rnp_decrypt(ffi, input, decout) ||
+        rnp_output_memory_get_buf(decout, &buf, &len, false)) {
+        goto done;
+    }
+    res = (len == data.size()) && !memcmp(buf, data.data(), len);
+done:
+    rnp_key_handle_destroy(key);
+    rnp_op_encrypt_destroy(op);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    rnp_output_destroy(decout);
+    return res;
+}
+
+/* password is requested while keys are locked for reading, so they cannot be changed */
+static bool
+getpasscb_upgrade(rnp_ffi_t        ffi,
+                  void *           app_ctx,
+                  rnp_key_handle_t key,
+                  const char *     pgp_context,
+                  char *           buf,
+                  size_t           buf_len)
+{
+    rnp_result_t *res = (rnp_result_t *) app_ctx;
+
+    *res = rnp_ffi_set_s2k_cache(ffi, true);
+    strcpy(buf, "password");
+    return true;
+}
+
+void
+test_ffi_encrypt_threads(void **state)
+{
+    rnp_ffi_t                ffi = NULL;
+    rnp_input_t              input = NULL;
+    std::vector<std::thread> threads;
+    bool                     results[8] = {false};
+
+    assert_rnp_success(rnp_ffi_create(&ffi, "GPG", "GPG"));
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/pubring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS));
+    rnp_input_destroy(input);
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/secring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_SECRET_KEYS));
+    rnp_input_destroy(input);
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+
+    // all threads share the same ffi object and keyrings
+    for (size_t i = 0; i < ARRAY_SIZE(results); i++) {
+        threads.push_back(std::thread(
+          [ffi, i, &results] { results[i] = ffi_thread_encrypt_decrypt(ffi, i); }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+        assert_true(results[i]);
+    }
+
+    // shared lock is not silently upgraded to the exclusive one by the nested call
+    rnp_result_t upgrade = RNP_SUCCESS;
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb_upgrade, &upgrade));
+    assert_true(ffi_thread_encrypt_decrypt(ffi, 0));
+    assert_int_equal(upgrade, RNP_ERROR_BAD_STATE);
+    // while without the outer lock it succeeds
+    assert_rnp_success(rnp_ffi_set_s2k_cache(ffi, true));
+
+    rnp_ffi_destroy(ffi);
+}
+
+typedef struct ffi_async_results_t {
+    std::mutex              lock;
+    std::condition_variable cond;
+    size_t                  done;
+    rnp_result_t            results[8];
+} ffi_async_results_t;
+
+static ffi_async_results_t ffi_async_results;
+
+static void
+ffi_async_complete(void *app_ctx, rnp_result_t result)
+{
+    std::lock_guard<std::mutex> lock(ffi_async_results.lock);
+    ffi_async_results.results[(size_t) app_ctx] = result;
+    ffi_async_results.done++;
+    ffi_async_results.cond.notify_all();
+}
+
+void
+test_ffi_encrypt_async(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_input_t      inputs[8] = {NULL};
+    rnp_output_t     outputs[8] = {NULL};
+    rnp_op_encrypt_t ops[8] = {NULL};
+    const size_t     count = ARRAY_SIZE(ops);
+    std::string      data[8];
+
+    assert_rnp_success(rnp_ffi_create(&ffi, "GPG", "GPG"));
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+    assert_rnp_failure(rnp_ffi_set_worker_threads(NULL, 2));
+    assert_rnp_success(rnp_ffi_set_worker_threads(ffi, 2));
+
+    ffi_async_results.done = 0;
+    for (size_t i = 0; i < count; i++) {
+        data[i] = std::string(1000 * (i + 1), 'a' + i);
+        assert_rnp_success(rnp_input_from_memory(
+          &inputs[i], (const uint8_t *) data[i].data(), data[i].size(), false));
+        assert_rnp_success(rnp_output_to_memory(&outputs[i], 0));
+        assert_rnp_success(rnp_op_encrypt_create(&ops[i], ffi, inputs[i], outputs[i]));
+        assert_rnp_success(rnp_op_encrypt_add_password(ops[i], "password", NULL, 0, NULL));
+        ffi_async_results.results[i] = RNP_ERROR_GENERIC;
+        assert_rnp_success(
+          rnp_op_encrypt_execute_async(ops[i], ffi_async_complete, (void *) i));
+    }
+    // threads are already running
+    assert_int_equal(rnp_ffi_set_worker_threads(ffi, 4), RNP_ERROR_BAD_STATE);
+    {
+        std::unique_lock<std::mutex> lock(ffi_async_results.lock);
+        ffi_async_results.cond.wait(lock, [count] { return ffi_async_results.done == count; });
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        rnp_input_t  input = NULL;
+        rnp_output_t output = NULL;
+        uint8_t *    buf = NULL;
+        size_t       len = 0;
+
+        assert_rnp_success(ffi_async_results.results[i]);
+        assert_rnp_success(rnp_output_memory_get_buf(outputs[i], &buf, &len, false));
+        assert_rnp_success(rnp_input_from_memory(&input, buf, len, false));
+        assert_rnp_success(rnp_output_to_memory(&output, 0));
+        assert_rnp_success(rnp_decrypt(ffi, input, output));
+        assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+        assert_int_equal(len, data[i].size());
+        assert_memory_equal(buf, data[i].data(), len);
+        rnp_input_destroy(input);
+        rnp_output_destroy(output);
+
+        rnp_op_encrypt_destroy(ops[i]);
+        rnp_input_destroy(inputs[i]);
+        rnp_output_destroy(outputs[i]);
+    }
+
+    // sign and then verify asynchronously
+    rnp_op_sign_t    sops[8] = {NULL};
+    rnp_op_verify_t  vops[8] = {NULL};
+    rnp_output_t     signeds[8] = {NULL};
+    rnp_input_t      input = NULL;
+    rnp_key_handle_t key = NULL;
+
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/pubring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS));
+    rnp_input_destroy(input);
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/secring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_SECRET_KEYS));
+    rnp_input_destroy(input);
+    assert_rnp_success(rnp_locate_key(ffi, "userid", "key0-uid0", &key));
+
+    ffi_async_results.done = 0;
+    for (size_t i = 0; i < count; i++) {
+        assert_rnp_success(rnp_input_from_memory(
+          &inputs[i], (const uint8_t *) data[i].data(), data[i].size(), false));
+        assert_rnp_success(rnp_output_to_memory(&signeds[i], 0));
+        assert_rnp_success(rnp_op_sign_create(&sops[i], ffi, inputs[i], signeds[i]));
+        assert_rnp_success(rnp_op_sign_add_signature(sops[i], key, NULL));
+        ffi_async_results.results[i] = RNP_ERROR_GENERIC;
+        assert_rnp_success(rnp_op_sign_execute_async(sops[i], ffi_async_complete, (void *) i));
+    }
+    {
+        std::unique_lock<std::mutex> lock(ffi_async_results.lock);
+        ffi_async_results.cond.wait(lock, [count] { return ffi_async_results.done == count; });
+    }
+    rnp_key_handle_destroy(key);
+
+    ffi_async_results.done = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *buf = NULL;
+        size_t   len = 0;
+
+        assert_rnp_success(ffi_async_results.results[i]);
+        rnp_op_sign_destroy(sops[i]);
+        rnp_input_destroy(inputs[i]);
+        assert_rnp_success(rnp_output_memory_get_buf(signeds[i], &buf, &len, false));
+        assert_rnp_success(rnp_input_from_memory(&inputs[i], buf, len, false));
+        assert_rnp_success(rnp_output_to_memory(&outputs[i], 0));
+        assert_rnp_success(rnp_op_verify_create(&vops[i], ffi, inputs[i], outputs[i]));
+        ffi_async_results.results[i] = RNP_ERROR_GENERIC;
+        assert_rnp_success(
+          rnp_op_verify_execute_async(vops[i], ffi_async_complete, (void *) i));
+    }
+    {
+        std::unique_lock<std::mutex> lock(ffi_async_results.lock);
+        ffi_async_results.cond.wait(lock, [count] { return ffi_async_results.done == count; });
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        rnp_op_verify_signature_t sig = NULL;
+        size_t                    sigcount = 0;
+        uint8_t *                 buf = NULL;
+        size_t                    len = 0;
+
+        assert_rnp_success(ffi_async_results.results[i]);
+        assert_rnp_success(rnp_op_verify_get_signature_count(vops[i], &sigcount));
+        assert_int_equal(sigcount, 1);
+        assert_rnp_success(rnp_op_verify_get_signature_at(vops[i], 0, &sig));
+        assert_rnp_success(rnp_op_verify_signature_get_status(sig));
+        assert_rnp_success(rnp_output_memory_get_buf(outputs[i], &buf, &len, false));
+        assert_int_equal(len, data[i].size());
+        assert_memory_equal(buf, data[i].data(), len);
+
+        rnp_op_verify_destroy(vops[i]);
+        rnp_input_destroy(inputs[i]);
+        rnp_output_destroy(outputs[i]);
+        rnp_output_destroy(signeds[i]);
+    }
+
+    // callback is optional, and destroying the ffi object waits for the queued operations
+    ffi_async_results.done = 0;
+    for (size_t i = 0; i < count; i++) {
+        assert_rnp_success(rnp_input_from_memory(
+          &inputs[i], (const uint8_t *) data[i].data(), data[i].size(), false));
+        assert_rnp_success(rnp_output_to_memory(&outputs[i], 0));
+        assert_rnp_success(rnp_op_encrypt_create(&ops[i], ffi, inputs[i], outputs[i]));
+        assert_rnp_success(rnp_op_encrypt_add_password(ops[i], "password", NULL, 0, NULL));
+        ffi_async_results.results[i] = RNP_ERROR_GENERIC;
+        assert_rnp_success(rnp_op_encrypt_execute_async(
+          ops[i], (i % 2) ? ffi_async_complete : NULL, (void *) i));
+    }
+    rnp_ffi_destroy(ffi);
+    assert_int_equal(ffi_async_results.done, count / 2);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *buf = NULL;
+        size_t   len = 0;
+
+        if (i % 2) {
+            assert_rnp_success(ffi_async_results.results[i]);
+        } else {
+            assert_int_equal(ffi_async_results.results[i], RNP_ERROR_GENERIC);
+        }
+        // all of the operations, including ones without callback, are completed
+        assert_rnp_success(rnp_output_memory_get_buf(outputs[i], &buf, &len, false));
+        assert_true(len > 0);
+        rnp_op_encrypt_destroy(ops[i]);
+        rnp_input_destroy(inputs[i]);
+        rnp_output_destroy(outputs[i]);
+    }
+}
+
 static void
 test_ffi_init(void **state, rnp_ffi_t *ffi)
 {
@@ -1909,99 +2382,540 @@ test_ffi_signatures_memory(void **state)
 }
 
 void
-test_ffi_signatures(void **state)
+test_ffi_signatures_reuse(void **state)
 {
     rnp_ffi_t       ffi = NULL;
     rnp_input_t     input = NULL;
     rnp_output_t    output = NULL;
     rnp_op_sign_t   op = NULL;
-    rnp_op_verify_t verify;
+    rnp_op_verify_t verify = NULL;
+    uint8_t *       buf = NULL;
+    size_t          len = 0;
 
-    // init ffi
     test_ffi_init(state, &ffi);
-    // init file input
-    test_ffi_init_sign_file_input(state, &input, &output);
-    // create signature operation
+    test_ffi_init_sign_memory_input(state, &input, &output);
     assert_rnp_success(rnp_op_sign_create(&op, ffi, input, output));
-    // setup signature(s)
     test_ffi_setup_signatures(state, &ffi, &op);
-    // execute the operation
-    assert_rnp_success(rnp_op_sign_execute(op));
-    // make sure the output file was created
-    assert_true(rnp_file_exists("signed"));
+    // input and output are mandatory
+    assert_rnp_failure(rnp_op_sign_reset(op, NULL, output));
+
+    // the same signing and verification operations are used for all messages
+    for (size_t i = 0; i < 3; i++) {
+        std::string  msg = "message number " + std::to_string(i);
+        rnp_input_t  verin = NULL;
+        rnp_output_t verout = NULL;
+
+        if (i) {
+            assert_rnp_success(rnp_input_from_memory(
+              &input, (const uint8_t *) msg.data(), msg.size(), false));
+            assert_rnp_success(rnp_output_to_memory(&output, 0));
+            assert_rnp_success(rnp_op_sign_reset(op, input, output));
+        } else {
+            msg = "this is some data that will be signed";
+        }
+        assert_rnp_success(rnp_op_sign_execute(op));
+        // signing consumes inputs, so execute without reset must fail
+        assert_rnp_failure(rnp_op_sign_execute(op));
+        assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+
+        test_ffi_init_verify_memory_input(state, &verin, &verout, buf, len);
+        if (!verify) {
+            assert_rnp_success(rnp_op_verify_create(&verify, ffi, verin, verout));
+        } else {
+            assert_rnp_success(rnp_op_verify_reset(verify, verin, verout));
+        }
+        assert_rnp_failure(rnp_op_verify_detached_reset(verify, verin, verin));
+        assert_rnp_success(rnp_op_verify_execute(verify));
+        test_ffi_check_signatures(state, &verify);
+        assert_rnp_success(rnp_output_memory_get_buf(verout, &buf, &len, false));
+        assert_int_equal(len, msg.size());
+        assert_memory_equal(buf, msg.data(), len);
+
+        assert_rnp_success(rnp_input_destroy(verin));
+        assert_rnp_success(rnp_output_destroy(verout));
+        assert_rnp_success(rnp_input_destroy(input));
+        assert_rnp_success(rnp_output_destroy(output));
+    }
 
-    // cleanup
-    assert_rnp_success(rnp_input_destroy(input));
-    input = NULL;
-    assert_rnp_success(rnp_output_destroy(output));
-    output = NULL;
+    assert_rnp_success(rnp_op_verify_destroy(verify));
     assert_rnp_success(rnp_op_sign_destroy(op));
-    op = NULL;
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
 
-    /* now verify */
+static void
+ffi_decrypt_check(rnp_ffi_t          ffi,
+                  const char *       password,
+                  const uint8_t *    buf,
+                  size_t             len,
+                  const std::string &msg)
+{
+    rnp_input_t  input = NULL;
+    rnp_output_t output = NULL;
+    uint8_t *    dec = NULL;
+    size_t       declen = 0;
 
-    // create input and output
-    test_ffi_init_verify_file_input(state, &input, &output);
-    // call verify
-    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
-    assert_rnp_success(rnp_op_verify_execute(verify));
-    // check signatures
-    test_ffi_check_signatures(state, &verify);
-    // cleanup
-    assert_rnp_success(rnp_op_verify_destroy(verify));
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) password));
+    assert_rnp_success(rnp_input_from_memory(&input, buf, len, false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_decrypt(ffi, input, output));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &dec, &declen, false));
+    assert_int_equal(declen, msg.size());
+    assert_memory_equal(dec, msg.data(), declen);
     assert_rnp_success(rnp_input_destroy(input));
-    input = NULL;
     assert_rnp_success(rnp_output_destroy(output));
-    output = NULL;
-    assert_rnp_success(rnp_ffi_destroy(ffi));
-    // check output
-    test_ffi_check_recovered(state);
 }
 
 void
-test_ffi_signatures_detached_memory(void **state)
+test_ffi_encrypt_reuse(void **state)
 {
-    rnp_ffi_t       ffi = NULL;
-    rnp_input_t     input = NULL;
-    rnp_input_t     signature = NULL;
-    rnp_output_t    output = NULL;
-    rnp_op_sign_t   op = NULL;
-    rnp_op_verify_t verify;
-    uint8_t *       signed_buf;
-    size_t          signed_len;
+    rnp_ffi_t        ffi = NULL;
+    rnp_ffi_t        nokeys = NULL;
+    rnp_key_handle_t key = NULL;
+    rnp_op_encrypt_t op = NULL;
+    rnp_op_encrypt_t mixed = NULL;
 
-    // init ffi
     test_ffi_init(state, &ffi);
-    // init input
-    test_ffi_init_sign_memory_input(state, &input, &output);
-    // create signature operation
-    assert_rnp_success(rnp_op_sign_detached_create(&op, ffi, input, output));
-    // setup signature(s)
-    test_ffi_setup_signatures(state, &ffi, &op);
-    // execute the operation
-    assert_rnp_success(rnp_op_sign_execute(op));
-    assert_rnp_success(rnp_output_memory_get_buf(output, &signed_buf, &signed_len, true));
-    assert_non_null(signed_buf);
-    assert_true(signed_len > 0);
+    assert_rnp_success(rnp_ffi_create(&nokeys, "GPG", "GPG"));
+    assert_rnp_success(rnp_locate_key(ffi, "userid", "key0-uid2", &key));
 
-    // cleanup
-    assert_rnp_success(rnp_input_destroy(input));
-    input = NULL;
-    assert_rnp_success(rnp_output_destroy(output));
-    output = NULL;
-    assert_rnp_success(rnp_op_sign_destroy(op));
-    op = NULL;
+    // passwords and recipients are kept for all of the messages
+    for (size_t i = 0; i < 2; i++) {
+        std::string  msg = "encrypted message number " + std::to_string(i);
+        rnp_input_t  input = NULL;
+        rnp_output_t output = NULL;
+        rnp_output_t mixout = NULL;
+        uint8_t *    buf = NULL;
+        size_t       len = 0;
 
-    /* now verify */
+        assert_rnp_success(
+          rnp_input_from_memory(&input, (const uint8_t *) msg.data(), msg.size(), false));
+        assert_rnp_success(rnp_output_to_memory(&output, 0));
+        if (!op) {
+            assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+            assert_rnp_success(rnp_op_encrypt_add_password(op, "pass1", NULL, 0, NULL));
+        } else {
+            assert_rnp_success(rnp_op_encrypt_reset(op, input, output));
+        }
+        assert_rnp_success(rnp_op_encrypt_execute(op));
+        assert_rnp_success(rnp_input_destroy(input));
+        assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+        ffi_decrypt_check(nokeys, "pass1", buf, len, msg);
 
-    // create input and output
-    test_ffi_init_sign_memory_input(state, &input, NULL);
-    assert_rnp_success(rnp_input_from_memory(&signature, signed_buf, signed_len, true));
-    assert_non_null(signature);
-    // call verify
-    assert_rnp_success(rnp_op_verify_detached_create(&verify, ffi, input, signature));
-    assert_rnp_success(rnp_op_verify_execute(verify));
-    // check signatures
+        // recipient and password
+        assert_rnp_success(
+          rnp_input_from_memory(&input, (const uint8_t *) msg.data(), msg.size(), false));
+        assert_rnp_success(rnp_output_to_memory(&mixout, 0));
+        if (!mixed) {
+            assert_rnp_success(rnp_op_encrypt_create(&mixed, ffi, input, mixout));
+            assert_rnp_success(rnp_op_encrypt_add_recipient(mixed, key));
+            assert_rnp_success(rnp_op_encrypt_add_password(mixed, "pass2", NULL, 0, NULL));
+        } else {
+            assert_rnp_success(rnp_op_encrypt_reset(mixed, input, mixout));
+        }
+        assert_rnp_success(rnp_op_encrypt_execute(mixed));
+        assert_rnp_success(rnp_input_destroy(input));
+        assert_rnp_success(rnp_output_memory_get_buf(mixout, &buf, &len, false));
+        ffi_decrypt_check(ffi, "password", buf, len, msg);
+        ffi_decrypt_check(nokeys, "pass2", buf, len, msg);
+
+        assert_rnp_success(rnp_output_destroy(output));
+        assert_rnp_success(rnp_output_destroy(mixout));
+    }
+
+    assert_rnp_success(rnp_op_encrypt_destroy(op));
+    assert_rnp_success(rnp_op_encrypt_destroy(mixed));
+    assert_rnp_success(rnp_key_handle_destroy(key));
+    assert_rnp_success(rnp_ffi_destroy(nokeys));
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
+void
+test_ffi_batch(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_op_sign_t    op = NULL;
+    rnp_op_verify_t  verify = NULL;
+    rnp_op_encrypt_t encrypt = NULL;
+    const size_t     count = 16;
+    std::string      data[count];
+    const uint8_t *  bufs[count];
+    size_t           lens[count];
+    uint8_t *        signed_bufs[count];
+    size_t           signed_lens[count];
+    uint8_t *        outbufs[count];
+    size_t           outlens[count];
+    rnp_result_t     results[count];
+
+    test_ffi_init(state, &ffi);
+    for (size_t i = 0; i < count; i++) {
+        data[i] = "batch item " + std::to_string(i) + std::string(i * 100, 'x');
+        bufs[i] = (const uint8_t *) data[i].data();
+        lens[i] = data[i].size();
+    }
+
+    // items are processed by the ffi's worker threads
+    assert_rnp_success(rnp_ffi_set_worker_threads(ffi, 2));
+
+    // sign all the items with the same key
+    assert_rnp_success(rnp_op_sign_create(&op, ffi, NULL, NULL));
+    test_ffi_setup_signatures(state, &ffi, &op);
+    assert_rnp_failure(
+      rnp_op_sign_execute_batch(op, count, bufs, NULL, signed_bufs, signed_lens, results));
+    assert_rnp_success(
+      rnp_op_sign_execute_batch(op, count, bufs, lens, signed_bufs, signed_lens, results));
+    for (size_t i = 0; i < count; i++) {
+        assert_rnp_success(results[i]);
+        assert_non_null(signed_bufs[i]);
+    }
+    assert_rnp_success(rnp_op_sign_destroy(op));
+    assert_int_equal(rnp_ffi_set_worker_threads(ffi, 4), RNP_ERROR_BAD_STATE);
+
+    // verify them, with one of the items corrupted
+    signed_bufs[3][signed_lens[3] / 2] ^= 0xff;
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, NULL, NULL));
+    assert_int_equal(rnp_op_verify_execute_batch(verify,
+                                                 count,
+                                                 (const uint8_t **) signed_bufs,
+                                                 signed_lens,
+                                                 outbufs,
+                                                 outlens,
+                                                 results),
+                     RNP_ERROR_GENERIC);
+    for (size_t i = 0; i < count; i++) {
+        if (i == 3) {
+            assert_rnp_failure(results[i]);
+            assert_null(outbufs[i]);
+            continue;
+        }
+        assert_rnp_success(results[i]);
+        assert_int_equal(outlens[i], lens[i]);
+        assert_memory_equal(outbufs[i], bufs[i], lens[i]);
+        rnp_buffer_destroy(outbufs[i]);
+    }
+    assert_rnp_success(rnp_op_verify_destroy(verify));
+
+    // encrypt and decrypt back, password is shared by all of the items and batches
+    assert_rnp_success(rnp_op_encrypt_create(&encrypt, ffi, NULL, NULL));
+    assert_rnp_success(rnp_op_encrypt_add_password(encrypt, "password", NULL, 0, NULL));
+    for (size_t round = 0; round < 2; round++) {
+        assert_rnp_success(
+          rnp_op_encrypt_execute_batch(encrypt, count, bufs, lens, outbufs, outlens, results));
+        for (size_t i = 0; i < count; i++) {
+            rnp_input_t  input = NULL;
+            rnp_output_t output = NULL;
+            uint8_t *    buf = NULL;
+            size_t       len = 0;
+
+            assert_rnp_success(results[i]);
+            assert_rnp_success(rnp_input_from_memory(&input, outbufs[i], outlens[i], false));
+            assert_rnp_success(rnp_output_to_memory(&output, 0));
+            assert_rnp_success(rnp_decrypt(ffi, input, output));
+            assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+            assert_int_equal(len, lens[i]);
+            assert_memory_equal(buf, bufs[i], len);
+            rnp_input_destroy(input);
+            rnp_output_destroy(output);
+            rnp_buffer_destroy(outbufs[i]);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        rnp_buffer_destroy(signed_bufs[i]);
+    }
+    assert_rnp_success(rnp_op_encrypt_destroy(encrypt));
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
+void
+test_ffi_output_buffers(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_op_encrypt_t op = NULL;
+    const char       plaintext[] = "data which is encrypted to the caller's buffer";
+    uint8_t          small[16];
+    uint8_t          large[4096];
+    uint8_t *        buf = NULL;
+    uint8_t *        taken = NULL;
+    size_t           len = 0;
+    size_t           enclen = 0;
+    size_t           taken_len = 0;
+
+    test_ffi_init(state, &ffi);
+    assert_rnp_failure(rnp_output_to_buffer(&output, NULL, sizeof(large)));
+    assert_rnp_failure(rnp_output_to_buffer(&output, large, 0));
+
+    // caller's buffer is too small
+    assert_rnp_success(rnp_input_from_memory(
+      &input, (const uint8_t *) plaintext, strlen(plaintext), false));
+    assert_rnp_success(rnp_output_to_buffer(&output, small, sizeof(small)));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    assert_rnp_success(rnp_op_encrypt_add_password(op, "password", NULL, 0, NULL));
+    assert_int_equal(rnp_op_encrypt_execute(op), RNP_ERROR_SHORT_BUFFER);
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+
+    // caller's buffer is large enough
+    assert_rnp_success(rnp_input_from_memory(
+      &input, (const uint8_t *) plaintext, strlen(plaintext), false));
+    assert_rnp_success(rnp_output_to_buffer(&output, large, sizeof(large)));
+    assert_rnp_success(rnp_op_encrypt_reset(op, input, output));
+    assert_rnp_success(rnp_op_encrypt_execute(op));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+    assert_ptr_equal(buf, large);
+    assert_true(len > strlen(plaintext));
+    enclen = len;
+    // internal buffer may not be taken from the caller's one
+    assert_rnp_failure(rnp_output_memory_take_buf(output, &taken, &taken_len));
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+
+    // empty memory output gives the empty buffer
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    taken_len = 1;
+    assert_rnp_success(rnp_output_memory_take_buf(output, &taken, &taken_len));
+    assert_null(taken);
+    assert_int_equal(taken_len, 0);
+    assert_rnp_success(rnp_output_destroy(output));
+
+    // preallocated memory output, taken without copying
+    assert_rnp_success(rnp_input_from_memory(&input, large, enclen, false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_output_memory_reserve(output, enclen));
+    assert_rnp_success(rnp_decrypt(ffi, input, output));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+    assert_rnp_success(rnp_output_memory_take_buf(output, &taken, &taken_len));
+    assert_ptr_equal(taken, buf);
+    assert_int_equal(taken_len, strlen(plaintext));
+    assert_memory_equal(taken, plaintext, taken_len);
+    // output continues with the empty buffer
+    assert_rnp_failure(rnp_output_memory_get_buf(output, &buf, &len, false));
+    rnp_buffer_destroy(taken);
+    assert_rnp_success(rnp_output_memory_take_buf(output, &taken, &taken_len));
+    assert_null(taken);
+    assert_int_equal(taken_len, 0);
+    assert_rnp_success(rnp_input_destroy(input));
+    // and may be reused
+    assert_rnp_success(rnp_input_from_memory(&input, large, enclen, false));
+    assert_rnp_success(rnp_decrypt(ffi, input, output));
+    assert_rnp_success(rnp_output_memory_take_buf(output, &taken, &taken_len));
+    assert_non_null(taken);
+    assert_int_equal(taken_len, strlen(plaintext));
+    assert_memory_equal(taken, plaintext, taken_len);
+    rnp_buffer_destroy(taken);
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+
+    assert_rnp_success(rnp_op_encrypt_destroy(op));
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
+void
+test_ffi_output_size(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_op_encrypt_t op = NULL;
+    rnp_op_sign_t    sign = NULL;
+    rnp_key_handle_t key = NULL;
+    const size_t     lens[] = {0, 1, 191, 8192, 8193, 100000};
+    const char *     aeads[] = {"None", "EAX", "OCB", "EAX", "OCB"};
+    const int        abits[] = {21, 0, 0, 1, 10};
+    uint64_t         size = 0;
+    bool             exact = false;
+    uint8_t *        buf = NULL;
+    size_t           len = 0;
+
+    test_ffi_init(state, &ffi);
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, NULL, NULL));
+    assert_rnp_failure(rnp_op_encrypt_get_output_size(op, 0, NULL, &exact));
+    // no recipients or passwords yet
+    assert_rnp_failure(rnp_op_encrypt_get_output_size(op, 0, &size, &exact));
+    assert_rnp_failure(rnp_op_encrypt_set_aead(op, NULL));
+    assert_rnp_failure(rnp_op_encrypt_set_aead(op, "GCM"));
+    assert_rnp_failure(rnp_op_encrypt_set_aead_bits(op, -1));
+    assert_rnp_failure(rnp_op_encrypt_set_aead_bits(op, 57));
+    assert_rnp_success(rnp_op_encrypt_destroy(op));
+
+    // uncompressed password or ECDH encryption has exact output size, with small AEAD
+    // chunks data crosses the chunk boundaries
+    assert_rnp_success(
+      rnp_input_from_path(&input, "data/test_stream_key_load/ecc-p256-pub.asc"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS));
+    assert_rnp_success(rnp_input_destroy(input));
+    for (size_t m = 0; m < ARRAY_SIZE(aeads); m++) {
+        for (int ecdh = 0; ecdh < 2; ecdh++) {
+            for (size_t i = 0; i < ARRAY_SIZE(lens); i++) {
+                for (int armored = 0; armored < 2; armored++) {
+                    std::string data(lens[i], 'a');
+
+                    assert_rnp_success(rnp_input_from_memory(
+                      &input, (const uint8_t *) data.data(), data.size(), false));
+                    assert_rnp_success(rnp_output_to_memory(&output, 0));
+                    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+                    if (ecdh) {
+                        assert_rnp_success(rnp_locate_key(ffi, "userid", "ecc-p256", &key));
+                        assert_rnp_success(rnp_op_encrypt_add_recipient(op, key));
+                        assert_rnp_success(rnp_key_handle_destroy(key));
+                    } else {
+                        assert_rnp_success(
+                          rnp_op_encrypt_add_password(op, "password", NULL, 0, NULL));
+                    }
+                    assert_rnp_success(rnp_op_encrypt_set_aead(op, aeads[m]));
+                    assert_rnp_success(rnp_op_encrypt_set_aead_bits(op, abits[m]));
+                    assert_rnp_success(rnp_op_encrypt_set_compression(op, "Uncompressed", 0));
+                    assert_rnp_success(rnp_op_encrypt_set_armor(op, armored));
+                    assert_rnp_success(
+                      rnp_op_encrypt_get_output_size(op, data.size(), &size, &exact));
+                    assert_true(exact);
+                    assert_rnp_success(rnp_op_encrypt_execute(op));
+                    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+                    assert_int_equal(len, size);
+                    assert_rnp_success(rnp_op_encrypt_destroy(op));
+                    assert_rnp_success(rnp_input_destroy(input));
+                    assert_rnp_success(rnp_output_destroy(output));
+                }
+            }
+        }
+    }
+
+    // public key encryption with signing and compression gives an upper bound
+    std::string data(10000, 'b');
+    assert_rnp_success(
+      rnp_input_from_memory(&input, (const uint8_t *) data.data(), data.size(), false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    assert_rnp_success(rnp_locate_key(ffi, "userid", "key0-uid2", &key));
+    assert_rnp_success(rnp_op_encrypt_add_recipient(op, key));
+    assert_rnp_success(rnp_op_encrypt_add_signature(op, key, NULL));
+    assert_rnp_success(rnp_key_handle_destroy(key));
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+    assert_rnp_success(rnp_op_encrypt_set_armor(op, true));
+    assert_rnp_success(rnp_op_encrypt_get_output_size(op, data.size(), &size, &exact));
+    assert_false(exact);
+    assert_rnp_success(rnp_op_encrypt_execute(op));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+    assert_true(len <= size);
+    assert_rnp_success(rnp_op_encrypt_destroy(op));
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+
+    // signing with the RSA key
+    assert_rnp_success(
+      rnp_input_from_memory(&input, (const uint8_t *) data.data(), data.size(), false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_sign_create(&sign, ffi, input, output));
+    assert_rnp_failure(rnp_op_sign_get_output_size(sign, data.size(), &size, &exact));
+    test_ffi_setup_signatures(state, &ffi, &sign);
+    assert_rnp_success(rnp_op_sign_set_compression(sign, "Uncompressed", 0));
+    assert_rnp_success(rnp_op_sign_get_output_size(sign, data.size(), &size, NULL));
+    assert_rnp_success(rnp_op_sign_execute(sign));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+    assert_true(len <= size);
+    // only signature MPI may be shorter, changing armored length a bit
+    assert_true(len + 16 >= size);
+    assert_rnp_success(rnp_op_sign_destroy(sign));
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
+void
+test_ffi_signatures(void **state)
+{
+    rnp_ffi_t       ffi = NULL;
+    rnp_input_t     input = NULL;
+    rnp_output_t    output = NULL;
+    rnp_op_sign_t   op = NULL;
+    rnp_op_verify_t verify;
+
+    // init ffi
+    test_ffi_init(state, &ffi);
+    // init file input
+    test_ffi_init_sign_file_input(state, &input, &output);
+    // create signature operation
+    assert_rnp_success(rnp_op_sign_create(&op, ffi, input, output));
+    // setup signature(s)
+    test_ffi_setup_signatures(state, &ffi, &op);
+    // execute the operation
+    assert_rnp_success(rnp_op_sign_execute(op));
+    // make sure the output file was created
+    assert_true(rnp_file_exists("signed"));
+
+    // cleanup
+    assert_rnp_success(rnp_input_destroy(input));
+    input = NULL;
+    assert_rnp_success(rnp_output_destroy(output));
+    output = NULL;
+    assert_rnp_success(rnp_op_sign_destroy(op));
+    op = NULL;
+
+    /* now verify */
+
+    // create input and output
+    test_ffi_init_verify_file_input(state, &input, &output);
+    // call verify
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_rnp_success(rnp_op_verify_execute(verify));
+    // check signatures
+    test_ffi_check_signatures(state, &verify);
+    // cleanup
+    assert_rnp_success(rnp_op_verify_destroy(verify));
+    assert_rnp_success(rnp_input_destroy(input));
+    input = NULL;
+    assert_rnp_success(rnp_output_destroy(output));
+    output = NULL;
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+    // check output
+    test_ffi_check_recovered(state);
+}
+
+void
+test_ffi_signatures_detached_memory(void **state)
+{
+    rnp_ffi_t       ffi = NULL;
+    rnp_input_t     input = NULL;
+    rnp_input_t     signature = NULL;
+    rnp_output_t    output = NULL;
+    rnp_op_sign_t   op = NULL;
+    rnp_op_verify_t verify;
+    uint8_t *       signed_buf;
+    size_t          signed_len;
+
+    // init ffi
+    test_ffi_init(state, &ffi);
+    // init input
+    test_ffi_init_sign_memory_input(state, &input, &output);
+    // create signature operation
+    assert_rnp_success(rnp_op_sign_detached_create(&op, ffi, input, output));
+    // setup signature(s)
+    test_ffi_setup_signatures(state, &ffi, &op);
+    // execute the operation
+    assert_rnp_success(rnp_op_sign_execute(op));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &signed_buf, &signed_len, true));
+    assert_non_null(signed_buf);
+    assert_true(signed_len > 0);
+
+    // cleanup
+    assert_rnp_success(rnp_input_destroy(input));
+    input = NULL;
+    assert_rnp_success(rnp_output_destroy(output));
+    output = NULL;
+    assert_rnp_success(rnp_op_sign_destroy(op));
+    op = NULL;
+
+    /* now verify */
+
+    // create input and output
+    test_ffi_init_sign_memory_input(state, &input, NULL);
+    assert_rnp_success(rnp_input_from_memory(&signature, signed_buf, signed_len, true));
+    assert_non_null(signature);
+    // call verify
+    assert_rnp_success(rnp_op_verify_detached_create(&verify, ffi, input, signature));
+    assert_rnp_success(rnp_op_verify_execute(verify));
+    // check signatures
     test_ffi_check_signatures(state, &verify);
     // cleanup
     rnp_buffer_destroy(signed_buf);
@@ -2013,6 +2927,185 @@ test_ffi_signatures_detached_memory(void **state)
     assert_rnp_success(rnp_ffi_destroy(ffi));
 }
 
+static rnp_result_t
+verify_detached_text(rnp_ffi_t ffi, const char *text, uint8_t *sigbuf, size_t siglen)
+{
+    rnp_input_t               input = NULL;
+    rnp_input_t               signature = NULL;
+    rnp_op_verify_t           verify = NULL;
+    rnp_op_verify_signature_t sig = NULL;
+    size_t                    sig_count = 0;
+    rnp_result_t              ret;
+
+    assert_rnp_success(rnp_input_from_memory(&input, (uint8_t *) text, strlen(text), false));
+    assert_rnp_success(rnp_input_from_memory(&signature, sigbuf, siglen, false));
+    assert_rnp_success(rnp_op_verify_detached_create(&verify, ffi, input, signature));
+    (void) rnp_op_verify_execute(verify);
+    assert_rnp_success(rnp_op_verify_get_signature_count(verify, &sig_count));
+    assert_int_equal(sig_count, 1);
+    assert_rnp_success(rnp_op_verify_get_signature_at(verify, 0, &sig));
+    ret = rnp_op_verify_signature_get_status(sig);
+    assert_rnp_success(rnp_op_verify_destroy(verify));
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_input_destroy(signature));
+    return ret;
+}
+
+void
+test_ffi_signatures_textmode(void **state)
+{
+    rnp_ffi_t       ffi = NULL;
+    rnp_input_t     input = NULL;
+    rnp_output_t    output = NULL;
+    rnp_op_sign_t   op = NULL;
+    rnp_op_verify_t verify = NULL;
+    uint8_t *       signed_buf = NULL;
+    size_t          signed_len = 0;
+    uint8_t *       buf = NULL;
+    size_t          len = 0;
+    const char *    text = "line 1\nline 2 \r\n\nline 3\r";
+    const char *    crlftext = "line 1\r\nline 2 \r\n\r\nline 3\r";
+
+    test_ffi_init(state, &ffi);
+
+    // detached text signature
+    assert_rnp_success(rnp_input_from_memory(&input, (uint8_t *) text, strlen(text), false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_sign_detached_create(&op, ffi, input, output));
+    test_ffi_setup_signatures(state, &ffi, &op);
+    assert_rnp_success(rnp_op_sign_set_textmode(op, true));
+    assert_rnp_success(rnp_op_sign_execute(op));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &signed_buf, &signed_len, true));
+    assert_rnp_success(rnp_op_sign_destroy(op));
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+
+    // line endings doesn't matter, while the other changes do
+    assert_rnp_success(verify_detached_text(ffi, text, signed_buf, signed_len));
+    assert_rnp_success(verify_detached_text(ffi, crlftext, signed_buf, signed_len));
+    assert_int_equal(
+      verify_detached_text(ffi, "line 1\nline 2\n\nline 3\r", signed_buf, signed_len),
+      RNP_ERROR_SIGNATURE_INVALID);
+    rnp_buffer_destroy(signed_buf);
+
+    // embedded text signature, literal data is stored in the canonical form
+    assert_rnp_success(rnp_input_from_memory(&input, (uint8_t *) text, strlen(text), false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_sign_create(&op, ffi, input, output));
+    test_ffi_setup_signatures(state, &ffi, &op);
+    assert_rnp_success(rnp_op_sign_set_textmode(op, true));
+    assert_rnp_success(rnp_op_sign_execute(op));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &signed_buf, &signed_len, true));
+    assert_rnp_success(rnp_op_sign_destroy(op));
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+
+    assert_rnp_success(rnp_input_from_memory(&input, signed_buf, signed_len, false));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_rnp_success(rnp_op_verify_execute(verify));
+    test_ffi_check_signatures(state, &verify);
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &len, false));
+    assert_int_equal(len, strlen(crlftext));
+    assert_memory_equal(buf, crlftext, len);
+    assert_rnp_success(rnp_op_verify_destroy(verify));
+    assert_rnp_success(rnp_input_destroy(input));
+    assert_rnp_success(rnp_output_destroy(output));
+    rnp_buffer_destroy(signed_buf);
+
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
+static size_t
+hash_with_trailer(const char *data, const uint8_t *trailer, size_t tlen, uint8_t *digest)
+{
+    pgp_hash_t hash = {0};
+
+    assert_true(pgp_hash_create(&hash, PGP_HASH_SHA256));
+    assert_int_equal(pgp_hash_add(&hash, data, strlen(data)), 0);
+    assert_int_equal(pgp_hash_add(&hash, trailer, tlen), 0);
+    return pgp_hash_finish(&hash, digest);
+}
+
+void
+test_ffi_signatures_digest(void **state)
+{
+    rnp_ffi_t                 ffi = NULL;
+    rnp_key_handle_t          key = NULL;
+    rnp_input_t               input = NULL;
+    rnp_output_t              output = NULL;
+    rnp_op_sign_digest_t      op = NULL;
+    rnp_op_verify_digest_t    verify = NULL;
+    rnp_op_verify_signature_t sig = NULL;
+    char *                    hname = NULL;
+    uint8_t *                 trailer = NULL;
+    size_t                    tlen = 0;
+    uint8_t                   digest[PGP_MAX_HASH_SIZE];
+    size_t                    dlen = 0;
+    uint8_t *                 sigbuf = NULL;
+    size_t                    siglen = 0;
+    uint32_t                  create = 0;
+    const uint32_t            issued = 1516211899;
+    const char *              data = "this is some data that will be signed";
+
+    test_ffi_init(state, &ffi);
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+    assert_rnp_success(rnp_locate_key(ffi, "userid", "key0-uid2", &key));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+
+    // phase one: get the trailer, signature parameters are fixed afterwards
+    assert_rnp_success(rnp_op_sign_digest_create(&op, ffi, key));
+    assert_rnp_success(rnp_op_sign_digest_set_hash(op, "SHA256"));
+    assert_rnp_success(rnp_op_sign_digest_set_creation_time(op, issued));
+    assert_rnp_success(rnp_op_sign_digest_get_hash(op, &hname));
+    assert_string_equal(hname, "SHA256");
+    rnp_buffer_destroy(hname);
+    assert_int_equal(rnp_op_sign_digest_execute(op, digest, 32, output), RNP_ERROR_BAD_STATE);
+    assert_rnp_success(rnp_op_sign_digest_get_trailer(op, &trailer, &tlen));
+    assert_int_equal(rnp_op_sign_digest_set_hash(op, "SHA512"), RNP_ERROR_BAD_STATE);
+
+    // client side: hash the data followed by the trailer
+    dlen = hash_with_trailer(data, trailer, tlen, digest);
+    rnp_buffer_destroy(trailer);
+
+    // phase two: sign the digest
+    assert_int_equal(rnp_op_sign_digest_execute(op, digest, dlen - 1, output),
+                     RNP_ERROR_BAD_PARAMETERS);
+    assert_rnp_success(rnp_op_sign_digest_execute(op, digest, dlen, output));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &sigbuf, &siglen, true));
+    assert_rnp_success(rnp_op_sign_digest_destroy(op));
+    assert_rnp_success(rnp_output_destroy(output));
+    assert_rnp_success(rnp_key_handle_destroy(key));
+
+    // this is usual detached signature over the data
+    assert_rnp_success(verify_detached_text(ffi, data, sigbuf, siglen));
+
+    // verify it against the digest
+    assert_rnp_success(rnp_input_from_memory(&input, sigbuf, siglen, false));
+    assert_rnp_success(rnp_op_verify_digest_create(&verify, ffi, input));
+    assert_rnp_success(rnp_op_verify_digest_get_hash(verify, &hname));
+    assert_string_equal(hname, "SHA256");
+    rnp_buffer_destroy(hname);
+    assert_rnp_success(rnp_op_verify_digest_get_trailer(verify, &trailer, &tlen));
+    dlen = hash_with_trailer(data, trailer, tlen, digest);
+    assert_rnp_success(rnp_op_verify_digest_execute(verify, digest, dlen));
+    assert_rnp_success(rnp_op_verify_digest_get_signature(verify, &sig));
+    assert_rnp_success(rnp_op_verify_signature_get_status(sig));
+    assert_rnp_success(rnp_op_verify_signature_get_times(sig, &create, NULL));
+    assert_int_equal(create, issued);
+    // digest of the other data
+    dlen = hash_with_trailer("other data", trailer, tlen, digest);
+    assert_int_equal(rnp_op_verify_digest_execute(verify, digest, dlen),
+                     RNP_ERROR_SIGNATURE_INVALID);
+    assert_int_equal(rnp_op_verify_signature_get_status(sig), RNP_ERROR_SIGNATURE_INVALID);
+    rnp_buffer_destroy(trailer);
+    assert_rnp_success(rnp_op_verify_digest_destroy(verify));
+    assert_rnp_success(rnp_input_destroy(input));
+    rnp_buffer_destroy(sigbuf);
+
+    assert_rnp_success(rnp_ffi_destroy(ffi));
+}
+
 void
 test_ffi_signatures_detached(void **state)
 {
@@ -3073,3 +4166,290 @@ test_ffi_key_export(void **state)
     rnp_ffi_destroy(ffi);
 }
 
+
+void
+test_ffi_decrypt_session_key(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_op_encrypt_t op = NULL;
+    rnp_op_verify_t  verify = NULL;
+    const char *     plaintext = "data1";
+    char *           sesskey = NULL;
+    uint8_t *        buf = NULL;
+    size_t           buf_len = 0;
+
+    // setup FFI
+    assert_rnp_success(rnp_ffi_create(&ffi, "GPG", "GPG"));
+
+    // load our keyrings
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/pubring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS));
+    rnp_input_destroy(input);
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/secring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_SECRET_KEYS));
+    rnp_input_destroy(input);
+
+    // encrypt some data to the public key
+    assert_rnp_success(
+      rnp_input_from_memory(&input, (const uint8_t *) plaintext, strlen(plaintext), false));
+    assert_rnp_success(rnp_output_to_path(&output, "encrypted"));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    rnp_key_handle_t key = NULL;
+    assert_rnp_success(rnp_locate_key(ffi, "userid", "key0-uid2", &key));
+    assert_rnp_success(rnp_op_encrypt_add_recipient(op, key));
+    rnp_key_handle_destroy(key);
+    assert_rnp_success(rnp_op_encrypt_set_cipher(op, "AES256"));
+    assert_rnp_success(rnp_op_encrypt_execute(op));
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    rnp_op_encrypt_destroy(op);
+
+    // decrypt with the secret key and get the session key
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_int_equal(rnp_op_verify_get_session_key(verify, &sesskey), RNP_ERROR_BAD_STATE);
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+    assert_rnp_success(rnp_op_verify_execute(verify));
+    assert_rnp_success(rnp_op_verify_get_session_key(verify, &sesskey));
+    assert_non_null(sesskey);
+    assert_int_equal(strlen(sesskey), 2 + 64);
+    assert_int_equal(strncmp(sesskey, "9:", 2), 0);
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &buf_len, false));
+    assert_int_equal(buf_len, strlen(plaintext));
+    assert_int_equal(memcmp(buf, plaintext, buf_len), 0);
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+
+    // malformed session keys
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_int_equal(rnp_op_verify_set_session_key(verify, "9"), RNP_ERROR_BAD_PARAMETERS);
+    assert_int_equal(rnp_op_verify_set_session_key(verify, "9:00"), RNP_ERROR_BAD_PARAMETERS);
+    assert_int_equal(rnp_op_verify_set_session_key(verify, sesskey + 1),
+                     RNP_ERROR_BAD_PARAMETERS);
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+
+    // decrypt with the session key only, without the key password
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, NULL, NULL));
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_rnp_success(rnp_op_verify_set_session_key(verify, sesskey));
+    assert_rnp_success(rnp_op_verify_execute(verify));
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &buf_len, false));
+    assert_int_equal(buf_len, strlen(plaintext));
+    assert_int_equal(memcmp(buf, plaintext, buf_len), 0);
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+
+    // wrong session key must fail
+    sesskey[2] = sesskey[2] == '0' ? '1' : '0';
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_rnp_success(rnp_op_verify_set_session_key(verify, sesskey));
+    assert_rnp_failure(rnp_op_verify_execute(verify));
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+
+    // cleanup
+    rnp_buffer_destroy(sesskey);
+    rnp_ffi_destroy(ffi);
+}
+
+void
+test_ffi_encrypt_rewrap(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_op_encrypt_t op = NULL;
+    rnp_op_verify_t  verify = NULL;
+    const char *     plaintext = "data1";
+    char *           sesskey = NULL;
+    char *           newsesskey = NULL;
+    uint8_t *        buf = NULL;
+    size_t           buf_len = 0;
+
+    // setup FFI
+    assert_rnp_success(rnp_ffi_create(&ffi, "GPG", "GPG"));
+
+    // load our keyrings
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/pubring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_PUBLIC_KEYS));
+    rnp_input_destroy(input);
+    assert_rnp_success(rnp_input_from_path(&input, "data/keyrings/1/secring.gpg"));
+    assert_rnp_success(rnp_load_keys(ffi, "GPG", input, RNP_LOAD_SAVE_SECRET_KEYS));
+    rnp_input_destroy(input);
+
+    // encrypt some data to the public key
+    assert_rnp_success(
+      rnp_input_from_memory(&input, (const uint8_t *) plaintext, strlen(plaintext), false));
+    assert_rnp_success(rnp_output_to_path(&output, "encrypted"));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    rnp_key_handle_t key = NULL;
+    assert_rnp_success(rnp_locate_key(ffi, "userid", "key0-uid2", &key));
+    assert_rnp_success(rnp_op_encrypt_add_recipient(op, key));
+    rnp_key_handle_destroy(key);
+    assert_rnp_success(rnp_op_encrypt_set_cipher(op, "CAMELLIA192"));
+    assert_rnp_success(rnp_op_encrypt_execute(op));
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    rnp_op_encrypt_destroy(op);
+
+    // rewrap to the password and another key, using armored output
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "password"));
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_path(&output, "rewrapped"));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    assert_rnp_success(rnp_op_encrypt_add_password(op, "pass1", NULL, 0, NULL));
+    assert_rnp_success(rnp_locate_key(ffi, "userid", "key1-uid1", &key));
+    assert_rnp_success(rnp_op_encrypt_add_recipient(op, key));
+    rnp_key_handle_destroy(key);
+    assert_rnp_success(rnp_op_encrypt_set_armor(op, true));
+    assert_rnp_success(rnp_op_encrypt_rewrap(op));
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    rnp_op_encrypt_destroy(op);
+
+    // decrypt both, session key must be the same
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_null(&output));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_rnp_success(rnp_op_verify_execute(verify));
+    assert_rnp_success(rnp_op_verify_get_session_key(verify, &sesskey));
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb, (void *) "pass1"));
+    assert_rnp_success(rnp_input_from_path(&input, "rewrapped"));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_rnp_success(rnp_op_verify_execute(verify));
+    assert_rnp_success(rnp_op_verify_get_session_key(verify, &newsesskey));
+    assert_string_equal(sesskey, newsesskey);
+    assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &buf_len, false));
+    assert_int_equal(buf_len, strlen(plaintext));
+    assert_int_equal(memcmp(buf, plaintext, buf_len), 0);
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+
+    // rewrapping without a secret key must fail
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, NULL, NULL));
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_null(&output));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    assert_rnp_success(rnp_op_encrypt_add_password(op, "pass1", NULL, 0, NULL));
+    assert_rnp_failure(rnp_op_encrypt_rewrap(op));
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    rnp_op_encrypt_destroy(op);
+
+    // cleanup
+    rnp_buffer_destroy(sesskey);
+    rnp_buffer_destroy(newsesskey);
+    rnp_ffi_destroy(ffi);
+}
+
+static rnp_result_t
+decrypt_with_passwords(rnp_ffi_t ffi, const char **passwords, size_t count)
+{
+    rnp_input_t     input = NULL;
+    rnp_output_t    output = NULL;
+    rnp_op_verify_t verify = NULL;
+    uint8_t *       buf = NULL;
+    size_t          buf_len = 0;
+    rnp_result_t    ret;
+
+    assert_rnp_success(rnp_ffi_set_pass_provider(ffi, getpasscb_seq, &passwords));
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_rnp_success(rnp_op_verify_set_password_count(verify, count));
+    ret = rnp_op_verify_execute(verify);
+    if (!ret) {
+        assert_rnp_success(rnp_output_memory_get_buf(output, &buf, &buf_len, false));
+        assert_int_equal(buf_len, 5);
+        assert_int_equal(memcmp(buf, "data1", buf_len), 0);
+    }
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    return ret;
+}
+
+void
+test_ffi_decrypt_multiple_passwords(void **state)
+{
+    rnp_ffi_t        ffi = NULL;
+    rnp_input_t      input = NULL;
+    rnp_output_t     output = NULL;
+    rnp_op_encrypt_t op = NULL;
+    rnp_op_verify_t  verify = NULL;
+    const char *     plaintext = "data1";
+    const char *     wrong_first[] = {"wrong1", "wrong2", "wrong1", "pass2", NULL};
+    const char *     right_only[] = {"pass1", NULL};
+    const char *     wrong_single[] = {"wrong1", "wrong2", "pass1", NULL};
+
+    // setup FFI
+    assert_rnp_success(rnp_ffi_create(&ffi, "GPG", "GPG"));
+
+    // encrypt some data with two passwords
+    assert_rnp_success(
+      rnp_input_from_memory(&input, (const uint8_t *) plaintext, strlen(plaintext), false));
+    assert_rnp_success(rnp_output_to_path(&output, "encrypted"));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    assert_rnp_success(rnp_op_encrypt_add_password(op, "pass1", "SHA256", 65536, "AES128"));
+    assert_rnp_success(rnp_op_encrypt_add_password(op, "pass2", "SHA1", 32768, "AES256"));
+    assert_rnp_success(rnp_op_encrypt_execute(op));
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    rnp_op_encrypt_destroy(op);
+
+    // bad parameters
+    assert_rnp_success(rnp_input_from_path(&input, "encrypted"));
+    assert_rnp_success(rnp_output_to_memory(&output, 0));
+    assert_rnp_success(rnp_op_verify_create(&verify, ffi, input, output));
+    assert_int_equal(rnp_op_verify_set_password_count(NULL, 1), RNP_ERROR_NULL_POINTER);
+    assert_int_equal(rnp_op_verify_set_password_count(verify, 0), RNP_ERROR_BAD_PARAMETERS);
+    rnp_op_verify_destroy(verify);
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+
+    // only first password is requested by default
+    assert_rnp_failure(decrypt_with_passwords(ffi, wrong_first, 1));
+    // not enough passwords are requested
+    assert_rnp_failure(decrypt_with_passwords(ffi, wrong_first, 3));
+    // all passwords are tried, including the duplicate one
+    assert_rnp_success(decrypt_with_passwords(ffi, wrong_first, 4));
+    assert_rnp_success(decrypt_with_passwords(ffi, wrong_first, 10));
+    // password provider may stop earlier
+    assert_rnp_success(decrypt_with_passwords(ffi, right_only, 5));
+
+    // single password: SKESK has no encrypted session key, so any password "decrypts" it
+    assert_rnp_success(
+      rnp_input_from_memory(&input, (const uint8_t *) plaintext, strlen(plaintext), false));
+    assert_rnp_success(rnp_output_to_path(&output, "encrypted"));
+    assert_rnp_success(rnp_op_encrypt_create(&op, ffi, input, output));
+    assert_rnp_success(rnp_op_encrypt_add_password(op, "pass1", "SHA256", 65536, "AES128"));
+    assert_rnp_success(rnp_op_encrypt_execute(op));
+    rnp_input_destroy(input);
+    rnp_output_destroy(output);
+    rnp_op_encrypt_destroy(op);
+    assert_rnp_success(decrypt_with_passwords(ffi, wrong_single, 3));
+    assert_rnp_failure(decrypt_with_passwords(ffi, wrong_single, 2));
+
+    // cleanup
+    rnp_ffi_destroy(ffi);
+}
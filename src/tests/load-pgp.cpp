@@ -91,7 +91,7 @@ test_load_v3_keyring_pgp(void **state)
 
     // decrypt the key
     pgp_key_pkt_t *seckey = pgp_decrypt_seckey_pgp(
-      key->packets[0].raw, key->packets[0].length, pgp_get_key_pkt(key), "password");
+      key->packets[0].raw, key->packets[0].length, pgp_get_key_pkt(key), "password", NULL);
     assert_non_null(seckey);
 
     // cleanup
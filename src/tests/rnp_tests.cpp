@@ -133,6 +133,7 @@ main(int argc, char *argv[])
 
     struct CMUnitTest tests[] = {
       cmocka_unit_test(hash_test_success),
+      cmocka_unit_test(hash_workers_test),
       cmocka_unit_test(cipher_test_success),
       cmocka_unit_test(pkcs1_rsa_test_success),
       cmocka_unit_test(raw_elgamal_fixed_512bit_key_test_success),
@@ -140,6 +141,9 @@ main(int argc, char *argv[])
       cmocka_unit_test(rnp_test_eddsa),
       cmocka_unit_test(ecdsa_signverify_success),
       cmocka_unit_test(s2k_iteration_tuning),
+      cmocka_unit_test(s2k_calibration_persistence),
+      cmocka_unit_test(s2k_native_vs_botan),
+      cmocka_unit_test(s2k_derived_key_cache),
       cmocka_unit_test(rnpkeys_generatekey_testSignature),
       cmocka_unit_test(rnpkeys_generatekey_testEncryption),
       cmocka_unit_test(rnpkeys_generatekey_verifySupportedHashAlg),
@@ -185,6 +189,8 @@ main(int argc, char *argv[])
       cmocka_unit_test(test_stream_key_signatures),
       cmocka_unit_test(test_stream_dumper),
       cmocka_unit_test(test_stream_z),
+      cmocka_unit_test(test_stream_bzip2_false_magic),
+      cmocka_unit_test(test_stream_armor),
       cmocka_unit_test(test_stream_verify_no_key),
       cmocka_unit_test(test_stream_key_signature_validate),
       cmocka_unit_test(test_stream_key_load_errors),
@@ -196,10 +202,21 @@ main(int argc, char *argv[])
       cmocka_unit_test(test_ffi_add_userid),
       cmocka_unit_test(test_ffi_detect_key_format),
       cmocka_unit_test(test_ffi_encrypt_pass),
+      cmocka_unit_test(test_ffi_encrypt_compression_parallel),
+      cmocka_unit_test(test_ffi_encrypt_compression_adaptive),
       cmocka_unit_test(test_ffi_encrypt_pk),
       cmocka_unit_test(test_ffi_encrypt_and_sign),
+      cmocka_unit_test(test_ffi_encrypt_threads),
+      cmocka_unit_test(test_ffi_encrypt_async),
       cmocka_unit_test(test_ffi_signatures_memory),
+      cmocka_unit_test(test_ffi_signatures_reuse),
+      cmocka_unit_test(test_ffi_encrypt_reuse),
+      cmocka_unit_test(test_ffi_batch),
+      cmocka_unit_test(test_ffi_output_buffers),
+      cmocka_unit_test(test_ffi_output_size),
       cmocka_unit_test(test_ffi_signatures_detached_memory),
+      cmocka_unit_test(test_ffi_signatures_textmode),
+      cmocka_unit_test(test_ffi_signatures_digest),
       cmocka_unit_test(test_ffi_signatures_detached),
       cmocka_unit_test(test_ffi_signatures),
       cmocka_unit_test(test_ffi_load_keys),
@@ -211,6 +228,9 @@ main(int argc, char *argv[])
       cmocka_unit_test(test_ffi_enarmor_dearmor),
       cmocka_unit_test(test_ffi_version),
       cmocka_unit_test(test_ffi_key_export),
+      cmocka_unit_test(test_ffi_decrypt_session_key),
+      cmocka_unit_test(test_ffi_encrypt_rewrap),
+      cmocka_unit_test(test_ffi_decrypt_multiple_passwords),
       cmocka_unit_test(test_cli_rnp),
     };
 
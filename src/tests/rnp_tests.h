@@ -55,6 +55,8 @@ void rnp_test_eddsa(void **state);
 
 void hash_test_success(void **state);
 
+void hash_workers_test(void **state);
+
 void cipher_test_success(void **state);
 
 void pkcs1_rsa_test_success(void **state);
@@ -75,6 +77,12 @@ void generatekeyECDSA_explicitlySetWrongDigest_ShouldSuceed(void **state);
 
 void s2k_iteration_tuning(void **state);
 
+void s2k_calibration_persistence(void **state);
+
+void s2k_native_vs_botan(void **state);
+
+void s2k_derived_key_cache(void **state);
+
 void test_utils_list(void **state);
 
 void test_rnpcfg(void **state);
@@ -141,14 +149,36 @@ void test_ffi_save_keys(void **state);
 
 void test_ffi_encrypt_pass(void **state);
 
+void test_ffi_encrypt_compression_parallel(void **state);
+
+void test_ffi_encrypt_compression_adaptive(void **state);
+
 void test_ffi_encrypt_pk(void **state);
 
 void test_ffi_encrypt_and_sign(void **state);
 
+void test_ffi_encrypt_threads(void **state);
+
+void test_ffi_encrypt_async(void **state);
+
 void test_ffi_signatures_memory(void **state);
 
+void test_ffi_signatures_reuse(void **state);
+
+void test_ffi_encrypt_reuse(void **state);
+
+void test_ffi_batch(void **state);
+
+void test_ffi_output_buffers(void **state);
+
+void test_ffi_output_size(void **state);
+
 void test_ffi_signatures_detached_memory(void **state);
 
+void test_ffi_signatures_textmode(void **state);
+
+void test_ffi_signatures_digest(void **state);
+
 void test_ffi_signatures_detached(void **state);
 
 void test_ffi_signatures(void **state);
@@ -169,6 +199,12 @@ void test_ffi_version(void **state);
 
 void test_ffi_key_export(void **state);
 
+void test_ffi_decrypt_session_key(void **state);
+
+void test_ffi_encrypt_rewrap(void **state);
+
+void test_ffi_decrypt_multiple_passwords(void **state);
+
 void test_dsa_roundtrip(void **state);
 
 void test_dsa_verify_negative(void **state);
@@ -191,6 +227,10 @@ void test_stream_dumper(void **state);
 
 void test_stream_z(void **state);
 
+void test_stream_bzip2_false_magic(void **state);
+
+void test_stream_armor(void **state);
+
 void test_stream_verify_no_key(void **state);
 
 void test_stream_key_signature_validate(void **state);
@@ -31,12 +31,14 @@
 #include "crypto/hash.h"
 #include "pgp-key.h"
 #include <time.h>
+#include <vector>
 #include <rnp/rnp.h>
 #include <librepgp/stream-packet.h>
 #include <librepgp/stream-sig.h>
 #include <librepgp/stream-key.h>
 #include <librepgp/stream-dump.h>
 #include <librepgp/stream-armor.h>
+#include <librepgp/stream-bzip2.h>
 
 static bool
 stream_hash_file(pgp_hash_t *hash, const char *path)
@@ -1148,3 +1150,217 @@ test_stream_z(void **state)
     src_close(&src);
     dst_close(&dst, true);
 }
+
+void
+test_stream_bzip2_false_magic(void **state)
+{
+    /* symbol map of the block with these bytes is 0xE000 3141 5926 5359, i.e. the block magic.
+     * Runs of the same byte are avoided since run lengths are included in the map as well. */
+    const uint8_t        alphabet[] = {2,  3,  7,  9,  15, 17, 19, 20, 23, 26,
+                                       29, 30, 33, 35, 38, 39, 41, 43, 44, 47};
+    const size_t         datalen = 600000;
+    std::vector<uint8_t> data(datalen);
+    uint32_t             seed = 1;
+    pgp_bz2_writer_t *   writer = NULL;
+    pgp_bz2_reader_t *   reader = NULL;
+    pgp_source_t         src;
+    pgp_dest_t           dst;
+    uint8_t *            packed;
+    size_t               packedlen;
+    size_t               magics = 0;
+
+    for (size_t i = 0; i < datalen; i++) {
+        size_t idx;
+        seed = seed * 1103515245 + 12345;
+        idx = (seed >> 16) % sizeof(alphabet);
+        if (i && (data[i - 1] == alphabet[idx])) {
+            idx = (idx + 1) % sizeof(alphabet);
+        }
+        data[i] = alphabet[idx];
+    }
+
+    assert_rnp_success(init_mem_dest(&dst, NULL, 0));
+    assert_rnp_success(bz2_writer_create(&writer, &dst, 1, 2));
+    assert_rnp_success(bz2_writer_write(writer, data.data(), datalen));
+    assert_rnp_success(bz2_writer_finish(writer));
+    bz2_writer_destroy(writer);
+    packed = (uint8_t *) mem_dest_get_memory(&dst);
+    packedlen = dst.writeb;
+
+    /* each block of at most 100000 bytes must have the false magic as well */
+    for (size_t bit = 0; bit + 48 <= packedlen * 8; bit++) {
+        uint64_t val = 0;
+        for (size_t i = 0; i < 48; i++) {
+            size_t pos = bit + i;
+            val = (val << 1) | ((packed[pos / 8] >> (7 - pos % 8)) & 1);
+        }
+        magics += val == 0x314159265359ULL;
+    }
+    assert_true(magics >= 2 * (datalen / 100000));
+
+    /* false magics are skipped, giving the same data for any number of threads */
+    for (size_t threads = 1; threads <= 4; threads += 3) {
+        std::vector<uint8_t> out(datalen + 10000);
+        size_t               outlen = 0;
+        ssize_t              read;
+
+        assert_rnp_success(init_mem_src(&src, packed, packedlen, false));
+        assert_rnp_success(bz2_reader_create(&reader, &src, threads));
+        while ((read = bz2_reader_read(reader, out.data() + outlen, 10000)) > 0) {
+            outlen += read;
+            assert_true(outlen <= datalen);
+        }
+        assert_int_equal(read, 0);
+        assert_int_equal(outlen, datalen);
+        assert_memory_equal(out.data(), data.data(), datalen);
+        bz2_reader_destroy(reader);
+        src_close(&src);
+    }
+    dst_close(&dst, true);
+}
+
+/* dearmor the buffer, reading it by chunks of the specified size */
+static bool
+dearmor_buffer(const char *armored, size_t len, size_t chunk, uint8_t *out, size_t *outlen)
+{
+    pgp_source_t memsrc = {0};
+    pgp_source_t armorsrc = {0};
+    ssize_t      read = 0;
+    size_t       total = 0;
+
+    assert_rnp_success(init_mem_src(&memsrc, armored, len, false));
+    if (init_armored_src(&armorsrc, &memsrc)) {
+        src_close(&memsrc);
+        return false;
+    }
+    while (!src_eof(&armorsrc)) {
+        if ((read = src_read(&armorsrc, out + total, chunk)) <= 0) {
+            break;
+        }
+        total += read;
+    }
+    src_close(&armorsrc);
+    src_close(&memsrc);
+    *outlen = total;
+    return read >= 0;
+}
+
+/* re-split base64 lines of the armored message to the lines of llen chars, using eol */
+static size_t
+rewrap_armored(const char *armored, size_t len, size_t llen, const char *eol, char *out)
+{
+    const char *body = strstr(armored, "\r\n\r\n") + 4;
+    const char *crc = strstr(body - 1, "\n=") + 1;
+    size_t      outlen = body - armored;
+    size_t      lpos = 0;
+
+    memcpy(out, armored, outlen);
+    for (const char *ch = body; ch < crc; ch++) {
+        if ((*ch == '\r') || (*ch == '\n')) {
+            continue;
+        }
+        /* keep padding on the same line */
+        if ((*ch != '=') && (lpos == llen)) {
+            memcpy(out + outlen, eol, strlen(eol));
+            outlen += strlen(eol);
+            lpos = 0;
+        }
+        out[outlen++] = *ch;
+        lpos++;
+    }
+    if (lpos) {
+        memcpy(out + outlen, eol, strlen(eol));
+        outlen += strlen(eol);
+    }
+    memcpy(out + outlen, crc, armored + len - crc);
+    return outlen + (armored + len - crc);
+}
+
+void
+test_stream_armor(void **state)
+{
+    const size_t sizes[] = {0, 1, 2, 3, 4, 57, 100, 3072, 3073, 20000};
+    const size_t chunks[] = {1, 2, 3, 7, 1000, 4096, 30000};
+    const size_t llens[] = {1, 3, 4, 64, 75};
+    uint8_t *    data = (uint8_t *) malloc(20000);
+    uint8_t *    dec = (uint8_t *) malloc(20000);
+    char *       wrapped = (char *) malloc(60000);
+    size_t       declen = 0;
+
+    assert_non_null(data);
+    assert_non_null(dec);
+    assert_non_null(wrapped);
+    for (size_t i = 0; i < 20000; i++) {
+        data[i] = (i * 7 + (i >> 8)) & 0xff;
+    }
+
+    for (auto size : sizes) {
+        pgp_dest_t memdst = {0};
+        pgp_dest_t armordst = {0};
+
+        assert_rnp_success(init_mem_dest(&memdst, NULL, 0));
+        assert_rnp_success(init_armored_dst(&armordst, &memdst, PGP_ARMORED_MESSAGE));
+        dst_write(&armordst, data, size);
+        dst_close(&armordst, false);
+
+        const char *armored = (const char *) mem_dest_get_memory(&memdst);
+        size_t      len = memdst.writeb;
+
+        /* all base64 lines except the last one must be 76 chars long, ending with CRLF */
+        const char *line = strstr(armored, "\r\n\r\n") + 4;
+        const char *crcline = strstr(line - 1, "\n=") + 1;
+        size_t      b64len = 0;
+        while (line < crcline) {
+            const char *eol = strstr(line, "\r\n");
+            assert_non_null(eol);
+            assert_true(eol - line <= 76);
+            if (eol + 2 < crcline) {
+                assert_int_equal(eol - line, 76);
+            }
+            b64len += eol - line;
+            line = eol + 2;
+        }
+        assert_int_equal(b64len, (size + 2) / 3 * 4);
+
+        /* different read sizes */
+        for (auto chunk : chunks) {
+            assert_true(dearmor_buffer(armored, len, chunk, dec, &declen));
+            assert_int_equal(declen, size);
+            assert_memory_equal(dec, data, size);
+        }
+        /* different line lengths and eols */
+        for (auto llen : llens) {
+            size_t wlen = rewrap_armored(armored, len, llen, "\r\n", wrapped);
+            assert_true(dearmor_buffer(wrapped, wlen, 1000, dec, &declen));
+            assert_int_equal(declen, size);
+            assert_memory_equal(dec, data, size);
+            wlen = rewrap_armored(armored, len, llen, "\n", wrapped);
+            assert_true(dearmor_buffer(wrapped, wlen, 3, dec, &declen));
+            assert_int_equal(declen, size);
+            assert_memory_equal(dec, data, size);
+        }
+        /* corrupted data or checksum */
+        if (size) {
+            memcpy(wrapped, armored, len);
+            char *body = strstr(wrapped, "\r\n\r\n") + 4;
+            body[0] = body[0] == 'A' ? 'B' : 'A';
+            assert_false(dearmor_buffer(wrapped, len, 1000, dec, &declen));
+        }
+        memcpy(wrapped, armored, len);
+        char *crc = strstr(strstr(wrapped, "\r\n\r\n") + 3, "\n=") + 2;
+        crc[0] = crc[0] == 'A' ? 'B' : 'A';
+        assert_false(dearmor_buffer(wrapped, len, 1000, dec, &declen));
+        /* wrong character in the last base64 line */
+        if (size) {
+            memcpy(wrapped, armored, len);
+            crc[-4] = '*';
+            assert_false(dearmor_buffer(wrapped, len, 1000, dec, &declen));
+        }
+
+        dst_close(&memdst, true);
+    }
+
+    free(data);
+    free(dec);
+    free(wrapped);
+}